@@ -0,0 +1,1353 @@
+// Copyright (c) 2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#include "LuaJITBlock.hpp"
+#include "TestUtility.hpp"
+
+#include <Pothos/Config.hpp>
+#include <Pothos/Framework.hpp>
+#include <Pothos/Plugin.hpp>
+#include <Pothos/Proxy.hpp>
+#include <Pothos/Testing.hpp>
+#include <Pothos/Util/Compiler.hpp>
+
+#include <json.hpp>
+
+#include <Poco/Path.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+using nlohmann::json;
+
+//
+// Utility functions
+//
+
+static constexpr size_t numBenchBlocks = 32;
+static constexpr size_t numBenchElements = 8192;
+static constexpr size_t numFusionBenchElements = 1 << 22;
+
+// Returns 0 where unsupported, so the RSS columns read as unavailable.
+static size_t getResidentSetBytes()
+{
+#if defined(__linux__)
+    size_t totalPages = 0;
+    size_t residentPages = 0;
+
+    std::ifstream statm("/proc/self/statm");
+    statm >> totalPages >> residentPages;
+
+    return residentPages * size_t(::sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+struct MemoryTotals
+{
+    size_t luaHeapBytes = 0;
+    size_t jitMcodeBytes = 0;
+    size_t portBufferBytes = 0;
+};
+
+static MemoryTotals getLuaJITMemoryTotals()
+{
+    auto getInfo = Pothos::PluginRegistry::get("/devices/luajit/info").getObject().extract<Pothos::Callable>();
+    const auto info = json::parse(getInfo.call<std::string>());
+
+    MemoryTotals totals;
+    for(const auto& block: info["Block Memory Usage"]["Blocks"])
+    {
+        totals.luaHeapBytes += block["Lua Heap (bytes)"].get<size_t>();
+        totals.jitMcodeBytes += block["JIT Machine Code (bytes)"].get<size_t>();
+        totals.portBufferBytes += block["Port Buffers (bytes)"].get<size_t>();
+    }
+
+    return totals;
+}
+
+static size_t perBlock(size_t before, size_t after)
+{
+    return (after > before) ? ((after - before) / numBenchBlocks) : 0;
+}
+
+//
+// Benchmark kernels
+//
+
+static const std::string BenchFuncsScript = R"(
+
+local ffi = require("ffi")
+
+local BenchFuncs = {}
+
+--[[
+/*
+|PothosDoc Scale (LuaJIT Benchmark)
+
+|factory /luajit/bench/scale()
+*/
+--]]
+function BenchFuncs.scale(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    local floatBuffIn = ffi.cast("float*", buffsIn[0])
+    local floatBuffOut = ffi.cast("float*", buffsOut[0])
+
+    for i = 0, elems-1
+    do
+        floatBuffOut[i] = floatBuffIn[i] * 2.0
+    end
+end
+
+return BenchFuncs
+
+)";
+
+static const std::string BenchPreloadedFuncsScript = R"(
+
+local ffi = require("ffi")
+ffi.cdef[[
+
+float PothosLuaJIT_BenchScale(float val);
+
+]]
+
+local BenchFuncs = {}
+
+function BenchFuncs.scale(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    local floatBuffIn = ffi.cast("float*", buffsIn[0])
+    local floatBuffOut = ffi.cast("float*", buffsOut[0])
+
+    for i = 0, elems-1
+    do
+        floatBuffOut[i] = ffi.C.PothosLuaJIT_BenchScale(floatBuffIn[i])
+    end
+end
+
+return BenchFuncs
+
+)";
+
+static const std::string BenchFusionFuncsScript = R"(
+
+local ffi = require("ffi")
+
+local BenchFuncs = {}
+
+function BenchFuncs.scale(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    local floatBuffIn = ffi.cast("float*", buffsIn[0])
+    local floatBuffOut = ffi.cast("float*", buffsOut[0])
+
+    for i = 0, elems-1
+    do
+        floatBuffOut[i] = floatBuffIn[i] * 0.5
+    end
+end
+
+function BenchFuncs.offset(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    local floatBuffIn = ffi.cast("float*", buffsIn[0])
+    local floatBuffOut = ffi.cast("float*", buffsOut[0])
+
+    for i = 0, elems-1
+    do
+        floatBuffOut[i] = floatBuffIn[i] + 1.0
+    end
+end
+
+function BenchFuncs.clip(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    local floatBuffIn = ffi.cast("float*", buffsIn[0])
+    local floatBuffOut = ffi.cast("float*", buffsOut[0])
+
+    for i = 0, elems-1
+    do
+        local val = floatBuffIn[i]
+        if val > 1.0 then val = 1.0 elseif val < -1.0 then val = -1.0 end
+        floatBuffOut[i] = val
+    end
+end
+
+function BenchFuncs.square(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    local floatBuffIn = ffi.cast("float*", buffsIn[0])
+    local floatBuffOut = ffi.cast("float*", buffsOut[0])
+
+    for i = 0, elems-1
+    do
+        floatBuffOut[i] = floatBuffIn[i] * floatBuffIn[i]
+    end
+end
+
+return BenchFuncs
+
+)";
+
+// Deliberately heavy and stateful, so it can only be sped up by pipelining.
+static const std::string BenchPipelineFuncsScript = R"(
+
+local ffi = require("ffi")
+
+local BenchFuncs = {}
+
+local state = 0.0
+local function smooth(buffsIn, buffsOut, elems)
+    local floatBuffIn = ffi.cast("float*", buffsIn[0])
+    local floatBuffOut = ffi.cast("float*", buffsOut[0])
+
+    for i = 0, elems-1
+    do
+        local val = floatBuffIn[i]
+        for j = 1, 32
+        do
+            state = (state * 0.99) + (val * 0.01)
+        end
+        floatBuffOut[i] = state
+    end
+end
+
+BenchFuncs.stage = function(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    smooth(buffsIn, buffsOut, elems)
+end
+
+return BenchFuncs
+
+)";
+
+static const std::string BenchLibrarySource = R"(
+
+#include <Pothos/Config.hpp>
+
+extern "C" float POTHOS_HELPER_DLL_EXPORT PothosLuaJIT_BenchScale(float val)
+{
+    return (val * 2.0f);
+}
+
+)";
+
+//
+// Benchmark code
+//
+
+static void benchLuaJITBlockMemory(
+    const std::string& description,
+    const std::function<Pothos::Proxy()>& makeBlock)
+{
+    const auto rssBefore = getResidentSetBytes();
+    const auto totalsBefore = getLuaJITMemoryTotals();
+
+    std::vector<Pothos::Proxy> luajitBlocks;
+    for(size_t i = 0; i < numBenchBlocks; ++i)
+    {
+        luajitBlocks.emplace_back(makeBlock());
+    }
+    const auto rssConstructed = getResidentSetBytes();
+
+    Pothos::BufferChunk input("float32", numBenchElements);
+    std::memset(input.as<void*>(), 0, input.length);
+
+    auto feeder = Pothos::BlockRegistry::make("/blocks/feeder_source", "float32");
+    feeder.call("feedBuffer", input);
+
+    std::vector<Pothos::Proxy> sinks;
+    for(size_t i = 0; i < numBenchBlocks; ++i)
+    {
+        sinks.emplace_back(Pothos::BlockRegistry::make("/blocks/collector_sink", "float32"));
+    }
+
+    size_t rssActive = 0;
+    MemoryTotals totalsActive;
+    {
+        Pothos::Topology topology;
+        for(size_t i = 0; i < numBenchBlocks; ++i)
+        {
+            topology.connect(feeder, 0, luajitBlocks[i], 0);
+            topology.connect(luajitBlocks[i], 0, sinks[i], 0);
+        }
+
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+
+        rssActive = getResidentSetBytes();
+        totalsActive = getLuaJITMemoryTotals();
+    }
+
+    std::cout << std::left << std::setw(32) << description
+              << " RSS (constructed): " << std::setw(9) << perBlock(rssBefore, rssConstructed)
+              << " RSS (active): " << std::setw(9) << perBlock(rssBefore, rssActive)
+              << " Lua heap: " << std::setw(9) << perBlock(totalsBefore.luaHeapBytes, totalsActive.luaHeapBytes)
+              << " JIT mcode: " << std::setw(9) << perBlock(totalsBefore.jitMcodeBytes, totalsActive.jitMcodeBytes)
+              << " Port buffers: " << perBlock(totalsBefore.portBufferBytes, totalsActive.portBufferBytes)
+              << std::endl;
+}
+
+POTHOS_TEST_BLOCK("/luajit/bench", bench_luajit_block_memory)
+{
+    std::cout << "Memory per LuaJIT block (bytes, " << numBenchBlocks << " blocks):" << std::endl;
+
+    benchLuaJITBlockMemory(
+        "Script",
+        []()
+        {
+            auto block = Pothos::BlockRegistry::make(
+                             "/blocks/luajit_block",
+                             std::vector<std::string>{"float32"},
+                             std::vector<std::string>{"float32"});
+            block.call("setSource", BenchFuncsScript, "scale");
+
+            return block;
+        });
+
+    const auto scriptPath = writeToFileAndGetPath(BenchFuncsScript, "lua");
+    benchLuaJITBlockMemory(
+        "File",
+        [&scriptPath]()
+        {
+            auto block = Pothos::BlockRegistry::make(
+                             "/blocks/luajit_block",
+                             std::vector<std::string>{"float32"},
+                             std::vector<std::string>{"float32"});
+            block.call("setSource", scriptPath, "scale");
+
+            return block;
+        });
+
+    // The conf loader only needs the conf file's path to resolve the
+    // source, so the conf file itself doesn't need to exist.
+    const std::map<std::string, std::string> config =
+    {
+        {"confFilePath", Poco::Path(Poco::Path::temp(), "bench.conf").toString()},
+        {"factory", "/luajit/bench/scale"},
+        {"source", Poco::Path(scriptPath).getFileName()},
+        {"function", "scale"},
+        {"input_types", "float32"},
+        {"output_types", "float32"}
+    };
+    auto confLoader = Pothos::PluginRegistry::get("/framework/conf_loader/luajit").getObject().extract<Pothos::Callable>();
+    const auto confPluginPaths = confLoader.call<std::vector<Pothos::PluginPath>>(config);
+
+    benchLuaJITBlockMemory(
+        "Conf",
+        []()
+        {
+            return Pothos::BlockRegistry::make("/luajit/bench/scale");
+        });
+
+    for(const auto& pluginPath: confPluginPaths)
+    {
+        Pothos::PluginRegistry::remove(pluginPath);
+    }
+
+    auto compiler = Pothos::Util::Compiler::make();
+    if(compiler->test())
+    {
+        auto compilerArgs = Pothos::Util::CompilerArgs::defaultDevEnv();
+        compilerArgs.sources.emplace_back(writeToFileAndGetPath(BenchLibrarySource, "cpp"));
+        const auto libraryPath = compiler->compileCppModule(compilerArgs);
+
+        benchLuaJITBlockMemory(
+            "Script (preloaded library)",
+            [&libraryPath]()
+            {
+                auto block = Pothos::BlockRegistry::make(
+                                 "/blocks/luajit_block",
+                                 std::vector<std::string>{"float32"},
+                                 std::vector<std::string>{"float32"});
+                block.call("setSource", BenchPreloadedFuncsScript, "scale");
+                block.call("setPreloadedLibraries", std::vector<std::string>{libraryPath});
+
+                return block;
+            });
+    }
+    else std::cout << "Skipping preloaded library benchmark (no compiler)." << std::endl;
+}
+
+//
+// Fusion benchmark
+//
+
+static std::vector<Pothos::Proxy> makeBenchFusionChain()
+{
+    std::vector<Pothos::Proxy> chain;
+    for(const auto& functionName: {"scale", "offset", "clip", "square"})
+    {
+        auto block = Pothos::BlockRegistry::make(
+                         "/blocks/luajit_block",
+                         std::vector<std::string>{"float32"},
+                         std::vector<std::string>{"float32"});
+        block.call("setSource", BenchFusionFuncsScript, std::string(functionName));
+        block.call("setStateless", true);
+
+        chain.emplace_back(std::move(block));
+    }
+
+    return chain;
+}
+
+static double timeBenchFusionChain(
+    const Pothos::BufferChunk& input,
+    const std::vector<Pothos::Proxy>& chain,
+    Pothos::BufferChunk& output)
+{
+    auto feeder = Pothos::BlockRegistry::make("/blocks/feeder_source", "float32");
+    feeder.call("feedBuffer", input);
+
+    auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "float32");
+
+    Pothos::Topology topology;
+    topology.connect(feeder, 0, chain.front(), 0);
+    for(size_t i = 1; i < chain.size(); ++i)
+    {
+        topology.connect(chain[i-1], 0, chain[i], 0);
+    }
+    topology.connect(chain.back(), 0, sink, 0);
+
+    const auto start = std::chrono::steady_clock::now();
+    topology.commit();
+    POTHOS_TEST_TRUE(topology.waitInactive(0.01, 60.0));
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    output = sink.call<Pothos::BufferChunk>("getBuffer");
+
+    return elapsed.count();
+}
+
+POTHOS_TEST_BLOCK("/luajit/bench", bench_luajit_fused_chain)
+{
+    Pothos::BufferChunk input("float32", numFusionBenchElements);
+    for(size_t elem = 0; elem < numFusionBenchElements; ++elem)
+    {
+        input.as<float*>()[elem] = float(elem % 1024) / 256.0f - 2.0f;
+    }
+
+    Pothos::BufferChunk unfusedOutput;
+    const auto unfusedTime = timeBenchFusionChain(input, makeBenchFusionChain(), unfusedOutput);
+
+    Pothos::BufferChunk fusedOutput;
+    auto fusedBlock = Pothos::BlockRegistry::make("/luajit/fused_chain", makeBenchFusionChain());
+    const auto fusedTime = timeBenchFusionChain(input, {fusedBlock}, fusedOutput);
+
+    POTHOS_TEST_EQUAL(unfusedOutput.elements(), fusedOutput.elements());
+    POTHOS_TEST_EQUALA(
+        unfusedOutput.as<const float*>(),
+        fusedOutput.as<const float*>(),
+        fusedOutput.elements());
+
+    std::cout << "Fused chain (4 blocks, " << numFusionBenchElements << " elements):"
+              << " unfused: " << unfusedTime << " s"
+              << " fused: " << fusedTime << " s"
+              << " speedup: " << (unfusedTime / fusedTime) << "x"
+              << std::endl;
+}
+
+//
+// Pipeline benchmark
+//
+
+static constexpr size_t numPipelineBenchElements = 1 << 20;
+
+static double timeBenchPipeline(
+    const Pothos::BufferChunk& input,
+    size_t numStages)
+{
+    auto feeder = Pothos::BlockRegistry::make("/blocks/feeder_source", "float32");
+    feeder.call("feedBuffer", input);
+
+    auto pipelineBlock = Pothos::BlockRegistry::make(
+                             "/luajit/pipeline_block",
+                             "float32",
+                             "float32",
+                             std::vector<std::string>(numStages-1, "float32"));
+    pipelineBlock.call(
+        "setSource",
+        BenchPipelineFuncsScript,
+        std::vector<std::string>(numStages, "stage"));
+
+    auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "float32");
+
+    Pothos::Topology topology;
+    topology.connect(feeder, 0, pipelineBlock, 0);
+    topology.connect(pipelineBlock, 0, sink, 0);
+
+    const auto start = std::chrono::steady_clock::now();
+    topology.commit();
+    POTHOS_TEST_TRUE(topology.waitInactive(0.01, 60.0));
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    POTHOS_TEST_EQUAL(numPipelineBenchElements, sink.call<Pothos::BufferChunk>("getBuffer").elements());
+
+    return elapsed.count();
+}
+
+POTHOS_TEST_BLOCK("/luajit/bench", bench_luajit_pipeline_block)
+{
+    Pothos::BufferChunk input("float32", numPipelineBenchElements);
+    for(size_t elem = 0; elem < numPipelineBenchElements; ++elem)
+    {
+        input.as<float*>()[elem] = float(elem % 1024) / 1024.0f;
+    }
+
+    // The work per stage is fixed, so ideally, time stays flat as stages
+    // are added.
+    std::cout << "Pipeline (" << numPipelineBenchElements << " elements):" << std::endl;
+    for(size_t numStages = 1; numStages <= 4; ++numStages)
+    {
+        const auto elapsed = timeBenchPipeline(input, numStages);
+        std::cout << " " << numStages << " stage(s): " << elapsed << " s, "
+                  << ((numStages * numPipelineBenchElements) / elapsed / 1e6) << " Melem-stages/s"
+                  << std::endl;
+    }
+}
+
+//
+// Conf-declared benchmarks
+//
+
+// Benchmarks every conf-loaded factory with the parameters from its conf
+// file. Run on its own with:
+// PothosUtil --self-test1=/luajit/bench/bench_luajit_conf_factories
+POTHOS_TEST_BLOCK("/luajit/bench", bench_luajit_conf_factories)
+{
+    // Make sure there's at least one factory with benchmark parameters.
+    const auto scriptPath = writeToFileAndGetPath(BenchFuncsScript, "lua");
+    const std::map<std::string, std::string> config =
+    {
+        {"confFilePath", Poco::Path(Poco::Path::temp(), "bench.conf").toString()},
+        {"factory", "/luajit/bench/conf_scale"},
+        {"source", Poco::Path(scriptPath).getFileName()},
+        {"function", "scale"},
+        {"input_types", "float32"},
+        {"output_types", "float32"},
+        {"bench_chunk_sizes", "256 4096 65536"},
+        {"bench_input_distribution", "normal"},
+        {"bench_iterations", "50"}
+    };
+    auto confLoader = Pothos::PluginRegistry::get("/framework/conf_loader/luajit").getObject().extract<Pothos::Callable>();
+    const auto confPluginPaths = confLoader.call<std::vector<Pothos::PluginPath>>(config);
+
+    auto benchFactories = Pothos::PluginRegistry::get("/luajit/bench/conf_factories").getObject().extract<Pothos::Callable>();
+    const auto table = benchFactories.call<std::string>();
+    POTHOS_TEST_TRUE(table.find("/luajit/bench/conf_scale") != std::string::npos);
+
+    std::cout << table;
+
+    for(const auto& pluginPath: confPluginPaths)
+    {
+        Pothos::PluginRegistry::remove(pluginPath);
+    }
+}
+
+//
+// Math type benchmark
+//
+
+static constexpr size_t numMathTypesBenchElements = 1 << 22;
+
+// The same arithmetic, written with BlockEnv's complex type and by hand. With
+// the temporaries' allocations sunk, both should compile to the same code.
+static const std::string BenchMathTypesFuncsScript = R"(
+
+local ffi = require("ffi")
+
+local BenchFuncs = {}
+
+function BenchFuncs.metatype(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    local buffIn = ffi.cast(BlockEnv.complex_float64_ptr, buffsIn[0])
+    local buffOut = ffi.cast(BlockEnv.complex_float64_ptr, buffsOut[0])
+    local z = BlockEnv.complex_float64(0.5, 0.25)
+
+    for i = 0, elems-1
+    do
+        buffOut[i] = ((buffIn[i]:conj() * z) + 1.0) / 2.0
+    end
+end
+
+function BenchFuncs.handExpanded(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    local buffIn = ffi.cast("double*", buffsIn[0])
+    local buffOut = ffi.cast("double*", buffsOut[0])
+    local zReal = 0.5
+    local zImag = 0.25
+
+    for i = 0, elems-1
+    do
+        local real = buffIn[2*i]
+        local imag = -buffIn[(2*i)+1]
+        buffOut[2*i] = ((real * zReal) - (imag * zImag) + 1.0) / 2.0
+        buffOut[(2*i)+1] = ((real * zImag) + (imag * zReal)) / 2.0
+    end
+end
+
+return BenchFuncs
+
+)";
+
+static Pothos::BufferChunk runBenchMathTypes(
+    const Pothos::BufferChunk& input,
+    const std::string& functionName)
+{
+    auto feeder = Pothos::BlockRegistry::make("/blocks/feeder_source", "complex_float64");
+    feeder.call("feedBuffer", input);
+
+    auto luajitBlock = Pothos::BlockRegistry::make(
+                           "/blocks/luajit_block",
+                           std::vector<std::string>{"complex_float64"},
+                           std::vector<std::string>{"complex_float64"});
+    luajitBlock.call("setSource", BenchMathTypesFuncsScript, functionName);
+
+    auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "complex_float64");
+
+    // Machine code sizes are refreshed on deactivation.
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, luajitBlock, 0);
+        topology.connect(luajitBlock, 0, sink, 0);
+
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.01, 60.0));
+    }
+
+    const auto* luajitBlockPtr = dynamic_cast<const LuaJITBlock*>(luajitBlock.call<Pothos::Block*>("getPointer"));
+    std::cout << " " << functionName << ": "
+              << luajitBlock.call<double>("getNsPerElement") << " ns/element, "
+              << luajitBlockPtr->getMemoryUsage().jitMcodeBytes << " bytes of machine code"
+              << std::endl;
+
+    return sink.call<Pothos::BufferChunk>("getBuffer");
+}
+
+POTHOS_TEST_BLOCK("/luajit/bench", bench_luajit_math_types)
+{
+    Pothos::BufferChunk input("complex_float64", numMathTypesBenchElements);
+    for(size_t elem = 0; elem < (numMathTypesBenchElements * 2); ++elem)
+    {
+        input.as<double*>()[elem] = double(elem % 1024) / 256.0 - 2.0;
+    }
+
+    std::cout << "Complex math (" << numMathTypesBenchElements << " elements):" << std::endl;
+    const auto metatypeOutput = runBenchMathTypes(input, "metatype");
+    const auto handExpandedOutput = runBenchMathTypes(input, "handExpanded");
+
+    POTHOS_TEST_EQUAL(handExpandedOutput.elements(), metatypeOutput.elements());
+    POTHOS_TEST_EQUALA(
+        handExpandedOutput.as<const double*>(),
+        metatypeOutput.as<const double*>(),
+        (metatypeOutput.elements() * 2));
+}
+
+//
+// Channelizer benchmark
+//
+
+static constexpr size_t numChannelizerBenchElements = 1 << 20;
+static constexpr size_t numChannelizerBenchChannels = 16;
+
+// One channel's mixer, low-pass filter, and decimator, with the same taps as
+// the channelizer's defaults. The settings are prepended when the source is
+// generated.
+static const std::string BenchChannelFuncsScript = R"(
+
+local ffi = require("ffi")
+
+local BenchFuncs = {}
+
+local taps = ffi.new("double[?]", NumTaps)
+do
+    local center = (NumTaps - 1) / 2
+    local sum = 0.0
+    for i = 0, NumTaps-1
+    do
+        local x = (i - center) / NumChannels
+        local sinc = (x == 0) and 1.0 or (math.sin(math.pi * x) / (math.pi * x))
+        taps[i] = sinc * (0.5 - (0.5 * math.cos(2.0 * math.pi * (i + 1) / (NumTaps + 1))))
+        sum = sum + taps[i]
+    end
+    for i = 0, NumTaps-1
+    do
+        taps[i] = taps[i] / sum
+    end
+end
+
+-- The last NumTaps mixed inputs, newest last
+local historyReal = ffi.new("double[?]", NumTaps)
+local historyImag = ffi.new("double[?]", NumTaps)
+local mixerPhase = 0
+
+function BenchFuncs.channel(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems, inputElems, outputElems)
+    local input = ffi.cast("float*", buffsIn[0])
+    local output = ffi.cast("float*", buffsOut[0])
+
+    local numOutputs = math.min(math.floor(tonumber(inputElems[0]) / Decimation), tonumber(outputElems[0]))
+    for n = 0, numOutputs-1
+    do
+        for i = 0, Decimation-1
+        do
+            for j = 0, NumTaps-2
+            do
+                historyReal[j] = historyReal[j + 1]
+                historyImag[j] = historyImag[j + 1]
+            end
+
+            local phase = -2.0 * math.pi * mixerPhase / NumChannels
+            local mixReal = math.cos(phase)
+            local mixImag = math.sin(phase)
+            local inReal = input[2 * ((n * Decimation) + i)]
+            local inImag = input[(2 * ((n * Decimation) + i)) + 1]
+            historyReal[NumTaps-1] = (inReal * mixReal) - (inImag * mixImag)
+            historyImag[NumTaps-1] = (inReal * mixImag) + (inImag * mixReal)
+            mixerPhase = (mixerPhase + Channel) % NumChannels
+        end
+
+        local accReal = 0.0
+        local accImag = 0.0
+        for j = 0, NumTaps-1
+        do
+            accReal = accReal + (taps[NumTaps-1-j] * historyReal[j])
+            accImag = accImag + (taps[NumTaps-1-j] * historyImag[j])
+        end
+        output[2*n] = accReal
+        output[(2*n)+1] = accImag
+    end
+
+    inputElems[0] = numOutputs * Decimation
+    outputElems[0] = numOutputs
+end
+
+return BenchFuncs
+
+)";
+
+static double timeBenchChannelizer(
+    const Pothos::BufferChunk& input,
+    const std::vector<Pothos::Proxy>& blocks)
+{
+    auto feeder = Pothos::BlockRegistry::make("/blocks/feeder_source", "complex_float32");
+    feeder.call("feedBuffer", input);
+
+    Pothos::Topology topology;
+    std::vector<Pothos::Proxy> sinks;
+    for(size_t channel = 0; channel < numChannelizerBenchChannels; ++channel)
+    {
+        sinks.emplace_back(Pothos::BlockRegistry::make("/blocks/collector_sink", "complex_float32"));
+
+        // Either one channelizer with an output per channel, or a block per channel
+        if(blocks.size() == 1) topology.connect(blocks[0], channel, sinks.back(), 0);
+        else
+        {
+            topology.connect(feeder, 0, blocks[channel], 0);
+            topology.connect(blocks[channel], 0, sinks.back(), 0);
+        }
+    }
+    if(blocks.size() == 1) topology.connect(feeder, 0, blocks[0], 0);
+
+    const auto start = std::chrono::steady_clock::now();
+    topology.commit();
+    POTHOS_TEST_TRUE(topology.waitInactive(0.01, 120.0));
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    for(const auto& sink: sinks)
+    {
+        POTHOS_TEST_EQUAL(
+            (numChannelizerBenchElements / numChannelizerBenchChannels),
+            sink.call<Pothos::BufferChunk>("getBuffer").elements());
+    }
+
+    return elapsed.count();
+}
+
+POTHOS_TEST_BLOCK("/luajit/bench", bench_luajit_channelizer)
+{
+    Pothos::BufferChunk input("complex_float32", numChannelizerBenchElements);
+    for(size_t elem = 0; elem < (numChannelizerBenchElements * 2); ++elem)
+    {
+        input.as<float*>()[elem] = float(elem % 1024) / 512.0f - 1.0f;
+    }
+
+    auto channelizer = Pothos::BlockRegistry::make("/luajit/channelizer", numChannelizerBenchChannels, size_t(1));
+    const auto channelizerTime = timeBenchChannelizer(input, {channelizer});
+
+    std::vector<Pothos::Proxy> channelBlocks;
+    for(size_t channel = 0; channel < numChannelizerBenchChannels; ++channel)
+    {
+        const auto settings =
+            "local Channel = "+std::to_string(channel)+"\n"
+            "local NumChannels = "+std::to_string(numChannelizerBenchChannels)+"\n"
+            "local Decimation = "+std::to_string(numChannelizerBenchChannels)+"\n"
+            "local NumTaps = "+std::to_string(numChannelizerBenchChannels * 8)+"\n";
+
+        auto block = Pothos::BlockRegistry::make(
+                         "/blocks/luajit_block",
+                         std::vector<std::string>{"complex_float32"},
+                         std::vector<std::string>{"complex_float32"});
+        block.call("setSource", settings+BenchChannelFuncsScript, std::string("channel"));
+        block.call("setVariableRate", true);
+
+        channelBlocks.emplace_back(std::move(block));
+    }
+    const auto channelBlocksTime = timeBenchChannelizer(input, channelBlocks);
+
+    std::cout << "Channelizer (" << numChannelizerBenchChannels << " channels, "
+              << numChannelizerBenchElements << " elements):"
+              << " per-channel blocks: " << channelBlocksTime << " s"
+              << " channelizer: " << channelizerTime << " s"
+              << " speedup: " << (channelBlocksTime / channelizerTime) << "x"
+              << std::endl;
+}
+
+//
+// Symbol sync benchmark
+//
+
+static constexpr size_t numSymbolSyncBenchElements = 1 << 20;
+
+// The loop's cost doesn't depend on the pulse shape, so these are just
+// rectangular QPSK symbols.
+static Pothos::BufferChunk getBenchSymbols(double samplesPerSymbol)
+{
+    Pothos::BufferChunk output("complex_float32", numSymbolSyncBenchElements);
+    for(size_t elem = 0; elem < numSymbolSyncBenchElements; ++elem)
+    {
+        const auto symbol = size_t(double(elem) / samplesPerSymbol);
+        output.as<float*>()[2*elem] = ((symbol * 7) % 5 < 2) ? 0.7f : -0.7f;
+        output.as<float*>()[(2*elem)+1] = ((symbol * 3) % 7 < 3) ? 0.7f : -0.7f;
+    }
+
+    return output;
+}
+
+POTHOS_TEST_BLOCK("/luajit/bench", bench_luajit_symbol_sync)
+{
+    std::cout << "Symbol sync (" << numSymbolSyncBenchElements << " samples):" << std::endl;
+    for(const double samplesPerSymbol: {2.0, 4.0, 8.0, 16.0})
+    {
+        const auto input = getBenchSymbols(samplesPerSymbol);
+
+        for(const std::string detector: {"gardner", "mm"})
+        {
+            auto feeder = Pothos::BlockRegistry::make("/blocks/feeder_source", "complex_float32");
+            feeder.call("feedBuffer", input);
+
+            auto symbolSync = Pothos::BlockRegistry::make("/luajit/symbol_sync", samplesPerSymbol, detector);
+
+            auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "complex_float32");
+
+            Pothos::Topology topology;
+            topology.connect(feeder, 0, symbolSync, 0);
+            topology.connect(symbolSync, 0, sink, 0);
+
+            const auto start = std::chrono::steady_clock::now();
+            topology.commit();
+            POTHOS_TEST_TRUE(topology.waitInactive(0.01, 60.0));
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            std::cout << " " << samplesPerSymbol << " samples/symbol, " << detector << ": "
+                      << (numSymbolSyncBenchElements / elapsed.count() / 1e6) << " Msamples/s, "
+                      << sink.call<Pothos::BufferChunk>("getBuffer").elements() << " symbols"
+                      << std::endl;
+        }
+    }
+}
+
+//
+// Equalizer benchmark
+//
+
+static constexpr size_t numEqualizerBenchElements = 1 << 20;
+
+POTHOS_TEST_BLOCK("/luajit/bench", bench_luajit_equalizer)
+{
+    Pothos::BufferChunk input("complex_float32", numEqualizerBenchElements);
+    for(size_t elem = 0; elem < numEqualizerBenchElements; ++elem)
+    {
+        input.as<float*>()[2*elem] = ((elem * 7) % 5 < 2) ? 0.7f : -0.7f;
+        input.as<float*>()[(2*elem)+1] = ((elem * 3) % 7 < 3) ? 0.7f : -0.7f;
+    }
+
+    // Block updates let the filtering run as plain dot products, so larger
+    // blocks should be faster.
+    std::cout << "Equalizer (11 taps, " << numEqualizerBenchElements << " symbols):" << std::endl;
+    for(const std::string algorithm: {"lms", "nlms", "cma"})
+    {
+        for(const size_t blockSize: {1, 16, 64})
+        {
+            auto feeder = Pothos::BlockRegistry::make("/blocks/feeder_source", "complex_float32");
+            feeder.call("feedBuffer", input);
+
+            auto equalizer = Pothos::BlockRegistry::make("/luajit/equalizer", algorithm, size_t(11), size_t(1));
+            equalizer.call("setStepSize", 0.001);
+            equalizer.call("setBlockSize", blockSize);
+
+            auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "complex_float32");
+
+            Pothos::Topology topology;
+            topology.connect(feeder, 0, equalizer, 0);
+            topology.connect(equalizer, 0, sink, 0);
+
+            const auto start = std::chrono::steady_clock::now();
+            topology.commit();
+            POTHOS_TEST_TRUE(topology.waitInactive(0.01, 60.0));
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            std::cout << " " << algorithm << ", block size " << blockSize << ": "
+                      << (numEqualizerBenchElements / elapsed.count() / 1e6) << " Msymbols/s"
+                      << std::endl;
+        }
+    }
+}
+
+//
+// Viterbi decoder benchmark
+//
+
+static constexpr size_t numViterbiBenchBits = 1 << 18;
+
+// The same sliding-window algorithm as the block, for K=7 rate 1/2, as a
+// reference for what native code gets.
+static void nativeViterbiDecode(
+    const float* symbols,
+    size_t numBits,
+    std::vector<uint8_t>& output)
+{
+    constexpr size_t NumStates = 64;
+    constexpr size_t TracebackLength = 64;
+    constexpr size_t DecodeLength = 32;
+    constexpr size_t RingSteps = TracebackLength + DecodeLength;
+    constexpr size_t Polynomials[] = {121, 91};
+
+    uint8_t branchCodes[2*NumStates];
+    for(size_t state = 0; state < NumStates; ++state)
+    {
+        for(size_t j = 0; j < 2; ++j)
+        {
+            const size_t reg = ((state >> 5) << 6) | (((state << 1) & (NumStates-1)) | j);
+            uint8_t codeword = 0;
+            for(const auto polynomial: Polynomials)
+            {
+                codeword = uint8_t(codeword << 1) | uint8_t(__builtin_popcount(unsigned(reg & polynomial)) & 1);
+            }
+            branchCodes[(2*state)+j] = codeword;
+        }
+    }
+
+    std::vector<double> pathMetrics(NumStates, -1e30);
+    std::vector<double> newPathMetrics(NumStates);
+    std::vector<float> decisions(RingSteps * NumStates);
+    pathMetrics[0] = 0.0;
+
+    size_t outputCount = 0;
+    for(size_t step = 0; step < numBits; ++step)
+    {
+        const auto s0 = symbols[2*step];
+        const auto s1 = symbols[(2*step)+1];
+        const double branchMetrics[4] = {-s0-s1, -s0+s1, s0-s1, s0+s1};
+
+        float* stepDecisions = &decisions[(step % RingSteps) * NumStates];
+        for(size_t state = 0; state < NumStates; ++state)
+        {
+            const size_t pred0 = (state << 1) & (NumStates-1);
+            const auto metric0 = pathMetrics[pred0] + branchMetrics[branchCodes[2*state]];
+            const auto metric1 = pathMetrics[pred0+1] + branchMetrics[branchCodes[(2*state)+1]];
+
+            newPathMetrics[state] = std::max(metric0, metric1);
+            stepDecisions[state] = float(metric1 - metric0);
+        }
+        pathMetrics.swap(newPathMetrics);
+
+        if((step + 1) == (outputCount + RingSteps))
+        {
+            const auto bestIter = std::max_element(pathMetrics.begin(), pathMetrics.end());
+            size_t state = size_t(bestIter - pathMetrics.begin());
+            const auto bestMetric = *bestIter;
+
+            output.resize(outputCount + DecodeLength);
+            for(size_t tbStep = step + 1; tbStep-- > outputCount;)
+            {
+                if(tbStep < (outputCount + DecodeLength)) output[tbStep] = uint8_t(state >> 5);
+
+                const auto decision = (decisions[((tbStep % RingSteps) * NumStates) + state] > 0.0f) ? 1 : 0;
+                state = ((state << 1) & (NumStates-1)) | decision;
+            }
+
+            for(auto& metric: pathMetrics) metric -= bestMetric;
+            outputCount += DecodeLength;
+        }
+    }
+}
+
+POTHOS_TEST_BLOCK("/luajit/bench", bench_luajit_viterbi_decoder)
+{
+    // The decoder does the same work regardless of the symbols' values.
+    Pothos::BufferChunk softInput("float32", 2*numViterbiBenchBits);
+    Pothos::BufferChunk hardInput("uint8", 2*numViterbiBenchBits);
+    for(size_t i = 0; i < (2*numViterbiBenchBits); ++i)
+    {
+        const bool value = ((i * 7) % 5) < 2;
+        softInput.as<float*>()[i] = value ? 0.8f : -0.8f;
+        hardInput.as<uint8_t*>()[i] = value ? 1 : 0;
+    }
+
+    std::cout << "Viterbi decoder (K=7, rate 1/2, " << numViterbiBenchBits << " bits):" << std::endl;
+
+    std::vector<uint8_t> nativeOutput;
+    const auto nativeStart = std::chrono::steady_clock::now();
+    nativeViterbiDecode(softInput.as<const float*>(), numViterbiBenchBits, nativeOutput);
+    const std::chrono::duration<double> nativeElapsed = std::chrono::steady_clock::now() - nativeStart;
+    std::cout << " native reference: " << (numViterbiBenchBits / nativeElapsed.count() / 1e6) << " Mbit/s" << std::endl;
+
+    for(const bool softInputMode: {true, false})
+    {
+        const auto& input = softInputMode ? softInput : hardInput;
+
+        auto feeder = Pothos::BlockRegistry::make("/blocks/feeder_source", input.dtype);
+        feeder.call("feedBuffer", input);
+
+        auto decoder = Pothos::BlockRegistry::make(
+                           "/luajit/viterbi_decoder",
+                           size_t(7),
+                           std::vector<size_t>{121, 91},
+                           softInputMode);
+
+        auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "uint8");
+
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, decoder, 0);
+        topology.connect(decoder, 0, sink, 0);
+
+        const auto start = std::chrono::steady_clock::now();
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.01, 60.0));
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        const auto output = sink.call<Pothos::BufferChunk>("getBuffer");
+        POTHOS_TEST_EQUAL(nativeOutput.size(), output.elements());
+
+        std::cout << " " << (softInputMode ? "soft" : "hard") << " input: "
+                  << (numViterbiBenchBits / elapsed.count() / 1e6) << " Mbit/s, "
+                  << (nativeElapsed.count() / elapsed.count()) << "x native"
+                  << std::endl;
+    }
+}
+
+//
+// Interleaver benchmark
+//
+
+static constexpr size_t numInterleaverBenchElements = 1 << 22;
+
+// A straightforward block interleaver that computes each element's index as
+// it goes. The frame shape is prepended when the source is generated.
+static const std::string BenchInterleaverFuncsScript = R"(
+
+local ffi = require("ffi")
+
+local BenchFuncs = {}
+
+function BenchFuncs.interleave(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems, inputElems, outputElems)
+    local input = ffi.cast("uint32_t*", buffsIn[0])
+    local output = ffi.cast("uint32_t*", buffsOut[0])
+
+    local frameSize = NumRows * NumColumns
+    local numFrames = math.floor(math.min(tonumber(inputElems[0]), tonumber(outputElems[0])) / frameSize)
+    for i = 0, (numFrames * frameSize)-1
+    do
+        local frameIndex = i % frameSize
+        local column = math.floor(frameIndex / NumRows)
+        local row = frameIndex % NumRows
+        output[i] = input[(i - frameIndex) + (row * NumColumns) + column]
+    end
+
+    inputElems[0] = numFrames * frameSize
+    outputElems[0] = numFrames * frameSize
+end
+
+return BenchFuncs
+
+)";
+
+static double timeBenchInterleaver(
+    const Pothos::BufferChunk& input,
+    const Pothos::Proxy& block)
+{
+    auto feeder = Pothos::BlockRegistry::make("/blocks/feeder_source", input.dtype);
+    feeder.call("feedBuffer", input);
+
+    auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", input.dtype);
+
+    Pothos::Topology topology;
+    topology.connect(feeder, 0, block, 0);
+    topology.connect(block, 0, sink, 0);
+
+    const auto start = std::chrono::steady_clock::now();
+    topology.commit();
+    POTHOS_TEST_TRUE(topology.waitInactive(0.01, 60.0));
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return elapsed.count();
+}
+
+POTHOS_TEST_BLOCK("/luajit/bench", bench_luajit_interleavers)
+{
+    Pothos::BufferChunk input("uint32", numInterleaverBenchElements);
+    for(size_t elem = 0; elem < numInterleaverBenchElements; ++elem) input.as<uint32_t*>()[elem] = uint32_t(elem);
+
+    std::cout << "Interleavers (" << numInterleaverBenchElements << " elements):" << std::endl;
+
+    // Larger frames are where tiling matters. Frames have to fit in a port
+    // buffer, since only whole frames are consumed.
+    const std::vector<std::pair<size_t, size_t>> frameShapes = {{8, 16}, {32, 32}, {64, 64}};
+    for(const auto& frameShape: frameShapes)
+    {
+        auto scalarBlock = Pothos::BlockRegistry::make(
+                               "/blocks/luajit_block",
+                               std::vector<std::string>{"uint32"},
+                               std::vector<std::string>{"uint32"});
+        scalarBlock.call(
+            "setSource",
+            "local NumRows = "+std::to_string(frameShape.first)+"\n"
+            "local NumColumns = "+std::to_string(frameShape.second)+"\n"+
+            BenchInterleaverFuncsScript,
+            std::string("interleave"));
+        scalarBlock.call("setVariableRate", true);
+
+        const auto scalarTime = timeBenchInterleaver(input, scalarBlock);
+        const auto mappedTime = timeBenchInterleaver(
+                                    input,
+                                    Pothos::BlockRegistry::make("/luajit/block_interleaver", "uint32", frameShape.first, frameShape.second));
+
+        std::cout << " block " << frameShape.first << "x" << frameShape.second << ":"
+                  << " per-element indices: " << (numInterleaverBenchElements / scalarTime / 1e6) << " Melements/s"
+                  << " index map: " << (numInterleaverBenchElements / mappedTime / 1e6) << " Melements/s"
+                  << " speedup: " << (scalarTime / mappedTime) << "x"
+                  << std::endl;
+    }
+
+    const auto convTime = timeBenchInterleaver(
+                              input,
+                              Pothos::BlockRegistry::make("/luajit/convolutional_interleaver", "uint32", size_t(12), size_t(17)));
+    std::cout << " convolutional 12x17: " << (numInterleaverBenchElements / convTime / 1e6) << " Melements/s" << std::endl;
+}
+
+//
+// Fixed-point kernels
+//
+
+static constexpr size_t numFixedPointBenchElements = 1 << 22;
+
+static double timeBenchSingleOutput(
+    const std::vector<Pothos::BufferChunk>& inputs,
+    const Pothos::Proxy& block,
+    const std::string& outputDType)
+{
+    Pothos::Topology topology;
+    for(size_t i = 0; i < inputs.size(); ++i)
+    {
+        auto feeder = Pothos::BlockRegistry::make("/blocks/feeder_source", inputs[i].dtype);
+        feeder.call("feedBuffer", inputs[i]);
+        topology.connect(feeder, 0, block, i);
+    }
+
+    auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", outputDType);
+    topology.connect(block, 0, sink, 0);
+
+    const auto start = std::chrono::steady_clock::now();
+    topology.commit();
+    POTHOS_TEST_TRUE(topology.waitInactive(0.01, 60.0));
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return elapsed.count();
+}
+
+POTHOS_TEST_BLOCK("/luajit/bench", bench_luajit_fixed_point)
+{
+    Pothos::BufferChunk input16("complex_int16", numFixedPointBenchElements);
+    Pothos::BufferChunk input32("complex_int32", numFixedPointBenchElements);
+    for(size_t i = 0; i < (2 * numFixedPointBenchElements); ++i)
+    {
+        input16.as<int16_t*>()[i] = int16_t((i * 7919) & 0xFFFF);
+        input32.as<int32_t*>()[i] = int32_t(i * 2654435761U);
+    }
+
+    // A native complex Q15 multiply, for reference
+    std::vector<int16_t> nativeOutput(2 * numFixedPointBenchElements);
+    const auto* in = input16.as<const int16_t*>();
+    const auto nativeStart = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < numFixedPointBenchElements; ++i)
+    {
+        const int64_t ar = in[2*i], ai = in[(2*i)+1];
+        const int64_t real = (((ar * ar) - (ai * ai)) + (1 << 14)) >> 15;
+        const int64_t imag = ((2 * ar * ai) + (1 << 14)) >> 15;
+        nativeOutput[2*i] = int16_t(std::min<int64_t>(std::max<int64_t>(real, -32768), 32767));
+        nativeOutput[(2*i)+1] = int16_t(std::min<int64_t>(std::max<int64_t>(imag, -32768), 32767));
+    }
+    const std::chrono::duration<double> nativeTime = std::chrono::steady_clock::now() - nativeStart;
+
+    std::cout << "Fixed-point kernels (" << numFixedPointBenchElements << " elements):" << std::endl;
+
+    const auto multiplyTime = timeBenchSingleOutput(
+                                  {input16, input16},
+                                  Pothos::BlockRegistry::make("/luajit/fixed_multiply", "complex_int16"),
+                                  "complex_int16");
+    std::cout << " multiply cint16: " << (numFixedPointBenchElements / multiplyTime / 1e6) << " Msps"
+              << " (native loop: " << (numFixedPointBenchElements / nativeTime.count() / 1e6) << " Msps)"
+              << std::endl;
+
+    const auto scaleTime = timeBenchSingleOutput(
+                               {input16},
+                               Pothos::BlockRegistry::make("/luajit/fixed_scale", "complex_int16"),
+                               "complex_int16");
+    std::cout << " scale cint16: " << (numFixedPointBenchElements / scaleTime / 1e6) << " Msps" << std::endl;
+
+    const auto accumulateTime = timeBenchSingleOutput(
+                                    {input16},
+                                    Pothos::BlockRegistry::make("/luajit/fixed_accumulate", "complex_int16", "complex_int32", size_t(16)),
+                                    "complex_int32");
+    std::cout << " accumulate cint16 -> cint32 (16x): " << (numFixedPointBenchElements / accumulateTime / 1e6) << " Msps" << std::endl;
+
+    const auto roundTime = timeBenchSingleOutput(
+                               {input32},
+                               Pothos::BlockRegistry::make("/luajit/fixed_round_saturate", "complex_int32", "complex_int16"),
+                               "complex_int16");
+    std::cout << " round/saturate cint32 -> cint16: " << (numFixedPointBenchElements / roundTime / 1e6) << " Msps" << std::endl;
+}
+
+//
+// Noise
+//
+
+static constexpr size_t numNoiseBenchElements = 1 << 22;
+
+POTHOS_TEST_BLOCK("/luajit/bench", bench_luajit_noise)
+{
+    std::cout << "Noise adders (" << numNoiseBenchElements << " elements):" << std::endl;
+
+    for(const std::string dtype: {"float32", "complex_float32"})
+    {
+        Pothos::BufferChunk input(dtype, numNoiseBenchElements);
+        std::memset(input.as<void*>(), 0, input.length);
+
+        // The standard library's generators, for reference
+        std::mt19937_64 engine;
+        std::normal_distribution<float> normal;
+        std::vector<float> nativeOutput(input.length / sizeof(float));
+        const auto nativeStart = std::chrono::steady_clock::now();
+        for(auto& value: nativeOutput) value = normal(engine);
+        const std::chrono::duration<double> nativeTime = std::chrono::steady_clock::now() - nativeStart;
+
+        for(const std::string distribution: {"uniform", "gaussian"})
+        {
+            const auto time = timeBenchSingleOutput(
+                                  {input},
+                                  Pothos::BlockRegistry::make("/luajit/noise_adder", dtype, distribution),
+                                  dtype);
+            std::cout << " " << distribution << " " << dtype << ": " << (numNoiseBenchElements / time / 1e6) << " Msps" << std::endl;
+        }
+        std::cout << "  (std::normal_distribution: " << (numNoiseBenchElements / nativeTime.count() / 1e6) << " Msps)" << std::endl;
+    }
+}
+
+//
+// Frame kernels
+//
+
+static constexpr size_t numFrameBenchFrames = 4096;
+static constexpr size_t frameBenchFrameSize = 1024;
+
+// Sorting each frame as a Lua table, the way scripts had to before
+static const std::string BenchFrameFuncsScript = R"(
+
+local ffi = require("ffi")
+
+local BenchFuncs = {}
+
+function BenchFuncs.tableSort(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems, inputElems, outputElems)
+    local input = ffi.cast("float*", buffsIn[0])
+    local output = ffi.cast("float*", buffsOut[0])
+
+    local numFrames = math.floor(math.min(tonumber(inputElems[0]), tonumber(outputElems[0])) / FrameSize)
+    for frame = 0, numFrames-1
+    do
+        local offset = frame * FrameSize
+
+        local values = {}
+        for i = 0, FrameSize-1
+        do
+            values[i+1] = input[offset + i]
+        end
+        table.sort(values)
+        for i = 0, FrameSize-1
+        do
+            output[offset + i] = values[i+1]
+        end
+    end
+
+    inputElems[0] = numFrames * FrameSize
+    outputElems[0] = numFrames * FrameSize
+end
+
+return BenchFuncs
+
+)";
+
+POTHOS_TEST_BLOCK("/luajit/bench", bench_luajit_frame_kernels)
+{
+    constexpr size_t numElems = numFrameBenchFrames * frameBenchFrameSize;
+
+    std::mt19937 engine;
+    std::uniform_real_distribution<float> uniform(-1000.0f, 1000.0f);
+
+    Pothos::BufferChunk input("float32", numElems);
+    for(size_t i = 0; i < numElems; ++i) input.as<float*>()[i] = uniform(engine);
+
+    // Sorting each frame natively, for reference
+    std::vector<float> nativeOutput(input.as<const float*>(), input.as<const float*>() + numElems);
+    const auto nativeStart = std::chrono::steady_clock::now();
+    for(size_t frame = 0; frame < numFrameBenchFrames; ++frame)
+    {
+        const auto frameStart = nativeOutput.begin() + (frame * frameBenchFrameSize);
+        std::sort(frameStart, frameStart + frameBenchFrameSize);
+    }
+    const std::chrono::duration<double> nativeTime = std::chrono::steady_clock::now() - nativeStart;
+
+    auto tableSortBlock = Pothos::BlockRegistry::make(
+                              "/blocks/luajit_block",
+                              std::vector<std::string>{"float32"},
+                              std::vector<std::string>{"float32"});
+    tableSortBlock.call(
+        "setSource",
+        "local FrameSize = "+std::to_string(frameBenchFrameSize)+"\n"+BenchFrameFuncsScript,
+        std::string("tableSort"));
+    tableSortBlock.call("setVariableRate", true);
+
+    const auto tableSortTime = timeBenchSingleOutput({input}, tableSortBlock, "float32");
+    const auto radixSortTime = timeBenchSingleOutput(
+                                   {input},
+                                   Pothos::BlockRegistry::make("/luajit/radix_sort", "float32", frameBenchFrameSize),
+                                   "float32");
+
+    // Only the first output is collected.
+    const auto topKTime = timeBenchSingleOutput(
+                              {input},
+                              Pothos::BlockRegistry::make("/luajit/top_k", "float32", frameBenchFrameSize, size_t(16)),
+                              "float32");
+    const auto peakFinderTime = timeBenchSingleOutput(
+                                    {input},
+                                    Pothos::BlockRegistry::make("/luajit/peak_finder", "float32", frameBenchFrameSize),
+                                    "float32");
+
+    std::cout << "Frame kernels (" << numFrameBenchFrames << " frames of " << frameBenchFrameSize << " elements):" << std::endl;
+    std::cout << " radix sort float32: " << (numElems / radixSortTime / 1e6) << " Msps" << std::endl;
+    std::cout << "  (table.sort: " << (numElems / tableSortTime / 1e6) << " Msps, "
+              << "std::sort: " << (numElems / nativeTime.count() / 1e6) << " Msps)" << std::endl;
+    std::cout << " top-16 float32: " << (numElems / topKTime / 1e6) << " Msps" << std::endl;
+    std::cout << " peak finder float32: " << (numElems / peakFinderTime / 1e6) << " Msps" << std::endl;
+}
@@ -5,6 +5,7 @@
 #define SOL_USING_CXX_LUA_JIT 1
 
 #include "LuaJITBlock.hpp"
+#include "ScopedFlushDenormals.hpp"
 
 #include <Pothos/Exception.hpp>
 
@@ -12,7 +13,13 @@
 #include <Poco/Path.h>
 
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 //
@@ -22,10 +29,28 @@
 static const std::string BlockEnvScript = R"(
 
 local ffi = require("ffi")
+local jutil = require("jit.util")
 
 BlockEnv = {}
 
-function BlockEnv.CallBlockFunction(fcn, inputBuffers, outputBuffers, elems)
+-- Total size of the machine code generated for all traces in this state.
+function BlockEnv.GetMcodeSize()
+    local mcodeSize = 0
+    local trace = 1
+    while jutil.traceinfo(trace)
+    do
+        local mcode = jutil.tracemc(trace)
+        if mcode then mcodeSize = mcodeSize + #mcode end
+        trace = trace + 1
+    end
+
+    return mcodeSize
+end
+
+-- Variable-rate functions also get inputElems and outputElems, size_t
+-- arrays of each port's available elements, which the function replaces
+-- with the number of elements it consumed or produced.
+function BlockEnv.CallBlockFunction(fcn, inputBuffers, outputBuffers, elems, inputElems, outputElems)
     -- Copy pointers to FFI buffers so the block function can cast them
     -- as needed.
     local inputBuffersFFI = ffi.new("void*[?]", #inputBuffers)
@@ -44,9 +69,415 @@ function BlockEnv.CallBlockFunction(fcn, inputBuffers, outputBuffers, elems)
         outputBuffersFFI[i-1] = outputBuffers[i]
     end
 
-    fcn(inputBuffersFFI, #inputBuffers, outputBuffersFFI, #outputBuffers, elems)
+    if inputElems ~= nil
+    then
+        fcn(inputBuffersFFI, #inputBuffers, outputBuffersFFI, #outputBuffers, elems,
+            ffi.cast("size_t*", inputElems), ffi.cast("size_t*", outputElems))
+    else
+        fcn(inputBuffersFFI, #inputBuffers, outputBuffersFFI, #outputBuffers, elems)
+    end
+end
+
+-- Composes single-input, single-output functions into one function that
+-- runs them back-to-back, one tile at a time, so intermediate results stay
+-- in cache. elemSizes holds each function's input element size, followed by
+-- the last function's output element size.
+function BlockEnv.FuseFunctions(chunks, functionNames, elemSizes, tileElems)
+    local numStages = #chunks
+
+    local fcns = {}
+    for stage = 1,numStages
+    do
+        -- Each source gets its own globals so they can't clobber each other.
+        local userEnv = setfenv(chunks[stage], setmetatable({}, {__index = _G}))()
+        local fcn = (type(userEnv) == "table") and userEnv[functionNames[stage]]
+        if type(fcn) ~= "function"
+        then
+            error("The given field ("..functionNames[stage]..") must be a function.")
+        end
+
+        fcns[stage] = fcn
+    end
+
+    -- Stage N's output tile is stage N+1's input tile. The first input and
+    -- last output point into the block's buffers and are set per tile.
+    local stageInputs = {}
+    local stageOutputs = {}
+    for stage = 1,numStages
+    do
+        stageInputs[stage] = ffi.new("void*[1]")
+        stageOutputs[stage] = ffi.new("void*[1]")
+    end
+
+    -- Stored in BlockEnv so they live as long as the state.
+    BlockEnv.FusedTiles = {}
+    for stage = 1,(numStages-1)
+    do
+        local tile = ffi.new("uint8_t[?]", tileElems * elemSizes[stage+1])
+        BlockEnv.FusedTiles[stage] = tile
+        stageOutputs[stage][0] = tile
+        stageInputs[stage+1][0] = tile
+    end
+
+    local inputElemSize = elemSizes[1]
+    local outputElemSize = elemSizes[numStages+1]
+
+    return function(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+        local buffIn = ffi.cast("uint8_t*", buffsIn[0])
+        local buffOut = ffi.cast("uint8_t*", buffsOut[0])
+
+        local elem = 0
+        while elem < elems
+        do
+            local tileSize = elems - elem
+            if tileSize > tileElems then tileSize = tileElems end
+
+            stageInputs[1][0] = buffIn + (elem * inputElemSize)
+            stageOutputs[numStages][0] = buffOut + (elem * outputElemSize)
+            for stage = 1,numStages
+            do
+                fcns[stage](stageInputs[stage], 1, stageOutputs[stage], 1, tileSize)
+            end
+
+            elem = elem + tileSize
+        end
+    end
+end
+
+-- Piecewise cubic approximation. Each segment's cubic interpolates the
+-- function at the segment's Chebyshev nodes, 0.5 - 0.5cos((2k+1)pi/8),
+-- which comes close to the segment's minimax cubic. These are written out
+-- since the math library may not be open yet.
+local ApproximationNodes =
+{
+    [0] = 0.03806023374435663,
+    [1] = 0.3086582838174551,
+    [2] = 0.6913417161825448,
+    [3] = 0.9619397662556434,
+}
+
+-- Error is measured at this many evenly spaced points per segment.
+local ApproximationChecks = 16
+local MaxApproximationSegments = 65536
+
+-- Writes the coefficients of segment [x0, x0+width), in powers of the
+-- position within it (0 to 1), to coeffs[0...3].
+local function FitSegment(fcn, x0, width, coeffs)
+    -- Newton divided differences, then expanded into powers of t
+    local d = {}
+    for k = 0, 3
+    do
+        d[k] = fcn(x0 + (ApproximationNodes[k] * width))
+    end
+    for level = 1, 3
+    do
+        for k = 3, level, -1
+        do
+            d[k] = (d[k] - d[k-1]) / (ApproximationNodes[k] - ApproximationNodes[k-level])
+        end
+    end
+
+    coeffs[0], coeffs[1], coeffs[2], coeffs[3] = d[3], 0, 0, 0
+    for k = 2, 0, -1
+    do
+        local node = ApproximationNodes[k]
+        coeffs[3] = coeffs[2] - (node * coeffs[3])
+        coeffs[2] = coeffs[1] - (node * coeffs[2])
+        coeffs[1] = coeffs[0] - (node * coeffs[1])
+        coeffs[0] = d[k] - (node * coeffs[0])
+    end
+end
+
+local function EvaluateSegment(c, t)
+    return (((c[3] * t) + c[2]) * t + c[1]) * t + c[0]
+end
+
+-- Returns the largest error of the given number of segments.
+local function MeasureApproximation(fcn, xMin, xMax, numSegments)
+    local width = (xMax - xMin) / numSegments
+    local coeffs = ffi.new("double[4]")
+
+    local maxError = 0.0
+    for segment = 0, numSegments-1
+    do
+        local x0 = xMin + (segment * width)
+        FitSegment(fcn, x0, width, coeffs)
+
+        for i = 0, ApproximationChecks
+        do
+            local t = i / ApproximationChecks
+            local err = math.abs(fcn(x0 + (t * width)) - EvaluateSegment(coeffs, t))
+
+            -- NaN compares false, so check this way around.
+            if not (err <= maxError) then maxError = err end
+        end
+    end
+
+    return maxError
+end
+
+local function MakeApproximation(coeffs, xMin, xMax, numSegments)
+    local scale = numSegments / (xMax - xMin)
+    local lastSegment = numSegments - 1
+
+    -- Outside the domain, this returns the values at its ends.
+    return function(x)
+        local position = math.max(0.0, math.min(numSegments, (x - xMin) * scale))
+        local segment = math.min(lastSegment, math.floor(position))
+
+        return EvaluateSegment(coeffs + (4 * segment), position - segment)
+    end
+end
+
+-- Compiled separately for each function timed, so each gets its own trace.
+local TimeCallsSource = [[
+    local fcn, points, numPoints, numRounds = ...
+
+    local best = math.huge
+    local sum = 0.0
+    for round = 1, numRounds
+    do
+        local start = BlockEnv.GetTime()
+        for i = 0, numPoints-1
+        do
+            sum = sum + fcn(points[i])
+        end
+        best = math.min(best, BlockEnv.GetTime() - start)
+    end
+
+    return best, sum
+]]
+
+-- How many times faster the approximation is than calling fcn directly,
+-- measured over the domain
+local function MeasureSpeedup(fcn, approximation, xMin, xMax)
+    local NumPoints = 4096
+    local NumRounds = 5
+
+    local points = ffi.new("double[?]", NumPoints)
+    for i = 0, NumPoints-1
+    do
+        points[i] = xMin + ((xMax - xMin) * (i + 0.5) / NumPoints)
+    end
+
+    local directTime = load(TimeCallsSource)(fcn, points, NumPoints, NumRounds)
+    local approximationTime = load(TimeCallsSource)(approximation, points, NumPoints, NumRounds)
+
+    return (approximationTime > 0.0) and (directTime / approximationTime) or math.huge
+end
+
+-- Exact, unlike tostring()
+local function DoubleKey(x)
+    return tostring(ffi.cast("uint64_t*", ffi.new("double[1]", x))[0])
+end
+
+-- Returns a function approximating fcn over [xMin, xMax] to within
+-- maxError, with as few segments as that takes, along with a table of the
+-- measured maxError, number of segments, and a measureSpeedup() function,
+-- which times the approximation against calling fcn. Timing takes a while,
+-- so it's only done when asked for, once per process.
+-- The approximation is built once per process for each key (which must
+-- identify fcn), domain, and maxError. This needs the math library.
+function BlockEnv.Approximate(key, fcn, xMin, xMax, maxError)
+    if math == nil
+    then
+        error("BlockEnv.Approximate requires the math library.")
+    end
+    if not (xMax > xMin)
+    then
+        error("Approximating "..key..": the domain's maximum must be above its minimum.")
+    end
+
+    local tableKey = "luajit/approximate/"..key.."/"..DoubleKey(xMin).."/"..DoubleKey(xMax).."/"..DoubleKey(maxError)
+
+    -- The segment count and measured error, found by doubling the count
+    -- until the error is small enough
+    local header = ffi.cast("double*", BlockEnv.GetSharedTable(
+        tableKey.."/header",
+        2 * ffi.sizeof("double"),
+        function(ptr)
+            local values = ffi.cast("double*", ptr)
+
+            local numSegments = 1
+            local measuredError = MeasureApproximation(fcn, xMin, xMax, numSegments)
+            while not (measuredError <= maxError)
+            do
+                numSegments = 2 * numSegments
+                if numSegments > MaxApproximationSegments
+                then
+                    error("Couldn't approximate "..key.." to within "..maxError.." with "..MaxApproximationSegments.." segments.")
+                end
+                measuredError = MeasureApproximation(fcn, xMin, xMax, numSegments)
+            end
+
+            values[0] = numSegments
+            values[1] = measuredError
+        end))
+    local numSegments = header[0]
+
+    local coeffs = ffi.cast("double*", BlockEnv.GetSharedTable(
+        tableKey.."/coeffs",
+        4 * numSegments * ffi.sizeof("double"),
+        function(ptr)
+            local values = ffi.cast("double*", ptr)
+            local width = (xMax - xMin) / numSegments
+            for segment = 0, numSegments-1
+            do
+                FitSegment(fcn, xMin + (segment * width), width, values + (4 * segment))
+            end
+        end))
+
+    local approximation = MakeApproximation(coeffs, xMin, xMax, numSegments)
+
+    local function measureSpeedup()
+        local speedup = ffi.cast("double*", BlockEnv.GetSharedTable(
+            tableKey.."/speedup",
+            ffi.sizeof("double"),
+            function(ptr)
+                ffi.cast("double*", ptr)[0] = MeasureSpeedup(fcn, approximation, xMin, xMax)
+            end))
+
+        return speedup[0]
+    end
+
+    return approximation, {maxError = header[1], segments = numSegments, measureSpeedup = measureSpeedup}
+end
+
+-- Complex and short-vector types for kernels. Every operation builds its
+-- result through the ctype and has no other side effects, so the JIT can
+-- sink the allocations of temporaries that don't escape a trace, and the
+-- generated code matches the hand-expanded arithmetic.
+local function DefineComplexType(elemType)
+    local Complex
+    local methods = {}
+
+    function methods.conj(a) return Complex(a.real, -a.imag) end
+    function methods.norm(a) return (a.real * a.real) + (a.imag * a.imag) end
+    function methods.abs(a) return ((a.real * a.real) + (a.imag * a.imag)) ^ 0.5 end
+
+    -- Either operand may be a real number.
+    local mt = {__index = methods}
+    function mt.__add(a, b)
+        if type(a) == "number" then return Complex(a + b.real, b.imag) end
+        if type(b) == "number" then return Complex(a.real + b, a.imag) end
+        return Complex(a.real + b.real, a.imag + b.imag)
+    end
+    function mt.__sub(a, b)
+        if type(a) == "number" then return Complex(a - b.real, -b.imag) end
+        if type(b) == "number" then return Complex(a.real - b, a.imag) end
+        return Complex(a.real - b.real, a.imag - b.imag)
+    end
+    function mt.__mul(a, b)
+        if type(a) == "number" then return Complex(a * b.real, a * b.imag) end
+        if type(b) == "number" then return Complex(a.real * b, a.imag * b) end
+        return Complex(
+                   (a.real * b.real) - (a.imag * b.imag),
+                   (a.real * b.imag) + (a.imag * b.real))
+    end
+    function mt.__div(a, b)
+        if type(b) == "number" then return Complex(a.real / b, a.imag / b) end
+        if type(a) == "number" then a = Complex(a, 0) end
+        local denom = (b.real * b.real) + (b.imag * b.imag)
+        return Complex(
+                   ((a.real * b.real) + (a.imag * b.imag)) / denom,
+                   ((a.imag * b.real) - (a.real * b.imag)) / denom)
+    end
+    function mt.__unm(a) return Complex(-a.real, -a.imag) end
+    function mt.__tostring(a) return "("..tostring(a.real)..","..tostring(a.imag)..")" end
+
+    -- Same layout as Pothos's interleaved complex types.
+    Complex = ffi.metatype("struct { "..elemType.." real; "..elemType.." imag; }", mt)
+
+    return Complex
+end
+
+local function DefineVec2Type()
+    local Vec2
+    local methods = {}
+
+    function methods.dot(a, b) return (a.x * b.x) + (a.y * b.y) end
+    function methods.length(a) return ((a.x * a.x) + (a.y * a.y)) ^ 0.5 end
+
+    -- Arithmetic is element-wise. Either operand may be a scalar.
+    local mt = {__index = methods}
+    function mt.__add(a, b)
+        if type(a) == "number" then return Vec2(a + b.x, a + b.y) end
+        if type(b) == "number" then return Vec2(a.x + b, a.y + b) end
+        return Vec2(a.x + b.x, a.y + b.y)
+    end
+    function mt.__sub(a, b)
+        if type(a) == "number" then return Vec2(a - b.x, a - b.y) end
+        if type(b) == "number" then return Vec2(a.x - b, a.y - b) end
+        return Vec2(a.x - b.x, a.y - b.y)
+    end
+    function mt.__mul(a, b)
+        if type(a) == "number" then return Vec2(a * b.x, a * b.y) end
+        if type(b) == "number" then return Vec2(a.x * b, a.y * b) end
+        return Vec2(a.x * b.x, a.y * b.y)
+    end
+    function mt.__div(a, b)
+        if type(a) == "number" then return Vec2(a / b.x, a / b.y) end
+        if type(b) == "number" then return Vec2(a.x / b, a.y / b) end
+        return Vec2(a.x / b.x, a.y / b.y)
+    end
+    function mt.__unm(a) return Vec2(-a.x, -a.y) end
+    function mt.__tostring(a) return "("..tostring(a.x)..","..tostring(a.y)..")" end
+
+    Vec2 = ffi.metatype("struct { float x; float y; }", mt)
+
+    return Vec2
+end
+
+local function DefineVec4Type()
+    local Vec4
+    local methods = {}
+
+    function methods.dot(a, b) return (a.x * b.x) + (a.y * b.y) + (a.z * b.z) + (a.w * b.w) end
+    function methods.length(a) return ((a.x * a.x) + (a.y * a.y) + (a.z * a.z) + (a.w * a.w)) ^ 0.5 end
+
+    -- Arithmetic is element-wise. Either operand may be a scalar.
+    local mt = {__index = methods}
+    function mt.__add(a, b)
+        if type(a) == "number" then return Vec4(a + b.x, a + b.y, a + b.z, a + b.w) end
+        if type(b) == "number" then return Vec4(a.x + b, a.y + b, a.z + b, a.w + b) end
+        return Vec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w)
+    end
+    function mt.__sub(a, b)
+        if type(a) == "number" then return Vec4(a - b.x, a - b.y, a - b.z, a - b.w) end
+        if type(b) == "number" then return Vec4(a.x - b, a.y - b, a.z - b, a.w - b) end
+        return Vec4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w)
+    end
+    function mt.__mul(a, b)
+        if type(a) == "number" then return Vec4(a * b.x, a * b.y, a * b.z, a * b.w) end
+        if type(b) == "number" then return Vec4(a.x * b, a.y * b, a.z * b, a.w * b) end
+        return Vec4(a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w)
+    end
+    function mt.__div(a, b)
+        if type(a) == "number" then return Vec4(a / b.x, a / b.y, a / b.z, a / b.w) end
+        if type(b) == "number" then return Vec4(a.x / b, a.y / b, a.z / b, a.w / b) end
+        return Vec4(a.x / b.x, a.y / b.y, a.z / b.z, a.w / b.w)
+    end
+    function mt.__unm(a) return Vec4(-a.x, -a.y, -a.z, -a.w) end
+    function mt.__tostring(a)
+        return "("..tostring(a.x)..","..tostring(a.y)..","..tostring(a.z)..","..tostring(a.w)..")"
+    end
+
+    Vec4 = ffi.metatype("struct { float x; float y; float z; float w; }", mt)
+
+    return Vec4
 end
 
+BlockEnv.complex_float32 = DefineComplexType("float")
+BlockEnv.complex_float64 = DefineComplexType("double")
+BlockEnv.vec2 = DefineVec2Type()
+BlockEnv.vec4 = DefineVec4Type()
+
+-- For casting buffers, e.g. ffi.cast(BlockEnv.complex_float32_ptr, buffsIn[0])
+BlockEnv.complex_float32_ptr = ffi.typeof("$*", BlockEnv.complex_float32)
+BlockEnv.complex_float64_ptr = ffi.typeof("$*", BlockEnv.complex_float64)
+BlockEnv.vec2_ptr = ffi.typeof("$*", BlockEnv.vec2)
+BlockEnv.vec4_ptr = ffi.typeof("$*", BlockEnv.vec4)
+
 return BlockEnv
 
 )";
@@ -77,6 +508,189 @@ static sol::protected_function_result safeLuaCall(const sol::protected_function&
     return pfr;
 }
 
+static sol::protected_function getLoadedChunk(sol::load_result&& loadResult)
+{
+    if(!loadResult.valid())
+    {
+        sol::error err = loadResult;
+        throw Pothos::Exception(err.what());
+    }
+
+    return loadResult.get<sol::protected_function>();
+}
+
+// If this is a path, import it as a script. Else, take it as a string literal.
+// The exists() check should theoretically take care of the case where, for
+// *some* reason, the source ends with ".lua".
+static sol::protected_function loadChunk(
+    sol::state& lua,
+    const std::string& luaSource)
+{
+    if(Poco::Path(luaSource).getExtension() == "lua")
+    {
+        if(Poco::File(luaSource).exists()) return getLoadedChunk(lua.load_file(luaSource));
+        else throw Pothos::FileNotFoundException(luaSource);
+    }
+    else return getLoadedChunk(lua.load(luaSource));
+}
+
+// In seconds, for timing from Lua without opening the os library
+static double getSteadyTime()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int writeBytecode(
+    lua_State*,
+    const void* data,
+    size_t size,
+    void* userData)
+{
+    static_cast<std::string*>(userData)->append(static_cast<const char*>(data), size);
+    return 0;
+}
+
+// These are always opened, as BlockEnv depends on them. Note that the JIT
+// compiler is only enabled when the jit library is opened.
+static const std::vector<sol::lib> RequiredLuaLibraries =
+{
+    sol::lib::base,
+    sol::lib::package,
+    sol::lib::jit,
+    sol::lib::ffi
+};
+
+static const std::unordered_map<std::string, std::vector<sol::lib>> LuaLibraryProfiles =
+{
+    {"minimal", {sol::lib::bit32, sol::lib::math}},
+    {"full",
+        {
+            sol::lib::bit32,
+            sol::lib::coroutine,
+            sol::lib::debug,
+            sol::lib::io,
+            sol::lib::math,
+            sol::lib::os,
+            sol::lib::string,
+            sol::lib::table
+        }
+    }
+};
+
+static const std::unordered_map<std::string, sol::lib> LuaLibraries =
+{
+    {"base", sol::lib::base},
+    {"bit", sol::lib::bit32},
+    {"coroutine", sol::lib::coroutine},
+    {"debug", sol::lib::debug},
+    {"ffi", sol::lib::ffi},
+    {"io", sol::lib::io},
+    {"jit", sol::lib::jit},
+    {"math", sol::lib::math},
+    {"os", sol::lib::os},
+    {"package", sol::lib::package},
+    {"string", sol::lib::string},
+    {"table", sol::lib::table}
+};
+
+// Each entry can be a profile name or a single library name.
+static std::vector<sol::lib> getLuaLibraries(const std::vector<std::string>& luaLibraries)
+{
+    auto libs = RequiredLuaLibraries;
+    for(const auto& luaLibrary: luaLibraries)
+    {
+        const auto profileIter = LuaLibraryProfiles.find(luaLibrary);
+        const auto libIter = LuaLibraries.find(luaLibrary);
+
+        if(profileIter != LuaLibraryProfiles.end())
+        {
+            libs.insert(libs.end(), profileIter->second.begin(), profileIter->second.end());
+        }
+        else if(libIter != LuaLibraries.end()) libs.emplace_back(libIter->second);
+        else throw Pothos::InvalidArgumentException("Invalid Lua library or profile: "+luaLibrary);
+    }
+
+    return libs;
+}
+
+//
+// Registry of live blocks, used for process-wide memory accounting
+//
+
+static constexpr std::chrono::seconds MemoryUsageUpdatePeriod(1);
+
+static constexpr size_t DefaultSliceElems = 1024;
+
+static constexpr size_t DefaultBufferPoolDepth = 4;
+
+// Check every 16th call, looking at up to 64 values per port.
+static constexpr size_t DenormalSamplePeriod = 16;
+static constexpr size_t DenormalSamplesPerPort = 64;
+
+template <typename T>
+static size_t countSampledDenormals(
+    const void* buffer,
+    size_t numScalars)
+{
+    const auto* values = static_cast<const T*>(buffer);
+    const auto stride = std::max<size_t>(1, (numScalars / DenormalSamplesPerPort));
+
+    size_t count = 0;
+    for(size_t i = 0; i < numScalars; i += stride)
+    {
+        if(std::fpclassify(values[i]) == FP_SUBNORMAL) ++count;
+    }
+
+    return count;
+}
+
+// Only float types can hold denormals.
+static size_t countSampledDenormals(
+    const Pothos::DType& dtype,
+    const void* buffer,
+    size_t elems)
+{
+    if(!dtype.isFloat()) return 0;
+
+    const auto scalarsPerElem = dtype.dimension() * (dtype.isComplex() ? 2 : 1);
+    const auto scalarSize = dtype.size() / scalarsPerElem;
+    const auto numScalars = elems * scalarsPerElem;
+
+    if(scalarSize == sizeof(float)) return countSampledDenormals<float>(buffer, numScalars);
+    if(scalarSize == sizeof(double)) return countSampledDenormals<double>(buffer, numScalars);
+
+    return 0;
+}
+
+static std::mutex& getBlockRegistryMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+static std::set<const LuaJITBlock*>& getBlockRegistry()
+{
+    static std::set<const LuaJITBlock*> registry;
+    return registry;
+}
+
+//
+// Tables shared between all blocks in this process, such as coefficients,
+// built by whichever block needs them first
+//
+
+static std::recursive_mutex& getSharedTablesMutex()
+{
+    static std::recursive_mutex mutex;
+    return mutex;
+}
+
+static std::unordered_map<std::string, std::weak_ptr<Pothos::BufferChunk>>& getSharedTables()
+{
+    static std::unordered_map<std::string, std::weak_ptr<Pothos::BufferChunk>> sharedTables;
+    return sharedTables;
+}
+
 //
 // Implementation
 //
@@ -84,19 +698,41 @@ static sol::protected_function_result safeLuaCall(const sol::protected_function&
 Pothos::Block* LuaJITBlock::make(
     const std::vector<std::string>& inputTypes,
     const std::vector<std::string>& outputTypes,
-    bool exposeSetters)
+    bool exposeSetters,
+    const std::vector<std::string>& luaLibraries)
 {
-    return new LuaJITBlock(inputTypes, outputTypes, exposeSetters);
+    return new LuaJITBlock(inputTypes, outputTypes, exposeSetters, luaLibraries);
 }
 
 LuaJITBlock::LuaJITBlock(
     const std::vector<std::string>& inputTypes,
     const std::vector<std::string>& outputTypes,
-    bool exposeSetters): _lua(), _functionSet(false)
+    bool exposeSetters,
+    const std::vector<std::string>& luaLibraries):
+    _lua(),
+    _functionSet(false),
+    _stateless(false),
+    _variableRate(false),
+    _timeSlice(0),
+    _sliceElems(DefaultSliceElems),
+    _sliceOffset(0),
+    _bufferPoolDepth(DefaultBufferPoolDepth),
+    _nextBufferHandle(0),
+    _flushDenormals(false),
+    _callsUntilDenormalSample(0),
+    _memoryUsage(),
+    _totalWorkNs(0),
+    _totalElems(0),
+    _totalCalls(0),
+    _partialReturns(0),
+    _bufferPoolHits(0),
+    _bufferPoolMisses(0),
+    _denormalInputs(0),
+    _denormalOutputs(0),
+    _activateTime(0),
+    _deactivateTime(0)
 {
-    _lua.open_libraries();
-    _lua["BlockEnv"] = safeLuaCall(_lua.load(BlockEnvScript));
-    _callBlockFcn = _lua["BlockEnv"]["CallBlockFunction"];
+    this->initLuaState(luaLibraries);
 
     for(size_t inputIndex = 0; inputIndex < inputTypes.size(); ++inputIndex)
     {
@@ -106,12 +742,53 @@ LuaJITBlock::LuaJITBlock(
     {
         this->setupOutput(outputIndex, outputTypes[outputIndex]);
     }
+    _inputStaging.resize(inputTypes.size());
+    _outputStaging.resize(outputTypes.size());
 
     if(exposeSetters)
     {
         this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlock, setSource));
         this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlock, setPreloadedLibraries));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlock, setLuaLibraries));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlock, setStateless));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlock, setVariableRate));
     }
+
+    // Scheduling options don't affect what the function does, so they're
+    // always available.
+    this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlock, setTimeSlice));
+    this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlock, setSliceSize));
+    this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlock, setBufferPoolSizes));
+    this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlock, setBufferPoolDepth));
+    this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlock, setFlushDenormals));
+    this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlock, setInputStaging));
+    this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlock, setOutputStaging));
+
+    this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlock, getNsPerElement));
+    this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlock, getCallRate));
+    this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlock, getLoad));
+    this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlock, getPartialReturns));
+    this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlock, getBufferPoolHitRate));
+    this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlock, getDenormalInputs));
+    this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlock, getDenormalOutputs));
+    this->registerProbe("getNsPerElement");
+    this->registerProbe("getCallRate");
+    this->registerProbe("getLoad");
+    this->registerProbe("getPartialReturns");
+    this->registerProbe("getBufferPoolHitRate");
+    this->registerProbe("getDenormalInputs");
+    this->registerProbe("getDenormalOutputs");
+
+    this->updateMemoryUsage(false);
+
+    std::lock_guard<std::mutex> lock(getBlockRegistryMutex());
+    getBlockRegistry().insert(this);
+}
+
+LuaJITBlock::~LuaJITBlock()
+{
+    std::lock_guard<std::mutex> lock(getBlockRegistryMutex());
+    getBlockRegistry().erase(this);
 }
 
 void LuaJITBlock::setSource(
@@ -123,38 +800,34 @@ void LuaJITBlock::setSource(
         throw Pothos::RuntimeException("Cannot set source for active block.");
     }
 
-    // If this is a path, import it as a script. Else, take it as a string literal.
-    // The exists() check should theoretically take care of the case where, for
-    // *some* reason, the source ends with ".lua".
-    if(Poco::Path(luaSource).getExtension() == "lua")
-    {
-        if(Poco::File(luaSource).exists())
-        {
-            _lua["BlockEnv"]["UserEnv"] = safeLuaCall(_lua.load_file(luaSource));
-        }
-        else throw Pothos::FileNotFoundException(luaSource);
-    }
-    else
-    {
-        _lua["BlockEnv"]["UserEnv"] = safeLuaCall(_lua.load(luaSource));
-    }
+    this->loadUserEnv(loadChunk(_lua, luaSource), luaSource, functionName);
+}
 
-    // Make sure the given entry point exists and is a function.
-    sol::optional<sol::object> maybeFunc = _lua["BlockEnv"]["UserEnv"][functionName];
-    if(!maybeFunc)
+void LuaJITBlock::setCompiledSource(
+    const std::string& luaSource,
+    const std::string& bytecode,
+    const std::string& functionName)
+{
+    if(this->isActive())
     {
-        throw Pothos::InvalidArgumentException("The given field ("+functionName+")"+" does not exist.");
+        throw Pothos::RuntimeException("Cannot set source for active block.");
     }
 
-    const auto type = (*maybeFunc).get_type();
-    if(type != sol::type::function)
-    {
-        const auto typeName = sol::type_name(_lua, type);
-        throw Pothos::InvalidArgumentException("The given field ("+functionName+")"+" must be a function. Found "+typeName+".");
-    }
-    else _blockFcn = (*maybeFunc);
+    this->loadUserEnv(getLoadedChunk(_lua.load(bytecode)), luaSource, functionName);
+}
 
-    _functionSet = true;
+std::string LuaJITBlock::compileSource(const std::string& luaSource)
+{
+    // Compiling doesn't need any libraries.
+    sol::state lua;
+    const auto chunk = loadChunk(lua, luaSource);
+
+    std::string bytecode;
+    chunk.push(lua.lua_state());
+    lua_dump(lua.lua_state(), writeBytecode, &bytecode);
+    lua_pop(lua.lua_state(), 1);
+
+    return bytecode;
 }
 
 void LuaJITBlock::setPreloadedLibraries(const std::vector<std::string>& libraries)
@@ -168,44 +841,928 @@ void LuaJITBlock::setPreloadedLibraries(const std::vector<std::string>& librarie
     _dynLibPaths = libraries;
 }
 
-void LuaJITBlock::activate()
+void LuaJITBlock::setLuaLibraries(const std::vector<std::string>& luaLibraries)
 {
-    std::transform(
-        _dynLibPaths.begin(),
-        _dynLibPaths.end(),
-        std::back_inserter(_dynLibs),
-        ScopedDynLib::load);
+    if(this->isActive())
+    {
+        throw Pothos::RuntimeException("Cannot set Lua libraries for active block.");
+    }
+    if(luaLibraries == _luaLibraries) return;
+
+    // Set the current state aside while the new one is built and the source
+    // is reloaded into it, and put it back if either fails, so the block is
+    // left as it was.
+    auto oldLua = std::move(_lua);
+    auto oldCallBlockFcn = std::move(_callBlockFcn);
+    auto oldBlockFcn = std::move(_blockFcn);
+    auto oldGetMcodeSizeFcn = std::move(_getMcodeSizeFcn);
+    const auto oldFunctionSet = _functionSet;
+    const auto oldLuaLibraries = _luaLibraries;
+
+    try
+    {
+        this->initLuaState(luaLibraries);
+
+        // The source was loaded into the old state, so reload it.
+        if(!_luaSource.empty()) this->setSource(_luaSource, _functionName);
+        else this->updateMemoryUsage(false);
+    }
+    catch(...)
+    {
+        // These reference the new state, so release them before it's closed.
+        _callBlockFcn = sol::protected_function();
+        _blockFcn = sol::protected_function();
+        _getMcodeSizeFcn = sol::protected_function();
+
+        _lua = std::move(oldLua);
+        _callBlockFcn = std::move(oldCallBlockFcn);
+        _blockFcn = std::move(oldBlockFcn);
+        _getMcodeSizeFcn = std::move(oldGetMcodeSizeFcn);
+        _functionSet = oldFunctionSet;
+        _luaLibraries = oldLuaLibraries;
+
+        throw;
+    }
 }
 
-void LuaJITBlock::deactivate()
+void LuaJITBlock::setStateless(bool stateless)
 {
-    _dynLibs.clear();
+    _stateless = stateless;
 }
 
-void LuaJITBlock::work()
+void LuaJITBlock::setVariableRate(bool variableRate)
 {
-    if(!_functionSet)
+    if(this->isActive())
     {
-        throw Pothos::Exception("LuaJIT function not set.");
+        throw Pothos::RuntimeException("Cannot set variable rate for active block.");
     }
 
-    const auto& workInfo = this->workInfo();
+    _variableRate = variableRate;
+}
 
-    const auto elems = workInfo.minElements;
-    if(0 == elems) return;
+void LuaJITBlock::setTimeSlice(size_t timeSliceUs)
+{
+    _timeSlice = std::chrono::microseconds(timeSliceUs);
+}
+
+void LuaJITBlock::setSliceSize(size_t sliceSize)
+{
+    if(0 == sliceSize)
+    {
+        throw Pothos::InvalidArgumentException("Slice size must be non-zero.");
+    }
+
+    _sliceElems = sliceSize;
+}
+
+void LuaJITBlock::setBufferPoolSizes(const std::vector<size_t>& bufferSizes)
+{
+    if(this->isActive())
+    {
+        throw Pothos::RuntimeException("Cannot set buffer pool sizes for active block.");
+    }
+    if(std::find(bufferSizes.begin(), bufferSizes.end(), 0) != bufferSizes.end())
+    {
+        throw Pothos::InvalidArgumentException("Buffer pool sizes must be non-zero.");
+    }
+
+    // Sorted so acquireBuffer() can take the first pool that fits.
+    _bufferPoolSizes = bufferSizes;
+    std::sort(_bufferPoolSizes.begin(), _bufferPoolSizes.end());
+    _bufferPoolSizes.erase(
+        std::unique(_bufferPoolSizes.begin(), _bufferPoolSizes.end()),
+        _bufferPoolSizes.end());
+}
+
+void LuaJITBlock::setBufferPoolDepth(size_t numBuffers)
+{
+    if(this->isActive())
+    {
+        throw Pothos::RuntimeException("Cannot set buffer pool depth for active block.");
+    }
+    if(0 == numBuffers)
+    {
+        throw Pothos::InvalidArgumentException("Buffer pool depth must be non-zero.");
+    }
+
+    _bufferPoolDepth = numBuffers;
+}
+
+void LuaJITBlock::setFlushDenormals(bool flushDenormals)
+{
+    _flushDenormals = flushDenormals;
+}
+
+static LuaJITPortStaging::UPtr makePortStaging(
+    const Pothos::DType& portDType,
+    const std::string& kernelType,
+    bool split)
+{
+    if(kernelType.empty() && !split) return nullptr;
+
+    const auto kernelDType = kernelType.empty() ? portDType : Pothos::DType(kernelType);
+
+    return LuaJITPortStaging::UPtr(new LuaJITPortStaging(portDType, kernelDType, split));
+}
+
+void LuaJITBlock::setInputStaging(
+    size_t inputIndex,
+    const std::string& kernelType,
+    bool split)
+{
+    if(this->isActive())
+    {
+        throw Pothos::RuntimeException("Cannot set port staging for active block.");
+    }
+    if(inputIndex >= _inputStaging.size())
+    {
+        throw Pothos::InvalidArgumentException("Invalid input index: "+std::to_string(inputIndex));
+    }
+
+    _inputStaging[inputIndex] = makePortStaging(this->input(inputIndex)->dtype(), kernelType, split);
+}
+
+void LuaJITBlock::setOutputStaging(
+    size_t outputIndex,
+    const std::string& kernelType,
+    bool split)
+{
+    if(this->isActive())
+    {
+        throw Pothos::RuntimeException("Cannot set port staging for active block.");
+    }
+    if(outputIndex >= _outputStaging.size())
+    {
+        throw Pothos::InvalidArgumentException("Invalid output index: "+std::to_string(outputIndex));
+    }
+
+    _outputStaging[outputIndex] = makePortStaging(this->output(outputIndex)->dtype(), kernelType, split);
+}
+
+bool LuaJITBlock::hasPortStaging() const
+{
+    const auto isStaged = [](const LuaJITPortStaging::UPtr& staging){return bool(staging);};
+
+    return std::any_of(_inputStaging.begin(), _inputStaging.end(), isStaged) ||
+           std::any_of(_outputStaging.begin(), _outputStaging.end(), isStaged);
+}
+
+void LuaJITBlock::setFusedSources(
+    const std::vector<std::string>& luaSources,
+    const std::vector<std::string>& functionNames,
+    const std::vector<size_t>& elemSizes,
+    size_t tileElems)
+{
+    if(this->isActive())
+    {
+        throw Pothos::RuntimeException("Cannot set source for active block.");
+    }
+    if(luaSources.empty() || (luaSources.size() != functionNames.size()) || (elemSizes.size() != (luaSources.size()+1)))
+    {
+        throw Pothos::InvalidArgumentException("Mismatched fused source parameters.");
+    }
+    if(0 == tileElems)
+    {
+        throw Pothos::InvalidArgumentException("Tile size must be non-zero.");
+    }
+
+    auto chunks = _lua.create_table();
+    auto functionNamesTable = _lua.create_table();
+    auto elemSizesTable = _lua.create_table();
+    for(size_t stage = 0; stage < luaSources.size(); ++stage)
+    {
+        chunks[stage+1] = loadChunk(_lua, luaSources[stage]);
+        functionNamesTable[stage+1] = functionNames[stage];
+    }
+    for(size_t i = 0; i < elemSizes.size(); ++i)
+    {
+        elemSizesTable[i+1] = elemSizes[i];
+    }
+
+    sol::protected_function fuseFunctions = _lua["BlockEnv"]["FuseFunctions"];
+    _blockFcn = safeLuaCall(fuseFunctions, chunks, functionNamesTable, elemSizesTable, tileElems);
+
+    // There's no single source to reload if the Lua libraries change.
+    _functionSet = true;
+    _luaSource.clear();
+    _functionName.clear();
+
+    this->updateMemoryUsage(false);
+}
+
+const std::string& LuaJITBlock::getSource() const
+{
+    return _luaSource;
+}
+
+const std::string& LuaJITBlock::getFunctionName() const
+{
+    return _functionName;
+}
+
+const std::vector<std::string>& LuaJITBlock::getPreloadedLibraries() const
+{
+    return _dynLibPaths;
+}
+
+const std::vector<std::string>& LuaJITBlock::getLuaLibraries() const
+{
+    return _luaLibraries;
+}
+
+bool LuaJITBlock::isStateless() const
+{
+    return _stateless;
+}
+
+bool LuaJITBlock::isVariableRate() const
+{
+    return _variableRate;
+}
+
+void LuaJITBlock::activate()
+{
+    if(_variableRate && this->hasPortStaging())
+    {
+        throw Pothos::RuntimeException("Port staging isn't supported for variable-rate functions.");
+    }
+
+    _totalWorkNs = 0;
+    _totalElems = 0;
+    _totalCalls = 0;
+    _partialReturns = 0;
+    _bufferPoolHits = 0;
+    _bufferPoolMisses = 0;
+    _denormalInputs = 0;
+    _denormalOutputs = 0;
+    _callsUntilDenormalSample = 0;
+    _activateTime = std::chrono::steady_clock::now().time_since_epoch().count();
+    _deactivateTime = 0;
+
+    std::transform(
+        _dynLibPaths.begin(),
+        _dynLibPaths.end(),
+        std::back_inserter(_dynLibs),
+        ScopedDynLib::load);
+
+    for(const auto bufferSize: _bufferPoolSizes)
+    {
+        Pothos::BufferManagerArgs bufferManagerArgs;
+        bufferManagerArgs.numBuffers = _bufferPoolDepth;
+        bufferManagerArgs.bufferSize = bufferSize;
+
+        _bufferPools.emplace_back(Pothos::BufferManager::make("generic", bufferManagerArgs));
+    }
+    _postedOutputs.assign(this->outputs().size(), false);
+    _sliceOffset = 0;
+
+    // Output buffers aren't available until the first call to work(),
+    // so force an update then.
+    this->updateMemoryUsage(false);
+    _lastMemoryUsageUpdate = std::chrono::steady_clock::time_point();
+}
+
+void LuaJITBlock::deactivate()
+{
+    _deactivateTime = std::chrono::steady_clock::now().time_since_epoch().count();
+    _dynLibs.clear();
+
+    // Posted buffers return to their pools once downstream is done with
+    // them, so the pools can be released here regardless.
+    _acquiredBuffers.clear();
+    _bufferPools.clear();
+
+    this->updateMemoryUsage(true);
+}
+
+void LuaJITBlock::work()
+{
+    const auto& workInfo = this->workInfo();
 
     auto inputs = this->inputs();
     auto outputs = this->outputs();
 
+    // Variable-rate functions see each port's available elements and
+    // replace them with the number of elements they consumed or produced.
+    if(_variableRate)
+    {
+        _inputElems.resize(inputs.size());
+        _outputElems.resize(outputs.size());
+        for(size_t i = 0; i < inputs.size(); ++i) _inputElems[i] = inputs[i]->elements();
+        for(size_t i = 0; i < outputs.size(); ++i) _outputElems[i] = outputs[i]->elements();
+
+        // Sources only need output space, but everything else needs input.
+        const auto& portElems = inputs.empty() ? _outputElems : _inputElems;
+        if(std::all_of(portElems.begin(), portElems.end(), [](size_t elems){return (0 == elems);})) return;
+    }
+    else
+    {
+        if(0 == workInfo.minElements) return;
+
+        _inputElems.assign(inputs.size(), workInfo.minElements);
+        _outputElems.assign(outputs.size(), workInfo.minElements);
+    }
+
+    // Sample outside of the flush scope, since DAZ makes denormals
+    // compare as zero.
+    const bool sampleDenormals = (0 == _callsUntilDenormalSample);
+    _callsUntilDenormalSample = sampleDenormals ? (DenormalSamplePeriod-1) : (_callsUntilDenormalSample-1);
+    if(sampleDenormals)
+    {
+        size_t denormalInputs = 0;
+        for(size_t i = 0; i < inputs.size(); ++i)
+        {
+            denormalInputs += countSampledDenormals(inputs[i]->dtype(), workInfo.inputPointers[i], _inputElems[i]);
+        }
+        _denormalInputs.fetch_add(denormalInputs, std::memory_order_relaxed);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    {
+        ScopedFlushDenormals flushDenormals(_flushDenormals);
+
+        if(_variableRate) this->callFunctionVariableRate(workInfo.minElements);
+        else if(_timeSlice.count() > 0)
+        {
+            const auto elems = this->callFunctionTimeSliced(workInfo.minElements);
+            std::fill(_inputElems.begin(), _inputElems.end(), elems);
+            std::fill(_outputElems.begin(), _outputElems.end(), elems);
+        }
+        else
+        {
+            this->callFunctionStaged(
+                workInfo.inputPointers,
+                workInfo.outputPointers,
+                workInfo.minElements);
+        }
+    }
+    const auto workNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+    if(sampleDenormals)
+    {
+        size_t denormalOutputs = 0;
+        for(size_t i = 0; i < outputs.size(); ++i)
+        {
+            if(!_postedOutputs[i])
+            {
+                denormalOutputs += countSampledDenormals(outputs[i]->dtype(), workInfo.outputPointers[i], _outputElems[i]);
+            }
+        }
+        _denormalOutputs.fetch_add(denormalOutputs, std::memory_order_relaxed);
+    }
+
+    // For the cost model, a call processes as many elements as its busiest
+    // input, or output for sources.
+    const auto& processedElems = inputs.empty() ? _outputElems : _inputElems;
+    const auto elems = processedElems.empty() ? 0 : *std::max_element(processedElems.begin(), processedElems.end());
+
+    _totalWorkNs.fetch_add(workNs.count(), std::memory_order_relaxed);
+    _totalElems.fetch_add(elems, std::memory_order_relaxed);
+    _totalCalls.fetch_add(1, std::memory_order_relaxed);
+
+    for(size_t i = 0; i < inputs.size(); ++i)
+    {
+        if(_inputElems[i] > 0) inputs[i]->consume(_inputElems[i]);
+    }
+
+    // Outputs the function posted buffers to don't produce from their
+    // stream buffers this call.
+    for(size_t i = 0; i < outputs.size(); ++i)
+    {
+        if(_postedOutputs[i]) _postedOutputs[i] = false;
+        else if(_outputElems[i] > 0) outputs[i]->produce(_outputElems[i]);
+    }
+
+    if((std::chrono::steady_clock::now() - _lastMemoryUsageUpdate) >= MemoryUsageUpdatePeriod)
+    {
+        this->updateMemoryUsage(true);
+    }
+}
+
+void LuaJITBlock::callFunction(
+    const std::vector<const void*>& inputPointers,
+    const std::vector<void*>& outputPointers,
+    size_t elems)
+{
+    if(!_functionSet)
+    {
+        throw Pothos::Exception("LuaJIT function not set.");
+    }
+
+    safeLuaCall(
+        _callBlockFcn,
+        _blockFcn,
+        inputPointers,
+        outputPointers,
+        elems);
+}
+
+void LuaJITBlock::callFunctionVariableRate(size_t elems)
+{
+    if(!_functionSet)
+    {
+        throw Pothos::Exception("LuaJIT function not set.");
+    }
+
+    const auto& workInfo = this->workInfo();
+
+    // Lua gets a valid pointer even when there are no ports on one side.
+    _inputElems.reserve(1);
+    _outputElems.reserve(1);
+
     safeLuaCall(
         _callBlockFcn,
         _blockFcn,
         workInfo.inputPointers,
         workInfo.outputPointers,
-        elems);
+        elems,
+        static_cast<void*>(_inputElems.data()),
+        static_cast<void*>(_outputElems.data()));
 
-    for(auto* input: inputs) input->consume(elems);
-    for(auto* output: outputs) output->produce(elems);
+    for(size_t i = 0; i < _inputElems.size(); ++i)
+    {
+        const auto availableElems = this->input(i)->elements();
+        if(_inputElems[i] > availableElems)
+        {
+            throw Pothos::RangeException(
+                      "Function consumed "+std::to_string(_inputElems[i])+" elements from input "+std::to_string(i)+
+                      ", but only "+std::to_string(availableElems)+" were available.");
+        }
+    }
+    for(size_t i = 0; i < _outputElems.size(); ++i)
+    {
+        const auto availableElems = this->output(i)->elements();
+        if(_outputElems[i] > availableElems)
+        {
+            throw Pothos::RangeException(
+                      "Function produced "+std::to_string(_outputElems[i])+" elements on output "+std::to_string(i)+
+                      ", but only had space for "+std::to_string(availableElems)+".");
+        }
+    }
+}
+
+// Converts staged ports to and from the function's layout around the call.
+void LuaJITBlock::callFunctionStaged(
+    const std::vector<const void*>& inputPointers,
+    const std::vector<void*>& outputPointers,
+    size_t elems)
+{
+    if(!this->hasPortStaging())
+    {
+        this->callFunction(inputPointers, outputPointers, elems);
+        return;
+    }
+
+    _stagedInputPointers.resize(inputPointers.size());
+    _stagedOutputPointers.resize(outputPointers.size());
+    for(size_t i = 0; i < inputPointers.size(); ++i)
+    {
+        _stagedInputPointers[i] = _inputStaging[i] ? _inputStaging[i]->stageInput(inputPointers[i], elems) : inputPointers[i];
+    }
+    for(size_t i = 0; i < outputPointers.size(); ++i)
+    {
+        _stagedOutputPointers[i] = _outputStaging[i] ? _outputStaging[i]->getOutputScratch(elems) : outputPointers[i];
+    }
+
+    this->callFunction(_stagedInputPointers, _stagedOutputPointers, elems);
+
+    for(size_t i = 0; i < outputPointers.size(); ++i)
+    {
+        if(_outputStaging[i]) _outputStaging[i]->unstageOutput(outputPointers[i], elems);
+    }
+}
+
+// Returns the number of elements processed before the time slice ran out.
+size_t LuaJITBlock::callFunctionTimeSliced(size_t elems)
+{
+    const auto& workInfo = this->workInfo();
+    const auto& inputs = this->inputs();
+    const auto& outputs = this->outputs();
+
+    _slicedInputPointers.resize(inputs.size());
+    _slicedOutputPointers.resize(outputs.size());
+
+    const auto start = std::chrono::steady_clock::now();
+    size_t processedElems = 0;
+    while(processedElems < elems)
+    {
+        for(size_t i = 0; i < inputs.size(); ++i)
+        {
+            _slicedInputPointers[i] = static_cast<const std::uint8_t*>(workInfo.inputPointers[i]) + (processedElems * inputs[i]->dtype().size());
+        }
+        for(size_t i = 0; i < outputs.size(); ++i)
+        {
+            _slicedOutputPointers[i] = static_cast<std::uint8_t*>(workInfo.outputPointers[i]) + (processedElems * outputs[i]->dtype().size());
+        }
+
+        const auto sliceElems = std::min(_sliceElems, (elems - processedElems));
+        _sliceOffset = processedElems;
+        this->callFunctionStaged(
+            _slicedInputPointers,
+            _slicedOutputPointers,
+            sliceElems);
+        processedElems += sliceElems;
+
+        if((processedElems < elems) && ((std::chrono::steady_clock::now() - start) >= _timeSlice))
+        {
+            _partialReturns.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+    _sliceOffset = 0;
+
+    return processedElems;
+}
+
+std::tuple<int, void*> LuaJITBlock::acquireBuffer(size_t numBytes)
+{
+    Pothos::BufferChunk buffer;
+
+    const auto poolIter = std::lower_bound(_bufferPoolSizes.begin(), _bufferPoolSizes.end(), numBytes);
+    const auto poolIndex = size_t(std::distance(_bufferPoolSizes.begin(), poolIter));
+    if((poolIndex < _bufferPools.size()) && !_bufferPools[poolIndex]->empty())
+    {
+        buffer = _bufferPools[poolIndex]->front();
+        _bufferPools[poolIndex]->pop(buffer.length);
+        _bufferPoolHits.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        buffer = Pothos::BufferChunk(numBytes);
+        _bufferPoolMisses.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    const auto handle = _nextBufferHandle++;
+    auto* address = buffer.as<void*>();
+    _acquiredBuffers.emplace(handle, std::move(buffer));
+
+    return std::make_tuple(handle, address);
+}
+
+Pothos::BufferChunk LuaJITBlock::takeAcquiredBuffer(
+    int handle,
+    size_t outputIndex,
+    size_t elems)
+{
+    if(!this->isActive())
+    {
+        throw Pothos::RuntimeException("Buffers can only be posted by an active block.");
+    }
+
+    const auto bufferIter = _acquiredBuffers.find(handle);
+    if(bufferIter == _acquiredBuffers.end())
+    {
+        throw Pothos::InvalidArgumentException("Invalid buffer handle: "+std::to_string(handle));
+    }
+    if(outputIndex >= this->outputs().size())
+    {
+        throw Pothos::InvalidArgumentException("Invalid output index: "+std::to_string(outputIndex));
+    }
+
+    auto buffer = std::move(bufferIter->second);
+    _acquiredBuffers.erase(bufferIter);
+
+    const auto& dtype = this->output(outputIndex)->dtype();
+    if((elems * dtype.size()) > buffer.length)
+    {
+        throw Pothos::InvalidArgumentException("Buffer is too small for "+std::to_string(elems)+" elements.");
+    }
+
+    buffer.dtype = dtype;
+    buffer.length = elems * dtype.size();
+
+    return buffer;
+}
+
+void LuaJITBlock::postBuffer(
+    int handle,
+    size_t outputIndex,
+    size_t elems)
+{
+    auto buffer = this->takeAcquiredBuffer(handle, outputIndex, elems);
+    this->output(outputIndex)->postBuffer(std::move(buffer));
+
+    _postedOutputs[outputIndex] = true;
+}
+
+void LuaJITBlock::postPacket(
+    int handle,
+    size_t outputIndex,
+    size_t elems)
+{
+    Pothos::Packet packet;
+    packet.payload = this->takeAcquiredBuffer(handle, outputIndex, elems);
+
+    this->output(outputIndex)->postMessage(std::move(packet));
+
+    _postedOutputs[outputIndex] = true;
+}
+
+// The packet references the input's buffer instead of copying from it, so
+// upstream can't reuse that buffer until downstream is done with the packet.
+// When time slicing, the offset is relative to the current slice.
+void LuaJITBlock::postInputSlice(
+    size_t inputIndex,
+    size_t outputIndex,
+    size_t offset,
+    size_t elems)
+{
+    if(!this->isActive())
+    {
+        throw Pothos::RuntimeException("Slices can only be posted by an active block.");
+    }
+    if(inputIndex >= this->inputs().size())
+    {
+        throw Pothos::InvalidArgumentException("Invalid input index: "+std::to_string(inputIndex));
+    }
+    if(outputIndex >= this->outputs().size())
+    {
+        throw Pothos::InvalidArgumentException("Invalid output index: "+std::to_string(outputIndex));
+    }
+
+    auto* input = this->input(inputIndex);
+    const auto elemSize = input->dtype().size();
+    offset += _sliceOffset;
+
+    auto slice = input->buffer();
+    if(((offset + elems) * elemSize) > slice.length)
+    {
+        throw Pothos::RangeException(
+                  "Slice ["+std::to_string(offset)+", "+std::to_string(offset+elems)+
+                  ") is past the end of input "+std::to_string(inputIndex)+".");
+    }
+
+    slice.address += (offset * elemSize);
+    slice.length = (elems * elemSize);
+
+    Pothos::Packet packet;
+    packet.payload = std::move(slice);
+
+    this->output(outputIndex)->postMessage(std::move(packet));
+
+    _postedOutputs[outputIndex] = true;
+}
+
+void LuaJITBlock::releaseBuffer(int handle)
+{
+    _acquiredBuffers.erase(handle);
+}
+
+// Lua numbers are posted as doubles, and booleans and strings as themselves.
+// When time slicing, the index is relative to the current slice.
+void LuaJITBlock::postLabel(
+    size_t outputIndex,
+    const std::string& id,
+    const sol::object& value,
+    size_t index)
+{
+    Pothos::Object labelValue;
+    switch(value.get_type())
+    {
+        case sol::type::number:
+            labelValue = Pothos::Object(value.as<double>());
+            break;
+
+        case sol::type::boolean:
+            labelValue = Pothos::Object(value.as<bool>());
+            break;
+
+        case sol::type::string:
+            labelValue = Pothos::Object(value.as<std::string>());
+            break;
+
+        case sol::type::lua_nil:
+            break;
+
+        default:
+            throw Pothos::InvalidArgumentException("Unsupported label value type for label "+id);
+    }
+
+    this->output(outputIndex)->postLabel(Pothos::Label(id, labelValue, _sliceOffset + index));
+}
+
+// Returns the table for the given key, calling initFcn with its address to
+// fill it in if it doesn't already exist. The lock is held during initFcn
+// so each table is only built once, and it's recursive so initFcn can get
+// other tables. The last holder of a table removes its entry.
+void* LuaJITBlock::getSharedTable(
+    const std::string& key,
+    size_t numBytes,
+    const sol::protected_function& initFcn)
+{
+    std::lock_guard<std::recursive_mutex> lock(getSharedTablesMutex());
+
+    auto& weakSharedTable = getSharedTables()[key];
+    auto sharedTable = weakSharedTable.lock();
+    if(sharedTable)
+    {
+        if(sharedTable->length != numBytes)
+        {
+            throw Pothos::InvalidArgumentException(
+                      "Shared table "+key+" is "+std::to_string(sharedTable->length)+
+                      " bytes, not "+std::to_string(numBytes)+".");
+        }
+    }
+    else
+    {
+        // The entry is only erased if it hasn't been replaced since.
+        sharedTable = std::shared_ptr<Pothos::BufferChunk>(
+            new Pothos::BufferChunk(numBytes),
+            [key](Pothos::BufferChunk* table)
+            {
+                {
+                    std::lock_guard<std::recursive_mutex> lock(getSharedTablesMutex());
+
+                    auto& sharedTables = getSharedTables();
+                    const auto iter = sharedTables.find(key);
+                    if((iter != sharedTables.end()) && iter->second.expired()) sharedTables.erase(iter);
+                }
+                delete table;
+            });
+        safeLuaCall(initFcn, sharedTable->as<void*>());
+        weakSharedTable = sharedTable;
+    }
+
+    _sharedTables[key] = sharedTable;
+
+    return sharedTable->as<void*>();
+}
+
+double LuaJITBlock::getBufferPoolHitRate() const
+{
+    const auto hits = double(_bufferPoolHits.load(std::memory_order_relaxed));
+    const auto misses = double(_bufferPoolMisses.load(std::memory_order_relaxed));
+
+    return ((hits + misses) > 0.0) ? (hits / (hits + misses)) : 0.0;
+}
+
+unsigned long long LuaJITBlock::getDenormalInputs() const
+{
+    return _denormalInputs.load(std::memory_order_relaxed);
+}
+
+unsigned long long LuaJITBlock::getDenormalOutputs() const
+{
+    return _denormalOutputs.load(std::memory_order_relaxed);
+}
+
+LuaJITMemoryUsage LuaJITBlock::getMemoryUsage() const
+{
+    std::lock_guard<std::mutex> lock(_memoryUsageMutex);
+
+    auto memoryUsage = _memoryUsage;
+    memoryUsage.blockName = this->getName();
+
+    return memoryUsage;
+}
+
+LuaJITCostModel LuaJITBlock::getCostModel() const
+{
+    LuaJITCostModel costModel = {0.0, 0.0, 0.0, 0.0};
+
+    const auto activateTime = _activateTime.load();
+    if(0 == activateTime) return costModel;
+
+    // After deactivation, rates are relative to the time the block ran.
+    const auto deactivateTime = _deactivateTime.load();
+    const auto endTime = (0 != deactivateTime) ? deactivateTime : std::chrono::steady_clock::now().time_since_epoch().count();
+    const std::chrono::steady_clock::duration activeTime(endTime - activateTime);
+    const auto activeNs = double(std::chrono::duration_cast<std::chrono::nanoseconds>(activeTime).count());
+    if(activeNs <= 0.0) return costModel;
+
+    const auto totalWorkNs = double(_totalWorkNs.load(std::memory_order_relaxed));
+    const auto totalElems = double(_totalElems.load(std::memory_order_relaxed));
+    const auto totalCalls = double(_totalCalls.load(std::memory_order_relaxed));
+
+    costModel.nsPerElement = (totalElems > 0.0) ? (totalWorkNs / totalElems) : 0.0;
+    costModel.callRate = totalCalls / (activeNs / 1e9);
+    costModel.elementRate = totalElems / (activeNs / 1e9);
+    costModel.load = totalWorkNs / activeNs;
+
+    return costModel;
+}
+
+double LuaJITBlock::getNsPerElement() const
+{
+    return this->getCostModel().nsPerElement;
+}
+
+double LuaJITBlock::getCallRate() const
+{
+    return this->getCostModel().callRate;
+}
+
+double LuaJITBlock::getLoad() const
+{
+    return this->getCostModel().load;
+}
+
+unsigned long long LuaJITBlock::getPartialReturns() const
+{
+    return _partialReturns.load(std::memory_order_relaxed);
+}
+
+std::vector<LuaJITMemoryUsage> LuaJITBlock::getAllMemoryUsage()
+{
+    std::lock_guard<std::mutex> lock(getBlockRegistryMutex());
+
+    std::vector<LuaJITMemoryUsage> allMemoryUsage;
+    std::transform(
+        getBlockRegistry().begin(),
+        getBlockRegistry().end(),
+        std::back_inserter(allMemoryUsage),
+        [](const LuaJITBlock* block)
+        {
+            return block->getMemoryUsage();
+        });
+
+    return allMemoryUsage;
+}
+
+void LuaJITBlock::initLuaState(const std::vector<std::string>& luaLibraries)
+{
+    // Validate before touching the current state.
+    const auto libs = getLuaLibraries(luaLibraries);
+
+    // These reference the current state, so release them before it's closed.
+    _callBlockFcn = sol::protected_function();
+    _blockFcn = sol::protected_function();
+    _getMcodeSizeFcn = sol::protected_function();
+    _functionSet = false;
+
+    _lua = sol::state();
+    for(const auto lib: libs) _lua.open_libraries(lib);
+
+    _lua["BlockEnv"] = safeLuaCall(_lua.load(BlockEnvScript));
+    _callBlockFcn = _lua["BlockEnv"]["CallBlockFunction"];
+    _getMcodeSizeFcn = _lua["BlockEnv"]["GetMcodeSize"];
+
+    sol::table blockEnv = _lua["BlockEnv"];
+    blockEnv.set_function("AcquireBuffer", &LuaJITBlock::acquireBuffer, this);
+    blockEnv.set_function("PostBuffer", &LuaJITBlock::postBuffer, this);
+    blockEnv.set_function("PostPacket", &LuaJITBlock::postPacket, this);
+    blockEnv.set_function("PostInputSlice", &LuaJITBlock::postInputSlice, this);
+    blockEnv.set_function("ReleaseBuffer", &LuaJITBlock::releaseBuffer, this);
+    blockEnv.set_function("PostLabel", &LuaJITBlock::postLabel, this);
+    blockEnv.set_function("GetSharedTable", &LuaJITBlock::getSharedTable, this);
+    blockEnv.set_function("GetTime", &getSteadyTime);
+
+    _luaLibraries = luaLibraries;
+}
+
+void LuaJITBlock::loadUserEnv(
+    const sol::protected_function& chunk,
+    const std::string& luaSource,
+    const std::string& functionName)
+{
+    _lua["BlockEnv"]["UserEnv"] = safeLuaCall(chunk);
+
+    // Make sure the given entry point exists and is a function.
+    sol::optional<sol::object> maybeFunc = _lua["BlockEnv"]["UserEnv"][functionName];
+    if(!maybeFunc)
+    {
+        throw Pothos::InvalidArgumentException("The given field ("+functionName+")"+" does not exist.");
+    }
+
+    const auto type = (*maybeFunc).get_type();
+    if(type != sol::type::function)
+    {
+        const auto typeName = sol::type_name(_lua, type);
+        throw Pothos::InvalidArgumentException("The given field ("+functionName+")"+" must be a function. Found "+typeName+".");
+    }
+    else _blockFcn = (*maybeFunc);
+
+    _functionSet = true;
+    _luaSource = luaSource;
+    _functionName = functionName;
+
+    this->updateMemoryUsage(false);
+}
+
+// Must be called from the block's thread context, as this queries the Lua
+// state and the block's ports.
+void LuaJITBlock::updateMemoryUsage(bool updatePortBuffers)
+{
+    auto* L = _lua.lua_state();
+    const size_t luaHeapBytes = (size_t(lua_gc(L, LUA_GCCOUNT, 0)) * 1024) + size_t(lua_gc(L, LUA_GCCOUNTB, 0));
+    const auto jitMcodeBytes = safeLuaCall(_getMcodeSizeFcn).get<size_t>();
+
+    // The output ports' underlying buffers are owned by this block. The
+    // input buffers belong to upstream blocks and are accounted there.
+    size_t portBufferBytes = 0;
+    if(updatePortBuffers)
+    {
+        for(auto* output: this->outputs())
+        {
+            portBufferBytes += output->buffer().getBuffer().getLength();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_memoryUsageMutex);
+    _memoryUsage.luaHeapBytes = luaHeapBytes;
+    _memoryUsage.jitMcodeBytes = jitMcodeBytes;
+    if(updatePortBuffers) _memoryUsage.portBufferBytes = portBufferBytes;
+    _lastMemoryUsageUpdate = std::chrono::steady_clock::now();
 }
 
 //
@@ -219,6 +1776,20 @@ void LuaJITBlock::work()
  * containing a function to execute. This function operates directly on
  * the block's Pothos-allocated buffers.
  *
+ * The function can label its outputs with
+ * <tt>BlockEnv.PostLabel(outputIndex, id, value, index)</tt>, where the index
+ * is relative to the start of this call's output buffer, and the value is a
+ * number, boolean, string, or nil.
+ *
+ * It can also post part of an input buffer as a packet, without copying, with
+ * <tt>BlockEnv.PostInputSlice(inputIndex, outputIndex, offset, elems)</tt>,
+ * where the offset is relative to the start of this call's input buffer.
+ *
+ * Expensive math functions of one variable can be replaced with piecewise
+ * cubic approximations from
+ * <tt>BlockEnv.Approximate(key, fcn, xMin, xMax, maxError)</tt>, which are
+ * built once per process and shared between blocks.
+ *
  * |category /LuaJIT
  * |keywords lua jit ffi interop
  *
@@ -250,11 +1821,84 @@ void LuaJITBlock::work()
  * |default ""
  * |widget StringEntry()
  *
+ * |param luaLibraries[Lua Libraries]
+ * The Lua standard libraries to open in the block's Lua state. Each entry is
+ * either a library name (bit, coroutine, debug, io, math, os, string, table)
+ * or a profile: <b>minimal</b> (bit, math) or <b>full</b> (all libraries).
+ *
+ * The base, package, jit, and ffi libraries are always opened. Opening fewer
+ * libraries makes the block cheaper to construct and its Lua state smaller.
+ * |default ["full"]
+ * |widget LineEdit()
+ *
+ * |param stateless[Stateless]
+ * Whether the function's output is independent of how its input is split
+ * across calls. Stateless single-input, single-output blocks with matching
+ * types can be fused into one block with <b>/luajit/fused_chain</b>.
+ * |default false
+ * |option [True] true
+ * |option [False] false
+ *
+ * |param variableRate[Variable Rate]
+ * Whether the function decides how many elements it consumes and produces on
+ * each port. If set, the function takes two more parameters, <tt>inputElems</tt>
+ * and <tt>outputElems</tt>, arrays holding the number of elements available on
+ * each port, which the function must replace with the number of elements it
+ * consumed or produced.
+ * |default false
+ * |option [True] true
+ * |option [False] false
+ *
+ * |param timeSlice[Time Slice]
+ * If non-zero, the maximum time a single call to work() should run before
+ * returning with the elements processed so far, letting other blocks on the
+ * same thread pool run. The function is called on sub-chunks of
+ * <b>Slice Size</b> elements, and the time is checked between them.
+ * |units us
+ * |default 0
+ *
+ * |param sliceSize[Slice Size] The number of elements per sub-chunk when time slicing.
+ * |units elements
+ * |default 1024
+ *
+ * |param bufferPoolSizes[Buffer Pool Sizes]
+ * The sizes of the buffers the function can acquire from the block's pools with
+ * <tt>BlockEnv.AcquireBuffer(numBytes)</tt>, which returns a handle and a pointer.
+ * The buffer can then be posted downstream without copying with
+ * <tt>BlockEnv.PostBuffer(handle, outputIndex, elems)</tt> or
+ * <tt>BlockEnv.PostPacket(handle, outputIndex, elems)</tt>, or returned with
+ * <tt>BlockEnv.ReleaseBuffer(handle)</tt>. Requests that no pool can satisfy
+ * are allocated separately.
+ * |units bytes
+ * |default []
+ * |widget LineEdit()
+ *
+ * |param bufferPoolDepth[Buffer Pool Depth] The number of buffers in each pool.
+ * |default 4
+ *
+ * |param flushDenormals[Flush Denormals]
+ * Whether to set flush-to-zero and denormals-are-zero while the function runs,
+ * so decaying values don't fall into much slower denormal arithmetic. The
+ * <b>getDenormalInputs</b> and <b>getDenormalOutputs</b> probes count denormals
+ * found by sampling the block's float buffers.
+ * |default false
+ * |option [True] true
+ * |option [False] false
+ *
  * |factory /blocks/luajit_block(inputTypes,outputTypes)
+ * |setter setLuaLibraries(luaLibraries)
  * |setter setSource(source, functionName)
  * |setter setPreloadedLibraries(preloadedLibraries)
+ * |setter setStateless(stateless)
+ * |setter setVariableRate(variableRate)
+ * |setter setTimeSlice(timeSlice)
+ * |setter setSliceSize(sliceSize)
+ * |setter setBufferPoolSizes(bufferPoolSizes)
+ * |setter setBufferPoolDepth(bufferPoolDepth)
+ * |setter setFlushDenormals(flushDenormals)
  */
 static Pothos::BlockRegistry registerLuaJITBlock(
     "/blocks/luajit_block",
     Pothos::Callable(&LuaJITBlock::make)
-        .bind<bool>(true, 2));
+        .bind<bool>(true, 2)
+        .bind(std::vector<std::string>{"full"}, 3));
@@ -3,49 +3,319 @@
 
 #pragma once
 
+#include "LuaJITPortStaging.hpp"
 #include "ScopedDynLib.hpp"
 
+#include <Pothos/Exception.hpp>
 #include <Pothos/Framework.hpp>
 
 #include <lua.hpp>
 #include <sol/sol.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+struct LuaJITMemoryUsage
+{
+    std::string blockName;
+
+    size_t luaHeapBytes;
+    size_t jitMcodeBytes;
+    size_t portBufferBytes;
+};
+
+// Measured from the block's work() calls since it was last activated.
+struct LuaJITCostModel
+{
+    double nsPerElement;
+    double callRate;
+    double elementRate;
+
+    // The fraction of one core spent in the block's function.
+    double load;
+};
+
 class LuaJITBlock: public Pothos::Block
 {
     public:
         static Pothos::Block* make(
             const std::vector<std::string>& inputTypes,
             const std::vector<std::string>& outputTypes,
-            bool exposeSetters);
+            bool exposeSetters,
+            const std::vector<std::string>& luaLibraries);
 
         LuaJITBlock(
             const std::vector<std::string>& inputTypes,
             const std::vector<std::string>& outputTypes,
-            bool exposeSetters);
-        virtual ~LuaJITBlock() = default;
+            bool exposeSetters,
+            const std::vector<std::string>& luaLibraries);
+        virtual ~LuaJITBlock();
 
         void setSource(
             const std::string& luaSource,
             const std::string& functionName);
 
+        // Like setSource(), but loads bytecode from compileSource() instead
+        // of compiling the source again. luaSource is kept for reference.
+        void setCompiledSource(
+            const std::string& luaSource,
+            const std::string& bytecode,
+            const std::string& functionName);
+
+        static std::string compileSource(const std::string& luaSource);
+
         void setPreloadedLibraries(const std::vector<std::string>& libraries);
 
+        void setLuaLibraries(const std::vector<std::string>& luaLibraries);
+
+        // A hint that the function's output doesn't depend on how its input
+        // is split across calls, which allows it to be fused with others.
+        void setStateless(bool stateless);
+
+        // If non-zero, work() calls the function on sliceSize-element
+        // sub-chunks and returns early once timeSliceUs is used up, letting
+        // other blocks on the thread pool run.
+        void setTimeSlice(size_t timeSliceUs);
+
+        void setSliceSize(size_t sliceSize);
+
+        // If set, the function also takes inputElems and outputElems arrays
+        // holding each port's available elements, and replaces them with the
+        // number of elements it consumed or produced. Time slicing and port
+        // staging don't apply to variable-rate functions.
+        void setVariableRate(bool variableRate);
+
+        // Buffers Lua can acquire through BlockEnv.AcquireBuffer(), with one
+        // pool of numBuffers buffers for each size (in bytes). The pools are
+        // allocated on activation.
+        void setBufferPoolSizes(const std::vector<size_t>& bufferSizes);
+
+        void setBufferPoolDepth(size_t numBuffers);
+
+        // Sets flush-to-zero and denormals-are-zero on the worker thread
+        // around each call to the function.
+        void setFlushDenormals(bool flushDenormals);
+
+        // Presents the port's buffer to the function as kernelType, which
+        // defaults to the port's type if empty. If split is set, complex
+        // buffers are deinterleaved into N reals followed by N imaginary
+        // values. Outputs are converted back after each call. Setting an
+        // empty kernelType without splitting removes the staging.
+        void setInputStaging(
+            size_t inputIndex,
+            const std::string& kernelType,
+            bool split);
+
+        void setOutputStaging(
+            size_t outputIndex,
+            const std::string& kernelType,
+            bool split);
+
+        bool hasPortStaging() const;
+
+        // Runs single-input, single-output functions back-to-back in this
+        // block's state, one tile of tileElems elements at a time. elemSizes
+        // holds each function's input element size, followed by the last
+        // function's output element size.
+        void setFusedSources(
+            const std::vector<std::string>& luaSources,
+            const std::vector<std::string>& functionNames,
+            const std::vector<size_t>& elemSizes,
+            size_t tileElems);
+
+        const std::string& getSource() const;
+
+        const std::string& getFunctionName() const;
+
+        const std::vector<std::string>& getPreloadedLibraries() const;
+
+        const std::vector<std::string>& getLuaLibraries() const;
+
+        bool isStateless() const;
+
+        bool isVariableRate() const;
+
         void activate() override;
 
         void deactivate() override;
 
         void work() override;
 
+        // Calls the function on the given buffers, bypassing the ports. This
+        // must not be called concurrently with work() or itself.
+        void callFunction(
+            const std::vector<const void*>& inputPointers,
+            const std::vector<void*>& outputPointers,
+            size_t elems);
+
+        LuaJITMemoryUsage getMemoryUsage() const;
+
+        LuaJITCostModel getCostModel() const;
+
+        double getNsPerElement() const;
+
+        double getCallRate() const;
+
+        double getLoad() const;
+
+        unsigned long long getPartialReturns() const;
+
+        // The fraction of acquired buffers that came from a pool instead of
+        // a new allocation.
+        double getBufferPoolHitRate() const;
+
+        // Denormal values seen by sampling the float ports' buffers every
+        // few calls, so these undercount but show when it's happening.
+        unsigned long long getDenormalInputs() const;
+
+        unsigned long long getDenormalOutputs() const;
+
+        // Snapshots of all LuaJIT blocks currently alive in this process.
+        static std::vector<LuaJITMemoryUsage> getAllMemoryUsage();
+
+    protected:
+        // Calls a function in the table returned by the source, which lets
+        // blocks built on this one pass settings to and read state from
+        // their functions.
+        template <typename ReturnType = void, typename... ArgsType>
+        ReturnType callUserFunction(const std::string& name, ArgsType&&... args);
+
     private:
         sol::state _lua;
         sol::protected_function _callBlockFcn;
         sol::protected_function _blockFcn;
+        sol::protected_function _getMcodeSizeFcn;
 
         bool _functionSet;
+        std::string _luaSource;
+        std::string _functionName;
+        std::vector<std::string> _luaLibraries;
+        bool _stateless;
+        bool _variableRate;
+        std::vector<size_t> _inputElems;
+        std::vector<size_t> _outputElems;
+
+        std::chrono::nanoseconds _timeSlice;
+        size_t _sliceElems;
+        std::vector<const void*> _slicedInputPointers;
+        std::vector<void*> _slicedOutputPointers;
+
+        // Where the current slice starts in this call's buffers, which
+        // labels and input slices are posted relative to
+        size_t _sliceOffset;
+
+        std::vector<size_t> _bufferPoolSizes;
+        size_t _bufferPoolDepth;
+        std::vector<Pothos::BufferManager::Sptr> _bufferPools;
+        std::unordered_map<int, Pothos::BufferChunk> _acquiredBuffers;
+        int _nextBufferHandle;
+        std::vector<bool> _postedOutputs;
+
+        bool _flushDenormals;
+        size_t _callsUntilDenormalSample;
+
+        std::vector<LuaJITPortStaging::UPtr> _inputStaging;
+        std::vector<LuaJITPortStaging::UPtr> _outputStaging;
+        std::vector<const void*> _stagedInputPointers;
+        std::vector<void*> _stagedOutputPointers;
+
+        // Held so tables this block uses outlive it being the last user.
+        std::unordered_map<std::string, std::shared_ptr<Pothos::BufferChunk>> _sharedTables;
 
         std::vector<std::string> _dynLibPaths;
         std::vector<ScopedDynLib::SPtr> _dynLibs;
+
+        // Refreshed from the block's own thread, read from anywhere.
+        mutable std::mutex _memoryUsageMutex;
+        LuaJITMemoryUsage _memoryUsage;
+        std::chrono::steady_clock::time_point _lastMemoryUsageUpdate;
+
+        std::atomic<unsigned long long> _totalWorkNs;
+        std::atomic<unsigned long long> _totalElems;
+        std::atomic<unsigned long long> _totalCalls;
+        std::atomic<unsigned long long> _partialReturns;
+        std::atomic<unsigned long long> _bufferPoolHits;
+        std::atomic<unsigned long long> _bufferPoolMisses;
+        std::atomic<unsigned long long> _denormalInputs;
+        std::atomic<unsigned long long> _denormalOutputs;
+        std::atomic<std::chrono::steady_clock::rep> _activateTime;
+        std::atomic<std::chrono::steady_clock::rep> _deactivateTime;
+
+        void initLuaState(const std::vector<std::string>& luaLibraries);
+
+        void loadUserEnv(
+            const sol::protected_function& chunk,
+            const std::string& luaSource,
+            const std::string& functionName);
+
+        size_t callFunctionTimeSliced(size_t elems);
+
+        void callFunctionVariableRate(size_t elems);
+
+        void callFunctionStaged(
+            const std::vector<const void*>& inputPointers,
+            const std::vector<void*>& outputPointers,
+            size_t elems);
+
+        // Called from Lua through BlockEnv. Output indices are 0-based, like
+        // the function's buffers.
+        std::tuple<int, void*> acquireBuffer(size_t numBytes);
+
+        void postBuffer(int handle, size_t outputIndex, size_t elems);
+
+        void postPacket(int handle, size_t outputIndex, size_t elems);
+
+        void releaseBuffer(int handle);
+
+        // Posts elements [offset, offset+elems) of the buffer the function
+        // sees as a packet, without copying.
+        void postInputSlice(
+            size_t inputIndex,
+            size_t outputIndex,
+            size_t offset,
+            size_t elems);
+
+        // The label's index is relative to the elements the function
+        // writes this call.
+        void postLabel(
+            size_t outputIndex,
+            const std::string& id,
+            const sol::object& value,
+            size_t index);
+
+        Pothos::BufferChunk takeAcquiredBuffer(int handle, size_t outputIndex, size_t elems);
+
+        void* getSharedTable(
+            const std::string& key,
+            size_t numBytes,
+            const sol::protected_function& initFcn);
+
+        void updateMemoryUsage(bool updatePortBuffers);
 };
+
+template <typename ReturnType, typename... ArgsType>
+ReturnType LuaJITBlock::callUserFunction(const std::string& name, ArgsType&&... args)
+{
+    sol::optional<sol::protected_function> maybeFcn = _lua["BlockEnv"]["UserEnv"][name];
+    if(!maybeFcn)
+    {
+        throw Pothos::NotFoundException("No function named "+name);
+    }
+
+    auto result = (*maybeFcn)(std::forward<ArgsType>(args)...);
+    if(!result.valid())
+    {
+        sol::error err = result;
+        throw Pothos::Exception(err.what());
+    }
+
+    if constexpr(!std::is_void<ReturnType>::value) return result.template get<ReturnType>();
+}
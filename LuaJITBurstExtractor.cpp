@@ -0,0 +1,481 @@
+// Copyright (c) 2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#include "LuaJITBlock.hpp"
+
+#include <Pothos/Exception.hpp>
+#include <Pothos/Framework.hpp>
+
+#include <string>
+#include <vector>
+
+//
+// Embedded Lua
+//
+
+static const std::string BurstExtractorScript = R"(
+
+local ffi = require("ffi")
+
+local BurstExtractor = {}
+
+local elemSize = 0
+local isComplex = false
+local minBurstLength = 1
+local maxBurstLength = 1
+
+local onThreshold = 0.0
+local offThreshold = 0.0
+local holdoff = 1
+local quietCount = 0
+
+--
+-- Detectors
+--
+-- A detector is called as detect(input, first, last, active), where input
+-- is the input buffer's address. If active is false, it returns the index in
+-- [first, last) where a burst starts. Otherwise, it returns the index just
+-- past where the current burst ends, in (first, last]. It returns nil if
+-- neither happens before last.
+--
+
+local function realPower(samples, i)
+    return samples[i] * samples[i]
+end
+
+local function complexPower(samples, i)
+    local real = samples[2*i]
+    local imag = samples[(2*i) + 1]
+    return (real * real) + (imag * imag)
+end
+
+-- Bursts start when the power crosses onThreshold, and end once it's been
+-- below offThreshold for holdoff samples in a row, including those samples.
+local function powerDetect(input, first, last, active)
+    local samples = ffi.cast("const float*", input)
+    local power = isComplex and complexPower or realPower
+
+    if not active
+    then
+        for i = first, last-1
+        do
+            if power(samples, i) > onThreshold
+            then
+                quietCount = 0
+                return i
+            end
+        end
+    else
+        for i = first, last-1
+        do
+            if power(samples, i) < offThreshold
+            then
+                quietCount = quietCount + 1
+                if quietCount >= holdoff
+                then
+                    quietCount = 0
+                    return i + 1
+                end
+            else
+                quietCount = 0
+            end
+        end
+    end
+
+    return nil
+end
+
+local detect = powerDetect
+
+--
+-- Burst assembly
+--
+
+local active = false
+
+-- Where the current burst starts in this call's input, or 0 if it started
+-- in an earlier one
+local burstStart = 0
+
+-- Bursts that span calls are copied into a pooled buffer as they go. The
+-- buffer's capacity is kept, since the max burst length can change while
+-- it's in use.
+local spanHandle = nil
+local spanBuffer = nil
+local spanCapacity = 0
+local spanElems = 0
+
+local function appendToSpan(input, first, last)
+    if spanHandle == nil
+    then
+        local handle, ptr = BlockEnv.AcquireBuffer(maxBurstLength * elemSize)
+        spanHandle = handle
+        spanBuffer = ffi.cast("uint8_t*", ptr)
+        spanCapacity = maxBurstLength
+    end
+
+    ffi.copy(spanBuffer + (spanElems * elemSize), input + (first * elemSize), (last - first) * elemSize)
+    spanElems = spanElems + (last - first)
+end
+
+-- Bursts entirely within this call's input are posted as slices of it, and
+-- the rest from their pooled buffer.
+local function postBurst(input, first, last)
+    local burstLength = spanElems + (last - first)
+
+    if spanHandle == nil
+    then
+        if burstLength >= minBurstLength
+        then
+            BlockEnv.PostInputSlice(0, 0, first, burstLength)
+        end
+    else
+        appendToSpan(input, first, last)
+        if burstLength >= minBurstLength
+        then
+            BlockEnv.PostPacket(spanHandle, 0, burstLength)
+        else
+            BlockEnv.ReleaseBuffer(spanHandle)
+        end
+
+        spanHandle = nil
+        spanBuffer = nil
+        spanCapacity = 0
+        spanElems = 0
+    end
+end
+
+function BurstExtractor.extract(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems, inputElems, outputElems)
+    local input = ffi.cast("const uint8_t*", buffsIn[0])
+    local numInputs = tonumber(inputElems[0])
+
+    local i = 0
+    while i < numInputs
+    do
+        if not active
+        then
+            local start = detect(input, i, numInputs, false)
+            if start == nil
+            then
+                break
+            end
+
+            active = true
+            burstStart = start
+            i = start
+        else
+            -- Bursts that reach the max length are cut off there, or at the
+            -- capacity of the buffer they're being copied into.
+            local burstCapacity = (spanHandle ~= nil) and math.min(maxBurstLength, spanCapacity) or maxBurstLength
+            local limit = burstStart + math.max(0, burstCapacity - spanElems)
+            local last = math.min(numInputs, limit)
+
+            local stop = detect(input, i, last, true)
+            if (stop == nil) and (last == limit)
+            then
+                stop = limit
+            end
+
+            if stop ~= nil
+            then
+                postBurst(input, burstStart, stop)
+                active = false
+                i = stop
+            else
+                appendToSpan(input, burstStart, numInputs)
+                burstStart = 0
+                i = numInputs
+            end
+        end
+    end
+
+    inputElems[0] = numInputs
+    outputElems[0] = 0
+end
+
+-- source is a Lua chunk returning a detector function, or empty for the
+-- built-in power detector.
+function BurstExtractor.setDetector(source)
+    if source == ""
+    then
+        detect = powerDetect
+    else
+        detect = assert(load(source, "detector"))()
+    end
+end
+
+-- Thresholds are in power (magnitude squared).
+function BurstExtractor.configure(newElemSize, newIsComplex, newMinBurstLength, newMaxBurstLength, newOnThreshold, newOffThreshold, newHoldoff)
+    elemSize = newElemSize
+    isComplex = newIsComplex
+    minBurstLength = newMinBurstLength
+    maxBurstLength = newMaxBurstLength
+    onThreshold = newOnThreshold
+    offThreshold = newOffThreshold
+    holdoff = newHoldoff
+end
+
+function BurstExtractor.reset()
+    if spanHandle ~= nil
+    then
+        BlockEnv.ReleaseBuffer(spanHandle)
+    end
+
+    active = false
+    burstStart = 0
+    spanHandle = nil
+    spanBuffer = nil
+    spanCapacity = 0
+    spanElems = 0
+    quietCount = 0
+end
+
+return BurstExtractor
+
+)";
+
+//
+// Utility code
+//
+
+static constexpr size_t DefaultMinBurstLength = 1;
+static constexpr size_t DefaultMaxBurstLength = 65536;
+static constexpr double DefaultOnThreshold = 0.01;
+static constexpr double DefaultOffThreshold = 0.005;
+static constexpr size_t DefaultHoldoff = 16;
+
+//
+// Implementation
+//
+
+class LuaJITBurstExtractor: public LuaJITBlock
+{
+    public:
+        static Pothos::Block* make(const Pothos::DType& dtype)
+        {
+            return new LuaJITBurstExtractor(dtype);
+        }
+
+        LuaJITBurstExtractor(const Pothos::DType& dtype):
+            LuaJITBlock(
+                std::vector<std::string>{dtype.name()},
+                std::vector<std::string>{dtype.name()},
+                false,
+                std::vector<std::string>{"minimal"}),
+            _dtype(dtype),
+            _minBurstLength(DefaultMinBurstLength),
+            _maxBurstLength(DefaultMaxBurstLength),
+            _onThreshold(DefaultOnThreshold),
+            _offThreshold(DefaultOffThreshold),
+            _holdoff(DefaultHoldoff),
+            _detectorSource()
+        {
+            if((dtype != Pothos::DType("float32")) && (dtype != Pothos::DType("complex_float32")))
+            {
+                throw Pothos::InvalidArgumentException("Burst extraction requires float32 or complex_float32, not "+dtype.name());
+            }
+
+            this->setSource(BurstExtractorScript, "extract");
+            this->setVariableRate(true);
+            this->configure();
+
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBurstExtractor, setMinBurstLength));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBurstExtractor, getMinBurstLength));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBurstExtractor, setMaxBurstLength));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBurstExtractor, getMaxBurstLength));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBurstExtractor, setOnThreshold));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBurstExtractor, getOnThreshold));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBurstExtractor, setOffThreshold));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBurstExtractor, getOffThreshold));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBurstExtractor, setHoldoff));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBurstExtractor, getHoldoff));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBurstExtractor, setDetector));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBurstExtractor, getDetector));
+        }
+
+        virtual ~LuaJITBurstExtractor() = default;
+
+        // Shorter bursts are discarded.
+        void setMinBurstLength(size_t minBurstLength)
+        {
+            _minBurstLength = minBurstLength;
+            this->configure();
+        }
+
+        size_t getMinBurstLength() const
+        {
+            return _minBurstLength;
+        }
+
+        // Longer bursts are split. A burst already being copied across calls
+        // is cut off at the length it started with, if that's shorter.
+        void setMaxBurstLength(size_t maxBurstLength)
+        {
+            if(0 == maxBurstLength)
+            {
+                throw Pothos::RangeException("Max burst length must be positive.");
+            }
+
+            _maxBurstLength = maxBurstLength;
+            this->configure();
+        }
+
+        size_t getMaxBurstLength() const
+        {
+            return _maxBurstLength;
+        }
+
+        void setOnThreshold(double onThreshold)
+        {
+            _onThreshold = onThreshold;
+            this->configure();
+        }
+
+        double getOnThreshold() const
+        {
+            return _onThreshold;
+        }
+
+        void setOffThreshold(double offThreshold)
+        {
+            _offThreshold = offThreshold;
+            this->configure();
+        }
+
+        double getOffThreshold() const
+        {
+            return _offThreshold;
+        }
+
+        void setHoldoff(size_t holdoff)
+        {
+            if(0 == holdoff)
+            {
+                throw Pothos::RangeException("Holdoff must be positive.");
+            }
+
+            _holdoff = holdoff;
+            this->configure();
+        }
+
+        size_t getHoldoff() const
+        {
+            return _holdoff;
+        }
+
+        // A Lua chunk returning a detector function, replacing the built-in
+        // power detector unless it's empty
+        void setDetector(const std::string& detectorSource)
+        {
+            this->callUserFunction("setDetector", detectorSource);
+            _detectorSource = detectorSource;
+        }
+
+        const std::string& getDetector() const
+        {
+            return _detectorSource;
+        }
+
+        void activate() override
+        {
+            this->callUserFunction("reset");
+            LuaJITBlock::activate();
+        }
+
+    private:
+        Pothos::DType _dtype;
+        size_t _minBurstLength;
+        size_t _maxBurstLength;
+        double _onThreshold;
+        double _offThreshold;
+        size_t _holdoff;
+        std::string _detectorSource;
+
+        void configure()
+        {
+            this->callUserFunction(
+                "configure",
+                _dtype.size(),
+                _dtype.isComplex(),
+                _minBurstLength,
+                _maxBurstLength,
+                _onThreshold,
+                _offThreshold,
+                _holdoff);
+
+            // Bursts spanning input buffers are copied into these. The pools
+            // are only resized while inactive, so until then, bursts longer
+            // than before are copied into new allocations.
+            if(!this->isActive())
+            {
+                this->setBufferPoolSizes(std::vector<size_t>{_maxBurstLength * _dtype.size()});
+            }
+        }
+};
+
+//
+// Registration
+//
+
+/***********************************************************************
+ * |PothosDoc Burst Extractor (LuaJIT)
+ *
+ * Detects bursts in a stream and outputs each one as a packet. Bursts
+ * that fit within one input buffer are posted as slices of it, without
+ * copying, and only bursts that span input buffers are copied, into pooled
+ * buffers.
+ *
+ * By default, a burst starts when the input's power crosses
+ * <b>On Threshold</b>, and ends once it's been below <b>Off Threshold</b>
+ * for <b>Holdoff</b> samples in a row, which are included in the burst.
+ * <b>Detector</b> can replace this with a Lua chunk returning a function
+ * <tt>detect(input, first, last, active)</tt>, where <tt>input</tt> is the
+ * address of the input buffer. If <tt>active</tt> is false, it returns the
+ * index in [first, last) where a burst starts, and otherwise the index just
+ * past where the current burst ends, in (first, last]. It returns nil if
+ * neither happens before <tt>last</tt>.
+ *
+ * |category /LuaJIT/Packet
+ * |keywords burst packet detector squelch
+ *
+ * |param dtype[Data Type]
+ * |widget DTypeChooser(float32=1,cfloat32=1)
+ * |default "complex_float32"
+ * |preview disable
+ *
+ * |param minBurstLength[Min Burst Length] Shorter bursts are discarded.
+ * |units samples
+ * |default 1
+ *
+ * |param maxBurstLength[Max Burst Length] Longer bursts are split.
+ * |units samples
+ * |default 65536
+ *
+ * |param onThreshold[On Threshold]
+ * |units power
+ * |default 0.01
+ *
+ * |param offThreshold[Off Threshold]
+ * |units power
+ * |default 0.005
+ *
+ * |param holdoff[Holdoff]
+ * |units samples
+ * |default 16
+ *
+ * |param detector[Detector] Lua source for a custom detector, or empty for the power detector.
+ * |default ""
+ * |widget StringEntry()
+ * |preview valid
+ *
+ * |factory /luajit/burst_extractor(dtype)
+ * |setter setMinBurstLength(minBurstLength)
+ * |setter setMaxBurstLength(maxBurstLength)
+ * |setter setOnThreshold(onThreshold)
+ * |setter setOffThreshold(offThreshold)
+ * |setter setHoldoff(holdoff)
+ * |setter setDetector(detector)
+ */
+static Pothos::BlockRegistry registerLuaJITBurstExtractor(
+    "/luajit/burst_extractor",
+    Pothos::Callable(&LuaJITBurstExtractor::make));
@@ -0,0 +1,725 @@
+// Copyright (c) 2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#include "LuaJITBlock.hpp"
+
+#include <Pothos/Exception.hpp>
+#include <Pothos/Framework.hpp>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+//
+// Embedded Lua
+//
+
+static const std::string CarrierLoopScript = R"(
+
+local ffi = require("ffi")
+
+-- Everything the per-sample loop touches lives in one FFI struct, so the
+-- compiled loop keeps it in registers instead of hashing table fields.
+ffi.cdef[[
+typedef struct
+{
+    double phase;
+    double frequency;
+    double alpha;
+    double beta;
+    double maxFrequency;
+
+    double lockMetric;
+    double lockAlpha;
+    double lockThreshold;
+    double unlockThreshold;
+    int32_t locked;
+
+    // Only used by the FLL
+    double prevReal;
+    double prevImag;
+
+    int32_t order;
+    int32_t labelInterval;
+    int32_t samplesUntilLabel;
+} luajit_carrier_loop_t;
+]]
+
+local CarrierLoop = {}
+
+local TwoPi = 2.0 * math.pi
+local HalfPi = 0.5 * math.pi
+local QuarterPi = 0.25 * math.pi
+
+-- sin() over one cycle, with a quarter cycle more so cos() can use the same
+-- table, and one more entry for interpolation. A phase just below 2pi can
+-- still scale to an index of SinTableSize, so there's a guard entry after that.
+local SinTableSize = 1024
+local SinTableScale = SinTableSize / TwoPi
+local CosOffset = SinTableSize / 4
+local SinTableEntries = SinTableSize + CosOffset + 2
+
+local sinTable = ffi.cast("double*", BlockEnv.GetSharedTable(
+    "luajit/carrier_loop/sin/"..SinTableSize,
+    SinTableEntries * ffi.sizeof("double"),
+    function(ptr)
+        local values = ffi.cast("double*", ptr)
+        for i = 0, SinTableEntries-1
+        do
+            values[i] = math.sin(i / SinTableScale)
+        end
+    end))
+
+local state = ffi.new("luajit_carrier_loop_t")
+
+-- Returns cos(phase), sin(phase) for phase in [0, 2pi).
+local function nco(phase)
+    local x = phase * SinTableScale
+    local index = math.floor(x)
+    local frac = x - index
+
+    local sinValue = sinTable[index] + (frac * (sinTable[index + 1] - sinTable[index]))
+    local cosIndex = index + CosOffset
+    local cosValue = sinTable[cosIndex] + (frac * (sinTable[cosIndex + 1] - sinTable[cosIndex]))
+
+    return cosValue, sinValue
+end
+
+-- Within about 0.0015 radians
+local function fastAtan2(y, x)
+    local absX = math.abs(x)
+    local absY = math.abs(y)
+    local maxXY = math.max(absX, absY)
+    if maxXY == 0.0
+    then
+        return 0.0
+    end
+
+    local z = math.min(absX, absY) / maxXY
+    local angle = (QuarterPi * z) - (z * (z - 1.0) * (0.2447 + (0.0663 * z)))
+    if absY > absX then angle = HalfPi - angle end
+    if x < 0.0 then angle = math.pi - angle end
+    if y < 0.0 then angle = -angle end
+
+    return angle
+end
+
+-- Raises a complex value to the loop's order (1, 2, 4, or 8).
+local function power(real, imag)
+    local order = state.order
+    while order > 1
+    do
+        real, imag = (real * real) - (imag * imag), 2.0 * real * imag
+        order = order / 2
+    end
+
+    return real, imag
+end
+
+-- cos(order * angle(z)), which is near 1 once the loop has removed the
+-- modulation's phase ambiguity
+local function lockValue(real, imag)
+    local powReal = power(real, imag)
+    local mag = ((real * real) + (imag * imag)) ^ (state.order / 2)
+
+    return (mag > 0.0) and (powReal / mag) or 0.0
+end
+
+-- The QPSK detector settles on points at odd multiples of pi/4, where
+-- cos(4 * angle) is -1.
+local function costasLockValue(real, imag)
+    local value = lockValue(real, imag)
+    return (state.order == 4) and -value or value
+end
+
+local function updateLock(value)
+    state.lockMetric = state.lockMetric + (state.lockAlpha * (value - state.lockMetric))
+
+    if (state.locked == 0) and (state.lockMetric > state.lockThreshold)
+    then
+        state.locked = 1
+    elseif (state.locked ~= 0) and (state.lockMetric < state.unlockThreshold)
+    then
+        state.locked = 0
+    end
+end
+
+-- Wrapping a tiny negative phase can round up to exactly 2pi, which is
+-- the same as 0.
+local function advancePhase(phaseStep)
+    local phase = state.phase + phaseStep
+    phase = phase - (TwoPi * math.floor(phase / TwoPi))
+    state.phase = (phase < TwoPi) and phase or 0.0
+end
+
+local function updateLoopFilter(err)
+    err = math.max(-1.0, math.min(1.0, err))
+
+    local frequency = state.frequency + (state.beta * err)
+    state.frequency = math.max(-state.maxFrequency, math.min(state.maxFrequency, frequency))
+
+    advancePhase(state.frequency + (state.alpha * err))
+end
+
+--
+-- Phase detectors
+--
+
+local Sqrt2Minus1 = math.sqrt(2.0) - 1.0
+local EighthPiCos = math.cos(math.pi / 8.0)
+local EighthPiSin = math.sin(math.pi / 8.0)
+
+local function pllError(real, imag)
+    return fastAtan2(imag, real)
+end
+
+local function costasError(real, imag)
+    local order = state.order
+    if order == 2
+    then
+        return real * imag
+    elseif order == 4
+    then
+        return ((real >= 0.0) and imag or -imag) - ((imag >= 0.0) and real or -real)
+    else
+        -- This detector settles on points at odd multiples of pi/8, so
+        -- rotate the input to settle on multiples of pi/4 instead.
+        real, imag = (real * EighthPiCos) - (imag * EighthPiSin), (real * EighthPiSin) + (imag * EighthPiCos)
+
+        local signReal = (real >= 0.0) and 1.0 or -1.0
+        local signImag = (imag >= 0.0) and 1.0 or -1.0
+        if math.abs(real) >= math.abs(imag)
+        then
+            return (signReal * imag) - (Sqrt2Minus1 * signImag * real)
+        else
+            return (Sqrt2Minus1 * signReal * imag) - (signImag * real)
+        end
+    end
+end
+
+--
+-- Tracking loops
+--
+-- Each processes samples [first, last) and returns where it stopped, which
+-- is early if the lock state changed.
+--
+
+local function trackPhase(detector, lockDetector, input, output, first, last)
+    local locked = state.locked
+
+    for i = first, last-1
+    do
+        local cosValue, sinValue = nco(state.phase)
+        local inReal = input[2*i]
+        local inImag = input[(2*i)+1]
+        local real = (inReal * cosValue) + (inImag * sinValue)
+        local imag = (inImag * cosValue) - (inReal * sinValue)
+        output[2*i] = real
+        output[(2*i)+1] = imag
+
+        updateLoopFilter(detector(real, imag))
+        updateLock(lockDetector(real, imag))
+        if state.locked ~= locked
+        then
+            return i + 1
+        end
+    end
+
+    return last
+end
+
+local function trackPLL(input, output, first, last)
+    return trackPhase(pllError, lockValue, input, output, first, last)
+end
+
+local function trackCostas(input, output, first, last)
+    return trackPhase(costasError, costasLockValue, input, output, first, last)
+end
+
+-- The phase difference between consecutive samples, after raising them to
+-- the loop's order to remove the modulation, drives the frequency.
+local function trackFLL(input, output, first, last)
+    local locked = state.locked
+
+    for i = first, last-1
+    do
+        local cosValue, sinValue = nco(state.phase)
+        local inReal = input[2*i]
+        local inImag = input[(2*i)+1]
+        local real = (inReal * cosValue) + (inImag * sinValue)
+        local imag = (inImag * cosValue) - (inReal * sinValue)
+        output[2*i] = real
+        output[(2*i)+1] = imag
+
+        -- z[n] * conj(z[n-1])
+        local diffReal = (real * state.prevReal) + (imag * state.prevImag)
+        local diffImag = (imag * state.prevReal) - (real * state.prevImag)
+        state.prevReal = real
+        state.prevImag = imag
+
+        local powReal, powImag = power(diffReal, diffImag)
+        local err = fastAtan2(powImag, powReal) / state.order
+
+        local frequency = state.frequency + (state.alpha * err)
+        state.frequency = math.max(-state.maxFrequency, math.min(state.maxFrequency, frequency))
+        advancePhase(state.frequency)
+
+        updateLock(lockValue(diffReal, diffImag))
+        if state.locked ~= locked
+        then
+            return i + 1
+        end
+    end
+
+    return last
+end
+
+-- Labels are posted between calls to the tracking loops, so the loops
+-- themselves never leave compiled code.
+local function runLoop(track, buffsIn, buffsOut, elems)
+    local input = ffi.cast("float*", buffsIn[0])
+    local output = ffi.cast("float*", buffsOut[0])
+
+    local i = 0
+    while i < elems
+    do
+        local last = elems
+        if state.labelInterval > 0
+        then
+            last = math.min(elems, i + state.samplesUntilLabel)
+        end
+
+        local locked = state.locked
+        local stop = track(input, output, i, last)
+
+        if state.locked ~= locked
+        then
+            BlockEnv.PostLabel(0, "lock", (state.locked ~= 0), stop - 1)
+        end
+        if state.labelInterval > 0
+        then
+            state.samplesUntilLabel = state.samplesUntilLabel - (stop - i)
+            if state.samplesUntilLabel == 0
+            then
+                BlockEnv.PostLabel(0, "freq", state.frequency / TwoPi, stop - 1)
+                state.samplesUntilLabel = state.labelInterval
+            end
+        end
+
+        i = stop
+    end
+end
+
+function CarrierLoop.pll(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    runLoop(trackPLL, buffsIn, buffsOut, elems)
+end
+
+function CarrierLoop.costas(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    runLoop(trackCostas, buffsIn, buffsOut, elems)
+end
+
+function CarrierLoop.fll(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    runLoop(trackFLL, buffsIn, buffsOut, elems)
+end
+
+-- Frequencies are in radians per sample.
+function CarrierLoop.configure(order, alpha, beta, maxFrequency, lockThreshold, lockAlpha, labelInterval)
+    state.order = order
+    state.alpha = alpha
+    state.beta = beta
+    state.maxFrequency = maxFrequency
+    state.lockThreshold = lockThreshold
+    state.unlockThreshold = lockThreshold - 0.1
+    state.lockAlpha = lockAlpha
+    state.labelInterval = labelInterval
+    state.samplesUntilLabel = labelInterval
+
+    state.frequency = math.max(-maxFrequency, math.min(maxFrequency, state.frequency))
+end
+
+function CarrierLoop.reset()
+    state.phase = 0.0
+    state.frequency = 0.0
+    state.lockMetric = 0.0
+    state.locked = 0
+    state.prevReal = 0.0
+    state.prevImag = 0.0
+    state.samplesUntilLabel = state.labelInterval
+end
+
+function CarrierLoop.getFrequency()
+    return state.frequency
+end
+
+function CarrierLoop.getPhase()
+    return state.phase
+end
+
+function CarrierLoop.getLockMetric()
+    return state.lockMetric
+end
+
+function CarrierLoop.isLocked()
+    return (state.locked ~= 0)
+end
+
+return CarrierLoop
+
+)";
+
+//
+// Utility code
+//
+
+static constexpr double DefaultLoopBandwidth = 2.0 * M_PI / 100.0;
+static constexpr double DefaultMaxFrequency = 0.25;
+static constexpr double DefaultLockThreshold = 0.8;
+
+// The lock metric is averaged over roughly this many samples.
+static constexpr double LockAveragingSamples = 100.0;
+
+static bool isPowerOf2(size_t value)
+{
+    return (value > 0) && (0 == (value & (value-1)));
+}
+
+//
+// Implementation
+//
+
+class LuaJITCarrierLoop: public LuaJITBlock
+{
+    public:
+        static Pothos::Block* makePLL()
+        {
+            return new LuaJITCarrierLoop("pll", 1);
+        }
+
+        static Pothos::Block* makeCostasLoop(size_t order)
+        {
+            if((order < 2) || (order > 8) || !isPowerOf2(order))
+            {
+                throw Pothos::InvalidArgumentException("Costas loop order must be 2 (BPSK), 4 (QPSK), or 8 (8PSK).");
+            }
+
+            return new LuaJITCarrierLoop("costas", order);
+        }
+
+        static Pothos::Block* makeFLL(size_t order)
+        {
+            if((order > 8) || !isPowerOf2(order))
+            {
+                throw Pothos::InvalidArgumentException("FLL order must be 1, 2, 4, or 8.");
+            }
+
+            return new LuaJITCarrierLoop("fll", order);
+        }
+
+        LuaJITCarrierLoop(
+            const std::string& loopType,
+            size_t order
+        ):
+            LuaJITBlock(
+                std::vector<std::string>{"complex_float32"},
+                std::vector<std::string>{"complex_float32"},
+                false,
+                std::vector<std::string>{"minimal"}),
+            _isFLL(loopType == "fll"),
+            _order(order),
+            _loopBandwidth(DefaultLoopBandwidth),
+            _maxFrequency(DefaultMaxFrequency),
+            _lockThreshold(DefaultLockThreshold),
+            _labelInterval(0)
+        {
+            this->setSource(CarrierLoopScript, loopType);
+            this->configure();
+
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITCarrierLoop, setLoopBandwidth));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITCarrierLoop, getLoopBandwidth));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITCarrierLoop, setMaxFrequency));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITCarrierLoop, getMaxFrequency));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITCarrierLoop, setLockThreshold));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITCarrierLoop, getLockThreshold));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITCarrierLoop, setLabelInterval));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITCarrierLoop, getLabelInterval));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITCarrierLoop, getFrequency));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITCarrierLoop, getPhase));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITCarrierLoop, getLockMetric));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITCarrierLoop, isLocked));
+            this->registerProbe("getFrequency");
+            this->registerProbe("getPhase");
+            this->registerProbe("getLockMetric");
+            this->registerProbe("isLocked");
+        }
+
+        virtual ~LuaJITCarrierLoop() = default;
+
+        void setLoopBandwidth(double loopBandwidth)
+        {
+            if(loopBandwidth <= 0.0)
+            {
+                throw Pothos::RangeException("Loop bandwidth must be positive.");
+            }
+
+            _loopBandwidth = loopBandwidth;
+            this->configure();
+        }
+
+        double getLoopBandwidth() const
+        {
+            return _loopBandwidth;
+        }
+
+        void setMaxFrequency(double maxFrequency)
+        {
+            if((maxFrequency <= 0.0) || (maxFrequency > 0.5))
+            {
+                throw Pothos::RangeException("Max frequency must be in the range (0, 0.5].");
+            }
+
+            _maxFrequency = maxFrequency;
+            this->configure();
+        }
+
+        double getMaxFrequency() const
+        {
+            return _maxFrequency;
+        }
+
+        void setLockThreshold(double lockThreshold)
+        {
+            if((lockThreshold <= -1.0) || (lockThreshold >= 1.0))
+            {
+                throw Pothos::RangeException("Lock threshold must be in the range (-1, 1).");
+            }
+
+            _lockThreshold = lockThreshold;
+            this->configure();
+        }
+
+        double getLockThreshold() const
+        {
+            return _lockThreshold;
+        }
+
+        void setLabelInterval(size_t labelInterval)
+        {
+            _labelInterval = labelInterval;
+            this->configure();
+        }
+
+        size_t getLabelInterval() const
+        {
+            return _labelInterval;
+        }
+
+        // In cycles per sample
+        double getFrequency()
+        {
+            return this->callUserFunction<double>("getFrequency") / (2.0 * M_PI);
+        }
+
+        // In radians
+        double getPhase()
+        {
+            return this->callUserFunction<double>("getPhase");
+        }
+
+        double getLockMetric()
+        {
+            return this->callUserFunction<double>("getLockMetric");
+        }
+
+        bool isLocked()
+        {
+            return this->callUserFunction<bool>("isLocked");
+        }
+
+        void activate() override
+        {
+            this->callUserFunction("reset");
+            LuaJITBlock::activate();
+        }
+
+    private:
+        bool _isFLL;
+        size_t _order;
+        double _loopBandwidth;
+        double _maxFrequency;
+        double _lockThreshold;
+        size_t _labelInterval;
+
+        // The PLL and Costas loops use a second-order loop filter with a
+        // damping factor of 1/sqrt(2), and the FLL integrates its frequency
+        // error directly.
+        void configure()
+        {
+            double alpha = _loopBandwidth;
+            double beta = 0.0;
+            if(!_isFLL)
+            {
+                const auto damping = std::sqrt(2.0) / 2.0;
+                const auto denom = 1.0 + (2.0 * damping * _loopBandwidth) + (_loopBandwidth * _loopBandwidth);
+                alpha = (4.0 * damping * _loopBandwidth) / denom;
+                beta = (4.0 * _loopBandwidth * _loopBandwidth) / denom;
+            }
+
+            this->callUserFunction(
+                "configure",
+                _order,
+                alpha,
+                beta,
+                (2.0 * M_PI * _maxFrequency),
+                _lockThreshold,
+                (1.0 / LockAveragingSamples),
+                _labelInterval);
+        }
+};
+
+//
+// Registration
+//
+
+/***********************************************************************
+ * |PothosDoc PLL (LuaJIT)
+ *
+ * A phase-locked loop that tracks a carrier and mixes it down to DC. The
+ * input should have roughly unit amplitude.
+ *
+ * The loop's frequency estimate and lock state are available as probes. It
+ * also labels its output with <b>lock</b> (a boolean) whenever its lock state
+ * changes, and with <b>freq</b> (in cycles per sample) every
+ * <b>Label Interval</b> samples.
+ *
+ * |category /LuaJIT/Synchronization
+ * |keywords carrier phase tracking nco
+ *
+ * |param loopBandwidth[Loop Bandwidth]
+ * |units rad/sample
+ * |default 0.0628
+ *
+ * |param maxFrequency[Max Frequency] The largest frequency offset the loop will track.
+ * |units cycles/sample
+ * |default 0.25
+ *
+ * |param lockThreshold[Lock Threshold]
+ * The loop is locked when the average cosine of its phase error is above this,
+ * and unlocked when it drops 0.1 below it.
+ * |default 0.8
+ *
+ * |param labelInterval[Label Interval]
+ * How often to label the frequency estimate, or 0 to disable.
+ * |units samples
+ * |default 0
+ *
+ * |factory /luajit/pll()
+ * |setter setLoopBandwidth(loopBandwidth)
+ * |setter setMaxFrequency(maxFrequency)
+ * |setter setLockThreshold(lockThreshold)
+ * |setter setLabelInterval(labelInterval)
+ */
+static Pothos::BlockRegistry registerLuaJITPLL(
+    "/luajit/pll",
+    Pothos::Callable(&LuaJITCarrierLoop::makePLL));
+
+/***********************************************************************
+ * |PothosDoc Costas Loop (LuaJIT)
+ *
+ * Recovers the carrier of a PSK signal at one sample per symbol, using a
+ * decision-directed phase detector. BPSK symbols settle on the real axis,
+ * QPSK symbols on odd multiples of pi/4, and 8PSK symbols on multiples of pi/4.
+ * The input should have roughly unit amplitude.
+ *
+ * The loop's frequency estimate and lock state are available as probes. It
+ * also labels its output with <b>lock</b> (a boolean) whenever its lock state
+ * changes, and with <b>freq</b> (in cycles per sample) every
+ * <b>Label Interval</b> samples.
+ *
+ * |category /LuaJIT/Synchronization
+ * |keywords carrier phase tracking psk bpsk qpsk 8psk
+ *
+ * |param order[Order]
+ * |default 4
+ * |option [BPSK] 2
+ * |option [QPSK] 4
+ * |option [8PSK] 8
+ *
+ * |param loopBandwidth[Loop Bandwidth]
+ * |units rad/sample
+ * |default 0.0628
+ *
+ * |param maxFrequency[Max Frequency] The largest frequency offset the loop will track.
+ * |units cycles/sample
+ * |default 0.25
+ *
+ * |param lockThreshold[Lock Threshold]
+ * The loop is locked when the average cosine of its phase error (times the
+ * order) is above this, and unlocked when it drops 0.1 below it.
+ * |default 0.8
+ *
+ * |param labelInterval[Label Interval]
+ * How often to label the frequency estimate, or 0 to disable.
+ * |units samples
+ * |default 0
+ *
+ * |factory /luajit/costas_loop(order)
+ * |setter setLoopBandwidth(loopBandwidth)
+ * |setter setMaxFrequency(maxFrequency)
+ * |setter setLockThreshold(lockThreshold)
+ * |setter setLabelInterval(labelInterval)
+ */
+static Pothos::BlockRegistry registerLuaJITCostasLoop(
+    "/luajit/costas_loop",
+    Pothos::Callable(&LuaJITCarrierLoop::makeCostasLoop));
+
+/***********************************************************************
+ * |PothosDoc FLL (LuaJIT)
+ *
+ * A frequency-locked loop that removes a carrier frequency offset without
+ * tracking its phase, using the phase difference between consecutive samples.
+ * For PSK signals, setting <b>Order</b> to the modulation order removes the
+ * modulation from the difference first.
+ *
+ * The loop's frequency estimate and lock state are available as probes. It
+ * also labels its output with <b>lock</b> (a boolean) whenever its lock state
+ * changes, and with <b>freq</b> (in cycles per sample) every
+ * <b>Label Interval</b> samples.
+ *
+ * |category /LuaJIT/Synchronization
+ * |keywords carrier frequency tracking afc
+ *
+ * |param order[Order]
+ * |default 1
+ * |option [Unmodulated] 1
+ * |option [BPSK] 2
+ * |option [QPSK] 4
+ * |option [8PSK] 8
+ *
+ * |param loopBandwidth[Loop Bandwidth]
+ * |units rad/sample
+ * |default 0.0628
+ *
+ * |param maxFrequency[Max Frequency] The largest frequency offset the loop will track.
+ * |units cycles/sample
+ * |default 0.25
+ *
+ * |param lockThreshold[Lock Threshold]
+ * The loop is locked when the average cosine of the sample-to-sample phase
+ * difference (times the order) is above this, and unlocked when it drops 0.1
+ * below it.
+ * |default 0.8
+ *
+ * |param labelInterval[Label Interval]
+ * How often to label the frequency estimate, or 0 to disable.
+ * |units samples
+ * |default 0
+ *
+ * |factory /luajit/fll(order)
+ * |setter setLoopBandwidth(loopBandwidth)
+ * |setter setMaxFrequency(maxFrequency)
+ * |setter setLockThreshold(lockThreshold)
+ * |setter setLabelInterval(labelInterval)
+ */
+static Pothos::BlockRegistry registerLuaJITFLL(
+    "/luajit/fll",
+    Pothos::Callable(&LuaJITCarrierLoop::makeFLL));
@@ -0,0 +1,419 @@
+// Copyright (c) 2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#include "LuaJITBlock.hpp"
+
+#include <Pothos/Exception.hpp>
+#include <Pothos/Framework.hpp>
+
+#include <Poco/DigestEngine.h>
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//
+// Embedded Lua
+//
+
+static const std::string ChannelizerScript = R"(
+
+local ffi = require("ffi")
+
+local Channelizer = {}
+
+-- Outputs computed per pass over the history buffer
+local TileOutputs = 64
+
+local numChannels = 0
+local decimation = 0
+local tapsPerBranch = 0
+local numTaps = 0
+
+local taps = nil
+local bitReverse = nil
+local twiddles = nil
+
+local historyReal = nil
+local historyImag = nil
+local branchReal = nil
+local branchImag = nil
+local outputCount = 0
+
+local function getLog2(n)
+    local log2N = 0
+    while bit.lshift(1, log2N) < n
+    do
+        log2N = log2N + 1
+    end
+
+    return log2N
+end
+
+-- The FFT plan only depends on the number of channels, so every channelizer
+-- with the same number of channels shares one.
+local function getFFTPlan(n)
+    local log2N = getLog2(n)
+
+    local bitReversePtr = BlockEnv.GetSharedTable(
+        "luajit/channelizer/bit_reverse/"..n,
+        n * ffi.sizeof("int32_t"),
+        function(ptr)
+            local values = ffi.cast("int32_t*", ptr)
+            for i = 0, n-1
+            do
+                local reversed = 0
+                for b = 0, log2N-1
+                do
+                    if bit.band(i, bit.lshift(1, b)) ~= 0
+                    then
+                        reversed = bit.bor(reversed, bit.lshift(1, log2N-1-b))
+                    end
+                end
+                values[i] = reversed
+            end
+        end)
+
+    -- e^(j*2*pi*k/n) for k < n/2, interleaved
+    local twiddlesPtr = BlockEnv.GetSharedTable(
+        "luajit/channelizer/twiddles/"..n,
+        n * ffi.sizeof("double"),
+        function(ptr)
+            local values = ffi.cast("double*", ptr)
+            for k = 0, (n/2)-1
+            do
+                values[2*k] = math.cos(2.0 * math.pi * k / n)
+                values[(2*k)+1] = math.sin(2.0 * math.pi * k / n)
+            end
+        end)
+
+    return ffi.cast("int32_t*", bitReversePtr), ffi.cast("double*", twiddlesPtr)
+end
+
+-- In-place radix-2 FFT with a positive exponent.
+local function fft(real, imag)
+    local n = numChannels
+
+    for i = 0, n-1
+    do
+        local j = bitReverse[i]
+        if j > i
+        then
+            real[i], real[j] = real[j], real[i]
+            imag[i], imag[j] = imag[j], imag[i]
+        end
+    end
+
+    local size = 2
+    while size <= n
+    do
+        local half = size / 2
+        local twiddleStride = 2 * (n / size)
+        for first = 0, n-1, size
+        do
+            for k = 0, half-1
+            do
+                local twiddleReal = twiddles[k * twiddleStride]
+                local twiddleImag = twiddles[(k * twiddleStride) + 1]
+                local a = first + k
+                local b = a + half
+
+                local tempReal = (real[b] * twiddleReal) - (imag[b] * twiddleImag)
+                local tempImag = (real[b] * twiddleImag) + (imag[b] * twiddleReal)
+                real[b] = real[a] - tempReal
+                imag[b] = imag[a] - tempImag
+                real[a] = real[a] + tempReal
+                imag[a] = imag[a] + tempImag
+            end
+        end
+
+        size = size * 2
+    end
+end
+
+-- tapsTable holds the prototype filter, whose length is a multiple of the
+-- number of channels. tapsKey identifies the taps, so channelizers with the
+-- same taps share the polyphase arrangement.
+function Channelizer.configure(newNumChannels, newDecimation, tapsTable, tapsKey)
+    numChannels = newNumChannels
+    decimation = newDecimation
+    numTaps = #tapsTable
+    tapsPerBranch = numTaps / numChannels
+
+    -- Each branch's taps are contiguous: taps[(k * tapsPerBranch) + j] = h[k + (j * numChannels)]
+    taps = ffi.cast("double*", BlockEnv.GetSharedTable(
+        "luajit/channelizer/taps/"..tapsKey,
+        numTaps * ffi.sizeof("double"),
+        function(ptr)
+            local values = ffi.cast("double*", ptr)
+            for k = 0, numChannels-1
+            do
+                for j = 0, tapsPerBranch-1
+                do
+                    values[(k * tapsPerBranch) + j] = tapsTable[k + (j * numChannels) + 1]
+                end
+            end
+        end))
+
+    bitReverse, twiddles = getFFTPlan(numChannels)
+
+    -- The last numTaps-1 inputs, followed by a tile of new inputs
+    historyReal = ffi.new("double[?]", (numTaps - 1) + (TileOutputs * decimation))
+    historyImag = ffi.new("double[?]", (numTaps - 1) + (TileOutputs * decimation))
+    branchReal = ffi.new("double[?]", numChannels)
+    branchImag = ffi.new("double[?]", numChannels)
+
+    Channelizer.reset()
+end
+
+function Channelizer.reset()
+    ffi.fill(historyReal, ffi.sizeof(historyReal))
+    ffi.fill(historyImag, ffi.sizeof(historyImag))
+    outputCount = 0
+end
+
+function Channelizer.work(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems, inputElems, outputElems)
+    local input = ffi.cast("float*", buffsIn[0])
+    local outputs = ffi.cast("float**", buffsOut)
+
+    local numOutputs = math.floor(tonumber(inputElems[0]) / decimation)
+    for channel = 0, numChannels-1
+    do
+        numOutputs = math.min(numOutputs, tonumber(outputElems[channel]))
+    end
+
+    local historyLength = numTaps - 1
+    local oversampled = (decimation ~= numChannels)
+
+    local done = 0
+    while done < numOutputs
+    do
+        local tileOutputs = math.min(TileOutputs, numOutputs - done)
+        local tileInputs = tileOutputs * decimation
+
+        local inputOffset = 2 * done * decimation
+        for i = 0, tileInputs-1
+        do
+            historyReal[historyLength + i] = input[inputOffset + (2*i)]
+            historyImag[historyLength + i] = input[inputOffset + (2*i) + 1]
+        end
+
+        for n = 0, tileOutputs-1
+        do
+            -- Polyphase front end: branch k filters every numChannels'th
+            -- input, starting k inputs before the newest.
+            local newest = historyLength + ((n + 1) * decimation) - 1
+            for k = 0, numChannels-1
+            do
+                local accReal = 0.0
+                local accImag = 0.0
+                local tapsOffset = k * tapsPerBranch
+                local index = newest - k
+                for j = 0, tapsPerBranch-1
+                do
+                    local tap = taps[tapsOffset + j]
+                    accReal = accReal + (tap * historyReal[index])
+                    accImag = accImag + (tap * historyImag[index])
+                    index = index - numChannels
+                end
+                branchReal[k] = accReal
+                branchImag[k] = accImag
+            end
+
+            fft(branchReal, branchImag)
+
+            -- When oversampled, odd channels alternate sign every output,
+            -- since each output advances their mixer by half a cycle.
+            local flipOdd = oversampled and (bit.band(outputCount, 1) == 1)
+            local outputIndex = 2 * (done + n)
+            for channel = 0, numChannels-1
+            do
+                local sign = (flipOdd and (bit.band(channel, 1) == 1)) and -1.0 or 1.0
+                outputs[channel][outputIndex] = branchReal[channel] * sign
+                outputs[channel][outputIndex + 1] = branchImag[channel] * sign
+            end
+
+            outputCount = outputCount + 1
+        end
+
+        -- The source is always ahead of the destination, so copying forward
+        -- is safe.
+        for i = 0, historyLength-1
+        do
+            historyReal[i] = historyReal[i + tileInputs]
+            historyImag[i] = historyImag[i + tileInputs]
+        end
+
+        done = done + tileOutputs
+    end
+
+    inputElems[0] = numOutputs * decimation
+    for channel = 0, numChannels-1
+    do
+        outputElems[channel] = numOutputs
+    end
+end
+
+return Channelizer
+
+)";
+
+//
+// Utility code
+//
+
+static constexpr size_t DefaultTapsPerChannel = 8;
+
+// Hann-windowed sinc with its cutoff at the channel edges and unity gain at DC.
+static std::vector<double> getDefaultTaps(size_t numChannels)
+{
+    const auto numTaps = numChannels * DefaultTapsPerChannel;
+    const auto center = double(numTaps - 1) / 2.0;
+
+    std::vector<double> taps(numTaps);
+    double sum = 0.0;
+    for(size_t i = 0; i < numTaps; ++i)
+    {
+        const auto x = (double(i) - center) / double(numChannels);
+        const auto sinc = (x == 0.0) ? 1.0 : (std::sin(M_PI * x) / (M_PI * x));
+        const auto window = 0.5 - (0.5 * std::cos(2.0 * M_PI * double(i + 1) / double(numTaps + 1)));
+
+        taps[i] = sinc * window;
+        sum += taps[i];
+    }
+    for(auto& tap: taps) tap /= sum;
+
+    return taps;
+}
+
+//
+// Implementation
+//
+
+class LuaJITChannelizer: public LuaJITBlock
+{
+    public:
+        static Pothos::Block* make(
+            size_t numChannels,
+            size_t oversampling)
+        {
+            return new LuaJITChannelizer(numChannels, oversampling);
+        }
+
+        LuaJITChannelizer(
+            size_t numChannels,
+            size_t oversampling
+        ):
+            LuaJITBlock(
+                std::vector<std::string>{"complex_float32"},
+                std::vector<std::string>(numChannels, "complex_float32"),
+                false,
+                std::vector<std::string>{"minimal"}),
+            _numChannels(numChannels),
+            _decimation(0)
+        {
+            if((numChannels < 2) || (0 != (numChannels & (numChannels-1))))
+            {
+                throw Pothos::InvalidArgumentException("The number of channels must be a power of 2.");
+            }
+            if((1 != oversampling) && (2 != oversampling))
+            {
+                throw Pothos::InvalidArgumentException("Oversampling must be 1 (critically sampled) or 2.");
+            }
+
+            _decimation = numChannels / oversampling;
+
+            // Each output needs a full set of new inputs.
+            this->input(0)->setReserve(_decimation);
+
+            this->setSource(ChannelizerScript, "work");
+            this->setVariableRate(true);
+            this->setTaps({});
+
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITChannelizer, setTaps));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITChannelizer, getTaps));
+        }
+
+        virtual ~LuaJITChannelizer() = default;
+
+        // If empty, the default taps are used.
+        void setTaps(const std::vector<double>& newTaps)
+        {
+            const auto taps = newTaps.empty() ? getDefaultTaps(_numChannels) : newTaps;
+            if(0 != (taps.size() % _numChannels))
+            {
+                throw Pothos::InvalidArgumentException("The number of taps must be a non-zero multiple of the number of channels.");
+            }
+
+            // Channelizers with the same taps share the polyphase
+            // arrangement. The key holds the taps' bytes, in hex, so only
+            // identical taps can match.
+            const auto* tapsBytes = reinterpret_cast<const std::uint8_t*>(taps.data());
+            const Poco::DigestEngine::Digest tapsDigest(tapsBytes, tapsBytes + (taps.size() * sizeof(double)));
+            const auto tapsKey = std::to_string(_numChannels)+"/"+Poco::DigestEngine::digestToHex(tapsDigest);
+
+            this->callUserFunction("configure", _numChannels, _decimation, sol::as_table(taps), tapsKey);
+            _taps = taps;
+        }
+
+        std::vector<double> getTaps() const
+        {
+            return _taps;
+        }
+
+        void activate() override
+        {
+            this->callUserFunction("reset");
+            LuaJITBlock::activate();
+        }
+
+    private:
+        size_t _numChannels;
+        size_t _decimation;
+        std::vector<double> _taps;
+};
+
+//
+// Registration
+//
+
+/***********************************************************************
+ * |PothosDoc Channelizer (LuaJIT)
+ *
+ * A polyphase filter-bank channelizer, which splits its input into
+ * <b>Channels</b> equally spaced channels, one per output. Channel <i>c</i>
+ * is centered at <i>c / Channels</i> of the input sample rate (channels in
+ * the upper half are the negative frequencies), and is filtered by the
+ * prototype filter and decimated.
+ *
+ * The polyphase taps and FFT plan are shared between all channelizers with the
+ * same configuration.
+ *
+ * |category /LuaJIT/Channelizers
+ * |keywords pfb polyphase filter bank fft
+ *
+ * |param numChannels[Channels] The number of channels, which must be a power of 2.
+ * |default 8
+ *
+ * |param oversampling[Oversampling]
+ * The output rate of each channel, relative to the channel spacing.
+ * When oversampled, each channel's output has twice the channel spacing's
+ * bandwidth, so signals near the channel edges aren't lost.
+ * |default 1
+ * |option [Critically Sampled] 1
+ * |option [2x Oversampled] 2
+ *
+ * |param taps[Taps]
+ * The prototype low-pass filter, whose length must be a multiple of the
+ * number of channels. If empty, a windowed sinc with 8 taps per channel is
+ * used.
+ * |default []
+ * |preview disable
+ *
+ * |factory /luajit/channelizer(numChannels, oversampling)
+ * |setter setTaps(taps)
+ */
+static Pothos::BlockRegistry registerLuaJITChannelizer(
+    "/luajit/channelizer",
+    Pothos::Callable(&LuaJITChannelizer::make));
@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: MIT
 
 #include "LuaJITBlock.hpp"
+#include "LuaJITDocCache.hpp"
 
 #include <Pothos/Callable.hpp>
 #include <Pothos/Exception.hpp>
@@ -9,17 +10,46 @@
 #include <Pothos/Object.hpp>
 #include <Pothos/Plugin.hpp>
 #include <Pothos/Proxy.hpp>
+#include <Pothos/System/Paths.hpp>
+#include <Pothos/System/Version.hpp>
 #include <Pothos/Util/BlockDescription.hpp>
 
+#include <Poco/DigestEngine.h>
 #include <Poco/File.h>
+#include <Poco/NumberFormatter.h>
+#include <Poco/NumberParser.h>
 #include <Poco/Path.h>
+#include <Poco/Process.h>
+#include <Poco/SHA1Engine.h>
 #include <Poco/StringTokenizer.h>
 
 #include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iterator>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+static constexpr size_t DefaultBenchChunkSize = 4096;
+static constexpr size_t DefaultBenchIterations = 100;
+static const std::vector<std::string> BenchInputDistributions = {"uniform", "normal", "ramp"};
+
+// Optional benchmark parameters, so every factory is benchmarked the same way.
+struct BenchArgs
+{
+    std::vector<size_t> chunkSizes;
+    std::string inputDistribution;
+    size_t iterations;
+};
+
 struct FactoryArgs
 {
     std::string factory;
@@ -29,15 +59,34 @@ struct FactoryArgs
     std::vector<std::string> inputTypes;
     std::vector<std::string> outputTypes;
     std::vector<std::string> preloadedLibraries;
+    std::vector<std::string> luaLibraries;
+    bool stateless;
+
+    BenchArgs benchArgs;
 };
 
-static Pothos::Object opaqueLuaJITBlockFactory(
+// This backdoor allows us to create the block without allowing the
+// source and preloaded libraries to be set post-construction, then
+// use our access to the block type to call it via the function itself.
+static Pothos::Callable getLuaJITBlockCallable()
+{
+    auto blockPlugin = Pothos::PluginRegistry::get("/blocks/blocks/luajit_block");
+
+    auto callable = blockPlugin.getObject().extract<Pothos::Callable>();
+    callable.unbind(2);
+    callable.unbind(3);
+
+    return callable;
+}
+
+// If no bytecode is given, the block compiles the source itself.
+static Pothos::Object makeLuaJITBlock(
+    const Pothos::Callable& callable,
     const FactoryArgs& factoryArgs,
+    const std::string& bytecode,
     const Pothos::Object* args,
     const size_t numArgs)
 {
-    auto blockPlugin = Pothos::PluginRegistry::get("/blocks/blocks/luajit_block");
-
     // The LuaJIT block takes in the input and output types, which are
     // provided by the configuration file. Theoretically, there should
     // be nothing extra passed in the args parameter, but incorporate
@@ -46,31 +95,142 @@ static Pothos::Object opaqueLuaJITBlockFactory(
     argsVector.emplace_back(factoryArgs.inputTypes);
     argsVector.emplace_back(factoryArgs.outputTypes);
     argsVector.emplace_back(false); // Disallow changing parameters after construction
-
-    // This backdoor allows us to create the block without allowing the
-    // source and preloaded libraries to be set post-construction, then
-    // use our access to the block type to call it via the function itself.
-    auto callable = blockPlugin.getObject().extract<Pothos::Callable>();
-    callable.unbind(2);
+    argsVector.emplace_back(factoryArgs.luaLibraries);
 
     auto luajitBlock = callable.opaqueCall(argsVector.data(), argsVector.size());
 
     luajitBlock.ref<Pothos::Block*>()->setName(factoryArgs.factory);
 
     // Pothos::Object::ref() doesn't allow pointer casts.
-    dynamic_cast<LuaJITBlock*>(luajitBlock.ref<Pothos::Block*>())->setSource(
-        factoryArgs.sourceFilepath,
-        factoryArgs.functionName);
+    auto* luajitBlockPtr = dynamic_cast<LuaJITBlock*>(luajitBlock.ref<Pothos::Block*>());
+
+    if(bytecode.empty())
+    {
+        luajitBlockPtr->setSource(
+            factoryArgs.sourceFilepath,
+            factoryArgs.functionName);
+    }
+    else
+    {
+        luajitBlockPtr->setCompiledSource(
+            factoryArgs.sourceFilepath,
+            bytecode,
+            factoryArgs.functionName);
+    }
 
     if(!factoryArgs.preloadedLibraries.empty())
     {
-        // Pothos::Object::ref() doesn't allow pointer casts.
-        dynamic_cast<LuaJITBlock*>(luajitBlock.ref<Pothos::Block*>())->setPreloadedLibraries(factoryArgs.preloadedLibraries);
+        luajitBlockPtr->setPreloadedLibraries(factoryArgs.preloadedLibraries);
     }
 
+    luajitBlockPtr->setStateless(factoryArgs.stateless);
+
     return luajitBlock;
 }
 
+static Pothos::Object opaqueLuaJITBlockFactory(
+    const FactoryArgs& factoryArgs,
+    const Pothos::Object* args,
+    const size_t numArgs)
+{
+    return makeLuaJITBlock(
+               getLuaJITBlockCallable(),
+               factoryArgs,
+               "",
+               args,
+               numArgs);
+}
+
+//
+// Bulk instantiation of conf-loaded blocks
+//
+
+static std::mutex& getFactoryArgsMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+static std::map<std::string, FactoryArgs>& getFactoryArgsMap()
+{
+    static std::map<std::string, FactoryArgs> factoryArgsMap;
+    return factoryArgsMap;
+}
+
+// Entries outlive their conf files' plugins, which are removed when the
+// module is unloaded, so drop any whose factory is gone. The caller must
+// hold the factory args mutex.
+static void pruneFactoryArgsMap()
+{
+    auto& factoryArgsMap = getFactoryArgsMap();
+    for(auto iter = factoryArgsMap.begin(); iter != factoryArgsMap.end();)
+    {
+        if(Pothos::PluginRegistry::exists("/blocks"+iter->first)) ++iter;
+        else iter = factoryArgsMap.erase(iter);
+    }
+}
+
+// Resolves the LuaJIT block factory and compiles the source once for all
+// instances, then creates the blocks in parallel.
+static std::vector<Pothos::Proxy> makeLuaJITBlocks(
+    const std::string& factory,
+    const size_t numBlocks)
+{
+    FactoryArgs factoryArgs;
+    {
+        std::lock_guard<std::mutex> lock(getFactoryArgsMutex());
+        pruneFactoryArgsMap();
+
+        const auto& factoryArgsMap = getFactoryArgsMap();
+        const auto factoryArgsIter = factoryArgsMap.find(Pothos::PluginPath(factory).toString());
+        if(factoryArgsIter == factoryArgsMap.end())
+        {
+            throw Pothos::NotFoundException("No conf-loaded LuaJIT factory: "+factory);
+        }
+
+        factoryArgs = factoryArgsIter->second;
+    }
+
+    const auto callable = getLuaJITBlockCallable();
+    const auto bytecode = LuaJITBlock::compileSource(factoryArgs.sourceFilepath);
+
+    // Each block has its own Lua state, so they can be initialized
+    // independently. Take ownership immediately so nothing leaks if
+    // any of them fail.
+    std::vector<std::shared_ptr<Pothos::Block>> blocks(numBlocks);
+    const size_t numThreads = std::min<size_t>(numBlocks, std::max<size_t>(1, std::thread::hardware_concurrency()));
+
+    std::vector<std::future<void>> futures;
+    for(size_t threadIndex = 0; threadIndex < numThreads; ++threadIndex)
+    {
+        futures.emplace_back(std::async(
+            std::launch::async,
+            [&, threadIndex]()
+            {
+                for(size_t i = threadIndex; i < numBlocks; i += numThreads)
+                {
+                    auto luajitBlock = makeLuaJITBlock(callable, factoryArgs, bytecode, nullptr, 0);
+                    blocks[i].reset(luajitBlock.extract<Pothos::Block*>());
+                }
+            }));
+    }
+    for(auto& future: futures) future.get();
+
+    auto env = Pothos::ProxyEnvironment::make("managed");
+
+    std::vector<Pothos::Proxy> blockProxies;
+    std::transform(
+        blocks.begin(),
+        blocks.end(),
+        std::back_inserter(blockProxies),
+        [&env](const std::shared_ptr<Pothos::Block>& block)
+        {
+            return env->makeProxy(block);
+        });
+
+    return blockProxies;
+}
+
 static std::vector<std::string> stringTokenizerToVector(const Poco::StringTokenizer& tokenizer)
 {
     std::vector<std::string> stdVector;
@@ -82,6 +242,267 @@ static std::vector<std::string> stringTokenizerToVector(const Poco::StringTokeni
     return stdVector;
 }
 
+//
+// Benchmarking conf-loaded blocks
+//
+
+// Fixed seed so every run sees the same inputs. Integer types get inputs
+// scaled to fit in the smallest integer type.
+static Pothos::BufferChunk getBenchInputs(
+    const Pothos::DType& dtype,
+    const std::string& distribution,
+    size_t numElements)
+{
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    std::normal_distribution<double> normal(0.0, 1.0 / 3.0);
+
+    const auto scale = dtype.isFloat() ? 1.0 : 127.0;
+    const auto numValues = numElements * dtype.dimension() * (dtype.isComplex() ? 2 : 1);
+
+    Pothos::BufferChunk values(
+        Pothos::DType(dtype.isComplex() ? "complex_float64" : "float64", dtype.dimension()),
+        numElements);
+    auto* valuesPtr = values.as<double*>();
+    for(size_t i = 0; i < numValues; ++i)
+    {
+        if(distribution == "normal")       valuesPtr[i] = normal(rng);
+        else if(distribution == "ramp")    valuesPtr[i] = (2.0 * i / numValues) - 1.0;
+        else                               valuesPtr[i] = uniform(rng);
+
+        valuesPtr[i] = std::max(-1.0, std::min(1.0, valuesPtr[i])) * scale;
+    }
+
+    return values.convert(dtype, numElements);
+}
+
+// Calls the block's function directly, so no scheduler overhead is included.
+static std::string benchLuaJITFactory(const FactoryArgs& factoryArgs)
+{
+    const auto luajitBlockObject = makeLuaJITBlock(getLuaJITBlockCallable(), factoryArgs, "", nullptr, 0);
+    std::unique_ptr<Pothos::Block> block(luajitBlockObject.extract<Pothos::Block*>());
+    auto* luajitBlock = dynamic_cast<LuaJITBlock*>(block.get());
+
+    const auto& benchArgs = factoryArgs.benchArgs;
+
+    // Activation loads the preloaded libraries the function may call.
+    luajitBlock->activate();
+
+    std::ostringstream results;
+    for(const auto chunkSize: benchArgs.chunkSizes)
+    {
+        std::vector<Pothos::BufferChunk> inputs;
+        std::vector<const void*> inputPointers;
+        for(const auto* input: luajitBlock->inputs())
+        {
+            inputs.emplace_back(getBenchInputs(input->dtype(), benchArgs.inputDistribution, chunkSize));
+            inputPointers.emplace_back(inputs.back().as<const void*>());
+        }
+
+        std::vector<Pothos::BufferChunk> outputs;
+        std::vector<void*> outputPointers;
+        for(const auto* output: luajitBlock->outputs())
+        {
+            outputs.emplace_back(output->dtype(), chunkSize);
+            outputPointers.emplace_back(outputs.back().as<void*>());
+        }
+
+        // Let the JIT compile the function before timing it.
+        luajitBlock->callFunction(inputPointers, outputPointers, chunkSize);
+
+        const auto start = std::chrono::steady_clock::now();
+        for(size_t iteration = 0; iteration < benchArgs.iterations; ++iteration)
+        {
+            luajitBlock->callFunction(inputPointers, outputPointers, chunkSize);
+        }
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+        const auto totalElems = double(chunkSize * benchArgs.iterations);
+        const auto nsPerElement = elapsed.count() / totalElems;
+
+        results << std::left << std::setw(40) << factoryArgs.factory
+                << std::right << std::setw(10) << chunkSize
+                << std::setw(10) << benchArgs.inputDistribution
+                << std::setw(12) << benchArgs.iterations
+                << std::fixed << std::setprecision(3)
+                << std::setw(12) << nsPerElement
+                << std::setw(12) << (1e3 / nsPerElement)
+                << std::endl;
+    }
+
+    luajitBlock->deactivate();
+
+    return results.str();
+}
+
+// Returns a plain-text table, sorted by factory, so results can be diffed
+// between releases.
+static std::string benchLuaJITFactories()
+{
+    std::map<std::string, FactoryArgs> factoryArgsMap;
+    {
+        std::lock_guard<std::mutex> lock(getFactoryArgsMutex());
+        pruneFactoryArgsMap();
+        factoryArgsMap = getFactoryArgsMap();
+    }
+
+    std::ostringstream table;
+    table << std::left << std::setw(40) << "Factory"
+          << std::right << std::setw(10) << "Chunk"
+          << std::setw(10) << "Input"
+          << std::setw(12) << "Iterations"
+          << std::setw(12) << "ns/elem"
+          << std::setw(12) << "Melem/s"
+          << std::endl;
+
+    for(const auto& factoryArgsPair: factoryArgsMap)
+    {
+        try
+        {
+            table << benchLuaJITFactory(factoryArgsPair.second);
+        }
+        catch(const Pothos::Exception& ex)
+        {
+            table << std::left << std::setw(40) << factoryArgsPair.first
+                  << " failed: " << ex.displayText() << std::endl;
+        }
+    }
+
+    return table.str();
+}
+
+//
+// Block documentation cache
+//
+
+// Bump this if the cached format changes.
+static const std::string DocCacheVersion = "1";
+
+static bool readFile(
+    const std::string& filepath,
+    std::string& contents)
+{
+    std::ifstream in(filepath.c_str(), std::ios::in | std::ios::binary);
+    if(!in) return false;
+
+    contents.assign(
+        std::istreambuf_iterator<char>(in),
+        std::istreambuf_iterator<char>());
+
+    return !in.bad();
+}
+
+static std::string getSHA1Hex(const std::vector<std::string>& fields)
+{
+    Poco::SHA1Engine sha1;
+    for(const auto& field: fields)
+    {
+        sha1.update(field);
+        sha1.update('\0');
+    }
+
+    return Poco::DigestEngine::digestToHex(sha1.digest());
+}
+
+std::string getDocCacheRoot()
+{
+    return Poco::Path(Pothos::System::getUserDataPath(), Poco::Path("luajit/doc_cache/")).toString();
+}
+
+// Entries from another cache format or Pothos version will never be read
+// again, so each combination gets its own directory, and the others are
+// removed.
+static std::string getDocCacheGeneration()
+{
+    return "v"+DocCacheVersion+"-"+getSHA1Hex({Pothos::System::getLibVersion()}).substr(0, 12);
+}
+
+static void pruneDocCache()
+{
+    static std::once_flag pruneOnce;
+    std::call_once(
+        pruneOnce,
+        []()
+        {
+            try
+            {
+                Poco::File docCacheRoot(getDocCacheRoot());
+                if(!docCacheRoot.exists()) return;
+
+                std::vector<Poco::File> entries;
+                docCacheRoot.list(entries);
+                for(auto& entry: entries)
+                {
+                    if(Poco::Path(entry.path()).getFileName() != getDocCacheGeneration()) entry.remove(true);
+                }
+            }
+            catch(const Poco::Exception&) {}
+        });
+}
+
+// The generated JSON depends on the factory path and the parser as well as
+// the doc source itself.
+std::string getDocCacheFilepath(
+    const std::string& docSource,
+    const std::string& factory)
+{
+    return Poco::Path(
+               Poco::Path(getDocCacheRoot()),
+               Poco::Path(getDocCacheGeneration()+"/"+getSHA1Hex({factory, docSource})+".json")).toString();
+}
+
+static std::string readDocSource(const std::string& docSourceFilepath)
+{
+    std::string docSource;
+    if(!readFile(docSourceFilepath, docSource))
+    {
+        throw Pothos::FileNotFoundException(docSourceFilepath);
+    }
+
+    return docSource;
+}
+
+// Parsing the docs is a notable part of startup for large kernel libraries,
+// so reuse the JSON from the last time this exact doc source was parsed.
+// The cache is only an optimization, so failing to write it isn't an error.
+static std::string getBlockDocsJSON(
+    const std::string& docSourceFilepath,
+    const std::string& factory)
+{
+    const auto docSource = readDocSource(docSourceFilepath);
+    const auto cacheFilepath = getDocCacheFilepath(docSource, factory);
+
+    std::string docsJSON;
+    if(readFile(cacheFilepath, docsJSON) && !docsJSON.empty()) return docsJSON;
+
+    Pothos::Util::BlockDescriptionParser parser;
+    parser.feedFilePath(docSourceFilepath);
+    docsJSON = parser.getJSONObject(factory);
+
+    try
+    {
+        pruneDocCache();
+        Poco::File(Poco::Path(cacheFilepath).parent()).createDirectories();
+
+        // Write to a process-specific file and rename it into place so
+        // concurrent loaders never see a partially written cache file.
+        Poco::File tempFile(cacheFilepath+"."+Poco::NumberFormatter::format(Poco::Process::id()));
+        {
+            std::ofstream out(tempFile.path().c_str(), std::ios::out | std::ios::binary);
+            out << docsJSON;
+        }
+        try {tempFile.renameTo(cacheFilepath);}
+        catch(const Poco::Exception&)
+        {
+            tempFile.remove();
+            throw;
+        }
+    }
+    catch(const Poco::Exception&) {}
+
+    return docsJSON;
+}
+
 static std::vector<Pothos::PluginPath> LuaJITConfLoader(const std::map<std::string, std::string>& config)
 {
     static const auto tokOptions = Poco::StringTokenizer::TOK_IGNORE_EMPTY | Poco::StringTokenizer::TOK_TRIM;
@@ -156,8 +577,52 @@ static std::vector<Pothos::PluginPath> LuaJITConfLoader(const std::map<std::stri
         factoryArgs.preloadedLibraries = stringTokenizerToVector(Poco::StringTokenizer(preloadedLibsIter->second, tokSep, tokOptions));
     }
 
-    Pothos::Util::BlockDescriptionParser parser;
-    parser.feedFilePath(docSourceFilepath);
+    // Conf-loaded kernels get a minimal Lua state unless they ask for more.
+    auto luaLibrariesIter = config.find("lua_libraries");
+    if(luaLibrariesIter != config.end())
+    {
+        factoryArgs.luaLibraries = stringTokenizerToVector(Poco::StringTokenizer(luaLibrariesIter->second, tokSep, tokOptions));
+    }
+    else factoryArgs.luaLibraries = {"minimal"};
+
+    auto statelessIter = config.find("stateless");
+    if(statelessIter != config.end())
+    {
+        factoryArgs.stateless = Poco::NumberParser::parseBool(statelessIter->second);
+    }
+    else factoryArgs.stateless = false;
+
+    auto benchChunkSizesIter = config.find("bench_chunk_sizes");
+    if(benchChunkSizesIter != config.end())
+    {
+        for(const auto& chunkSize: Poco::StringTokenizer(benchChunkSizesIter->second, tokSep, tokOptions))
+        {
+            factoryArgs.benchArgs.chunkSizes.emplace_back(Poco::NumberParser::parseUnsigned64(chunkSize));
+        }
+    }
+    else factoryArgs.benchArgs.chunkSizes = {DefaultBenchChunkSize};
+
+    auto benchInputDistributionIter = config.find("bench_input_distribution");
+    if(benchInputDistributionIter != config.end())
+    {
+        factoryArgs.benchArgs.inputDistribution = benchInputDistributionIter->second;
+        if(std::find(BenchInputDistributions.begin(), BenchInputDistributions.end(), factoryArgs.benchArgs.inputDistribution) == BenchInputDistributions.end())
+        {
+            throw Pothos::InvalidArgumentException("Invalid benchmark input distribution: "+factoryArgs.benchArgs.inputDistribution);
+        }
+    }
+    else factoryArgs.benchArgs.inputDistribution = BenchInputDistributions.front();
+
+    auto benchIterationsIter = config.find("bench_iterations");
+    if(benchIterationsIter != config.end())
+    {
+        factoryArgs.benchArgs.iterations = Poco::NumberParser::parseUnsigned64(benchIterationsIter->second);
+        if(0 == factoryArgs.benchArgs.iterations)
+        {
+            throw Pothos::InvalidArgumentException("Benchmark iterations must be positive.");
+        }
+    }
+    else factoryArgs.benchArgs.iterations = DefaultBenchIterations;
 
     //
     // Register all factory paths, using the parameters from the config file.
@@ -169,7 +634,13 @@ static std::vector<Pothos::PluginPath> LuaJITConfLoader(const std::map<std::stri
         blockFactory);
     Pothos::PluginRegistry::add(
         "/blocks/docs"+factoryArgs.factory,
-        parser.getJSONObject(factoryArgs.factory));
+        getBlockDocsJSON(docSourceFilepath, factoryArgs.factory));
+
+    // Only added once the factory exists, so pruning doesn't remove it.
+    {
+        std::lock_guard<std::mutex> lock(getFactoryArgsMutex());
+        getFactoryArgsMap()[factoryArgs.factory] = factoryArgs;
+    }
 
     return
     {
@@ -186,4 +657,12 @@ pothos_static_block(pothosRegisterLuaJITConfLoader)
     Pothos::PluginRegistry::addCall(
         "/framework/conf_loader/luajit",
         &LuaJITConfLoader);
+
+    Pothos::PluginRegistry::addCall(
+        "/luajit/make_blocks",
+        &makeLuaJITBlocks);
+
+    Pothos::PluginRegistry::addCall(
+        "/luajit/bench/conf_factories",
+        &benchLuaJITFactories);
 }
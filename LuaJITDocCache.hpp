@@ -0,0 +1,16 @@
+// Copyright (c) 2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <string>
+
+// Where the JSON generated from conf-loaded blocks' docs is cached, under
+// the Pothos user data directory
+std::string getDocCacheRoot();
+
+// The cache file for the JSON generated from the given doc source's
+// contents for the given factory path
+std::string getDocCacheFilepath(
+    const std::string& docSource,
+    const std::string& factory);
@@ -0,0 +1,555 @@
+// Copyright (c) 2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#include "LuaJITBlock.hpp"
+
+#include <Pothos/Exception.hpp>
+#include <Pothos/Framework.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <string>
+#include <vector>
+
+//
+// Embedded Lua
+//
+
+static const std::string EqualizerScript = R"(
+
+local ffi = require("ffi")
+
+local Equalizer = {}
+
+-- Outputs computed per pass over the history buffer
+local TileOutputs = 256
+
+-- Keeps NLMS from dividing by zero on silence
+local NLMSEpsilon = 1e-6
+
+local numTaps = 0
+local decimation = 1
+local stepSize = 0.0
+local blockSize = 1
+local modulus = 1.0
+
+-- The weights, and their accumulated update for this block
+local weightsReal = nil
+local weightsImag = nil
+local gradientReal = nil
+local gradientImag = nil
+local blockCount = 0
+
+-- The last numTaps-1 inputs, followed by a tile of new inputs
+local historyReal = nil
+local historyImag = nil
+
+-- The tile's outputs, before adaptation
+local outputReal = ffi.new("double[?]", TileOutputs)
+local outputImag = ffi.new("double[?]", TileOutputs)
+
+local numPoints = 0
+local pointsReal = nil
+local pointsImag = nil
+
+-- Filters outputs [first, first+count) of the tile with the current weights.
+local function filter(first, count)
+    for n = first, first+count-1
+    do
+        local newest = (numTaps - 1) + ((n + 1) * decimation) - 1
+        local accReal = 0.0
+        local accImag = 0.0
+        for k = 0, numTaps-1
+        do
+            local xReal = historyReal[newest - k]
+            local xImag = historyImag[newest - k]
+            accReal = accReal + (weightsReal[k] * xReal) - (weightsImag[k] * xImag)
+            accImag = accImag + (weightsReal[k] * xImag) + (weightsImag[k] * xReal)
+        end
+        outputReal[n] = accReal
+        outputImag[n] = accImag
+    end
+end
+
+-- Returns the constellation point nearest to the given output.
+local function decide(real, imag)
+    local bestReal = pointsReal[0]
+    local bestImag = pointsImag[0]
+    local bestDistance = math.huge
+    for i = 0, numPoints-1
+    do
+        local diffReal = real - pointsReal[i]
+        local diffImag = imag - pointsImag[i]
+        local distance = (diffReal * diffReal) + (diffImag * diffImag)
+        if distance < bestDistance
+        then
+            bestReal = pointsReal[i]
+            bestImag = pointsImag[i]
+            bestDistance = distance
+        end
+    end
+
+    return bestReal, bestImag
+end
+
+local function decisionError(real, imag)
+    local decisionReal, decisionImag = decide(real, imag)
+    return (decisionReal - real), (decisionImag - imag)
+end
+
+local function constantModulusError(real, imag)
+    local scale = modulus - ((real * real) + (imag * imag))
+    return (real * scale), (imag * scale)
+end
+
+-- Adds error * conj(x) for outputs [first, first+count) to the gradient,
+-- optionally normalized by each output's input energy.
+local function accumulate(errorFcn, normalize, first, count)
+    for n = first, first+count-1
+    do
+        local newest = (numTaps - 1) + ((n + 1) * decimation) - 1
+        local errReal, errImag = errorFcn(outputReal[n], outputImag[n])
+
+        if normalize
+        then
+            local energy = NLMSEpsilon
+            for k = 0, numTaps-1
+            do
+                local xReal = historyReal[newest - k]
+                local xImag = historyImag[newest - k]
+                energy = energy + (xReal * xReal) + (xImag * xImag)
+            end
+            errReal = errReal / energy
+            errImag = errImag / energy
+        end
+
+        for k = 0, numTaps-1
+        do
+            local xReal = historyReal[newest - k]
+            local xImag = historyImag[newest - k]
+            gradientReal[k] = gradientReal[k] + (errReal * xReal) + (errImag * xImag)
+            gradientImag[k] = gradientImag[k] + (errImag * xReal) - (errReal * xImag)
+        end
+    end
+end
+
+-- The gradient is summed, not averaged, over the block, so a step size
+-- adapts about as fast for any block size.
+local function applyGradient()
+    for k = 0, numTaps-1
+    do
+        weightsReal[k] = weightsReal[k] + (stepSize * gradientReal[k])
+        weightsImag[k] = weightsImag[k] + (stepSize * gradientImag[k])
+        gradientReal[k] = 0.0
+        gradientImag[k] = 0.0
+    end
+end
+
+-- Within a block, the weights are fixed, so each block's outputs are
+-- filtered in one pass before any of them are adapted on.
+local function equalize(errorFcn, normalize, buffsIn, buffsOut, inputElems, outputElems)
+    local input = ffi.cast("float*", buffsIn[0])
+    local output = ffi.cast("float*", buffsOut[0])
+
+    local numOutputs = math.min(math.floor(tonumber(inputElems[0]) / decimation), tonumber(outputElems[0]))
+    local historyLength = numTaps - 1
+
+    local done = 0
+    while done < numOutputs
+    do
+        local tileOutputs = math.min(TileOutputs, numOutputs - done)
+        local tileInputs = tileOutputs * decimation
+
+        local inputOffset = 2 * done * decimation
+        for i = 0, tileInputs-1
+        do
+            historyReal[historyLength + i] = input[inputOffset + (2*i)]
+            historyImag[historyLength + i] = input[inputOffset + (2*i) + 1]
+        end
+
+        local n = 0
+        while n < tileOutputs
+        do
+            local count = math.min(tileOutputs - n, blockSize - blockCount)
+            filter(n, count)
+            accumulate(errorFcn, normalize, n, count)
+
+            blockCount = blockCount + count
+            if blockCount == blockSize
+            then
+                applyGradient()
+                blockCount = 0
+            end
+
+            n = n + count
+        end
+
+        for i = 0, tileOutputs-1
+        do
+            output[2 * (done + i)] = outputReal[i]
+            output[(2 * (done + i)) + 1] = outputImag[i]
+        end
+
+        -- The source is always ahead of the destination, so copying forward
+        -- is safe.
+        for i = 0, historyLength-1
+        do
+            historyReal[i] = historyReal[i + tileInputs]
+            historyImag[i] = historyImag[i + tileInputs]
+        end
+
+        done = done + tileOutputs
+    end
+
+    inputElems[0] = numOutputs * decimation
+    outputElems[0] = numOutputs
+end
+
+function Equalizer.lms(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems, inputElems, outputElems)
+    equalize(decisionError, false, buffsIn, buffsOut, inputElems, outputElems)
+end
+
+function Equalizer.nlms(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems, inputElems, outputElems)
+    equalize(decisionError, true, buffsIn, buffsOut, inputElems, outputElems)
+end
+
+function Equalizer.cma(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems, inputElems, outputElems)
+    equalize(constantModulusError, false, buffsIn, buffsOut, inputElems, outputElems)
+end
+
+-- tapsTable holds interleaved real and imaginary weights.
+function Equalizer.setTaps(tapsTable)
+    numTaps = #tapsTable / 2
+
+    weightsReal = ffi.new("double[?]", numTaps)
+    weightsImag = ffi.new("double[?]", numTaps)
+    gradientReal = ffi.new("double[?]", numTaps)
+    gradientImag = ffi.new("double[?]", numTaps)
+    for k = 0, numTaps-1
+    do
+        weightsReal[k] = tapsTable[(2*k) + 1]
+        weightsImag[k] = tapsTable[(2*k) + 2]
+    end
+    blockCount = 0
+
+    historyReal = ffi.new("double[?]", (numTaps - 1) + (TileOutputs * decimation))
+    historyImag = ffi.new("double[?]", (numTaps - 1) + (TileOutputs * decimation))
+end
+
+function Equalizer.getTaps()
+    local tapsTable = {}
+    for k = 0, numTaps-1
+    do
+        tapsTable[(2*k) + 1] = weightsReal[k]
+        tapsTable[(2*k) + 2] = weightsImag[k]
+    end
+
+    return tapsTable
+end
+
+-- pointsTable holds interleaved real and imaginary constellation points.
+function Equalizer.setConstellation(pointsTable)
+    numPoints = #pointsTable / 2
+
+    pointsReal = ffi.new("double[?]", numPoints)
+    pointsImag = ffi.new("double[?]", numPoints)
+    for i = 0, numPoints-1
+    do
+        pointsReal[i] = pointsTable[(2*i) + 1]
+        pointsImag[i] = pointsTable[(2*i) + 2]
+    end
+end
+
+function Equalizer.configure(newDecimation, newStepSize, newBlockSize, newModulus)
+    decimation = newDecimation
+    stepSize = newStepSize
+    modulus = newModulus
+
+    -- Apply what's accumulated so far, so the new block size starts clean.
+    if (gradientReal ~= nil) and (blockCount > 0)
+    then
+        applyGradient()
+    end
+    blockSize = newBlockSize
+    blockCount = 0
+end
+
+function Equalizer.reset()
+    ffi.fill(historyReal, ffi.sizeof(historyReal))
+    ffi.fill(historyImag, ffi.sizeof(historyImag))
+end
+
+return Equalizer
+
+)";
+
+//
+// Utility code
+//
+
+static constexpr double DefaultStepSize = 0.01;
+
+static const std::vector<std::string> EqualizerAlgorithms = {"lms", "nlms", "cma"};
+
+static std::vector<std::complex<double>> getDefaultConstellation()
+{
+    const auto scale = 1.0 / std::sqrt(2.0);
+    return
+    {
+        { scale,  scale},
+        { scale, -scale},
+        {-scale,  scale},
+        {-scale, -scale}
+    };
+}
+
+static std::vector<double> interleave(const std::vector<std::complex<double>>& values)
+{
+    std::vector<double> interleaved;
+    for(const auto& value: values)
+    {
+        interleaved.emplace_back(value.real());
+        interleaved.emplace_back(value.imag());
+    }
+
+    return interleaved;
+}
+
+//
+// Implementation
+//
+
+class LuaJITEqualizer: public LuaJITBlock
+{
+    public:
+        static Pothos::Block* make(
+            const std::string& algorithm,
+            size_t numTaps,
+            size_t decimation)
+        {
+            return new LuaJITEqualizer(algorithm, numTaps, decimation);
+        }
+
+        LuaJITEqualizer(
+            const std::string& algorithm,
+            size_t numTaps,
+            size_t decimation
+        ):
+            LuaJITBlock(
+                std::vector<std::string>{"complex_float32"},
+                std::vector<std::string>{"complex_float32"},
+                false,
+                std::vector<std::string>{"minimal"}),
+            _decimation(decimation),
+            _stepSize(DefaultStepSize),
+            _blockSize(1),
+            _modulus(1.0)
+        {
+            if(EqualizerAlgorithms.end() == std::find(EqualizerAlgorithms.begin(), EqualizerAlgorithms.end(), algorithm))
+            {
+                throw Pothos::InvalidArgumentException("Invalid equalizer algorithm: "+algorithm);
+            }
+            if(0 == numTaps)
+            {
+                throw Pothos::InvalidArgumentException("The equalizer needs at least one tap.");
+            }
+            if(0 == decimation)
+            {
+                throw Pothos::InvalidArgumentException("Decimation must be positive.");
+            }
+
+            this->setSource(EqualizerScript, algorithm);
+            this->setVariableRate(true);
+            this->configure();
+            this->setConstellation(getDefaultConstellation());
+
+            // Start as a pass-through, delayed to the middle tap.
+            std::vector<std::complex<double>> taps(numTaps);
+            taps[numTaps / 2] = 1.0;
+            this->setTaps(taps);
+
+            this->input(0)->setReserve(_decimation);
+
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITEqualizer, setStepSize));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITEqualizer, getStepSize));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITEqualizer, setBlockSize));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITEqualizer, getBlockSize));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITEqualizer, setModulus));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITEqualizer, getModulus));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITEqualizer, setConstellation));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITEqualizer, getConstellation));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITEqualizer, setTaps));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITEqualizer, getTaps));
+            this->registerProbe("getTaps");
+        }
+
+        virtual ~LuaJITEqualizer() = default;
+
+        void setStepSize(double stepSize)
+        {
+            if(stepSize < 0.0)
+            {
+                throw Pothos::RangeException("Step size can't be negative.");
+            }
+
+            _stepSize = stepSize;
+            this->configure();
+        }
+
+        double getStepSize() const
+        {
+            return _stepSize;
+        }
+
+        // The number of outputs between weight updates
+        void setBlockSize(size_t blockSize)
+        {
+            if(0 == blockSize)
+            {
+                throw Pothos::RangeException("Block size must be positive.");
+            }
+
+            _blockSize = blockSize;
+            this->configure();
+        }
+
+        size_t getBlockSize() const
+        {
+            return _blockSize;
+        }
+
+        // The squared modulus CMA drives outputs toward
+        void setModulus(double modulus)
+        {
+            if(modulus <= 0.0)
+            {
+                throw Pothos::RangeException("Modulus must be positive.");
+            }
+
+            _modulus = modulus;
+            this->configure();
+        }
+
+        double getModulus() const
+        {
+            return _modulus;
+        }
+
+        // The points LMS and NLMS decide between
+        void setConstellation(const std::vector<std::complex<double>>& constellation)
+        {
+            if(constellation.empty())
+            {
+                throw Pothos::InvalidArgumentException("The constellation can't be empty.");
+            }
+
+            this->callUserFunction("setConstellation", sol::as_table(interleave(constellation)));
+            _constellation = constellation;
+        }
+
+        std::vector<std::complex<double>> getConstellation() const
+        {
+            return _constellation;
+        }
+
+        // Restarts adaptation from the given weights, which can also change
+        // the number of taps.
+        void setTaps(const std::vector<std::complex<double>>& taps)
+        {
+            if(taps.empty())
+            {
+                throw Pothos::InvalidArgumentException("The equalizer needs at least one tap.");
+            }
+
+            this->callUserFunction("setTaps", sol::as_table(interleave(taps)));
+        }
+
+        std::vector<std::complex<double>> getTaps()
+        {
+            const auto interleaved = this->callUserFunction<std::vector<double>>("getTaps");
+
+            std::vector<std::complex<double>> taps;
+            for(size_t i = 0; (i+1) < interleaved.size(); i += 2)
+            {
+                taps.emplace_back(interleaved[i], interleaved[i+1]);
+            }
+
+            return taps;
+        }
+
+        void activate() override
+        {
+            this->callUserFunction("reset");
+            LuaJITBlock::activate();
+        }
+
+    private:
+        size_t _decimation;
+        double _stepSize;
+        size_t _blockSize;
+        double _modulus;
+        std::vector<std::complex<double>> _constellation;
+
+        void configure()
+        {
+            this->callUserFunction("configure", _decimation, _stepSize, _blockSize, _modulus);
+        }
+};
+
+//
+// Registration
+//
+
+/***********************************************************************
+ * |PothosDoc Equalizer (LuaJIT)
+ *
+ * An adaptive FIR equalizer for complex streams. Its weights start as a
+ * pass-through, and adapt to minimize the error chosen by <b>Algorithm</b>.
+ *
+ * With a <b>Block Size</b> above 1, the weights are only updated once per block
+ * of outputs (block LMS), from the sum of the block's gradients. Within a block,
+ * the weights are fixed, so its outputs are filtered as plain dot products,
+ * which is faster and converges at about the same rate for small blocks.
+ *
+ * |category /LuaJIT/Equalizers
+ * |keywords lms nlms cma adaptive filter block
+ *
+ * |param algorithm[Algorithm]
+ * <ul>
+ * <li><b>LMS</b>: least mean squares, against the nearest constellation point</li>
+ * <li><b>NLMS</b>: LMS, normalized by the input's energy across the taps</li>
+ * <li><b>CMA</b>: constant modulus, which needs no decisions, but leaves a phase ambiguity</li>
+ * </ul>
+ * |default "lms"
+ * |option [LMS] "lms"
+ * |option [NLMS] "nlms"
+ * |option [CMA] "cma"
+ *
+ * |param numTaps[Num Taps]
+ * |default 11
+ *
+ * |param decimation[Decimation] Inputs per output, such as 2 for a fractionally spaced equalizer.
+ * |default 1
+ *
+ * |param stepSize[Step Size]
+ * |default 0.01
+ *
+ * |param blockSize[Block Size] Outputs per weight update.
+ * |default 1
+ *
+ * |param modulus[Modulus] The squared output magnitude CMA adapts toward.
+ * |default 1.0
+ *
+ * |param constellation[Constellation] The symbols LMS and NLMS decide between.
+ * |default [0.7071+0.7071j, 0.7071-0.7071j, -0.7071+0.7071j, -0.7071-0.7071j]
+ *
+ * |factory /luajit/equalizer(algorithm, numTaps, decimation)
+ * |setter setStepSize(stepSize)
+ * |setter setBlockSize(blockSize)
+ * |setter setModulus(modulus)
+ * |setter setConstellation(constellation)
+ */
+static Pothos::BlockRegistry registerLuaJITEqualizer(
+    "/luajit/equalizer",
+    Pothos::Callable(&LuaJITEqualizer::make));
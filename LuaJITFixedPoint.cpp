@@ -0,0 +1,478 @@
+// Copyright (c) 2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#include "LuaJITBlock.hpp"
+
+#include <Pothos/Exception.hpp>
+#include <Pothos/Framework.hpp>
+
+#include <cmath>
+#include <complex>
+#include <string>
+#include <vector>
+
+//
+// Embedded Lua
+//
+
+static const std::string FixedPointScript = R"(
+
+local ffi = require("ffi")
+
+local FixedPoint = {}
+
+local Int64 = ffi.typeof("int64_t")
+
+local IntPtrTypes =
+{
+    [16] = ffi.typeof("int16_t*"),
+    [32] = ffi.typeof("int32_t*"),
+}
+
+local inputPtrType = nil
+local outputPtrType = nil
+
+-- All arithmetic is on 64-bit integers, which the JIT keeps unboxed in
+-- registers. These only overflow for a complex int32 product with every
+-- component at -2^31.
+local shift = 0
+local roundOffset = Int64(0)
+local outputMin = Int64(0)
+local outputMax = Int64(0)
+
+local gainReal = 0
+local gainImag = 0
+local decimation = 1
+
+-- The sum so far, and its number of inputs, for a decimation that spans calls
+local accReal = Int64(0)
+local accImag = Int64(0)
+local accCount = 0
+
+--
+-- Rounding and saturation
+--
+-- Values are rounded half up: the offset is added before the arithmetic
+-- shift right.
+--
+
+local function saturate(value)
+    if value > outputMax then return outputMax end
+    if value < outputMin then return outputMin end
+    return value
+end
+
+local function roundShift(value)
+    return bit.arshift(value + roundOffset, shift)
+end
+
+-- Returns a*b, rounded, shifted, and saturated.
+local function complexMultiply(ar, ai, br, bi)
+    local real = (Int64(ar) * br) - (Int64(ai) * bi)
+    local imag = (Int64(ar) * bi) + (Int64(ai) * br)
+    return saturate(roundShift(real)), saturate(roundShift(imag))
+end
+
+--
+-- Kernels
+--
+
+function FixedPoint.multiply(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    local input0 = ffi.cast(inputPtrType, buffsIn[0])
+    local input1 = ffi.cast(inputPtrType, buffsIn[1])
+    local output = ffi.cast(outputPtrType, buffsOut[0])
+
+    for i = 0, elems-1
+    do
+        output[2*i], output[(2*i)+1] = complexMultiply(
+            input0[2*i], input0[(2*i)+1],
+            input1[2*i], input1[(2*i)+1])
+    end
+end
+
+function FixedPoint.scale(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    local input = ffi.cast(inputPtrType, buffsIn[0])
+    local output = ffi.cast(outputPtrType, buffsOut[0])
+
+    for i = 0, elems-1
+    do
+        output[2*i], output[(2*i)+1] = complexMultiply(input[2*i], input[(2*i)+1], gainReal, gainImag)
+    end
+end
+
+function FixedPoint.accumulate(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems, inputElems, outputElems)
+    local input = ffi.cast(inputPtrType, buffsIn[0])
+    local output = ffi.cast(outputPtrType, buffsOut[0])
+
+    local numInputs = tonumber(inputElems[0])
+    local outputSpace = tonumber(outputElems[0])
+
+    local real = accReal
+    local imag = accImag
+    local count = accCount
+
+    local i = 0
+    local numOutputs = 0
+    while (i < numInputs) and (numOutputs < outputSpace)
+    do
+        local last = math.min(numInputs, i + (decimation - count))
+        for j = i, last-1
+        do
+            real = real + input[2*j]
+            imag = imag + input[(2*j)+1]
+        end
+        count = count + (last - i)
+        i = last
+
+        if count == decimation
+        then
+            output[2*numOutputs] = saturate(roundShift(real))
+            output[(2*numOutputs)+1] = saturate(roundShift(imag))
+            numOutputs = numOutputs + 1
+
+            real = Int64(0)
+            imag = Int64(0)
+            count = 0
+        end
+    end
+
+    accReal = real
+    accImag = imag
+    accCount = count
+
+    inputElems[0] = i
+    outputElems[0] = numOutputs
+end
+
+function FixedPoint.roundSaturate(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    local input = ffi.cast(inputPtrType, buffsIn[0])
+    local output = ffi.cast(outputPtrType, buffsOut[0])
+
+    for i = 0, (2*elems)-1
+    do
+        output[i] = saturate(roundShift(input[i]))
+    end
+end
+
+-- Bit widths are 16 or 32, and the gain is in units of 2^-shift.
+function FixedPoint.configure(inputBits, outputBits, newShift, newGainReal, newGainImag, newDecimation)
+    inputPtrType = IntPtrTypes[inputBits]
+    outputPtrType = IntPtrTypes[outputBits]
+
+    shift = newShift
+    roundOffset = (shift > 0) and bit.lshift(Int64(1), shift - 1) or Int64(0)
+
+    outputMax = bit.lshift(Int64(1), outputBits - 1) - 1
+    outputMin = -bit.lshift(Int64(1), outputBits - 1)
+
+    gainReal = newGainReal
+    gainImag = newGainImag
+    decimation = newDecimation
+end
+
+function FixedPoint.reset()
+    accReal = Int64(0)
+    accImag = Int64(0)
+    accCount = 0
+end
+
+return FixedPoint
+
+)";
+
+//
+// Utility code
+//
+
+static size_t getFixedPointBits(const Pothos::DType& dtype)
+{
+    if(dtype == Pothos::DType("complex_int16")) return 16;
+    if(dtype == Pothos::DType("complex_int32")) return 32;
+
+    throw Pothos::InvalidArgumentException("Fixed-point kernels require complex_int16 or complex_int32, not "+dtype.name());
+}
+
+// The largest shift that leaves a rounding offset in 64 bits
+static constexpr size_t MaxShift = 62;
+
+//
+// Implementation
+//
+
+class LuaJITFixedPoint: public LuaJITBlock
+{
+    public:
+        static Pothos::Block* makeMultiply(const Pothos::DType& dtype)
+        {
+            const auto bits = getFixedPointBits(dtype);
+            return new LuaJITFixedPoint("multiply", {dtype, dtype}, dtype, bits-1, 1);
+        }
+
+        static Pothos::Block* makeScale(const Pothos::DType& dtype)
+        {
+            const auto bits = getFixedPointBits(dtype);
+            return new LuaJITFixedPoint("scale", {dtype}, dtype, bits-1, 1);
+        }
+
+        static Pothos::Block* makeAccumulate(
+            const Pothos::DType& inputDType,
+            const Pothos::DType& outputDType,
+            size_t decimation)
+        {
+            if(0 == decimation)
+            {
+                throw Pothos::RangeException("Decimation must be positive.");
+            }
+
+            return new LuaJITFixedPoint("accumulate", {inputDType}, outputDType, 0, decimation);
+        }
+
+        static Pothos::Block* makeRoundSaturate(
+            const Pothos::DType& inputDType,
+            const Pothos::DType& outputDType)
+        {
+            const auto inputBits = getFixedPointBits(inputDType);
+            const auto outputBits = getFixedPointBits(outputDType);
+            const auto shift = (inputBits > outputBits) ? (inputBits - outputBits) : 0;
+
+            return new LuaJITFixedPoint("roundSaturate", {inputDType}, outputDType, shift, 1);
+        }
+
+        LuaJITFixedPoint(
+            const std::string& operation,
+            const std::vector<Pothos::DType>& inputDTypes,
+            const Pothos::DType& outputDType,
+            size_t shift,
+            size_t decimation
+        ):
+            LuaJITBlock(
+                std::vector<std::string>(inputDTypes.size(), inputDTypes[0].name()),
+                std::vector<std::string>{outputDType.name()},
+                false,
+                std::vector<std::string>{"minimal"}),
+            _inputBits(getFixedPointBits(inputDTypes[0])),
+            _outputBits(getFixedPointBits(outputDType)),
+            _defaultShift(shift),
+            _shift(shift),
+            _gain(1.0),
+            _decimation(decimation)
+        {
+            this->setSource(FixedPointScript, operation);
+
+            // accumulate() always reports how much it consumed and
+            // produced, even when every input is output.
+            if("accumulate" == operation) this->setVariableRate(true);
+            this->configure();
+
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITFixedPoint, setShift));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITFixedPoint, getShift));
+            if("scale" == operation)
+            {
+                this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITFixedPoint, setGain));
+                this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITFixedPoint, getGain));
+            }
+        }
+
+        virtual ~LuaJITFixedPoint() = default;
+
+        // How far results are shifted right, with rounding, before
+        // saturating. A negative shift restores the types' default.
+        void setShift(int shift)
+        {
+            if(shift > int(MaxShift))
+            {
+                throw Pothos::RangeException("Shift must be at most "+std::to_string(MaxShift)+".");
+            }
+
+            _shift = (shift < 0) ? _defaultShift : size_t(shift);
+            this->configure();
+        }
+
+        size_t getShift() const
+        {
+            return _shift;
+        }
+
+        // Quantized to units of 2^-shift
+        void setGain(const std::complex<double>& gain)
+        {
+            _gain = gain;
+            this->configure();
+        }
+
+        std::complex<double> getGain() const
+        {
+            return _gain;
+        }
+
+        void activate() override
+        {
+            this->callUserFunction("reset");
+            LuaJITBlock::activate();
+        }
+
+    private:
+        size_t _inputBits;
+        size_t _outputBits;
+        size_t _defaultShift;
+        size_t _shift;
+        std::complex<double> _gain;
+        size_t _decimation;
+
+        void configure()
+        {
+            const auto gainScale = std::ldexp(1.0, int(_shift));
+            const auto gainReal = std::round(_gain.real() * gainScale);
+            const auto gainImag = std::round(_gain.imag() * gainScale);
+
+            // Its products with 32-bit inputs have to fit in 64 bits. 2^31
+            // is allowed, so a gain of 1.0 works at a shift of 31.
+            constexpr double MaxGain = 2147483648.0;
+            if((std::abs(gainReal) > MaxGain) || (std::abs(gainImag) > MaxGain))
+            {
+                throw Pothos::RangeException("The gain is too large for this shift.");
+            }
+
+            this->callUserFunction(
+                "configure",
+                _inputBits,
+                _outputBits,
+                _shift,
+                gainReal,
+                gainImag,
+                _decimation);
+        }
+};
+
+//
+// Registration
+//
+
+/***********************************************************************
+ * |PothosDoc Fixed-Point Multiply (LuaJIT)
+ *
+ * Multiplies two complex integer streams. Each product is computed exactly,
+ * then shifted right by <b>Shift</b> bits, rounding half up, and saturated to
+ * the output type. The default shift treats both inputs as Q15 (or Q31)
+ * fractions, and a negative shift restores it.
+ *
+ * |category /LuaJIT/Fixed Point
+ * |keywords fixed point integer multiply mixer q15
+ *
+ * |param dtype[Data Type]
+ * |widget DTypeChooser(cint16=1,cint32=1)
+ * |default "complex_int16"
+ * |preview disable
+ *
+ * |param shift[Shift]
+ * |units bits
+ * |default -1
+ * |widget ComboBox(editable=true)
+ * |option [Type Default] -1
+ *
+ * |factory /luajit/fixed_multiply(dtype)
+ * |setter setShift(shift)
+ */
+static Pothos::BlockRegistry registerLuaJITFixedMultiply(
+    "/luajit/fixed_multiply",
+    Pothos::Callable(&LuaJITFixedPoint::makeMultiply));
+
+/***********************************************************************
+ * |PothosDoc Fixed-Point Scale (LuaJIT)
+ *
+ * Multiplies a complex integer stream by a constant gain, which is
+ * quantized to units of 2^-<b>Shift</b>. Each product is shifted right by
+ * <b>Shift</b> bits, rounding half up, and saturated. The default shift, or
+ * a negative one, is 15 for complex_int16 and 31 for complex_int32.
+ *
+ * |category /LuaJIT/Fixed Point
+ * |keywords fixed point integer scale gain
+ *
+ * |param dtype[Data Type]
+ * |widget DTypeChooser(cint16=1,cint32=1)
+ * |default "complex_int16"
+ * |preview disable
+ *
+ * |param gain[Gain]
+ * |default 1.0
+ *
+ * |param shift[Shift]
+ * |units bits
+ * |default -1
+ * |widget ComboBox(editable=true)
+ * |option [Type Default] -1
+ *
+ * |factory /luajit/fixed_scale(dtype)
+ * |setter setShift(shift)
+ * |setter setGain(gain)
+ */
+static Pothos::BlockRegistry registerLuaJITFixedScale(
+    "/luajit/fixed_scale",
+    Pothos::Callable(&LuaJITFixedPoint::makeScale));
+
+/***********************************************************************
+ * |PothosDoc Fixed-Point Accumulate (LuaJIT)
+ *
+ * Sums each <b>Decimation</b> consecutive complex integer inputs
+ * (integrate and dump) in 64 bits, then shifts the sum right by
+ * <b>Shift</b> bits, rounding half up, and saturates it to the output type.
+ *
+ * |category /LuaJIT/Fixed Point
+ * |keywords fixed point integer accumulate integrate dump decimate
+ *
+ * |param inputDType[Input Type]
+ * |widget DTypeChooser(cint16=1,cint32=1)
+ * |default "complex_int16"
+ * |preview disable
+ *
+ * |param outputDType[Output Type]
+ * |widget DTypeChooser(cint16=1,cint32=1)
+ * |default "complex_int32"
+ * |preview disable
+ *
+ * |param decimation[Decimation]
+ * |default 8
+ *
+ * |param shift[Shift]
+ * |units bits
+ * |default 0
+ *
+ * |factory /luajit/fixed_accumulate(inputDType, outputDType, decimation)
+ * |setter setShift(shift)
+ */
+static Pothos::BlockRegistry registerLuaJITFixedAccumulate(
+    "/luajit/fixed_accumulate",
+    Pothos::Callable(&LuaJITFixedPoint::makeAccumulate));
+
+/***********************************************************************
+ * |PothosDoc Fixed-Point Round/Saturate (LuaJIT)
+ *
+ * Shifts complex integers right by <b>Shift</b> bits, rounding half up, and
+ * saturates them to the output type. By default, or for a negative shift,
+ * the shift is the difference in width between the input and output types.
+ *
+ * |category /LuaJIT/Fixed Point
+ * |keywords fixed point integer round saturate narrow
+ *
+ * |param inputDType[Input Type]
+ * |widget DTypeChooser(cint16=1,cint32=1)
+ * |default "complex_int32"
+ * |preview disable
+ *
+ * |param outputDType[Output Type]
+ * |widget DTypeChooser(cint16=1,cint32=1)
+ * |default "complex_int16"
+ * |preview disable
+ *
+ * |param shift[Shift]
+ * |units bits
+ * |default -1
+ * |widget ComboBox(editable=true)
+ * |option [Type Default] -1
+ *
+ * |factory /luajit/fixed_round_saturate(inputDType, outputDType)
+ * |setter setShift(shift)
+ */
+static Pothos::BlockRegistry registerLuaJITFixedRoundSaturate(
+    "/luajit/fixed_round_saturate",
+    Pothos::Callable(&LuaJITFixedPoint::makeRoundSaturate));
@@ -0,0 +1,669 @@
+// Copyright (c) 2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#include "LuaJITBlock.hpp"
+
+#include <Pothos/Exception.hpp>
+#include <Pothos/Framework.hpp>
+
+#include <string>
+#include <vector>
+
+//
+// Embedded Lua
+//
+
+static const std::string FrameKernelsScript = R"(
+
+local ffi = require("ffi")
+
+local FrameKernels = {}
+
+local PtrTypes =
+{
+    float32 = ffi.typeof("float*"),
+    float64 = ffi.typeof("double*"),
+    int32 = ffi.typeof("int32_t*"),
+    uint32 = ffi.typeof("uint32_t*"),
+}
+
+local Int32Ptr = ffi.typeof("int32_t*")
+local UInt32Ptr = ffi.typeof("uint32_t*")
+
+local ptrType = nil
+local frameSize = 0
+
+--
+-- Min-heap of the largest keys seen, each with a payload, used by both
+-- top-k selection and peak ranking. Keeping only k entries makes selection
+-- O(n log k) with no allocations.
+--
+
+local heapKeys = nil
+local heapPayloads = nil
+local heapCapacity = 0
+local heapSize = 0
+
+local function allocateHeap(capacity)
+    heapKeys = ffi.new("double[?]", capacity)
+    heapPayloads = ffi.new("double[?]", capacity)
+    heapCapacity = capacity
+end
+
+local function siftDown(pos, size)
+    local key = heapKeys[pos]
+    local payload = heapPayloads[pos]
+
+    while true
+    do
+        local child = (2 * pos) + 1
+        if child >= size then break end
+        if ((child + 1) < size) and (heapKeys[child + 1] < heapKeys[child])
+        then
+            child = child + 1
+        end
+        if heapKeys[child] >= key then break end
+
+        heapKeys[pos] = heapKeys[child]
+        heapPayloads[pos] = heapPayloads[child]
+        pos = child
+    end
+
+    heapKeys[pos] = key
+    heapPayloads[pos] = payload
+end
+
+local function heapOffer(key, payload)
+    if heapSize < heapCapacity
+    then
+        -- Sift up
+        local pos = heapSize
+        heapSize = heapSize + 1
+        while pos > 0
+        do
+            local parent = math.floor((pos - 1) / 2)
+            if heapKeys[parent] <= key then break end
+
+            heapKeys[pos] = heapKeys[parent]
+            heapPayloads[pos] = heapPayloads[parent]
+            pos = parent
+        end
+        heapKeys[pos] = key
+        heapPayloads[pos] = payload
+    elseif key > heapKeys[0]
+    then
+        heapKeys[0] = key
+        heapPayloads[0] = payload
+        siftDown(0, heapSize)
+    end
+end
+
+-- Empties the heap into outKeys[offset...] and outPayloads[offset...],
+-- largest first. Returns the number of entries.
+local function heapDrain(outKeys, outPayloads, offset)
+    local count = heapSize
+    for last = count-1, 0, -1
+    do
+        outKeys[offset + last] = heapKeys[0]
+        outPayloads[offset + last] = heapPayloads[0]
+
+        heapKeys[0] = heapKeys[last]
+        heapPayloads[0] = heapPayloads[last]
+        siftDown(0, last)
+    end
+    heapSize = 0
+
+    return count
+end
+
+--
+-- Top-k selection
+--
+
+local k = 0
+
+function FrameKernels.topK(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems, inputElems, outputElems)
+    local input = ffi.cast(ptrType, buffsIn[0])
+    local outValues = ffi.cast(ptrType, buffsOut[0])
+    local outIndices = ffi.cast(UInt32Ptr, buffsOut[1])
+
+    local numFrames = math.min(
+                          math.floor(tonumber(inputElems[0]) / frameSize),
+                          math.floor(tonumber(outputElems[0]) / k),
+                          math.floor(tonumber(outputElems[1]) / k))
+
+    for frame = 0, numFrames-1
+    do
+        local frameInput = input + (frame * frameSize)
+        for i = 0, frameSize-1
+        do
+            heapOffer(frameInput[i], i)
+        end
+        heapDrain(outValues, outIndices, frame * k)
+    end
+
+    inputElems[0] = numFrames * frameSize
+    outputElems[0] = numFrames * k
+    outputElems[1] = numFrames * k
+end
+
+function FrameKernels.configureTopK(dtypeName, newFrameSize, newK)
+    ptrType = PtrTypes[dtypeName]
+    frameSize = newFrameSize
+    k = newK
+    allocateHeap(k)
+end
+
+--
+-- Peak finding
+--
+
+local threshold = 0.0
+local maxPeaks = 0
+local frameLabelId = ""
+
+-- Local maxima at or above the threshold, with the first of a plateau
+-- counted. Each peak's position and value come from the parabola through it
+-- and its neighbors. The strongest maxPeaks are kept.
+local function findPeaks(input)
+    for i = 1, frameSize-2
+    do
+        local b = input[i]
+        if b >= threshold
+        then
+            local a = input[i-1]
+            local c = input[i+1]
+            if (b > a) and (b >= c)
+            then
+                local p = 0.5 * (a - c) / (a - (2.0 * b) + c)
+                heapOffer(b - (0.25 * (a - c) * p), i + p)
+            end
+        end
+    end
+end
+
+function FrameKernels.findPeaks(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems, inputElems, outputElems)
+    local input = ffi.cast(ptrType, buffsIn[0])
+    local outPositions = ffi.cast(ptrType, buffsOut[0])
+    local outValues = ffi.cast(ptrType, buffsOut[1])
+
+    -- A frame can have up to maxPeaks peaks, so only take frames there's
+    -- room for in the worst case.
+    local numFrames = math.min(
+                          math.floor(tonumber(inputElems[0]) / frameSize),
+                          math.floor(tonumber(outputElems[0]) / maxPeaks),
+                          math.floor(tonumber(outputElems[1]) / maxPeaks))
+
+    local numOutputs = 0
+    for frame = 0, numFrames-1
+    do
+        findPeaks(input + (frame * frameSize))
+
+        local numPeaks = heapDrain(outValues, outPositions, numOutputs)
+        if (numPeaks > 0) and (#frameLabelId > 0)
+        then
+            BlockEnv.PostLabel(0, frameLabelId, numPeaks, numOutputs)
+        end
+        numOutputs = numOutputs + numPeaks
+    end
+
+    inputElems[0] = numFrames * frameSize
+    outputElems[0] = numOutputs
+    outputElems[1] = numOutputs
+end
+
+function FrameKernels.configurePeaks(dtypeName, newFrameSize, newThreshold, newMaxPeaks, newFrameLabelId)
+    ptrType = PtrTypes[dtypeName]
+    frameSize = newFrameSize
+    threshold = newThreshold
+    maxPeaks = newMaxPeaks
+    frameLabelId = newFrameLabelId
+    allocateHeap(maxPeaks)
+end
+
+--
+-- LSD radix sort on 32-bit keys, a byte at a time
+--
+-- Values are mapped to unsigned keys that sort the same way: for integers,
+-- the sign bit is flipped, and for floats, negative values have every bit
+-- flipped. NaNs sort past the infinities of the same sign. Bit operations
+-- work on signed 32-bit numbers, so everything is handled as int32_t, with
+-- logical shifts to get each byte.
+--
+
+local KeyUnsigned = 0
+local KeySigned = 1
+local KeyFloat = 2
+
+local KeyModes =
+{
+    uint32 = KeyUnsigned,
+    int32 = KeySigned,
+    float32 = KeyFloat,
+}
+
+local keyMode = KeyUnsigned
+
+local keysA = nil
+local keysB = nil
+
+-- One 256-entry histogram per byte
+local CountsBytes = 4 * 256 * ffi.sizeof("int32_t")
+local counts = ffi.new("int32_t[?]", 4 * 256)
+
+local function toKey(value)
+    if keyMode == KeySigned
+    then
+        return bit.bxor(value, 0x80000000)
+    elseif keyMode == KeyFloat
+    then
+        return (value < 0) and bit.bnot(value) or bit.bxor(value, 0x80000000)
+    end
+
+    return value
+end
+
+local function fromKey(key)
+    if keyMode == KeySigned
+    then
+        return bit.bxor(key, 0x80000000)
+    elseif keyMode == KeyFloat
+    then
+        return (key < 0) and bit.bxor(key, 0x80000000) or bit.bnot(key)
+    end
+
+    return key
+end
+
+local function sortFrame(input, output)
+    ffi.fill(counts, CountsBytes)
+
+    for i = 0, frameSize-1
+    do
+        local key = toKey(input[i])
+        keysA[i] = key
+
+        counts[bit.band(key, 0xff)] = counts[bit.band(key, 0xff)] + 1
+        counts[256 + bit.band(bit.rshift(key, 8), 0xff)] = counts[256 + bit.band(bit.rshift(key, 8), 0xff)] + 1
+        counts[512 + bit.band(bit.rshift(key, 16), 0xff)] = counts[512 + bit.band(bit.rshift(key, 16), 0xff)] + 1
+        counts[768 + bit.rshift(key, 24)] = counts[768 + bit.rshift(key, 24)] + 1
+    end
+
+    local src, dst = keysA, keysB
+    for pass = 0, 3
+    do
+        local histogram = counts + (256 * pass)
+        local shift = 8 * pass
+
+        -- Skip bytes that are the same in every key.
+        if histogram[bit.band(bit.rshift(src[0], shift), 0xff)] ~= frameSize
+        then
+            -- Counts become each byte value's first output position.
+            local total = 0
+            for byte = 0, 255
+            do
+                local count = histogram[byte]
+                histogram[byte] = total
+                total = total + count
+            end
+
+            for i = 0, frameSize-1
+            do
+                local key = src[i]
+                local byte = bit.band(bit.rshift(key, shift), 0xff)
+                dst[histogram[byte]] = key
+                histogram[byte] = histogram[byte] + 1
+            end
+
+            src, dst = dst, src
+        end
+    end
+
+    for i = 0, frameSize-1
+    do
+        output[i] = fromKey(src[i])
+    end
+end
+
+function FrameKernels.radixSort(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems, inputElems, outputElems)
+    local input = ffi.cast(Int32Ptr, buffsIn[0])
+    local output = ffi.cast(Int32Ptr, buffsOut[0])
+
+    local numFrames = math.floor(math.min(tonumber(inputElems[0]), tonumber(outputElems[0])) / frameSize)
+    for frame = 0, numFrames-1
+    do
+        sortFrame(input + (frame * frameSize), output + (frame * frameSize))
+    end
+
+    inputElems[0] = numFrames * frameSize
+    outputElems[0] = numFrames * frameSize
+end
+
+function FrameKernels.configureRadixSort(dtypeName, newFrameSize)
+    keyMode = KeyModes[dtypeName]
+    frameSize = newFrameSize
+    keysA = ffi.new("int32_t[?]", frameSize)
+    keysB = ffi.new("int32_t[?]", frameSize)
+end
+
+return FrameKernels
+
+)";
+
+//
+// Utility code
+//
+
+static constexpr double DefaultThreshold = 0.0;
+static constexpr size_t DefaultMaxPeaks = 16;
+
+static void validateFrameDType(
+    const Pothos::DType& dtype,
+    const std::vector<std::string>& supportedTypes,
+    const std::string& blockName)
+{
+    for(const auto& supportedType: supportedTypes)
+    {
+        if(dtype.name() == supportedType) return;
+    }
+
+    throw Pothos::InvalidArgumentException(blockName+" doesn't support type "+dtype.name());
+}
+
+//
+// Implementation
+//
+
+class LuaJITTopK: public LuaJITBlock
+{
+    public:
+        static Pothos::Block* make(
+            const Pothos::DType& dtype,
+            size_t frameSize,
+            size_t k)
+        {
+            return new LuaJITTopK(dtype, frameSize, k);
+        }
+
+        LuaJITTopK(
+            const Pothos::DType& dtype,
+            size_t frameSize,
+            size_t k
+        ):
+            LuaJITBlock(
+                std::vector<std::string>{dtype.name()},
+                std::vector<std::string>{dtype.name(), "uint32"},
+                false,
+                std::vector<std::string>{"minimal"})
+        {
+            validateFrameDType(dtype, {"float32", "float64", "int32", "uint32"}, "Top-k");
+            if((0 == k) || (k > frameSize))
+            {
+                throw Pothos::RangeException("K must be in the range [1, frame size].");
+            }
+
+            this->setSource(FrameKernelsScript, "topK");
+            this->setVariableRate(true);
+            this->callUserFunction("configureTopK", dtype.name(), frameSize, k);
+
+            // Only whole frames are ranked.
+            this->input(0)->setReserve(frameSize);
+            this->output(0)->setReserve(k);
+            this->output(1)->setReserve(k);
+        }
+
+        virtual ~LuaJITTopK() = default;
+};
+
+class LuaJITPeakFinder: public LuaJITBlock
+{
+    public:
+        static Pothos::Block* make(
+            const Pothos::DType& dtype,
+            size_t frameSize)
+        {
+            return new LuaJITPeakFinder(dtype, frameSize);
+        }
+
+        LuaJITPeakFinder(
+            const Pothos::DType& dtype,
+            size_t frameSize
+        ):
+            LuaJITBlock(
+                std::vector<std::string>{dtype.name()},
+                std::vector<std::string>{dtype.name(), dtype.name()},
+                false,
+                std::vector<std::string>{"minimal"}),
+            _dtypeName(dtype.name()),
+            _frameSize(frameSize),
+            _threshold(DefaultThreshold),
+            _maxPeaks(DefaultMaxPeaks),
+            _frameLabelId()
+        {
+            validateFrameDType(dtype, {"float32", "float64"}, "Peak finder");
+            if(frameSize < 3)
+            {
+                throw Pothos::RangeException("Frames must have at least 3 elements.");
+            }
+
+            this->setSource(FrameKernelsScript, "findPeaks");
+            this->setVariableRate(true);
+            this->configure();
+
+            this->input(0)->setReserve(frameSize);
+
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITPeakFinder, setThreshold));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITPeakFinder, getThreshold));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITPeakFinder, setMaxPeaks));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITPeakFinder, getMaxPeaks));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITPeakFinder, setFrameLabelId));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITPeakFinder, getFrameLabelId));
+        }
+
+        virtual ~LuaJITPeakFinder() = default;
+
+        // Local maxima below this are ignored.
+        void setThreshold(double threshold)
+        {
+            _threshold = threshold;
+            this->configure();
+        }
+
+        double getThreshold() const
+        {
+            return _threshold;
+        }
+
+        // The most peaks output per frame, strongest first
+        void setMaxPeaks(size_t maxPeaks)
+        {
+            if(0 == maxPeaks)
+            {
+                throw Pothos::RangeException("Max peaks must be positive.");
+            }
+
+            _maxPeaks = maxPeaks;
+            this->configure();
+        }
+
+        size_t getMaxPeaks() const
+        {
+            return _maxPeaks;
+        }
+
+        // If non-empty, the first peak of each frame is labeled with this ID,
+        // with the frame's number of peaks as its value.
+        void setFrameLabelId(const std::string& frameLabelId)
+        {
+            _frameLabelId = frameLabelId;
+            this->configure();
+        }
+
+        const std::string& getFrameLabelId() const
+        {
+            return _frameLabelId;
+        }
+
+    private:
+        std::string _dtypeName;
+        size_t _frameSize;
+        double _threshold;
+        size_t _maxPeaks;
+        std::string _frameLabelId;
+
+        void configure()
+        {
+            this->callUserFunction(
+                "configurePeaks",
+                _dtypeName,
+                _frameSize,
+                _threshold,
+                _maxPeaks,
+                _frameLabelId);
+
+            // A frame is only searched if there's room for all of its peaks.
+            this->output(0)->setReserve(_maxPeaks);
+            this->output(1)->setReserve(_maxPeaks);
+        }
+};
+
+class LuaJITRadixSort: public LuaJITBlock
+{
+    public:
+        static Pothos::Block* make(
+            const Pothos::DType& dtype,
+            size_t frameSize)
+        {
+            return new LuaJITRadixSort(dtype, frameSize);
+        }
+
+        LuaJITRadixSort(
+            const Pothos::DType& dtype,
+            size_t frameSize
+        ):
+            LuaJITBlock(
+                std::vector<std::string>{dtype.name()},
+                std::vector<std::string>{dtype.name()},
+                false,
+                std::vector<std::string>{"minimal"})
+        {
+            validateFrameDType(dtype, {"float32", "int32", "uint32"}, "Radix sort");
+            if(0 == frameSize)
+            {
+                throw Pothos::RangeException("Frame size must be positive.");
+            }
+
+            this->setSource(FrameKernelsScript, "radixSort");
+            this->setVariableRate(true);
+            this->callUserFunction("configureRadixSort", dtype.name(), frameSize);
+
+            // Only whole frames are sorted.
+            this->input(0)->setReserve(frameSize);
+            this->output(0)->setReserve(frameSize);
+        }
+
+        virtual ~LuaJITRadixSort() = default;
+};
+
+//
+// Registration
+//
+
+/***********************************************************************
+ * |PothosDoc Top-K (LuaJIT)
+ *
+ * Outputs the <b>K</b> largest values of each frame of <b>Frame Size</b>
+ * elements, largest first, on output 0, with their indices within the frame
+ * on output 1. Selection keeps a K-entry heap in preallocated memory, so it
+ * takes O(n log K) time per frame and makes no allocations. Ties keep
+ * whichever value the heap saw first. Only whole frames are consumed.
+ *
+ * |category /LuaJIT/Frames
+ * |keywords top k largest select rank heap frame
+ *
+ * |param dtype[Data Type]
+ * |widget DTypeChooser(float32=1,float64=1,int32=1,uint32=1)
+ * |default "float32"
+ * |preview disable
+ *
+ * |param frameSize[Frame Size]
+ * |default 1024
+ *
+ * |param k[K]
+ * |default 8
+ *
+ * |factory /luajit/top_k(dtype, frameSize, k)
+ */
+static Pothos::BlockRegistry registerLuaJITTopK(
+    "/luajit/top_k",
+    Pothos::Callable(&LuaJITTopK::make));
+
+/***********************************************************************
+ * |PothosDoc Peak Finder (LuaJIT)
+ *
+ * Finds the local maxima of each frame of <b>Frame Size</b> elements that
+ * are at or above <b>Threshold</b>, such as the peaks of a spectrum. Each
+ * peak is refined by fitting a parabola through it and its neighbors, and
+ * its fractional position within the frame is output on output 0, with its
+ * interpolated value on output 1. Only the strongest <b>Max Peaks</b> are
+ * output, strongest first, so each frame outputs between 0 and
+ * <b>Max Peaks</b> elements. On a plateau, only its first element counts
+ * as a peak, and the frame's first and last elements never do.
+ *
+ * |category /LuaJIT/Frames
+ * |keywords peak maximum spectrum parabolic interpolation threshold frame
+ *
+ * |param dtype[Data Type]
+ * |widget DTypeChooser(float=1)
+ * |default "float32"
+ * |preview disable
+ *
+ * |param frameSize[Frame Size]
+ * |default 1024
+ *
+ * |param threshold[Threshold]
+ * |default 0.0
+ *
+ * |param maxPeaks[Max Peaks]
+ * |default 16
+ *
+ * |param frameLabelId[Frame Label ID]
+ * If non-empty, the first peak of each frame is labeled with this ID, with the frame's number of peaks.
+ * |default ""
+ * |widget StringEntry()
+ * |preview valid
+ *
+ * |factory /luajit/peak_finder(dtype, frameSize)
+ * |setter setThreshold(threshold)
+ * |setter setMaxPeaks(maxPeaks)
+ * |setter setFrameLabelId(frameLabelId)
+ */
+static Pothos::BlockRegistry registerLuaJITPeakFinder(
+    "/luajit/peak_finder",
+    Pothos::Callable(&LuaJITPeakFinder::make));
+
+/***********************************************************************
+ * |PothosDoc Radix Sort (LuaJIT)
+ *
+ * Sorts each frame of <b>Frame Size</b> elements into ascending order with
+ * a least-significant-digit radix sort, a byte per pass, in preallocated
+ * memory. Passes over bytes every element shares are skipped. Negative
+ * zero sorts before positive zero, and NaNs sort beyond the infinity of
+ * the same sign. Only whole frames are consumed.
+ *
+ * |category /LuaJIT/Frames
+ * |keywords sort radix order frame
+ *
+ * |param dtype[Data Type]
+ * |widget DTypeChooser(float32=1,int32=1,uint32=1)
+ * |default "float32"
+ * |preview disable
+ *
+ * |param frameSize[Frame Size]
+ * |default 1024
+ *
+ * |factory /luajit/radix_sort(dtype, frameSize)
+ */
+static Pothos::BlockRegistry registerLuaJITRadixSort(
+    "/luajit/radix_sort",
+    Pothos::Callable(&LuaJITRadixSort::make));
@@ -0,0 +1,130 @@
+// Copyright (c) 2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#include "LuaJITBlock.hpp"
+
+#include <Pothos/Callable.hpp>
+#include <Pothos/Exception.hpp>
+#include <Pothos/Framework.hpp>
+#include <Pothos/Proxy.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Small enough for all intermediate tiles to stay resident in L1.
+static constexpr size_t FusedTileBytes = 16384;
+
+static LuaJITBlock* getLuaJITBlock(const Pothos::Proxy& blockProxy)
+{
+    auto* luajitBlock = dynamic_cast<LuaJITBlock*>(blockProxy.call<Pothos::Block*>("getPointer"));
+    if(!luajitBlock)
+    {
+        throw Pothos::InvalidArgumentException("Only LuaJIT blocks can be fused.");
+    }
+
+    return luajitBlock;
+}
+
+static void appendUnique(
+    std::vector<std::string>& destination,
+    const std::vector<std::string>& source)
+{
+    std::copy_if(
+        source.begin(),
+        source.end(),
+        std::back_inserter(destination),
+        [&destination](const std::string& str)
+        {
+            return (std::find(destination.begin(), destination.end(), str) == destination.end());
+        });
+}
+
+static Pothos::Block* makeFusedChain(const std::vector<Pothos::Proxy>& chainProxies)
+{
+    if(chainProxies.size() < 2)
+    {
+        throw Pothos::InvalidArgumentException("At least two blocks are needed to fuse a chain.");
+    }
+
+    std::vector<LuaJITBlock*> chain;
+    std::transform(
+        chainProxies.begin(),
+        chainProxies.end(),
+        std::back_inserter(chain),
+        getLuaJITBlock);
+
+    std::vector<std::string> luaSources;
+    std::vector<std::string> functionNames;
+    std::vector<size_t> elemSizes;
+    std::vector<std::string> preloadedLibraries;
+    std::vector<std::string> luaLibraries;
+    std::string fusedName;
+
+    for(size_t i = 0; i < chain.size(); ++i)
+    {
+        const auto* luajitBlock = chain[i];
+        const auto& name = luajitBlock->getName();
+
+        if((luajitBlock->inputs().size() != 1) || (luajitBlock->outputs().size() != 1))
+        {
+            throw Pothos::InvalidArgumentException(name+": only single-input, single-output blocks can be fused.");
+        }
+        if(!luajitBlock->isStateless())
+        {
+            throw Pothos::InvalidArgumentException(name+": only stateless blocks can be fused.");
+        }
+        if(luajitBlock->hasPortStaging())
+        {
+            throw Pothos::InvalidArgumentException(name+": blocks with port staging can't be fused.");
+        }
+        if(luajitBlock->isVariableRate())
+        {
+            throw Pothos::InvalidArgumentException(name+": variable-rate blocks can't be fused.");
+        }
+        if(luajitBlock->getSource().empty())
+        {
+            throw Pothos::InvalidArgumentException(name+": no source set, or block is already fused.");
+        }
+        if((i > 0) && (chain[i-1]->output(0)->dtype() != luajitBlock->input(0)->dtype()))
+        {
+            throw Pothos::InvalidArgumentException(
+                      name+": input type "+luajitBlock->input(0)->dtype().name()+
+                      " doesn't match previous output type "+chain[i-1]->output(0)->dtype().name());
+        }
+
+        luaSources.emplace_back(luajitBlock->getSource());
+        functionNames.emplace_back(luajitBlock->getFunctionName());
+        elemSizes.emplace_back(luajitBlock->input(0)->dtype().size());
+        appendUnique(preloadedLibraries, luajitBlock->getPreloadedLibraries());
+        appendUnique(luaLibraries, luajitBlock->getLuaLibraries());
+        fusedName += (i > 0) ? (" -> "+name) : name;
+    }
+    elemSizes.emplace_back(chain.back()->output(0)->dtype().size());
+
+    const auto maxElemSize = *std::max_element(elemSizes.begin(), elemSizes.end());
+    const auto tileElems = std::max<size_t>(1, (FusedTileBytes / maxElemSize));
+
+    std::unique_ptr<LuaJITBlock> fusedBlock(new LuaJITBlock(
+        std::vector<std::string>{chain.front()->input(0)->dtype().name()},
+        std::vector<std::string>{chain.back()->output(0)->dtype().name()},
+        false,
+        luaLibraries));
+    fusedBlock->setFusedSources(luaSources, functionNames, elemSizes, tileElems);
+    fusedBlock->setPreloadedLibraries(preloadedLibraries);
+    fusedBlock->setStateless(true);
+    fusedBlock->setName("fused("+fusedName+")");
+
+    return fusedBlock.release();
+}
+
+//
+// Registration
+//
+
+// Not exposed in the GUI, as this operates on existing block instances.
+// Usage: Pothos::BlockRegistry::make("/luajit/fused_chain", std::vector<Pothos::Proxy>{...})
+static Pothos::BlockRegistry registerLuaJITFusedChain(
+    "/luajit/fused_chain",
+    Pothos::Callable(&makeFusedChain));
@@ -0,0 +1,511 @@
+// Copyright (c) 2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#include "LuaJITBlock.hpp"
+
+#include <Pothos/Exception.hpp>
+#include <Pothos/Framework.hpp>
+
+#include <string>
+#include <vector>
+
+//
+// Embedded Lua
+//
+
+static const std::string InterleaverScript = R"(
+
+local ffi = require("ffi")
+
+ffi.cdef[[
+typedef struct
+{
+    uint64_t low;
+    uint64_t high;
+} luajit_interleaver_elem16_t;
+]]
+
+local Interleaver = {}
+
+-- The block interleaver's map is traversed in square tiles of this many
+-- rows and columns, so both its reads and writes stay within a few cache
+-- lines at a time.
+local TileSize = 16
+
+-- Copying elements as plain integers works for any type of the same size.
+local ElemPtrTypes =
+{
+    [1] = ffi.typeof("uint8_t*"),
+    [2] = ffi.typeof("uint16_t*"),
+    [4] = ffi.typeof("uint32_t*"),
+    [8] = ffi.typeof("uint64_t*"),
+    [16] = ffi.typeof("luajit_interleaver_elem16_t*"),
+}
+
+local ElemArrayTypes =
+{
+    [1] = ffi.typeof("uint8_t[?]"),
+    [2] = ffi.typeof("uint16_t[?]"),
+    [4] = ffi.typeof("uint32_t[?]"),
+    [8] = ffi.typeof("uint64_t[?]"),
+    [16] = ffi.typeof("luajit_interleaver_elem16_t[?]"),
+}
+
+local elemPtrType = nil
+
+--
+-- Block interleaver
+--
+
+-- indexMap[2k] and indexMap[2k+1] are the kth element's position in the
+-- interleaved and the original frame, in tiled order. Deinterleaving reads
+-- the same map the other way around.
+local indexMap = nil
+local frameSize = 0
+local dstSlot = 0
+local srcSlot = 1
+local frameLabelId = ""
+
+local function permuteFrame(input, output, base)
+    for k = 0, frameSize-1
+    do
+        output[base + indexMap[(2 * k) + dstSlot]] = input[base + indexMap[(2 * k) + srcSlot]]
+    end
+end
+
+function Interleaver.block(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems, inputElems, outputElems)
+    local input = ffi.cast(elemPtrType, buffsIn[0])
+    local output = ffi.cast(elemPtrType, buffsOut[0])
+
+    local numFrames = math.floor(math.min(tonumber(inputElems[0]), tonumber(outputElems[0])) / frameSize)
+    for frame = 0, numFrames-1
+    do
+        permuteFrame(input, output, frame * frameSize)
+        if frameLabelId ~= ""
+        then
+            BlockEnv.PostLabel(0, frameLabelId, frameSize, frame * frameSize)
+        end
+    end
+
+    inputElems[0] = numFrames * frameSize
+    outputElems[0] = numFrames * frameSize
+end
+
+-- Frames are written into the interleaver by rows and read out by columns.
+function Interleaver.configureBlock(elemSize, numRows, numColumns, deinterleave, newFrameLabelId)
+    elemPtrType = ElemPtrTypes[elemSize]
+    frameSize = numRows * numColumns
+    dstSlot = deinterleave and 1 or 0
+    srcSlot = deinterleave and 0 or 1
+    frameLabelId = newFrameLabelId
+
+    indexMap = ffi.cast("int32_t*", BlockEnv.GetSharedTable(
+        "luajit/interleaver/block/"..numRows.."/"..numColumns,
+        2 * frameSize * ffi.sizeof("int32_t"),
+        function(ptr)
+            local values = ffi.cast("int32_t*", ptr)
+            local k = 0
+            for tileRow = 0, numRows-1, TileSize
+            do
+                for tileColumn = 0, numColumns-1, TileSize
+                do
+                    for row = tileRow, math.min(tileRow + TileSize, numRows)-1
+                    do
+                        for column = tileColumn, math.min(tileColumn + TileSize, numColumns)-1
+                        do
+                            values[2 * k] = (column * numRows) + row
+                            values[(2 * k) + 1] = (row * numColumns) + column
+                            k = k + 1
+                        end
+                    end
+                end
+            end
+        end))
+end
+
+--
+-- Convolutional interleaver
+--
+
+-- branchDelays[b] is how many elements back in the stream branch b's output
+-- comes from.
+local branchDelays = nil
+local numBranches = 0
+
+-- The last ringSize inputs, indexed by their position in the stream. Outputs
+-- read straight from the input buffer when they can, so only each call's
+-- tail is copied here.
+local ring = nil
+local ringMask = 0
+local position = 0
+local branch = 0
+
+function Interleaver.convolutional(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    local input = ffi.cast(elemPtrType, buffsIn[0])
+    local output = ffi.cast(elemPtrType, buffsOut[0])
+
+    local b = branch
+    for i = 0, elems-1
+    do
+        local src = i - branchDelays[b]
+        if src >= 0
+        then
+            output[i] = input[src]
+        else
+            output[i] = ring[bit.band(position + src, ringMask)]
+        end
+
+        b = b + 1
+        if b == numBranches then b = 0 end
+    end
+    branch = b
+
+    for i = math.max(0, elems - (ringMask + 1)), elems-1
+    do
+        ring[bit.band(position + i, ringMask)] = input[i]
+    end
+    position = position + elems
+end
+
+-- Branch b delays its elements by b*delay of its own elements when
+-- interleaving, and by (numBranches-1-b)*delay when deinterleaving.
+function Interleaver.configureConvolutional(elemSize, newNumBranches, delay, deinterleave)
+    elemPtrType = ElemPtrTypes[elemSize]
+    numBranches = newNumBranches
+
+    branchDelays = ffi.cast("int32_t*", BlockEnv.GetSharedTable(
+        "luajit/interleaver/convolutional/"..numBranches.."/"..delay.."/"..(deinterleave and "inverse" or "forward"),
+        numBranches * ffi.sizeof("int32_t"),
+        function(ptr)
+            local values = ffi.cast("int32_t*", ptr)
+            for b = 0, numBranches-1
+            do
+                local branchDelay = deinterleave and (numBranches - 1 - b) or b
+                values[b] = branchDelay * delay * numBranches
+            end
+        end))
+
+    local ringSize = 1
+    while ringSize < ((numBranches - 1) * delay * numBranches)
+    do
+        ringSize = ringSize * 2
+    end
+    ring = ElemArrayTypes[elemSize](ringSize)
+    ringMask = ringSize - 1
+
+    Interleaver.reset()
+end
+
+function Interleaver.reset()
+    if ring ~= nil
+    then
+        ffi.fill(ring, ffi.sizeof(ring))
+    end
+    position = 0
+    branch = 0
+end
+
+return Interleaver
+
+)";
+
+//
+// Utility code
+//
+
+// The element sizes the Lua side has a copy type for
+static void validateElemSize(const Pothos::DType& dtype)
+{
+    const auto elemSize = dtype.size();
+    if((elemSize != 1) && (elemSize != 2) && (elemSize != 4) && (elemSize != 8) && (elemSize != 16))
+    {
+        throw Pothos::InvalidArgumentException(
+                  "Interleavers only support 1, 2, 4, 8, or 16-byte elements. "+dtype.name()+" is "+
+                  std::to_string(elemSize)+" bytes.");
+    }
+}
+
+//
+// Implementation
+//
+
+class LuaJITBlockInterleaver: public LuaJITBlock
+{
+    public:
+        static Pothos::Block* makeInterleaver(
+            const Pothos::DType& dtype,
+            size_t numRows,
+            size_t numColumns)
+        {
+            return new LuaJITBlockInterleaver(dtype, numRows, numColumns, false);
+        }
+
+        static Pothos::Block* makeDeinterleaver(
+            const Pothos::DType& dtype,
+            size_t numRows,
+            size_t numColumns)
+        {
+            return new LuaJITBlockInterleaver(dtype, numRows, numColumns, true);
+        }
+
+        LuaJITBlockInterleaver(
+            const Pothos::DType& dtype,
+            size_t numRows,
+            size_t numColumns,
+            bool deinterleave
+        ):
+            LuaJITBlock(
+                std::vector<std::string>{dtype.name()},
+                std::vector<std::string>{dtype.name()},
+                false,
+                std::vector<std::string>{"minimal"}),
+            _elemSize(dtype.size()),
+            _numRows(numRows),
+            _numColumns(numColumns),
+            _deinterleave(deinterleave),
+            _frameLabelId()
+        {
+            validateElemSize(dtype);
+            if((0 == numRows) || (0 == numColumns))
+            {
+                throw Pothos::RangeException("Rows and columns must be positive.");
+            }
+
+            this->setSource(InterleaverScript, "block");
+            this->setVariableRate(true);
+            this->configure();
+
+            // Only whole frames are permuted.
+            const auto frameSize = numRows * numColumns;
+            this->input(0)->setReserve(frameSize);
+            this->output(0)->setReserve(frameSize);
+
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlockInterleaver, setFrameLabelId));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITBlockInterleaver, getFrameLabelId));
+        }
+
+        virtual ~LuaJITBlockInterleaver() = default;
+
+        // If non-empty, the first element of each output frame is labeled
+        // with this ID, with the frame size as its value.
+        void setFrameLabelId(const std::string& frameLabelId)
+        {
+            _frameLabelId = frameLabelId;
+            this->configure();
+        }
+
+        const std::string& getFrameLabelId() const
+        {
+            return _frameLabelId;
+        }
+
+    private:
+        size_t _elemSize;
+        size_t _numRows;
+        size_t _numColumns;
+        bool _deinterleave;
+        std::string _frameLabelId;
+
+        void configure()
+        {
+            this->callUserFunction(
+                "configureBlock",
+                _elemSize,
+                _numRows,
+                _numColumns,
+                _deinterleave,
+                _frameLabelId);
+        }
+};
+
+class LuaJITConvolutionalInterleaver: public LuaJITBlock
+{
+    public:
+        static Pothos::Block* makeInterleaver(
+            const Pothos::DType& dtype,
+            size_t numBranches,
+            size_t delay)
+        {
+            return new LuaJITConvolutionalInterleaver(dtype, numBranches, delay, false);
+        }
+
+        static Pothos::Block* makeDeinterleaver(
+            const Pothos::DType& dtype,
+            size_t numBranches,
+            size_t delay)
+        {
+            return new LuaJITConvolutionalInterleaver(dtype, numBranches, delay, true);
+        }
+
+        LuaJITConvolutionalInterleaver(
+            const Pothos::DType& dtype,
+            size_t numBranches,
+            size_t delay,
+            bool deinterleave
+        ):
+            LuaJITBlock(
+                std::vector<std::string>{dtype.name()},
+                std::vector<std::string>{dtype.name()},
+                false,
+                std::vector<std::string>{"minimal"})
+        {
+            validateElemSize(dtype);
+            if(numBranches < 2)
+            {
+                throw Pothos::RangeException("There must be at least 2 branches.");
+            }
+            if(0 == delay)
+            {
+                throw Pothos::RangeException("Delay must be positive.");
+            }
+
+            this->setSource(InterleaverScript, "convolutional");
+            this->callUserFunction(
+                "configureConvolutional",
+                dtype.size(),
+                numBranches,
+                delay,
+                deinterleave);
+        }
+
+        virtual ~LuaJITConvolutionalInterleaver() = default;
+
+        void activate() override
+        {
+            this->callUserFunction("reset");
+            LuaJITBlock::activate();
+        }
+};
+
+//
+// Registration
+//
+
+/***********************************************************************
+ * |PothosDoc Block Interleaver (LuaJIT)
+ *
+ * Writes each frame of <b>Rows</b> x <b>Columns</b> elements into a matrix
+ * by rows and reads it out by columns. The permutation is computed once per
+ * frame shape and shared between all block interleavers and deinterleavers
+ * in the process, and is applied in tiles so that large frames stay
+ * cache-friendly. Only whole frames are consumed.
+ *
+ * |category /LuaJIT/FEC
+ * |keywords interleaver permutation frame
+ *
+ * |param dtype[Data Type] The element type, which must be 1, 2, 4, 8, or 16 bytes.
+ * |widget DTypeChooser(int=1,uint=1,float=1,cint=1,cfloat=1,dim=1)
+ * |default "uint8"
+ * |preview disable
+ *
+ * |param numRows[Rows]
+ * |default 8
+ *
+ * |param numColumns[Columns]
+ * |default 16
+ *
+ * |param frameLabelId[Frame Label ID]
+ * If non-empty, the first element of each output frame is labeled with this ID.
+ * |default ""
+ * |widget StringEntry()
+ * |preview valid
+ *
+ * |factory /luajit/block_interleaver(dtype, numRows, numColumns)
+ * |setter setFrameLabelId(frameLabelId)
+ */
+static Pothos::BlockRegistry registerLuaJITBlockInterleaver(
+    "/luajit/block_interleaver",
+    Pothos::Callable(&LuaJITBlockInterleaver::makeInterleaver));
+
+/***********************************************************************
+ * |PothosDoc Block Deinterleaver (LuaJIT)
+ *
+ * Undoes <b>Block Interleaver</b> with the same <b>Rows</b> and
+ * <b>Columns</b>, writing each frame by columns and reading it by rows.
+ *
+ * |category /LuaJIT/FEC
+ * |keywords deinterleaver permutation frame
+ *
+ * |param dtype[Data Type] The element type, which must be 1, 2, 4, 8, or 16 bytes.
+ * |widget DTypeChooser(int=1,uint=1,float=1,cint=1,cfloat=1,dim=1)
+ * |default "uint8"
+ * |preview disable
+ *
+ * |param numRows[Rows]
+ * |default 8
+ *
+ * |param numColumns[Columns]
+ * |default 16
+ *
+ * |param frameLabelId[Frame Label ID]
+ * If non-empty, the first element of each output frame is labeled with this ID.
+ * |default ""
+ * |widget StringEntry()
+ * |preview valid
+ *
+ * |factory /luajit/block_deinterleaver(dtype, numRows, numColumns)
+ * |setter setFrameLabelId(frameLabelId)
+ */
+static Pothos::BlockRegistry registerLuaJITBlockDeinterleaver(
+    "/luajit/block_deinterleaver",
+    Pothos::Callable(&LuaJITBlockInterleaver::makeDeinterleaver));
+
+/***********************************************************************
+ * |PothosDoc Convolutional Interleaver (LuaJIT)
+ *
+ * A Forney convolutional interleaver. Elements are distributed across
+ * <b>Branches</b> in turn, and branch <i>b</i> delays its elements by
+ * <i>b</i> x <b>Delay</b> of its own elements. Outputs are read straight from
+ * the input buffer where possible, so only the most recent inputs are copied
+ * into the block's history.
+ *
+ * |category /LuaJIT/FEC
+ * |keywords interleaver forney convolutional
+ *
+ * |param dtype[Data Type] The element type, which must be 1, 2, 4, 8, or 16 bytes.
+ * |widget DTypeChooser(int=1,uint=1,float=1,cint=1,cfloat=1,dim=1)
+ * |default "uint8"
+ * |preview disable
+ *
+ * |param numBranches[Branches]
+ * |default 12
+ *
+ * |param delay[Delay]
+ * |units elements
+ * |default 17
+ *
+ * |factory /luajit/convolutional_interleaver(dtype, numBranches, delay)
+ */
+static Pothos::BlockRegistry registerLuaJITConvolutionalInterleaver(
+    "/luajit/convolutional_interleaver",
+    Pothos::Callable(&LuaJITConvolutionalInterleaver::makeInterleaver));
+
+/***********************************************************************
+ * |PothosDoc Convolutional Deinterleaver (LuaJIT)
+ *
+ * Undoes <b>Convolutional Interleaver</b> with the same <b>Branches</b> and
+ * <b>Delay</b>, with branch <i>b</i> delaying its elements by
+ * (<b>Branches</b> - 1 - <i>b</i>) x <b>Delay</b>. The two together delay
+ * the stream by (<b>Branches</b> - 1) x <b>Delay</b> x <b>Branches</b>
+ * elements.
+ *
+ * |category /LuaJIT/FEC
+ * |keywords deinterleaver forney convolutional
+ *
+ * |param dtype[Data Type] The element type, which must be 1, 2, 4, 8, or 16 bytes.
+ * |widget DTypeChooser(int=1,uint=1,float=1,cint=1,cfloat=1,dim=1)
+ * |default "uint8"
+ * |preview disable
+ *
+ * |param numBranches[Branches]
+ * |default 12
+ *
+ * |param delay[Delay]
+ * |units elements
+ * |default 17
+ *
+ * |factory /luajit/convolutional_deinterleaver(dtype, numBranches, delay)
+ */
+static Pothos::BlockRegistry registerLuaJITConvolutionalDeinterleaver(
+    "/luajit/convolutional_deinterleaver",
+    Pothos::Callable(&LuaJITConvolutionalInterleaver::makeDeinterleaver));
@@ -0,0 +1,588 @@
+// Copyright (c) 2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#include "LuaJITBlock.hpp"
+
+#include <Pothos/Exception.hpp>
+#include <Pothos/Framework.hpp>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+//
+// Embedded Lua
+//
+
+static const std::string NoiseScript = R"(
+
+local ffi = require("ffi")
+
+local Noise = {}
+
+local UInt64 = ffi.typeof("uint64_t")
+
+-- Scales the top 53 bits of a draw to [0, 1).
+local UnitScale = 2^-53
+
+local FloatPtrTypes =
+{
+    [4] = ffi.typeof("float*"),
+    [8] = ffi.typeof("double*"),
+}
+
+local ptrType = nil
+local numComponents = 1
+local amplitude = 1.0
+
+--
+-- xoshiro256**
+--
+-- Each stream starts 2^128 draws after the last, so blocks seeded the same
+-- with different streams never overlap.
+--
+
+local state = ffi.new("uint64_t[4]")
+
+local function nextDraw()
+    local s0, s1, s2, s3 = state[0], state[1], state[2], state[3]
+    local result = bit.rol(s1 * 5, 7) * 9
+    local t = bit.lshift(s1, 17)
+
+    s2 = bit.bxor(s2, s0)
+    s3 = bit.bxor(s3, s1)
+    s1 = bit.bxor(s1, s2)
+    s0 = bit.bxor(s0, s3)
+    s2 = bit.bxor(s2, t)
+    s3 = bit.rol(s3, 45)
+
+    state[0], state[1], state[2], state[3] = s0, s1, s2, s3
+    return result
+end
+
+-- Equivalent to 2^128 calls to nextDraw()
+local JumpPolynomial =
+{
+    0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+    0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL,
+}
+
+local function jump()
+    local j0, j1, j2, j3 = UInt64(0), UInt64(0), UInt64(0), UInt64(0)
+    for i = 1, 4
+    do
+        for b = 0, 63
+        do
+            if bit.band(JumpPolynomial[i], bit.lshift(1ULL, b)) ~= 0ULL
+            then
+                j0 = bit.bxor(j0, state[0])
+                j1 = bit.bxor(j1, state[1])
+                j2 = bit.bxor(j2, state[2])
+                j3 = bit.bxor(j3, state[3])
+            end
+            nextDraw()
+        end
+    end
+
+    state[0], state[1], state[2], state[3] = j0, j1, j2, j3
+end
+
+-- The generator is linear over GF(2), so jumping 2^level times is a 256x256
+-- bit matrix, stored as the 256 states it maps each single-bit state to.
+-- Each level's matrix is the square of the one before, so reaching stream
+-- N takes one matrix per set bit of N instead of N jumps. The matrices
+-- don't depend on the seed, so they're shared by every noise block.
+local JumpMatrixBytes = 256 * 4 * ffi.sizeof("uint64_t")
+local jumpMatrices = {}
+
+-- Sets output[0...3] to matrix times input[0...3].
+local function applyJumpMatrix(matrix, input, output)
+    local r0, r1, r2, r3 = UInt64(0), UInt64(0), UInt64(0), UInt64(0)
+    for word = 0, 3
+    do
+        local value = input[word]
+        for b = 0, 63
+        do
+            if bit.band(value, bit.lshift(1ULL, b)) ~= 0ULL
+            then
+                local column = matrix + (4 * ((64 * word) + b))
+                r0 = bit.bxor(r0, column[0])
+                r1 = bit.bxor(r1, column[1])
+                r2 = bit.bxor(r2, column[2])
+                r3 = bit.bxor(r3, column[3])
+            end
+        end
+    end
+
+    output[0], output[1], output[2], output[3] = r0, r1, r2, r3
+end
+
+local function getJumpMatrix(level)
+    for l = #jumpMatrices + 1, level + 1
+    do
+        local previous = jumpMatrices[l - 1]
+        jumpMatrices[l] = ffi.cast("uint64_t*", BlockEnv.GetSharedTable(
+            "luajit/noise/jump/"..(l - 1),
+            JumpMatrixBytes,
+            function(ptr)
+                local columns = ffi.cast("uint64_t*", ptr)
+                for j = 0, 255
+                do
+                    local column = columns + (4 * j)
+                    if previous == nil
+                    then
+                        for i = 0, 3 do state[i] = 0ULL end
+                        state[math.floor(j / 64)] = bit.lshift(1ULL, j % 64)
+                        jump()
+                        for i = 0, 3 do column[i] = state[i] end
+                    else
+                        applyJumpMatrix(previous, previous + (4 * j), column)
+                    end
+                end
+            end))
+    end
+
+    return jumpMatrices[level + 1]
+end
+
+-- Expands a 64-bit seed into a full state, as the generator's authors
+-- recommend.
+local function splitMix64(x)
+    x = x + 0x9e3779b97f4a7c15ULL
+    local z = x
+    z = bit.bxor(z, bit.rshift(z, 30)) * 0xbf58476d1ce4e5b9ULL
+    z = bit.bxor(z, bit.rshift(z, 27)) * 0x94d049bb133111ebULL
+    return bit.bxor(z, bit.rshift(z, 31)), x
+end
+
+-- Returns a value in [0, 1).
+local function nextUnit()
+    return tonumber(bit.rshift(nextDraw(), 11)) * UnitScale
+end
+
+--
+-- Gaussian values, using Doornik's 128-block ziggurat
+--
+
+local ZigguratBlocks = 128
+local ZigguratR = 3.442619855899
+local ZigguratV = 9.91256303526217e-3
+
+-- Block edges x[0...128], followed by each block's inner fraction
+-- x[i+1]/x[i], for i in [0, 128)
+local zigguratTable = ffi.cast("double*", BlockEnv.GetSharedTable(
+    "luajit/noise/ziggurat/"..ZigguratBlocks,
+    ((2 * ZigguratBlocks) + 1) * ffi.sizeof("double"),
+    function(ptr)
+        local values = ffi.cast("double*", ptr)
+
+        local f = math.exp(-0.5 * ZigguratR * ZigguratR)
+        values[0] = ZigguratV / f
+        values[1] = ZigguratR
+        values[ZigguratBlocks] = 0.0
+        for i = 2, ZigguratBlocks-1
+        do
+            values[i] = math.sqrt(-2.0 * math.log((ZigguratV / values[i-1]) + f))
+            f = math.exp(-0.5 * values[i] * values[i])
+        end
+
+        for i = 0, ZigguratBlocks-1
+        do
+            values[ZigguratBlocks + 1 + i] = values[i+1] / values[i]
+        end
+    end))
+
+local zigguratX = zigguratTable
+local zigguratRatio = zigguratTable + (ZigguratBlocks + 1)
+
+-- Beyond R, sampled by Marsaglia's method
+local function gaussianTail(negative)
+    local x, y
+    repeat
+        x = math.log(1.0 - nextUnit()) / ZigguratR
+        y = math.log(1.0 - nextUnit())
+    until (-2.0 * y) >= (x * x)
+
+    return negative and (x - ZigguratR) or (ZigguratR - x)
+end
+
+-- Handles the wedges and tail, starting from a draw that missed a block's
+-- inner rectangle.
+local function nextGaussianSlow(u, i)
+    while true
+    do
+        if i == 0
+        then
+            return gaussianTail(u < 0.0)
+        end
+
+        local x = u * zigguratX[i]
+        local f0 = math.exp(-0.5 * ((zigguratX[i] * zigguratX[i]) - (x * x)))
+        local f1 = math.exp(-0.5 * ((zigguratX[i+1] * zigguratX[i+1]) - (x * x)))
+        if (f1 + (nextUnit() * (f0 - f1))) < 1.0
+        then
+            return x
+        end
+
+        local draw = nextDraw()
+        u = (2.0 * tonumber(bit.rshift(draw, 11)) * UnitScale) - 1.0
+        i = tonumber(bit.band(draw, 0x7fULL))
+        if math.abs(u) < zigguratRatio[i]
+        then
+            return u * zigguratX[i]
+        end
+    end
+end
+
+-- Takes one draw: its top 53 bits give the position in the block, and its
+-- bottom 7 the block. About 99% of draws land in the block's inner
+-- rectangle, so the loop for the rest is kept out of this function, which
+-- lets it inline into the kernels' loops.
+local function nextGaussian()
+    local draw = nextDraw()
+    local u = (2.0 * tonumber(bit.rshift(draw, 11)) * UnitScale) - 1.0
+    local i = tonumber(bit.band(draw, 0x7fULL))
+
+    if math.abs(u) < zigguratRatio[i]
+    then
+        return u * zigguratX[i]
+    end
+
+    return nextGaussianSlow(u, i)
+end
+
+local function nextUniform()
+    return (2.0 * nextUnit()) - 1.0
+end
+
+--
+-- Kernels
+--
+-- Complex values are filled component by component, so the same loop
+-- handles every type.
+--
+
+local function fill(generate, output, numValues, scale)
+    for i = 0, numValues-1
+    do
+        output[i] = scale * generate()
+    end
+end
+
+local function add(generate, input, output, numValues, scale)
+    for i = 0, numValues-1
+    do
+        output[i] = input[i] + (scale * generate())
+    end
+end
+
+-- Complex Gaussian noise splits its power between the components.
+local function gaussianScale()
+    return (numComponents == 2) and (amplitude * math.sqrt(0.5)) or amplitude
+end
+
+function Noise.uniformSource(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    fill(nextUniform, ffi.cast(ptrType, buffsOut[0]), numComponents * elems, amplitude)
+end
+
+function Noise.gaussianSource(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    fill(nextGaussian, ffi.cast(ptrType, buffsOut[0]), numComponents * elems, gaussianScale())
+end
+
+function Noise.uniformAdd(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    add(nextUniform, ffi.cast(ptrType, buffsIn[0]), ffi.cast(ptrType, buffsOut[0]), numComponents * elems, amplitude)
+end
+
+function Noise.gaussianAdd(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    add(nextGaussian, ffi.cast(ptrType, buffsIn[0]), ffi.cast(ptrType, buffsOut[0]), numComponents * elems, gaussianScale())
+end
+
+-- Uniform noise is in [-amplitude, amplitude), and Gaussian noise has a
+-- standard deviation of amplitude.
+function Noise.configure(componentSize, newNumComponents, newAmplitude)
+    ptrType = FloatPtrTypes[componentSize]
+    numComponents = newNumComponents
+    amplitude = newAmplitude
+end
+
+-- The state each block's noise restarts from
+local streamStart = ffi.new("uint64_t[4]")
+
+-- The seed is split into 32-bit halves, since Lua numbers can't hold 64
+-- bits. Each stream starts 2^128 draws after the last.
+function Noise.seed(seedHigh, seedLow, stream)
+    local x = bit.bor(bit.lshift(UInt64(seedHigh), 32), UInt64(seedLow))
+    for i = 0, 3
+    do
+        streamStart[i], x = splitMix64(x)
+    end
+
+    local level = 0
+    while stream > 0
+    do
+        if (stream % 2) == 1
+        then
+            applyJumpMatrix(getJumpMatrix(level), streamStart, streamStart)
+        end
+        stream = math.floor(stream / 2)
+        level = level + 1
+    end
+
+    Noise.restart()
+end
+
+-- Starts the noise over from the seeded stream.
+function Noise.restart()
+    for i = 0, 3
+    do
+        state[i] = streamStart[i]
+    end
+end
+
+return Noise
+
+)";
+
+//
+// Utility code
+//
+
+static constexpr double DefaultAmplitude = 1.0;
+static constexpr unsigned long long DefaultSeed = 24301;
+
+// Each block takes the next stream unless given one, so blocks get
+// independent noise by default.
+static std::atomic<unsigned long long> NextStream(0);
+
+static void validateNoiseDType(const Pothos::DType& dtype)
+{
+    if(!dtype.isFloat() || (dtype.dimension() != 1))
+    {
+        throw Pothos::InvalidArgumentException("Noise requires a float or complex float type, not "+dtype.name());
+    }
+}
+
+static std::string getNoiseFunctionName(const std::string& distribution, const std::string& suffix)
+{
+    if(("uniform" != distribution) && ("gaussian" != distribution))
+    {
+        throw Pothos::InvalidArgumentException("Invalid distribution: "+distribution);
+    }
+
+    return distribution+suffix;
+}
+
+//
+// Implementation
+//
+
+class LuaJITNoise: public LuaJITBlock
+{
+    public:
+        static Pothos::Block* makeSource(
+            const Pothos::DType& dtype,
+            const std::string& distribution)
+        {
+            validateNoiseDType(dtype);
+            return new LuaJITNoise(
+                       dtype,
+                       std::vector<std::string>{},
+                       getNoiseFunctionName(distribution, "Source"));
+        }
+
+        static Pothos::Block* makeAdder(
+            const Pothos::DType& dtype,
+            const std::string& distribution)
+        {
+            validateNoiseDType(dtype);
+            return new LuaJITNoise(
+                       dtype,
+                       std::vector<std::string>{dtype.name()},
+                       getNoiseFunctionName(distribution, "Add"));
+        }
+
+        LuaJITNoise(
+            const Pothos::DType& dtype,
+            const std::vector<std::string>& inputTypes,
+            const std::string& functionName
+        ):
+            LuaJITBlock(
+                inputTypes,
+                std::vector<std::string>{dtype.name()},
+                false,
+                std::vector<std::string>{"minimal"}),
+            _dtype(dtype),
+            _amplitude(DefaultAmplitude),
+            _seed(DefaultSeed),
+            _stream(NextStream++)
+        {
+            this->setSource(NoiseScript, functionName);
+            this->configure();
+            this->reseed();
+
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITNoise, setAmplitude));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITNoise, getAmplitude));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITNoise, setSeed));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITNoise, getSeed));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITNoise, setStream));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITNoise, getStream));
+        }
+
+        virtual ~LuaJITNoise() = default;
+
+        // The bound of uniform noise, or the standard deviation of Gaussian
+        // noise
+        void setAmplitude(double amplitude)
+        {
+            _amplitude = amplitude;
+            this->configure();
+        }
+
+        double getAmplitude() const
+        {
+            return _amplitude;
+        }
+
+        void setSeed(unsigned long long seed)
+        {
+            _seed = seed;
+            this->reseed();
+        }
+
+        unsigned long long getSeed() const
+        {
+            return _seed;
+        }
+
+        // Blocks with the same seed and different streams never produce
+        // overlapping noise.
+        void setStream(unsigned long long stream)
+        {
+            _stream = stream;
+            this->reseed();
+        }
+
+        unsigned long long getStream() const
+        {
+            return _stream;
+        }
+
+        // Each run starts the stream over, so runs are repeatable.
+        void activate() override
+        {
+            this->callUserFunction("restart");
+            LuaJITBlock::activate();
+        }
+
+    private:
+        Pothos::DType _dtype;
+        double _amplitude;
+        unsigned long long _seed;
+        unsigned long long _stream;
+
+        void configure()
+        {
+            const auto numComponents = _dtype.isComplex() ? 2 : 1;
+            this->callUserFunction(
+                "configure",
+                _dtype.elemSize() / numComponents,
+                numComponents,
+                _amplitude);
+        }
+
+        void reseed()
+        {
+            this->callUserFunction(
+                "seed",
+                double(_seed >> 32),
+                double(_seed & 0xffffffffULL),
+                double(_stream));
+        }
+};
+
+//
+// Registration
+//
+
+/***********************************************************************
+ * |PothosDoc Noise Source (LuaJIT)
+ *
+ * Generates uniform or Gaussian noise, filling each output buffer in one
+ * call. Values come from a xoshiro256** generator, and Gaussian values are
+ * drawn with a ziggurat whose table is shared between blocks.
+ *
+ * Every block gets its own stream of the generator, so noise from
+ * different blocks is independent. Each block's noise restarts on
+ * activation, so runs with the same <b>Seed</b> are repeatable. setStream()
+ * picks a block's stream explicitly.
+ *
+ * Complex Gaussian noise splits its power evenly between the real and
+ * imaginary parts.
+ *
+ * |category /LuaJIT/Noise
+ * |keywords random noise gaussian uniform awgn xoshiro ziggurat
+ *
+ * |param dtype[Data Type]
+ * |widget DTypeChooser(float=1,cfloat=1)
+ * |default "complex_float32"
+ * |preview disable
+ *
+ * |param distribution[Distribution]
+ * |widget ComboBox(editable=false)
+ * |option [Gaussian] "gaussian"
+ * |option [Uniform] "uniform"
+ * |default "gaussian"
+ * |preview enable
+ *
+ * |param amplitude[Amplitude]
+ * The bound of uniform noise, or the standard deviation of Gaussian noise
+ * |default 1.0
+ *
+ * |param seed[Seed]
+ * |default 24301
+ * |preview valid
+ *
+ * |factory /luajit/noise_source(dtype, distribution)
+ * |setter setAmplitude(amplitude)
+ * |setter setSeed(seed)
+ */
+static Pothos::BlockRegistry registerLuaJITNoiseSource(
+    "/luajit/noise_source",
+    Pothos::Callable(&LuaJITNoise::makeSource));
+
+/***********************************************************************
+ * |PothosDoc Noise Adder (LuaJIT)
+ *
+ * Adds uniform or Gaussian noise to a stream, using the same generators
+ * and seeding as the LuaJIT noise source.
+ *
+ * |category /LuaJIT/Noise
+ * |keywords random noise gaussian uniform awgn dither
+ *
+ * |param dtype[Data Type]
+ * |widget DTypeChooser(float=1,cfloat=1)
+ * |default "complex_float32"
+ * |preview disable
+ *
+ * |param distribution[Distribution]
+ * |widget ComboBox(editable=false)
+ * |option [Gaussian] "gaussian"
+ * |option [Uniform] "uniform"
+ * |default "gaussian"
+ * |preview enable
+ *
+ * |param amplitude[Amplitude]
+ * The bound of uniform noise, or the standard deviation of Gaussian noise
+ * |default 0.1
+ *
+ * |param seed[Seed]
+ * |default 24301
+ * |preview valid
+ *
+ * |factory /luajit/noise_adder(dtype, distribution)
+ * |setter setAmplitude(amplitude)
+ * |setter setSeed(seed)
+ */
+static Pothos::BlockRegistry registerLuaJITNoiseAdder(
+    "/luajit/noise_adder",
+    Pothos::Callable(&LuaJITNoise::makeAdder));
@@ -0,0 +1,524 @@
+// Copyright (c) 2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#include "LuaJITBlock.hpp"
+#include "ScopedDynLib.hpp"
+
+#include <Pothos/Exception.hpp>
+#include <Pothos/Framework.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// Lock-free single-producer, single-consumer ring of tiles
+//
+
+class TileRing
+{
+public:
+    struct Tile
+    {
+        std::vector<std::uint8_t> buffer;
+        size_t elems;
+    };
+
+    TileRing(size_t numTiles, size_t tileBytes):
+        _tiles(numTiles, Tile{std::vector<std::uint8_t>(tileBytes), 0}),
+        _head(0),
+        _tail(0)
+    {}
+
+    // Producer side: the next free tile, or nullptr if the ring is full.
+    Tile* back()
+    {
+        const auto head = _head.load(std::memory_order_relaxed);
+        if((head - _tail.load(std::memory_order_acquire)) >= _tiles.size()) return nullptr;
+
+        return &_tiles[head % _tiles.size()];
+    }
+
+    void push()
+    {
+        _head.store(_head.load(std::memory_order_relaxed)+1, std::memory_order_release);
+    }
+
+    // Consumer side: the oldest filled tile, or nullptr if the ring is empty.
+    Tile* front()
+    {
+        const auto tail = _tail.load(std::memory_order_relaxed);
+        if(tail == _head.load(std::memory_order_acquire)) return nullptr;
+
+        return &_tiles[tail % _tiles.size()];
+    }
+
+    void pop()
+    {
+        _tail.store(_tail.load(std::memory_order_relaxed)+1, std::memory_order_release);
+    }
+
+    bool empty() const
+    {
+        return (_head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire));
+    }
+
+private:
+    std::vector<Tile> _tiles;
+
+    // On separate cache lines so the producer and consumer don't contend.
+    alignas(64) std::atomic<size_t> _head;
+    alignas(64) std::atomic<size_t> _tail;
+};
+
+//
+// Block
+//
+
+static constexpr size_t DefaultPipelineTileElems = 4096;
+static constexpr size_t DefaultPipelineNumTiles = 4;
+
+class LuaJITPipelineBlock: public Pothos::Block
+{
+    public:
+        static Pothos::Block* make(
+            const std::string& inputType,
+            const std::string& outputType,
+            const std::vector<std::string>& intermediateTypes);
+
+        LuaJITPipelineBlock(
+            const std::string& inputType,
+            const std::string& outputType,
+            const std::vector<std::string>& intermediateTypes);
+        virtual ~LuaJITPipelineBlock();
+
+        void setSource(
+            const std::string& luaSource,
+            const std::vector<std::string>& functionNames);
+
+        void setPreloadedLibraries(const std::vector<std::string>& libraries);
+
+        void setLuaLibraries(const std::vector<std::string>& luaLibraries);
+
+        void setTileSize(size_t tileSize);
+
+        void setNumTiles(size_t numTiles);
+
+        void activate() override;
+
+        void deactivate() override;
+
+        void work() override;
+
+    private:
+        std::vector<Pothos::DType> _types;
+        std::vector<std::unique_ptr<LuaJITBlock>> _stages;
+        std::vector<std::unique_ptr<TileRing>> _rings;
+        std::vector<std::thread> _stageThreads;
+
+        size_t _tileElems;
+        size_t _numTiles;
+        size_t _outputTileOffset;
+
+        std::atomic<bool> _running;
+        std::mutex _stageErrorMutex;
+        std::string _stageError;
+
+        // Set while a wake-up message is waiting in the input port
+        Pothos::InputPort* _wakePort;
+        std::atomic<bool> _wakePending;
+
+        std::vector<std::string> _dynLibPaths;
+        std::vector<ScopedDynLib::SPtr> _dynLibs;
+
+        void stageLoop(size_t stage);
+
+        void wake();
+
+        void stopStageThreads();
+};
+
+Pothos::Block* LuaJITPipelineBlock::make(
+    const std::string& inputType,
+    const std::string& outputType,
+    const std::vector<std::string>& intermediateTypes)
+{
+    return new LuaJITPipelineBlock(inputType, outputType, intermediateTypes);
+}
+
+LuaJITPipelineBlock::LuaJITPipelineBlock(
+    const std::string& inputType,
+    const std::string& outputType,
+    const std::vector<std::string>& intermediateTypes):
+    _tileElems(DefaultPipelineTileElems),
+    _numTiles(DefaultPipelineNumTiles),
+    _outputTileOffset(0),
+    _running(false),
+    _wakePort(nullptr),
+    _wakePending(false)
+{
+    // Stage N reads _types[N] and writes _types[N+1].
+    _types.emplace_back(inputType);
+    std::copy(
+        intermediateTypes.begin(),
+        intermediateTypes.end(),
+        std::back_inserter(_types));
+    _types.emplace_back(outputType);
+
+    // The stages are never part of a topology. They're only used for their
+    // Lua states, each of which is only ever touched by its stage's thread.
+    for(size_t stage = 0; stage < (_types.size()-1); ++stage)
+    {
+        _stages.emplace_back(new LuaJITBlock(
+            std::vector<std::string>{_types[stage].name()},
+            std::vector<std::string>{_types[stage+1].name()},
+            false,
+            std::vector<std::string>{"full"}));
+        _stages.back()->setName("LuaJIT pipeline stage "+std::to_string(stage));
+    }
+
+    this->setupInput(0, _types.front());
+    this->setupOutput(0, _types.back());
+    _wakePort = this->input(0);
+
+    this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITPipelineBlock, setSource));
+    this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITPipelineBlock, setPreloadedLibraries));
+    this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITPipelineBlock, setLuaLibraries));
+    this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITPipelineBlock, setTileSize));
+    this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITPipelineBlock, setNumTiles));
+}
+
+LuaJITPipelineBlock::~LuaJITPipelineBlock()
+{
+    this->stopStageThreads();
+}
+
+void LuaJITPipelineBlock::setSource(
+    const std::string& luaSource,
+    const std::vector<std::string>& functionNames)
+{
+    if(this->isActive())
+    {
+        throw Pothos::RuntimeException("Cannot set source for active block.");
+    }
+    if(functionNames.size() != _stages.size())
+    {
+        throw Pothos::InvalidArgumentException(
+                  "Expected "+std::to_string(_stages.size())+" function names, "+
+                  "found "+std::to_string(functionNames.size())+".");
+    }
+
+    // Each stage loads the source into its own state, so module-level
+    // variables are per-stage.
+    for(size_t stage = 0; stage < _stages.size(); ++stage)
+    {
+        _stages[stage]->setSource(luaSource, functionNames[stage]);
+    }
+}
+
+void LuaJITPipelineBlock::setPreloadedLibraries(const std::vector<std::string>& libraries)
+{
+    if(this->isActive())
+    {
+        throw Pothos::RuntimeException("Cannot set preloaded libraries for active block.");
+    }
+
+    // Loaded libraries are visible to all of the stages' states.
+    _dynLibs.clear();
+    _dynLibPaths = libraries;
+}
+
+void LuaJITPipelineBlock::setLuaLibraries(const std::vector<std::string>& luaLibraries)
+{
+    if(this->isActive())
+    {
+        throw Pothos::RuntimeException("Cannot set Lua libraries for active block.");
+    }
+
+    for(auto& stage: _stages) stage->setLuaLibraries(luaLibraries);
+}
+
+void LuaJITPipelineBlock::setTileSize(size_t tileSize)
+{
+    if(this->isActive())
+    {
+        throw Pothos::RuntimeException("Cannot set tile size for active block.");
+    }
+    if(0 == tileSize)
+    {
+        throw Pothos::InvalidArgumentException("Tile size must be non-zero.");
+    }
+
+    _tileElems = tileSize;
+}
+
+void LuaJITPipelineBlock::setNumTiles(size_t numTiles)
+{
+    if(this->isActive())
+    {
+        throw Pothos::RuntimeException("Cannot set number of tiles for active block.");
+    }
+    if(numTiles < 2)
+    {
+        throw Pothos::InvalidArgumentException("At least two tiles are needed per stage.");
+    }
+
+    _numTiles = numTiles;
+}
+
+void LuaJITPipelineBlock::activate()
+{
+    std::transform(
+        _dynLibPaths.begin(),
+        _dynLibPaths.end(),
+        std::back_inserter(_dynLibs),
+        ScopedDynLib::load);
+
+    // Ring N feeds stage N, and the last ring holds the pipeline's output.
+    _rings.clear();
+    for(const auto& type: _types)
+    {
+        _rings.emplace_back(new TileRing(_numTiles, (_tileElems * type.size())));
+    }
+    _outputTileOffset = 0;
+    _stageError.clear();
+    _wakePending = false;
+
+    _running = true;
+    for(size_t stage = 0; stage < _stages.size(); ++stage)
+    {
+        _stageThreads.emplace_back(&LuaJITPipelineBlock::stageLoop, this, stage);
+    }
+}
+
+void LuaJITPipelineBlock::deactivate()
+{
+    this->stopStageThreads();
+
+    _rings.clear();
+    _dynLibs.clear();
+}
+
+void LuaJITPipelineBlock::work()
+{
+    auto* input = this->input(0);
+    auto* output = this->output(0);
+
+    // Wake-up messages from the stage threads only get this called. The
+    // flag is cleared before looking at the rings, so a tile that arrives
+    // after that sends another.
+    _wakePending = false;
+    while(input->hasMessage()) input->popMessage();
+
+    {
+        std::lock_guard<std::mutex> lock(_stageErrorMutex);
+        if(!_stageError.empty()) throw Pothos::Exception(_stageError);
+    }
+
+    // Drain finished tiles first to make room further up the pipeline.
+    // produce() and consume() don't move the ports' buffers until work()
+    // returns, so this tracks how far into each buffer it's gotten.
+    auto& outputRing = *_rings.back();
+    const auto outputElemSize = _types.back().size();
+    auto* outputPtr = output->buffer().as<char*>();
+    size_t outputSpace = output->elements();
+    while(auto* tile = outputRing.front())
+    {
+        const auto elems = std::min(outputSpace, (tile->elems - _outputTileOffset));
+        if(0 == elems) break;
+
+        std::memcpy(
+            outputPtr,
+            tile->buffer.data() + (_outputTileOffset * outputElemSize),
+            (elems * outputElemSize));
+        output->produce(elems);
+
+        outputPtr += (elems * outputElemSize);
+        outputSpace -= elems;
+
+        _outputTileOffset += elems;
+        if(_outputTileOffset == tile->elems)
+        {
+            _outputTileOffset = 0;
+            outputRing.pop();
+        }
+    }
+
+    auto& inputRing = *_rings.front();
+    const auto inputElemSize = _types.front().size();
+    const auto* inputPtr = input->buffer().as<const char*>();
+    size_t inputElems = input->elements();
+    while(inputElems > 0)
+    {
+        auto* tile = inputRing.back();
+        if(!tile) break;
+
+        const auto elems = std::min(inputElems, _tileElems);
+        std::memcpy(tile->buffer.data(), inputPtr, (elems * inputElemSize));
+        tile->elems = elems;
+        inputRing.push();
+        input->consume(elems);
+
+        inputPtr += (elems * inputElemSize);
+        inputElems -= elems;
+    }
+}
+
+void LuaJITPipelineBlock::stageLoop(size_t stage)
+{
+    auto& inputRing = *_rings[stage];
+    auto& outputRing = *_rings[stage+1];
+    auto& stageBlock = *_stages[stage];
+
+    std::vector<const void*> inputPointers(1);
+    std::vector<void*> outputPointers(1);
+
+    size_t idleIterations = 0;
+    while(_running.load(std::memory_order_relaxed))
+    {
+        auto* inputTile = inputRing.front();
+        auto* outputTile = outputRing.back();
+        if(!inputTile || !outputTile)
+        {
+            // Spin briefly for low latency, then back off to avoid burning
+            // a core while the pipeline is idle.
+            if(++idleIterations < 1024) std::this_thread::yield();
+            else std::this_thread::sleep_for(std::chrono::microseconds(50));
+
+            continue;
+        }
+        idleIterations = 0;
+
+        inputPointers[0] = inputTile->buffer.data();
+        outputPointers[0] = outputTile->buffer.data();
+        // Nothing can be allowed to escape the thread, which would
+        // terminate the process.
+        std::string error;
+        try
+        {
+            stageBlock.callFunction(inputPointers, outputPointers, inputTile->elems);
+        }
+        catch(const Pothos::Exception& ex)
+        {
+            error = ex.displayText();
+        }
+        catch(const std::exception& ex)
+        {
+            error = ex.what();
+        }
+        catch(...)
+        {
+            error = "Unknown exception";
+        }
+
+        if(!error.empty())
+        {
+            {
+                std::lock_guard<std::mutex> lock(_stageErrorMutex);
+                _stageError = "Stage "+std::to_string(stage)+": "+error;
+            }
+            this->wake();
+            return;
+        }
+
+        outputTile->elems = inputTile->elems;
+        outputRing.push();
+        inputRing.pop();
+
+        // The block needs to run when the first stage frees up room for
+        // more input, or the last stage has output for it.
+        if((0 == stage) || ((stage+1) == _stages.size())) this->wake();
+    }
+}
+
+// Sends the block a message, which the scheduler wakes it up for, unless
+// one is already waiting.
+void LuaJITPipelineBlock::wake()
+{
+    if(!_wakePending.exchange(true)) _wakePort->pushMessage(Pothos::Object(true));
+}
+
+void LuaJITPipelineBlock::stopStageThreads()
+{
+    _running = false;
+    for(auto& stageThread: _stageThreads) stageThread.join();
+    _stageThreads.clear();
+}
+
+//
+// Registration
+//
+
+/***********************************************************************
+ * |PothosDoc LuaJIT Pipeline Block
+ *
+ * The LuaJIT Pipeline Block runs an ordered list of functions as a pipeline,
+ * with each function running in its own Lua state on its own thread. Each
+ * function's output feeds the next function's input through a lock-free ring
+ * of tiles inside the block.
+ *
+ * This allows a stateful chain of kernels too heavy for one core to be spread
+ * across several, while each function still sees its input in order. Each
+ * function takes the same parameters as the LuaJIT Block's function, with
+ * one input and one output buffer, and must produce one output element for
+ * each input element.
+ *
+ * |category /LuaJIT
+ * |keywords lua jit ffi pipeline thread parallel
+ *
+ * |param inputType[Input Type] The pipeline's input type.
+ * |default "float32"
+ *
+ * |param outputType[Output Type] The pipeline's output type.
+ * |default "float32"
+ *
+ * |param intermediateTypes[Intermediate Types]
+ * The types passed between consecutive functions. The pipeline has one more
+ * stage than the number of intermediate types.
+ * |default ["float32"]
+ *
+ * |param source[LuaJIT Source] Source code containing the functions to execute.
+ * The source can either be a string returning the source code or a
+ * path to a .lua file containing this source code.
+ * |default ""
+ * |widget FileEntry(mode=open)
+ *
+ * |param functionNames[Functions] The names of the functions to run, in order.
+ * |default ["", ""]
+ *
+ * |param preloadedLibraries[Preloaded Libraries]
+ * A list of dynamic libraries to load before executing the provided LuaJIT
+ * code.
+ * |default []
+ * |widget LineEdit()
+ *
+ * |param luaLibraries[Lua Libraries]
+ * The Lua standard libraries to open in each stage's Lua state. See the
+ * LuaJIT Block for details.
+ * |default ["full"]
+ * |widget LineEdit()
+ *
+ * |param tileSize[Tile Size] The number of elements passed between stages at a time.
+ * |default 4096
+ * |units elements
+ *
+ * |param numTiles[Tiles Per Stage] The number of tiles in each ring between stages.
+ * |default 4
+ *
+ * |factory /luajit/pipeline_block(inputType,outputType,intermediateTypes)
+ * |setter setLuaLibraries(luaLibraries)
+ * |setter setSource(source, functionNames)
+ * |setter setPreloadedLibraries(preloadedLibraries)
+ * |setter setTileSize(tileSize)
+ * |setter setNumTiles(numTiles)
+ */
+static Pothos::BlockRegistry registerLuaJITPipelineBlock(
+    "/luajit/pipeline_block",
+    Pothos::Callable(&LuaJITPipelineBlock::make));
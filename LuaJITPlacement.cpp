@@ -0,0 +1,95 @@
+// Copyright (c) 2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#include "LuaJITBlock.hpp"
+
+#include <Pothos/Callable.hpp>
+#include <Pothos/Exception.hpp>
+#include <Pothos/Framework.hpp>
+#include <Pothos/Plugin.hpp>
+#include <Pothos/Proxy.hpp>
+
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <vector>
+
+static const LuaJITBlock* getLuaJITBlock(const Pothos::Proxy& blockProxy)
+{
+    const auto* luajitBlock = dynamic_cast<const LuaJITBlock*>(blockProxy.call<Pothos::Block*>("getPointer"));
+    if(!luajitBlock)
+    {
+        throw Pothos::InvalidArgumentException("Only LuaJIT blocks can be placed by cost.");
+    }
+
+    return luajitBlock;
+}
+
+// Longest-processing-time-first: place the heaviest remaining block on the
+// least loaded pool. This is within 4/3 of the optimal maximum load.
+static std::vector<size_t> packLoads(
+    const std::vector<double>& loads,
+    size_t numPools)
+{
+    std::vector<size_t> order(loads.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(
+        order.begin(),
+        order.end(),
+        [&loads](size_t lhs, size_t rhs)
+        {
+            return (loads[lhs] > loads[rhs]);
+        });
+
+    std::vector<double> poolLoads(numPools, 0.0);
+    std::vector<size_t> assignments(loads.size(), 0);
+    for(const auto index: order)
+    {
+        const auto poolIter = std::min_element(poolLoads.begin(), poolLoads.end());
+        assignments[index] = size_t(std::distance(poolLoads.begin(), poolIter));
+        *poolIter += loads[index];
+    }
+
+    return assignments;
+}
+
+// Returns the index of the thread pool each block was placed on. This can be
+// called again at runtime to rebalance as the blocks' measured costs change.
+static std::vector<size_t> placeLuaJITBlocks(
+    const std::vector<Pothos::Proxy>& blocks,
+    const std::vector<Pothos::ThreadPool>& threadPools)
+{
+    if(threadPools.empty())
+    {
+        throw Pothos::InvalidArgumentException("At least one thread pool is needed.");
+    }
+
+    std::vector<double> loads;
+    std::transform(
+        blocks.begin(),
+        blocks.end(),
+        std::back_inserter(loads),
+        [](const Pothos::Proxy& block)
+        {
+            return getLuaJITBlock(block)->getCostModel().load;
+        });
+
+    const auto assignments = packLoads(loads, threadPools.size());
+    for(size_t i = 0; i < blocks.size(); ++i)
+    {
+        blocks[i].call("setThreadPool", threadPools[assignments[i]]);
+    }
+
+    return assignments;
+}
+
+//
+// Registration
+//
+
+pothos_static_block(registerLuaJITPlacement)
+{
+    Pothos::PluginRegistry::addCall(
+        "/luajit/placement/place_blocks",
+        &placeLuaJITBlocks);
+}
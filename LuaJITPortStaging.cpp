@@ -0,0 +1,246 @@
+// Copyright (c) 2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#include "LuaJITPortStaging.hpp"
+
+#include <Pothos/Exception.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+//
+// Conversion loops
+//
+// These are deliberately simple, branch-free loops over contiguous buffers
+// so the compiler vectorizes them.
+//
+
+// Float values going to an integer type are rounded to the nearest integer
+// and saturated, instead of truncated, and NaNs become 0. Rounding first
+// means the comparisons are against exactly representable limits.
+template <typename InType, typename OutType>
+static inline OutType convertScalar(InType value)
+{
+    if constexpr(std::is_floating_point<InType>::value && std::is_integral<OutType>::value)
+    {
+        constexpr auto MinValue = static_cast<InType>(std::numeric_limits<OutType>::min());
+        constexpr auto MaxValue = static_cast<InType>(std::numeric_limits<OutType>::max());
+
+        const auto rounded = std::nearbyint(value);
+        return (rounded != rounded) ? OutType(0)
+             : (rounded <= MinValue) ? std::numeric_limits<OutType>::min()
+             : (rounded >= MaxValue) ? std::numeric_limits<OutType>::max()
+             : static_cast<OutType>(rounded);
+    }
+    else return static_cast<OutType>(value);
+}
+
+template <typename InType, typename OutType, size_t ScalarsPerElem>
+static void convertElems(
+    const void* in,
+    void* out,
+    size_t elems)
+{
+    const auto* inPtr = static_cast<const InType*>(in);
+    auto* outPtr = static_cast<OutType*>(out);
+
+    const auto numScalars = elems * ScalarsPerElem;
+    for(size_t i = 0; i < numScalars; ++i)
+    {
+        outPtr[i] = convertScalar<InType, OutType>(inPtr[i]);
+    }
+}
+
+template <typename InType, typename OutType>
+static void deinterleaveElems(
+    const void* in,
+    void* out,
+    size_t elems)
+{
+    const auto* inPtr = static_cast<const InType*>(in);
+    auto* realPtr = static_cast<OutType*>(out);
+    auto* imagPtr = realPtr + elems;
+
+    for(size_t i = 0; i < elems; ++i)
+    {
+        realPtr[i] = convertScalar<InType, OutType>(inPtr[2*i]);
+        imagPtr[i] = convertScalar<InType, OutType>(inPtr[(2*i)+1]);
+    }
+}
+
+template <typename InType, typename OutType>
+static void interleaveElems(
+    const void* in,
+    void* out,
+    size_t elems)
+{
+    const auto* realPtr = static_cast<const InType*>(in);
+    const auto* imagPtr = realPtr + elems;
+    auto* outPtr = static_cast<OutType*>(out);
+
+    for(size_t i = 0; i < elems; ++i)
+    {
+        outPtr[2*i] = convertScalar<InType, OutType>(realPtr[i]);
+        outPtr[(2*i)+1] = convertScalar<InType, OutType>(imagPtr[i]);
+    }
+}
+
+//
+// Type dispatch
+//
+
+template <typename T>
+struct TypeTag
+{
+    using type = T;
+};
+
+// Calls fcn with a TypeTag for the DType's scalar type (the real type, for
+// complex DTypes).
+template <typename Fcn>
+static auto dispatchScalarType(
+    const Pothos::DType& dtype,
+    Fcn&& fcn)
+{
+    if(dtype.dimension() != 1)
+    {
+        throw Pothos::InvalidArgumentException("Staging doesn't support multi-dimensional types: "+dtype.name());
+    }
+
+    const auto scalarSize = dtype.elemSize() / (dtype.isComplex() ? 2 : 1);
+    if(dtype.isFloat())
+    {
+        if(scalarSize == 4) return fcn(TypeTag<float>());
+        if(scalarSize == 8) return fcn(TypeTag<double>());
+    }
+    else if(dtype.isInteger() && dtype.isSigned())
+    {
+        if(scalarSize == 1) return fcn(TypeTag<std::int8_t>());
+        if(scalarSize == 2) return fcn(TypeTag<std::int16_t>());
+        if(scalarSize == 4) return fcn(TypeTag<std::int32_t>());
+        if(scalarSize == 8) return fcn(TypeTag<std::int64_t>());
+    }
+    else if(dtype.isInteger())
+    {
+        if(scalarSize == 1) return fcn(TypeTag<std::uint8_t>());
+        if(scalarSize == 2) return fcn(TypeTag<std::uint16_t>());
+        if(scalarSize == 4) return fcn(TypeTag<std::uint32_t>());
+        if(scalarSize == 8) return fcn(TypeTag<std::uint64_t>());
+    }
+
+    throw Pothos::InvalidArgumentException("Staging doesn't support type: "+dtype.name());
+}
+
+using ConvertFcn = void(*)(const void*, void*, size_t);
+
+enum class StagingLayout
+{
+    Real,
+    Interleaved,
+    Deinterleave,
+    Interleave
+};
+
+static ConvertFcn getConvertFcn(
+    const Pothos::DType& inDType,
+    const Pothos::DType& outDType,
+    StagingLayout layout)
+{
+    return dispatchScalarType(
+        inDType,
+        [&](auto inTag)
+        {
+            using InType = typename decltype(inTag)::type;
+
+            return dispatchScalarType(
+                outDType,
+                [&](auto outTag) -> ConvertFcn
+                {
+                    using OutType = typename decltype(outTag)::type;
+
+                    switch(layout)
+                    {
+                        case StagingLayout::Interleaved:  return &convertElems<InType, OutType, 2>;
+                        case StagingLayout::Deinterleave: return &deinterleaveElems<InType, OutType>;
+                        case StagingLayout::Interleave:   return &interleaveElems<InType, OutType>;
+                        default:                          return &convertElems<InType, OutType, 1>;
+                    }
+                });
+        });
+}
+
+//
+// Implementation
+//
+
+LuaJITPortStaging::LuaJITPortStaging(
+    const Pothos::DType& portDType,
+    const Pothos::DType& kernelDType,
+    bool split):
+    _portDType(portDType),
+    _kernelDType(kernelDType),
+    _ingestFcn(nullptr),
+    _egressFcn(nullptr)
+{
+    if(portDType.isComplex() != kernelDType.isComplex())
+    {
+        throw Pothos::InvalidArgumentException(
+                  "Cannot stage between real and complex types: "+portDType.name()+", "+kernelDType.name());
+    }
+    if(split && !portDType.isComplex())
+    {
+        throw Pothos::InvalidArgumentException("Only complex types can be split: "+portDType.name());
+    }
+
+    if(split)
+    {
+        _ingestFcn = getConvertFcn(portDType, kernelDType, StagingLayout::Deinterleave);
+        _egressFcn = getConvertFcn(kernelDType, portDType, StagingLayout::Interleave);
+    }
+    else
+    {
+        const auto layout = portDType.isComplex() ? StagingLayout::Interleaved : StagingLayout::Real;
+        _ingestFcn = getConvertFcn(portDType, kernelDType, layout);
+        _egressFcn = getConvertFcn(kernelDType, portDType, layout);
+    }
+}
+
+const Pothos::DType& LuaJITPortStaging::kernelDType() const
+{
+    return _kernelDType;
+}
+
+const void* LuaJITPortStaging::stageInput(
+    const void* portBuffer,
+    size_t elems)
+{
+    auto* scratch = this->getScratch(elems);
+    _ingestFcn(portBuffer, scratch, elems);
+
+    return scratch;
+}
+
+void* LuaJITPortStaging::getOutputScratch(size_t elems)
+{
+    return this->getScratch(elems);
+}
+
+void LuaJITPortStaging::unstageOutput(
+    void* portBuffer,
+    size_t elems)
+{
+    _egressFcn(_scratch.as<const void*>(), portBuffer, elems);
+}
+
+// Only reallocates when a call needs more elements than any before it.
+void* LuaJITPortStaging::getScratch(size_t elems)
+{
+    if(_scratch.elements() < elems)
+    {
+        _scratch = Pothos::BufferChunk(_kernelDType, elems);
+    }
+
+    return _scratch.as<void*>();
+}
@@ -0,0 +1,48 @@
+// Copyright (c) 2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <Pothos/Framework.hpp>
+
+#include <cstddef>
+#include <memory>
+
+// Converts between a port's buffer and the layout a LuaJIT function wants,
+// using a scratch buffer that's reused across calls. In the split layout, a
+// complex buffer of N elements holds N reals followed by N imaginary values.
+class LuaJITPortStaging
+{
+    public:
+        using UPtr = std::unique_ptr<LuaJITPortStaging>;
+
+        LuaJITPortStaging(
+            const Pothos::DType& portDType,
+            const Pothos::DType& kernelDType,
+            bool split);
+
+        const Pothos::DType& kernelDType() const;
+
+        // Port buffer to scratch buffer. Returns the scratch buffer.
+        const void* stageInput(const void* portBuffer, size_t elems);
+
+        // The scratch buffer the function writes to, before unstageOutput().
+        void* getOutputScratch(size_t elems);
+
+        // Scratch buffer to port buffer.
+        void unstageOutput(void* portBuffer, size_t elems);
+
+    private:
+        using ConvertFcn = void(*)(const void*, void*, size_t);
+
+        Pothos::DType _portDType;
+        Pothos::DType _kernelDType;
+
+        // Both take and return scalars, so complex elements count twice.
+        ConvertFcn _ingestFcn;
+        ConvertFcn _egressFcn;
+
+        Pothos::BufferChunk _scratch;
+
+        void* getScratch(size_t elems);
+};
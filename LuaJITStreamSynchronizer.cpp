@@ -0,0 +1,478 @@
+// Copyright (c) 2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#include "LuaJITBlock.hpp"
+
+#include <Pothos/Exception.hpp>
+#include <Pothos/Framework.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+//
+// Embedded Lua
+//
+
+static const std::string StreamSynchronizerScript = R"(
+
+local ffi = require("ffi")
+
+local Synchronizer = {}
+
+local numPorts = 0
+local elemSize = 0
+local sampleRate = 1.0
+
+-- Per port: whether it's had a timestamp, the time of its next unconsumed
+-- sample (in seconds), its dropped samples, in total and this call, and the
+-- time of its first output this call (NaN if none)
+local timeKnown = nil
+local nextTimes = nil
+local dropCounts = nil
+local callDrops = nil
+local callOutputTimes = nil
+local availableElems = nil
+
+-- Set by the block before each call, for ports with timestamps in their
+-- buffers. Each port's indices are in ascending order.
+local labelIndices = {}
+local labelTimes = {}
+
+local alignmentError = 0.0
+
+local function drop(port, count)
+    callDrops[port] = callDrops[port] + count
+    dropCounts[port] = dropCounts[port] + count
+    nextTimes[port] = nextTimes[port] + (count / sampleRate)
+end
+
+-- A timestamp at the start of a port's buffer sets its time, and one later
+-- in the buffer limits how far this call can go, so it's at the start of
+-- the next one.
+local function applyTimeLabels(port, available)
+    local indices = labelIndices[port]
+    if indices == nil
+    then
+        return available
+    end
+
+    for i = 1, #indices
+    do
+        local index = indices[i]
+        if index == 0
+        then
+            nextTimes[port] = labelTimes[port][i]
+            timeKnown[port] = 1
+        elseif index < available
+        then
+            available = index
+            break
+        end
+    end
+
+    labelIndices[port] = nil
+    labelTimes[port] = nil
+
+    return available
+end
+
+function Synchronizer.sync(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems, inputElems, outputElems)
+    local allKnown = true
+    for port = 0, numPorts-1
+    do
+        availableElems[port] = applyTimeLabels(port, tonumber(inputElems[port]))
+        callDrops[port] = 0
+        callOutputTimes[port] = 0/0
+        allKnown = allKnown and (timeKnown[port] ~= 0)
+    end
+
+    local numOutputs = 0
+    if allKnown
+    then
+        -- Ports behind the latest one drop samples to catch up, and the
+        -- rest hold theirs until they do.
+        local target = nextTimes[0]
+        for port = 1, numPorts-1
+        do
+            target = math.max(target, nextTimes[port])
+        end
+
+        local aligned = true
+        for port = 0, numPorts-1
+        do
+            local behind = math.floor(((target - nextTimes[port]) * sampleRate) + 0.5)
+            if behind > 0
+            then
+                local count = math.min(behind, availableElems[port])
+                drop(port, count)
+                aligned = aligned and (count == behind)
+            end
+        end
+
+        if aligned
+        then
+            numOutputs = math.huge
+            for port = 0, numPorts-1
+            do
+                numOutputs = math.min(numOutputs, availableElems[port] - callDrops[port], tonumber(outputElems[port]))
+            end
+
+            local minTime = math.huge
+            local maxTime = -math.huge
+            for port = 0, numPorts-1
+            do
+                local input = ffi.cast("uint8_t*", buffsIn[port])
+                ffi.copy(buffsOut[port], input + (callDrops[port] * elemSize), numOutputs * elemSize)
+
+                if numOutputs > 0 then callOutputTimes[port] = nextTimes[port] end
+                nextTimes[port] = nextTimes[port] + (numOutputs / sampleRate)
+                minTime = math.min(minTime, nextTimes[port])
+                maxTime = math.max(maxTime, nextTimes[port])
+            end
+            alignmentError = maxTime - minTime
+        end
+    else
+        -- Ports can't be aligned until they've all had a timestamp, and
+        -- the ones that have hold their samples until then.
+        for port = 0, numPorts-1
+        do
+            if timeKnown[port] == 0
+            then
+                drop(port, availableElems[port])
+            end
+        end
+    end
+
+    for port = 0, numPorts-1
+    do
+        inputElems[port] = callDrops[port] + numOutputs
+        outputElems[port] = numOutputs
+    end
+end
+
+-- port is 0-based, and times are in seconds.
+function Synchronizer.setTimeLabels(port, indices, times)
+    labelIndices[port] = indices
+    labelTimes[port] = times
+end
+
+function Synchronizer.configure(newNumPorts, newElemSize, newSampleRate)
+    if newNumPorts ~= numPorts
+    then
+        numPorts = newNumPorts
+        timeKnown = ffi.new("int32_t[?]", numPorts)
+        nextTimes = ffi.new("double[?]", numPorts)
+        dropCounts = ffi.new("double[?]", numPorts)
+        callDrops = ffi.new("double[?]", numPorts)
+        callOutputTimes = ffi.new("double[?]", numPorts)
+        availableElems = ffi.new("double[?]", numPorts)
+    end
+    elemSize = newElemSize
+    sampleRate = newSampleRate
+end
+
+function Synchronizer.reset()
+    ffi.fill(timeKnown, ffi.sizeof(timeKnown))
+    ffi.fill(nextTimes, ffi.sizeof(nextTimes))
+    ffi.fill(dropCounts, ffi.sizeof(dropCounts))
+    ffi.fill(callDrops, ffi.sizeof(callDrops))
+    labelIndices = {}
+    labelTimes = {}
+    alignmentError = 0.0
+end
+
+-- Samples dropped from each port, in total and in the last call
+function Synchronizer.getDropCounts()
+    local counts = {}
+    for port = 0, numPorts-1
+    do
+        counts[port + 1] = dropCounts[port]
+    end
+
+    return counts
+end
+
+function Synchronizer.getCallDrops()
+    local drops = {}
+    for port = 0, numPorts-1
+    do
+        drops[port + 1] = callDrops[port]
+    end
+
+    return drops
+end
+
+function Synchronizer.getCallOutputTimes()
+    local times = {}
+    for port = 0, numPorts-1
+    do
+        times[port + 1] = callOutputTimes[port]
+    end
+
+    return times
+end
+
+-- The spread of the ports' times after the last aligned output, in seconds
+function Synchronizer.getAlignmentError()
+    return alignmentError
+end
+
+return Synchronizer
+
+)";
+
+//
+// Utility code
+//
+
+static const std::string DefaultTimeLabelId = "rxTime";
+static constexpr double DefaultSampleRate = 1e6;
+
+//
+// Implementation
+//
+
+class LuaJITStreamSynchronizer: public LuaJITBlock
+{
+    public:
+        static Pothos::Block* make(
+            const Pothos::DType& dtype,
+            size_t numPorts)
+        {
+            return new LuaJITStreamSynchronizer(dtype, numPorts);
+        }
+
+        LuaJITStreamSynchronizer(
+            const Pothos::DType& dtype,
+            size_t numPorts
+        ):
+            LuaJITBlock(
+                std::vector<std::string>(numPorts, dtype.name()),
+                std::vector<std::string>(numPorts, dtype.name()),
+                false,
+                std::vector<std::string>{"minimal"}),
+            _numPorts(numPorts),
+            _elemSize(dtype.size()),
+            _sampleRate(DefaultSampleRate),
+            _timeLabelId(DefaultTimeLabelId),
+            _haveTimeReference(false),
+            _timeReferenceNs(0),
+            _callDrops(numPorts, 0.0),
+            _callOutputTimes(numPorts, 0.0),
+            _pendingTimeLabels(numPorts, false)
+        {
+            if(numPorts < 2)
+            {
+                throw Pothos::RangeException("There must be at least 2 ports.");
+            }
+
+            this->setSource(StreamSynchronizerScript, "sync");
+            this->setVariableRate(true);
+            this->configure();
+
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITStreamSynchronizer, setSampleRate));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITStreamSynchronizer, getSampleRate));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITStreamSynchronizer, setTimeLabelId));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITStreamSynchronizer, getTimeLabelId));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITStreamSynchronizer, getDropCounts));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITStreamSynchronizer, getAlignmentError));
+            this->registerProbe("getDropCounts");
+            this->registerProbe("getAlignmentError");
+        }
+
+        virtual ~LuaJITStreamSynchronizer() = default;
+
+        // Shared by all ports
+        void setSampleRate(double sampleRate)
+        {
+            if(sampleRate <= 0.0)
+            {
+                throw Pothos::RangeException("Sample rate must be positive.");
+            }
+
+            _sampleRate = sampleRate;
+            this->configure();
+        }
+
+        double getSampleRate() const
+        {
+            return _sampleRate;
+        }
+
+        // Labels with this ID hold the time of the sample they're on, in
+        // nanoseconds.
+        void setTimeLabelId(const std::string& timeLabelId)
+        {
+            _timeLabelId = timeLabelId;
+        }
+
+        const std::string& getTimeLabelId() const
+        {
+            return _timeLabelId;
+        }
+
+        std::vector<size_t> getDropCounts()
+        {
+            const auto dropCounts = this->callUserFunction<std::vector<double>>("getDropCounts");
+            return std::vector<size_t>(dropCounts.begin(), dropCounts.end());
+        }
+
+        // In seconds
+        double getAlignmentError()
+        {
+            return this->callUserFunction<double>("getAlignmentError");
+        }
+
+        void activate() override
+        {
+            _haveTimeReference = false;
+            std::fill(_pendingTimeLabels.begin(), _pendingTimeLabels.end(), false);
+            this->callUserFunction("reset");
+            LuaJITBlock::activate();
+        }
+
+        // Timestamps are passed to the function as seconds since the first
+        // one the block saw, which keeps them precise as doubles.
+        void work() override
+        {
+            auto inputs = this->inputs();
+            for(size_t port = 0; port < inputs.size(); ++port)
+            {
+                std::vector<size_t> indices;
+                std::vector<double> times;
+                for(const auto& label: inputs[port]->labels())
+                {
+                    if(label.id != _timeLabelId) continue;
+
+                    const auto timeNs = label.data.convert<long long>();
+                    if(!_haveTimeReference)
+                    {
+                        _timeReferenceNs = timeNs;
+                        _haveTimeReference = true;
+                    }
+
+                    indices.emplace_back(size_t(label.index));
+                    times.emplace_back(double(timeNs - _timeReferenceNs) / 1e9);
+                }
+
+                if(!indices.empty())
+                {
+                    this->callUserFunction("setTimeLabels", port, sol::as_table(indices), sol::as_table(times));
+                }
+            }
+
+            LuaJITBlock::work();
+
+            _callDrops = this->callUserFunction<std::vector<double>>("getCallDrops");
+            _callOutputTimes = this->callUserFunction<std::vector<double>>("getCallOutputTimes");
+        }
+
+        // Each input's labels only go to its own output. Dropped samples are
+        // consumed before any aligned ones, so labels on them move to the
+        // first sample output after them, except for timestamps, which
+        // would be wrong there. Dropping samples skips time, so the first
+        // sample output after a drop is labeled with its time instead.
+        void propagateLabels(const Pothos::InputPort* input) override
+        {
+            const auto port = size_t(input->index());
+            const auto drops = static_cast<unsigned long long>(_callDrops[port]);
+            if(drops > 0) _pendingTimeLabels[port] = true;
+
+            auto output = this->output(port);
+            bool outputTimeLabeled = false;
+            for(auto label: input->labels())
+            {
+                const bool isTimeLabel = (label.id == _timeLabelId);
+                if(label.index < drops)
+                {
+                    if(isTimeLabel) continue;
+                    label.index = 0;
+                }
+                else
+                {
+                    label.index -= drops;
+                    outputTimeLabeled = outputTimeLabeled || (isTimeLabel && (0 == label.index));
+                }
+
+                output->postLabel(label);
+            }
+
+            const auto outputTime = _callOutputTimes[port];
+            if(outputTimeLabeled) _pendingTimeLabels[port] = false;
+            else if(_pendingTimeLabels[port] && !std::isnan(outputTime))
+            {
+                const auto timeNs = _timeReferenceNs + std::llround(outputTime * 1e9);
+                output->postLabel(Pothos::Label(_timeLabelId, timeNs, 0));
+                _pendingTimeLabels[port] = false;
+            }
+        }
+
+    private:
+        size_t _numPorts;
+        size_t _elemSize;
+        double _sampleRate;
+        std::string _timeLabelId;
+
+        bool _haveTimeReference;
+        long long _timeReferenceNs;
+        std::vector<double> _callDrops;
+        std::vector<double> _callOutputTimes;
+        std::vector<bool> _pendingTimeLabels;
+
+        void configure()
+        {
+            this->callUserFunction("configure", _numPorts, _elemSize, _sampleRate);
+        }
+};
+
+//
+// Registration
+//
+
+/***********************************************************************
+ * |PothosDoc Stream Synchronizer (LuaJIT)
+ *
+ * Aligns streams from independent sources by their timestamp labels, so
+ * each output sample corresponds to the same instant across all ports.
+ * Ports behind the latest one drop samples to catch up, while the others
+ * hold theirs, and a new timestamp on any port realigns the streams from
+ * there. Samples on a port are dropped until it has had a timestamp.
+ *
+ * Each input's labels are forwarded to its own output, except timestamps
+ * on dropped samples. Instead, the first sample output after a drop is
+ * labeled with its time. The
+ * probes report the number of samples dropped from each port, and the
+ * spread of the ports' times after the last aligned output, which is under
+ * a sample unless the sources' clocks disagree.
+ *
+ * |category /LuaJIT/Synchronization
+ * |keywords time timestamp align sync multichannel
+ *
+ * |param dtype[Data Type]
+ * |widget DTypeChooser(int=1,uint=1,float=1,cint=1,cfloat=1,dim=1)
+ * |default "complex_float32"
+ * |preview disable
+ *
+ * |param numPorts[Ports]
+ * |default 2
+ * |preview disable
+ *
+ * |param sampleRate[Sample Rate] The sample rate of every stream.
+ * |units samples/sec
+ * |default 1e6
+ *
+ * |param timeLabelId[Time Label ID]
+ * The ID of labels holding a sample's time in nanoseconds.
+ * |default "rxTime"
+ * |widget StringEntry()
+ * |preview valid
+ *
+ * |factory /luajit/stream_synchronizer(dtype, numPorts)
+ * |setter setSampleRate(sampleRate)
+ * |setter setTimeLabelId(timeLabelId)
+ */
+static Pothos::BlockRegistry registerLuaJITStreamSynchronizer(
+    "/luajit/stream_synchronizer",
+    Pothos::Callable(&LuaJITStreamSynchronizer::make));
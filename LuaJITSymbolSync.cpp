@@ -0,0 +1,415 @@
+// Copyright (c) 2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#include "LuaJITBlock.hpp"
+
+#include <Pothos/Exception.hpp>
+#include <Pothos/Framework.hpp>
+
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//
+// Embedded Lua
+//
+
+static const std::string SymbolSyncScript = R"(
+
+local ffi = require("ffi")
+
+local SymbolSync = {}
+
+-- Inputs copied per pass, after the history
+local TileInputs = 1024
+
+local samplesPerSymbol = 0
+local minPeriod = 0
+local maxPeriod = 0
+local maxFrequency = 0
+local alpha = 0
+local beta = 0
+local historyLength = 0
+
+-- The last historyLength inputs, followed by a tile of new inputs
+local stagingReal = nil
+local stagingImag = nil
+
+-- Everything the per-symbol loop updates
+ffi.cdef[[
+typedef struct
+{
+    // The next symbol's position in the staging buffer, in samples
+    double position;
+
+    // The loop filter's estimate of how far the symbol period is off from nominal
+    double frequency;
+
+    double prevReal;
+    double prevImag;
+    double prevDecisionReal;
+    double prevDecisionImag;
+
+    double error;
+} luajit_symbol_sync_t;
+]]
+
+local state = ffi.new("luajit_symbol_sync_t")
+
+-- Cubic Lagrange interpolation in Farrow form, between samples index and
+-- index+1 of the staging buffer
+local function interpolate(values, index, mu)
+    local xm1 = values[index - 1]
+    local x0 = values[index]
+    local x1 = values[index + 1]
+    local x2 = values[index + 2]
+
+    local c1 = (-xm1 / 3.0) - (x0 / 2.0) + x1 - (x2 / 6.0)
+    local c2 = (xm1 / 2.0) - x0 + (x1 / 2.0)
+    local c3 = (-xm1 / 6.0) + (x0 / 2.0) - (x1 / 2.0) + (x2 / 6.0)
+
+    return (((c3 * mu) + c2) * mu + c1) * mu + x0
+end
+
+local function interpolateComplex(position)
+    local index = math.floor(position)
+    local mu = position - index
+
+    return interpolate(stagingReal, index, mu), interpolate(stagingImag, index, mu)
+end
+
+local function sign(value)
+    return (value >= 0.0) and 1.0 or -1.0
+end
+
+--
+-- Timing error detectors, which are positive when sampling early
+--
+
+-- Needs the sample halfway between this symbol and the last.
+local function gardnerError(real, imag, position, period)
+    local midReal, midImag = interpolateComplex(position - (period / 2.0))
+    return (midReal * (state.prevReal - real)) + (midImag * (state.prevImag - imag))
+end
+
+-- Decision-directed, so it needs the carrier removed first.
+local function muellerMullerError(real, imag, position, period)
+    local decisionReal = sign(real)
+    local decisionImag = sign(imag)
+
+    local err = ((state.prevDecisionReal * real) + (state.prevDecisionImag * imag))
+              - ((decisionReal * state.prevReal) + (decisionImag * state.prevImag))
+
+    state.prevDecisionReal = decisionReal
+    state.prevDecisionImag = decisionImag
+
+    return err
+end
+
+-- Produces symbols from the staging buffer until the next one needs samples
+-- past stagingEnd. Returns the number of symbols produced.
+local function produceSymbols(detector, output, outputOffset, stagingEnd)
+    local numSymbols = 0
+
+    while (state.position + 2.0) < stagingEnd
+    do
+        local position = state.position
+        local period = samplesPerSymbol + state.frequency
+
+        local real, imag = interpolateComplex(position)
+        output[2 * (outputOffset + numSymbols)] = real
+        output[(2 * (outputOffset + numSymbols)) + 1] = imag
+        numSymbols = numSymbols + 1
+
+        local err = math.max(-1.0, math.min(1.0, detector(real, imag, position, period)))
+        state.error = err
+        state.prevReal = real
+        state.prevImag = imag
+
+        state.frequency = math.max(-maxFrequency, math.min(maxFrequency, state.frequency + (beta * err)))
+        local step = samplesPerSymbol + state.frequency + (alpha * err)
+        state.position = position + math.max(minPeriod, math.min(maxPeriod, step))
+    end
+
+    return numSymbols
+end
+
+local function runSync(detector, buffsIn, buffsOut, inputElems, outputElems)
+    local input = ffi.cast("float*", buffsIn[0])
+    local output = ffi.cast("float*", buffsOut[0])
+
+    local numInputs = tonumber(inputElems[0])
+    local outputSpace = tonumber(outputElems[0])
+
+    local inputsDone = 0
+    local outputsDone = 0
+    while inputsDone < numInputs
+    do
+        -- Symbols are at least minPeriod apart, so this many inputs can't
+        -- produce more symbols than there's room for.
+        local tileInputs = math.min(TileInputs, numInputs - inputsDone)
+        tileInputs = math.min(tileInputs, math.floor((outputSpace - outputsDone - 1) * minPeriod))
+        if tileInputs <= 0
+        then
+            break
+        end
+
+        for i = 0, tileInputs-1
+        do
+            stagingReal[historyLength + i] = input[2 * (inputsDone + i)]
+            stagingImag[historyLength + i] = input[(2 * (inputsDone + i)) + 1]
+        end
+
+        outputsDone = outputsDone + produceSymbols(detector, output, outputsDone, historyLength + tileInputs)
+
+        for i = 0, historyLength-1
+        do
+            stagingReal[i] = stagingReal[i + tileInputs]
+            stagingImag[i] = stagingImag[i + tileInputs]
+        end
+        state.position = state.position - tileInputs
+
+        inputsDone = inputsDone + tileInputs
+    end
+
+    inputElems[0] = inputsDone
+    outputElems[0] = outputsDone
+end
+
+function SymbolSync.gardner(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems, inputElems, outputElems)
+    runSync(gardnerError, buffsIn, buffsOut, inputElems, outputElems)
+end
+
+function SymbolSync.muellerMuller(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems, inputElems, outputElems)
+    runSync(muellerMullerError, buffsIn, buffsOut, inputElems, outputElems)
+end
+
+-- maxDeviation is the largest fraction the symbol period can deviate from
+-- nominal.
+function SymbolSync.configure(newSamplesPerSymbol, maxDeviation, newAlpha, newBeta)
+    samplesPerSymbol = newSamplesPerSymbol
+    maxFrequency = samplesPerSymbol * maxDeviation
+    minPeriod = samplesPerSymbol - maxFrequency
+    maxPeriod = samplesPerSymbol + maxFrequency
+    alpha = newAlpha
+    beta = newBeta
+
+    state.frequency = math.max(-maxFrequency, math.min(maxFrequency, state.frequency))
+
+    -- Enough to interpolate half a symbol back from a symbol that's just
+    -- before the start of the tile. The loop only restarts if this changes.
+    local newHistoryLength = math.ceil(maxPeriod) + 4
+    if newHistoryLength ~= historyLength
+    then
+        historyLength = newHistoryLength
+        stagingReal = ffi.new("double[?]", historyLength + TileInputs)
+        stagingImag = ffi.new("double[?]", historyLength + TileInputs)
+
+        SymbolSync.reset()
+    end
+end
+
+function SymbolSync.reset()
+    ffi.fill(stagingReal, ffi.sizeof(stagingReal))
+    ffi.fill(stagingImag, ffi.sizeof(stagingImag))
+    ffi.fill(state, ffi.sizeof(state))
+    state.position = historyLength
+end
+
+-- In samples per symbol
+function SymbolSync.getSymbolPeriod()
+    return samplesPerSymbol + state.frequency
+end
+
+function SymbolSync.getTimingError()
+    return state.error
+end
+
+return SymbolSync
+
+)";
+
+//
+// Utility code
+//
+
+static constexpr double DefaultLoopBandwidth = 0.01;
+static constexpr double DefaultMaxDeviation = 0.01;
+
+static const std::unordered_map<std::string, std::string> DetectorFunctions =
+{
+    {"gardner", "gardner"},
+    {"mm", "muellerMuller"}
+};
+
+//
+// Implementation
+//
+
+class LuaJITSymbolSync: public LuaJITBlock
+{
+    public:
+        static Pothos::Block* make(
+            double samplesPerSymbol,
+            const std::string& detector)
+        {
+            return new LuaJITSymbolSync(samplesPerSymbol, detector);
+        }
+
+        LuaJITSymbolSync(
+            double samplesPerSymbol,
+            const std::string& detector
+        ):
+            LuaJITBlock(
+                std::vector<std::string>{"complex_float32"},
+                std::vector<std::string>{"complex_float32"},
+                false,
+                std::vector<std::string>{"minimal"}),
+            _samplesPerSymbol(samplesPerSymbol),
+            _loopBandwidth(DefaultLoopBandwidth),
+            _maxDeviation(DefaultMaxDeviation)
+        {
+            if(samplesPerSymbol < 2.0)
+            {
+                throw Pothos::RangeException("Samples per symbol must be at least 2.");
+            }
+
+            auto detectorIter = DetectorFunctions.find(detector);
+            if(DetectorFunctions.end() == detectorIter)
+            {
+                throw Pothos::InvalidArgumentException("Invalid timing error detector: "+detector);
+            }
+
+            this->setSource(SymbolSyncScript, detectorIter->second);
+            this->setVariableRate(true);
+            this->configure();
+
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITSymbolSync, setLoopBandwidth));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITSymbolSync, getLoopBandwidth));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITSymbolSync, setMaxDeviation));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITSymbolSync, getMaxDeviation));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITSymbolSync, getSymbolPeriod));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITSymbolSync, getTimingError));
+            this->registerProbe("getSymbolPeriod");
+            this->registerProbe("getTimingError");
+        }
+
+        virtual ~LuaJITSymbolSync() = default;
+
+        // Normalized to the symbol rate
+        void setLoopBandwidth(double loopBandwidth)
+        {
+            if(loopBandwidth <= 0.0)
+            {
+                throw Pothos::RangeException("Loop bandwidth must be positive.");
+            }
+
+            _loopBandwidth = loopBandwidth;
+            this->configure();
+        }
+
+        double getLoopBandwidth() const
+        {
+            return _loopBandwidth;
+        }
+
+        void setMaxDeviation(double maxDeviation)
+        {
+            if((maxDeviation < 0.0) || (maxDeviation >= 0.5))
+            {
+                throw Pothos::RangeException("Max deviation must be in the range [0, 0.5).");
+            }
+
+            _maxDeviation = maxDeviation;
+            this->configure();
+        }
+
+        double getMaxDeviation() const
+        {
+            return _maxDeviation;
+        }
+
+        // In samples
+        double getSymbolPeriod()
+        {
+            return this->callUserFunction<double>("getSymbolPeriod");
+        }
+
+        double getTimingError()
+        {
+            return this->callUserFunction<double>("getTimingError");
+        }
+
+        void activate() override
+        {
+            this->callUserFunction("reset");
+            LuaJITBlock::activate();
+        }
+
+    private:
+        double _samplesPerSymbol;
+        double _loopBandwidth;
+        double _maxDeviation;
+
+        // A second-order loop filter with a damping factor of 1/sqrt(2). The
+        // detectors' errors are in symbols, so the gains are scaled to move
+        // the symbol position in samples.
+        void configure()
+        {
+            const auto damping = std::sqrt(2.0) / 2.0;
+            const auto denom = 1.0 + (2.0 * damping * _loopBandwidth) + (_loopBandwidth * _loopBandwidth);
+            const auto alpha = (4.0 * damping * _loopBandwidth) / denom;
+            const auto beta = (4.0 * _loopBandwidth * _loopBandwidth) / denom;
+
+            this->callUserFunction(
+                "configure",
+                _samplesPerSymbol,
+                _maxDeviation,
+                (alpha * _samplesPerSymbol),
+                (beta * _samplesPerSymbol));
+        }
+};
+
+//
+// Registration
+//
+
+/***********************************************************************
+ * |PothosDoc Symbol Sync (LuaJIT)
+ *
+ * Recovers symbol timing, producing one interpolated sample per symbol. The
+ * input is interpolated with a cubic Farrow interpolator, whose timing is
+ * driven by a second-order loop filter.
+ *
+ * The output rate follows the input's symbol rate, so the block consumes and
+ * produces a varying number of elements per call.
+ *
+ * |category /LuaJIT/Synchronization
+ * |keywords clock timing recovery gardner mueller muller farrow
+ *
+ * |param samplesPerSymbol[Samples Per Symbol] The nominal symbol period, which may be fractional.
+ * |default 4.0
+ *
+ * |param detector[Detector] The timing error detector.
+ * <ul>
+ * <li><b>Gardner</b>: independent of the carrier phase, but needs at least 2 samples per symbol.</li>
+ * <li><b>Mueller and Muller</b>: decision-directed, so the carrier should be removed first.</li>
+ * </ul>
+ * |default "gardner"
+ * |option [Gardner] "gardner"
+ * |option [Mueller and Muller] "mm"
+ *
+ * |param loopBandwidth[Loop Bandwidth] Normalized to the symbol rate.
+ * |default 0.01
+ *
+ * |param maxDeviation[Max Deviation] The largest fraction the symbol period can deviate from nominal.
+ * |default 0.01
+ *
+ * |factory /luajit/symbol_sync(samplesPerSymbol, detector)
+ * |setter setLoopBandwidth(loopBandwidth)
+ * |setter setMaxDeviation(maxDeviation)
+ */
+static Pothos::BlockRegistry registerLuaJITSymbolSync(
+    "/luajit/symbol_sync",
+    Pothos::Callable(&LuaJITSymbolSync::make));
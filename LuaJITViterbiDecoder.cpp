@@ -0,0 +1,525 @@
+// Copyright (c) 2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#include "LuaJITBlock.hpp"
+
+#include <Pothos/Exception.hpp>
+#include <Pothos/Framework.hpp>
+
+#include <string>
+#include <vector>
+
+//
+// Embedded Lua
+//
+
+static const std::string ViterbiScript = R"(
+
+local ffi = require("ffi")
+
+local Viterbi = {}
+
+-- Path metrics start here for states the decoder knows it isn't in.
+local Unreachable = -1e30
+
+local constraintLength = 0
+local numStates = 0
+local rate = 0
+local numCodewords = 0
+local topBitShift = 0
+
+-- branchCodes[(state * 2) + j] is the codeword sent on the transition into
+-- state from its jth predecessor, ((state << 1) & (numStates-1)) | j.
+local branchCodes = nil
+
+-- Each step's metric for every codeword
+local branchMetrics = nil
+
+local pathMetrics = nil
+local newPathMetrics = nil
+
+-- For each state and step, positive if predecessor 1 survived
+local decisions = nil
+local ringSteps = 0
+
+local tracebackLength = 0
+local decodeLength = 0
+local frameSize = 0
+
+-- Steps decoded, and steps whose bits have been output, since the last reset
+local stepCount = 0
+local outputCount = 0
+
+local function parity(value)
+    local result = 0
+    while value ~= 0
+    do
+        result = bit.bxor(result, bit.band(value, 1))
+        value = bit.rshift(value, 1)
+    end
+
+    return result
+end
+
+-- Soft symbols are positive for 1 bits, so a codeword's metric is its
+-- correlation with the symbols.
+local function computeBranchMetrics(symbols, offset)
+    for codeword = 0, numCodewords-1
+    do
+        local metric = 0.0
+        for i = 0, rate-1
+        do
+            local symbol = symbols[offset + i]
+            metric = metric + ((bit.band(bit.rshift(codeword, rate - 1 - i), 1) ~= 0) and symbol or -symbol)
+        end
+        branchMetrics[codeword] = metric
+    end
+end
+
+-- Add-compare-select for one step, recording decisions at the given step.
+-- Each decision is stored as the difference between the two candidates'
+-- metrics, which keeps this loop branch-free; its sign is only checked
+-- during traceback.
+local function addCompareSelect(step)
+    local decisionOffset = (step % ringSteps) * numStates
+    local mask = numStates - 1
+
+    for state = 0, numStates-1
+    do
+        local pred0 = bit.band(state + state, mask)
+        local metric0 = pathMetrics[pred0] + branchMetrics[branchCodes[2 * state]]
+        local metric1 = pathMetrics[pred0 + 1] + branchMetrics[branchCodes[(2 * state) + 1]]
+
+        newPathMetrics[state] = math.max(metric0, metric1)
+        decisions[decisionOffset + state] = metric1 - metric0
+    end
+
+    pathMetrics, newPathMetrics = newPathMetrics, pathMetrics
+end
+
+local function getBestState()
+    local bestState = 0
+    for state = 1, numStates-1
+    do
+        if pathMetrics[state] > pathMetrics[bestState]
+        then
+            bestState = state
+        end
+    end
+
+    return bestState
+end
+
+-- Keeps the metrics near zero, since only their differences matter.
+local function normalizePathMetrics(reference)
+    for state = 0, numStates-1
+    do
+        pathMetrics[state] = pathMetrics[state] - reference
+    end
+end
+
+-- Traces back from state at lastStep, writing the bits for steps
+-- [firstOutput, firstOutput+numBits) to output[outputOffset...].
+local function traceback(state, lastStep, firstOutput, numBits, output, outputOffset)
+    local mask = numStates - 1
+
+    for step = lastStep, firstOutput, -1
+    do
+        if step < (firstOutput + numBits)
+        then
+            output[outputOffset + (step - firstOutput)] = bit.rshift(state, topBitShift)
+        end
+
+        local decision = (decisions[((step % ringSteps) * numStates) + state] > 0.0) and 1 or 0
+        state = bit.bor(bit.band(bit.lshift(state, 1), mask), decision)
+    end
+end
+
+local function resetPathMetrics()
+    for state = 0, numStates-1
+    do
+        pathMetrics[state] = Unreachable
+    end
+    pathMetrics[0] = 0.0
+end
+
+-- Decodes with a sliding window: once tracebackLength+decodeLength steps are
+-- buffered, the oldest decodeLength bits are output.
+local function decodeStream(symbols, output, numSymbols, outputSpace)
+    local numSteps = math.floor(numSymbols / rate)
+    local outputsDone = 0
+
+    local step = 0
+    while step < numSteps
+    do
+        -- Don't start a window there's no room to output.
+        local windowEnd = outputCount + tracebackLength + decodeLength
+        if ((stepCount + 1) == windowEnd) and ((outputSpace - outputsDone) < decodeLength)
+        then
+            break
+        end
+
+        computeBranchMetrics(symbols, step * rate)
+        addCompareSelect(stepCount)
+        stepCount = stepCount + 1
+        step = step + 1
+
+        if stepCount == windowEnd
+        then
+            local bestState = getBestState()
+            traceback(bestState, stepCount - 1, outputCount, decodeLength, output, outputsDone)
+            normalizePathMetrics(pathMetrics[bestState])
+
+            outputCount = outputCount + decodeLength
+            outputsDone = outputsDone + decodeLength
+        end
+    end
+
+    return (step * rate), outputsDone
+end
+
+-- Decodes whole frames of frameSize bits, each followed by
+-- constraintLength-1 zero tail bits, so each starts and ends in state 0.
+local function decodeFrames(symbols, output, numSymbols, outputSpace)
+    local frameSteps = frameSize + constraintLength - 1
+    local numFrames = math.min(math.floor(numSymbols / (frameSteps * rate)), math.floor(outputSpace / frameSize))
+
+    for frame = 0, numFrames-1
+    do
+        resetPathMetrics()
+
+        local symbolOffset = frame * frameSteps * rate
+        for step = 0, frameSteps-1
+        do
+            computeBranchMetrics(symbols, symbolOffset + (step * rate))
+            addCompareSelect(step)
+        end
+
+        traceback(0, frameSteps - 1, 0, frameSize, output, frame * frameSize)
+    end
+
+    return (numFrames * frameSteps * rate), (numFrames * frameSize)
+end
+
+local function decode(symbols, buffsOut, inputElems, outputElems)
+    local output = ffi.cast("uint8_t*", buffsOut[0])
+    local numSymbols = tonumber(inputElems[0])
+    local outputSpace = tonumber(outputElems[0])
+
+    local symbolsDone, outputsDone
+    if frameSize > 0
+    then
+        symbolsDone, outputsDone = decodeFrames(symbols, output, numSymbols, outputSpace)
+    else
+        symbolsDone, outputsDone = decodeStream(symbols, output, numSymbols, outputSpace)
+    end
+
+    inputElems[0] = symbolsDone
+    outputElems[0] = outputsDone
+end
+
+function Viterbi.decodeSoft(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems, inputElems, outputElems)
+    decode(ffi.cast("float*", buffsIn[0]), buffsOut, inputElems, outputElems)
+end
+
+-- Hard bits become full-confidence soft symbols, so the correlation metric
+-- is equivalent to Hamming distance.
+local hardSymbols = nil
+
+function Viterbi.decodeHard(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems, inputElems, outputElems)
+    local input = ffi.cast("uint8_t*", buffsIn[0])
+
+    local numSymbols = tonumber(inputElems[0])
+    if (hardSymbols == nil) or (ffi.sizeof(hardSymbols) < (numSymbols * ffi.sizeof("float")))
+    then
+        hardSymbols = ffi.new("float[?]", numSymbols)
+    end
+    for i = 0, numSymbols-1
+    do
+        hardSymbols[i] = (input[i] ~= 0) and 1.0 or -1.0
+    end
+
+    decode(hardSymbols, buffsOut, inputElems, outputElems)
+end
+
+-- polynomials holds one generator per output symbol, where bit
+-- constraintLength-1 taps the newest input bit. codeKey identifies the code,
+-- so decoders for the same code share its branch table.
+function Viterbi.configure(newConstraintLength, polynomials, codeKey, newTracebackLength, newDecodeLength, newFrameSize)
+    constraintLength = newConstraintLength
+    numStates = bit.lshift(1, constraintLength - 1)
+    rate = #polynomials
+    numCodewords = bit.lshift(1, rate)
+    topBitShift = constraintLength - 2
+
+    branchCodes = ffi.cast("uint8_t*", BlockEnv.GetSharedTable(
+        "luajit/viterbi/branch_codes/"..codeKey,
+        2 * numStates,
+        function(ptr)
+            local values = ffi.cast("uint8_t*", ptr)
+            local mask = numStates - 1
+            for state = 0, numStates-1
+            do
+                -- The newest input bit ends up in the state's top bit.
+                local inputBit = bit.rshift(state, constraintLength - 2)
+                for j = 0, 1
+                do
+                    local pred = bit.bor(bit.band(bit.lshift(state, 1), mask), j)
+                    local register = bit.bor(bit.lshift(inputBit, constraintLength - 1), pred)
+
+                    local codeword = 0
+                    for i = 1, rate
+                    do
+                        codeword = bit.bor(bit.lshift(codeword, 1), parity(bit.band(register, polynomials[i])))
+                    end
+                    values[(2 * state) + j] = codeword
+                end
+            end
+        end))
+
+    branchMetrics = ffi.new("double[?]", numCodewords)
+    pathMetrics = ffi.new("double[?]", numStates)
+    newPathMetrics = ffi.new("double[?]", numStates)
+
+    tracebackLength = newTracebackLength
+    decodeLength = newDecodeLength
+    frameSize = newFrameSize
+
+    if frameSize > 0
+    then
+        ringSteps = frameSize + constraintLength - 1
+    else
+        ringSteps = tracebackLength + decodeLength
+    end
+    decisions = ffi.new("float[?]", ringSteps * numStates)
+
+    Viterbi.reset()
+end
+
+function Viterbi.reset()
+    resetPathMetrics()
+    stepCount = 0
+    outputCount = 0
+end
+
+return Viterbi
+
+)";
+
+//
+// Utility code
+//
+
+static constexpr size_t MinConstraintLength = 3;
+static constexpr size_t MaxConstraintLength = 9;
+static constexpr size_t MaxRate = 8;
+
+static constexpr size_t DefaultTracebackLength = 64;
+static constexpr size_t DefaultDecodeLength = 32;
+
+//
+// Implementation
+//
+
+class LuaJITViterbiDecoder: public LuaJITBlock
+{
+    public:
+        static Pothos::Block* make(
+            size_t constraintLength,
+            const std::vector<size_t>& polynomials,
+            bool softInput)
+        {
+            return new LuaJITViterbiDecoder(constraintLength, polynomials, softInput);
+        }
+
+        LuaJITViterbiDecoder(
+            size_t constraintLength,
+            const std::vector<size_t>& polynomials,
+            bool softInput
+        ):
+            LuaJITBlock(
+                std::vector<std::string>{softInput ? "float32" : "uint8"},
+                std::vector<std::string>{"uint8"},
+                false,
+                std::vector<std::string>{"minimal"}),
+            _constraintLength(constraintLength),
+            _polynomials(polynomials),
+            _tracebackLength(DefaultTracebackLength),
+            _decodeLength(DefaultDecodeLength),
+            _frameSize(0)
+        {
+            if((constraintLength < MinConstraintLength) || (constraintLength > MaxConstraintLength))
+            {
+                throw Pothos::RangeException(
+                          "Constraint length must be in the range ["+
+                          std::to_string(MinConstraintLength)+", "+
+                          std::to_string(MaxConstraintLength)+"].");
+            }
+            if((polynomials.size() < 2) || (polynomials.size() > MaxRate))
+            {
+                throw Pothos::InvalidArgumentException(
+                          "There must be between 2 and "+std::to_string(MaxRate)+" polynomials.");
+            }
+
+            // Decoders for the same code share its branch table.
+            _codeKey = std::to_string(constraintLength);
+            for(const auto polynomial: polynomials)
+            {
+                if((0 == polynomial) || (polynomial >= (size_t(1) << constraintLength)))
+                {
+                    throw Pothos::InvalidArgumentException(
+                              "Polynomial "+std::to_string(polynomial)+" doesn't fit the constraint length.");
+                }
+
+                _codeKey += "/"+std::to_string(polynomial);
+            }
+
+            this->setSource(ViterbiScript, (softInput ? "decodeSoft" : "decodeHard"));
+            this->setVariableRate(true);
+            this->configure();
+
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITViterbiDecoder, setTracebackLength));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITViterbiDecoder, getTracebackLength));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITViterbiDecoder, setDecodeLength));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITViterbiDecoder, getDecodeLength));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITViterbiDecoder, setFrameSize));
+            this->registerCall(this, POTHOS_FCN_TUPLE(LuaJITViterbiDecoder, getFrameSize));
+        }
+
+        virtual ~LuaJITViterbiDecoder() = default;
+
+        // How far back from the newest step the traceback starts outputting bits
+        void setTracebackLength(size_t tracebackLength)
+        {
+            if(0 == tracebackLength)
+            {
+                throw Pothos::RangeException("Traceback length must be positive.");
+            }
+
+            _tracebackLength = tracebackLength;
+            this->configure();
+        }
+
+        size_t getTracebackLength() const
+        {
+            return _tracebackLength;
+        }
+
+        // How many bits each traceback outputs
+        void setDecodeLength(size_t decodeLength)
+        {
+            if(0 == decodeLength)
+            {
+                throw Pothos::RangeException("Decode length must be positive.");
+            }
+
+            _decodeLength = decodeLength;
+            this->configure();
+        }
+
+        size_t getDecodeLength() const
+        {
+            return _decodeLength;
+        }
+
+        // If non-zero, the input is decoded as frames of frameSize bits, each
+        // terminated with constraintLength-1 zero bits.
+        void setFrameSize(size_t frameSize)
+        {
+            _frameSize = frameSize;
+            this->configure();
+        }
+
+        size_t getFrameSize() const
+        {
+            return _frameSize;
+        }
+
+        void activate() override
+        {
+            this->callUserFunction("reset");
+            LuaJITBlock::activate();
+        }
+
+    private:
+        size_t _constraintLength;
+        std::vector<size_t> _polynomials;
+        std::string _codeKey;
+
+        size_t _tracebackLength;
+        size_t _decodeLength;
+        size_t _frameSize;
+
+        void configure()
+        {
+            this->callUserFunction(
+                "configure",
+                _constraintLength,
+                sol::as_table(_polynomials),
+                _codeKey,
+                _tracebackLength,
+                _decodeLength,
+                _frameSize);
+
+            // Frames are only decoded once all of their symbols are available.
+            const auto frameSteps = (_frameSize > 0) ? (_frameSize + _constraintLength - 1) : 1;
+            this->input(0)->setReserve(frameSteps * _polynomials.size());
+        }
+};
+
+//
+// Registration
+//
+
+/***********************************************************************
+ * |PothosDoc Viterbi Decoder (LuaJIT)
+ *
+ * Decodes a rate 1/N convolutional code. The path metrics and survivor
+ * decisions are kept in FFI arrays, and the transitions' codewords come from a
+ * branch table computed once per code and shared between decoders.
+ *
+ * In streaming mode, each traceback starts <b>Traceback Length</b> steps after
+ * the oldest undecoded bit and outputs <b>Decode Length</b> bits, so the
+ * output lags the input by up to their sum. In frame mode, each frame is
+ * decoded from its known start and end states.
+ *
+ * |category /LuaJIT/FEC
+ * |keywords convolutional fec viterbi decoder
+ *
+ * |param constraintLength[Constraint Length]
+ * |default 7
+ *
+ * |param polynomials[Polynomials]
+ * One generator polynomial per output symbol, in the order the symbols were
+ * sent. Bit <i>K-1</i> taps the newest input bit.
+ * |default [121, 91]
+ *
+ * |param softInput[Soft Input]
+ * If set, the input is float32 symbols, positive for 1 bits and scaled by
+ * confidence. Otherwise, it's uint8 hard bits.
+ * |default true
+ * |option [Soft] true
+ * |option [Hard] false
+ *
+ * |param tracebackLength[Traceback Length]
+ * |units bits
+ * |default 64
+ *
+ * |param decodeLength[Decode Length]
+ * |units bits
+ * |default 32
+ *
+ * |param frameSize[Frame Size]
+ * If non-zero, the number of data bits per frame, each followed by K-1 zero
+ * tail bits.
+ * |units bits
+ * |default 0
+ *
+ * |factory /luajit/viterbi_decoder(constraintLength, polynomials, softInput)
+ * |setter setTracebackLength(tracebackLength)
+ * |setter setDecodeLength(decodeLength)
+ * |setter setFrameSize(frameSize)
+ */
+static Pothos::BlockRegistry registerLuaJITViterbiDecoder(
+    "/luajit/viterbi_decoder",
+    Pothos::Callable(&LuaJITViterbiDecoder::make));
@@ -1,6 +1,8 @@
 // Copyright (c) 2020 Nicholas Corgan
 // SPDX-License-Identifier: MIT
 
+#include "LuaJITBlock.hpp"
+
 #include <Pothos/Plugin.hpp>
 
 #include <json.hpp>
@@ -12,7 +14,7 @@
 
 using nlohmann::json;
 
-static std::string __getPothosLuaJITInfo()
+static json __getPothosLuaJITInfo()
 {
     sol::state lua;
     lua.open_libraries();
@@ -20,15 +22,45 @@ static std::string __getPothosLuaJITInfo()
     json topObject;
     topObject["LuaJIT Version"] = lua["jit"]["version"].get<std::string>();
 
-    return topObject.dump();
+    return topObject;
+}
+
+static json getBlockMemoryUsageInfo()
+{
+    json blocksArray = json::array();
+    size_t totalBytes = 0;
+
+    for(const auto& memoryUsage: LuaJITBlock::getAllMemoryUsage())
+    {
+        const auto blockBytes = memoryUsage.luaHeapBytes + memoryUsage.jitMcodeBytes + memoryUsage.portBufferBytes;
+        totalBytes += blockBytes;
+
+        json blockObject;
+        blockObject["Name"] = memoryUsage.blockName;
+        blockObject["Lua Heap (bytes)"] = memoryUsage.luaHeapBytes;
+        blockObject["JIT Machine Code (bytes)"] = memoryUsage.jitMcodeBytes;
+        blockObject["Port Buffers (bytes)"] = memoryUsage.portBufferBytes;
+        blockObject["Total (bytes)"] = blockBytes;
+        blocksArray.push_back(blockObject);
+    }
+
+    json memoryObject;
+    memoryObject["Blocks"] = blocksArray;
+    memoryObject["Total (bytes)"] = totalBytes;
+
+    return memoryObject;
 }
 
 static std::string getPothosLuaJITInfo()
 {
-    // Only do this once.
+    // Only query the LuaJIT version once.
     static const auto info = __getPothosLuaJITInfo();
 
-    return info;
+    // Block memory usage changes over time, so query it every call.
+    auto topObject = info;
+    topObject["Block Memory Usage"] = getBlockMemoryUsageInfo();
+
+    return topObject.dump();
 }
 
 pothos_static_block(registerPothosLuaJITInfo)
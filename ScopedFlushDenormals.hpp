@@ -0,0 +1,53 @@
+// Copyright (c) 2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+#include <xmmintrin.h>
+#define POTHOS_LUAJIT_FLUSH_DENORMALS_SSE
+#elif defined(__aarch64__)
+#define POTHOS_LUAJIT_FLUSH_DENORMALS_AARCH64
+#endif
+
+// Sets flush-to-zero and denormals-are-zero on the calling thread for the
+// object's lifetime, then restores the previous mode. This is a no-op on
+// unsupported architectures.
+class ScopedFlushDenormals
+{
+public:
+    inline explicit ScopedFlushDenormals(bool enable): _enabled(enable), _prevMode(0)
+    {
+        if(!_enabled) return;
+
+#if defined(POTHOS_LUAJIT_FLUSH_DENORMALS_SSE)
+        // FTZ (bit 15) and DAZ (bit 6)
+        _prevMode = _mm_getcsr();
+        _mm_setcsr(static_cast<unsigned int>(_prevMode | 0x8040));
+#elif defined(POTHOS_LUAJIT_FLUSH_DENORMALS_AARCH64)
+        // FZ (bit 24) covers both inputs and outputs.
+        asm volatile("mrs %0, fpcr" : "=r"(_prevMode));
+        asm volatile("msr fpcr, %0" : : "r"(_prevMode | (std::uint64_t(1) << 24)));
+#endif
+    }
+
+    inline ~ScopedFlushDenormals()
+    {
+        if(!_enabled) return;
+
+#if defined(POTHOS_LUAJIT_FLUSH_DENORMALS_SSE)
+        _mm_setcsr(static_cast<unsigned int>(_prevMode));
+#elif defined(POTHOS_LUAJIT_FLUSH_DENORMALS_AARCH64)
+        asm volatile("msr fpcr, %0" : : "r"(_prevMode));
+#endif
+    }
+
+    ScopedFlushDenormals(const ScopedFlushDenormals&) = delete;
+    ScopedFlushDenormals& operator=(const ScopedFlushDenormals&) = delete;
+
+private:
+    bool _enabled;
+    std::uint64_t _prevMode;
+};
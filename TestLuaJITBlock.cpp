@@ -1,14 +1,21 @@
 // Copyright (c) 2020-2021 Nicholas Corgan
 // SPDX-License-Identifier: MIT
 
+#include "LuaJITDocCache.hpp"
+#include "ScopedFlushDenormals.hpp"
+#include "TestUtility.hpp"
+
 #include <Pothos/Config.hpp>
 #include <Pothos/Framework.hpp>
+#include <Pothos/Plugin.hpp>
 #include <Pothos/Proxy.hpp>
+#include <Pothos/System/Paths.hpp>
 #include <Pothos/Testing.hpp>
 #include <Pothos/Util/Compiler.hpp>
 
 #include <json.hpp>
 
+#include <Poco/File.h>
 #include <Poco/Format.h>
 #include <Poco/NumberFormatter.h>
 #include <Poco/Path.h>
@@ -17,10 +24,20 @@
 #include <Poco/Timestamp.h>
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <complex>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 //
@@ -171,23 +188,6 @@ return TestFuncs
 // Test code
 //
 
-static std::string writeToFileAndGetPath(
-    const std::string& str,
-    const std::string& extension)
-{
-    auto tempFilepath = Poco::format(
-                            "%s%s.%s",
-                            Poco::Path::temp(),
-                            Poco::NumberFormatter::format(Poco::Timestamp().epochMicroseconds()),
-                            extension);
-    Poco::TemporaryFile::registerForDeletion(tempFilepath);
-
-    std::ofstream out(tempFilepath.c_str(), std::ios::out);
-    out << str;
-
-    return tempFilepath;
-}
-
 static void testLuaJITBlocks(const std::string& luaSource)
 {
     //
@@ -510,3 +510,2409 @@ POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_blocks_with_preloaded_libraries)
         epsilon,
         numElements);
 }
+
+//
+// Testing Lua library profiles
+//
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_block_lua_libraries)
+{
+    // The block function only exists if the io library wasn't opened.
+    static const std::string LuaJITBlockScript = R"(
+
+    local TestFuncs = {}
+
+    if not io
+    then
+        function TestFuncs.blockFunc(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+        end
+    end
+
+    return TestFuncs
+
+    )";
+
+    auto luajitBlock = Pothos::BlockRegistry::make(
+                           "/blocks/luajit_block",
+                           std::vector<std::string>{"float32"},
+                           std::vector<std::string>{"float32"});
+
+    // The default profile opens all libraries.
+    POTHOS_TEST_THROWS(
+        luajitBlock.call("setSource", LuaJITBlockScript, "blockFunc"),
+        Pothos::Exception);
+
+    luajitBlock.call("setLuaLibraries", std::vector<std::string>{"minimal"});
+    luajitBlock.call("setSource", LuaJITBlockScript, "blockFunc");
+
+    // Changing the libraries reloads the source into the new state.
+    POTHOS_TEST_THROWS(
+        luajitBlock.call("setLuaLibraries", std::vector<std::string>{"minimal", "io"}),
+        Pothos::Exception);
+
+    POTHOS_TEST_THROWS(
+        luajitBlock.call("setLuaLibraries", std::vector<std::string>{"not_a_library"}),
+        Pothos::Exception);
+
+    // Failing to change the libraries leaves the block's function in place.
+    const auto input = getRandomInputs();
+
+    auto source = Pothos::BlockRegistry::make("/blocks/feeder_source", "float32");
+    source.call("feedBuffer", input);
+
+    auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "float32");
+
+    {
+        Pothos::Topology topology;
+        topology.connect(source, 0, luajitBlock, 0);
+        topology.connect(luajitBlock, 0, sink, 0);
+
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+    }
+
+    POTHOS_TEST_EQUAL(input.elements(), sink.call<Pothos::BufferChunk>("getBuffer").elements());
+}
+
+//
+// Testing fusing chains of LuaJIT blocks
+//
+
+static const std::string FusionFuncsScript = R"(
+
+local ffi = require("ffi")
+
+local FusionFuncs = {}
+
+function FusionFuncs.scale(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    local floatBuffIn = ffi.cast("float*", buffsIn[0])
+    local floatBuffOut = ffi.cast("float*", buffsOut[0])
+
+    for i = 0, elems-1
+    do
+        floatBuffOut[i] = floatBuffIn[i] * 3.5
+    end
+end
+
+function FusionFuncs.offset(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    local floatBuffIn = ffi.cast("float*", buffsIn[0])
+    local floatBuffOut = ffi.cast("float*", buffsOut[0])
+
+    for i = 0, elems-1
+    do
+        floatBuffOut[i] = floatBuffIn[i] - 0.25
+    end
+end
+
+function FusionFuncs.square(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    local floatBuffIn = ffi.cast("float*", buffsIn[0])
+    local doubleBuffOut = ffi.cast("double*", buffsOut[0])
+
+    for i = 0, elems-1
+    do
+        doubleBuffOut[i] = floatBuffIn[i] * floatBuffIn[i]
+    end
+end
+
+return FusionFuncs
+
+)";
+
+static std::vector<Pothos::Proxy> makeFusionChain()
+{
+    const std::vector<std::string> functionNames = {"scale", "offset", "square"};
+    const std::vector<std::string> outputTypes = {"float32", "float32", "float64"};
+
+    std::vector<Pothos::Proxy> chain;
+    for(size_t i = 0; i < functionNames.size(); ++i)
+    {
+        auto luajitBlock = Pothos::BlockRegistry::make(
+                               "/blocks/luajit_block",
+                               std::vector<std::string>{"float32"},
+                               std::vector<std::string>{outputTypes[i]});
+        luajitBlock.call("setSource", FusionFuncsScript, functionNames[i]);
+        luajitBlock.call("setStateless", true);
+
+        chain.emplace_back(std::move(luajitBlock));
+    }
+
+    return chain;
+}
+
+static Pothos::BufferChunk runFusionChain(
+    const Pothos::BufferChunk& input,
+    const std::vector<Pothos::Proxy>& chain)
+{
+    auto source = Pothos::BlockRegistry::make("/blocks/feeder_source", "float32");
+    source.call("feedBuffer", input);
+
+    auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "float64");
+
+    {
+        Pothos::Topology topology;
+        topology.connect(source, 0, chain.front(), 0);
+        for(size_t i = 1; i < chain.size(); ++i)
+        {
+            topology.connect(chain[i-1], 0, chain[i], 0);
+        }
+        topology.connect(chain.back(), 0, sink, 0);
+
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+    }
+
+    return sink.call<Pothos::BufferChunk>("getBuffer");
+}
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_fused_chain)
+{
+    const auto input = getRandomInputs();
+
+    const auto expectedOutput = runFusionChain(input, makeFusionChain());
+    POTHOS_TEST_EQUAL(numElements, expectedOutput.elements());
+
+    auto fusedBlock = Pothos::BlockRegistry::make("/luajit/fused_chain", makeFusionChain());
+    const auto fusedOutput = runFusionChain(input, {fusedBlock});
+
+    // Fusing must not change the results at all.
+    POTHOS_TEST_EQUAL(expectedOutput.dtype, fusedOutput.dtype);
+    POTHOS_TEST_EQUAL(expectedOutput.elements(), fusedOutput.elements());
+    POTHOS_TEST_EQUALA(
+        expectedOutput.as<const double*>(),
+        fusedOutput.as<const double*>(),
+        fusedOutput.elements());
+
+    // Blocks not marked as stateless can't be fused.
+    auto chain = makeFusionChain();
+    chain[1].call("setStateless", false);
+    POTHOS_TEST_THROWS(
+        Pothos::BlockRegistry::make("/luajit/fused_chain", chain),
+        Pothos::Exception);
+}
+
+//
+// Testing pipelined LuaJIT stages
+//
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_pipeline_block)
+{
+    // Each stage keeps state across calls, so stages must see their input
+    // in order for the output to match.
+    static const std::string PipelineFuncsScript = R"(
+
+    local ffi = require("ffi")
+
+    local PipelineFuncs = {}
+
+    local sum = 0LL
+    function PipelineFuncs.runningSum(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+        local intBuffIn = ffi.cast("int32_t*", buffsIn[0])
+        local longBuffOut = ffi.cast("int64_t*", buffsOut[0])
+
+        for i = 0, elems-1
+        do
+            sum = sum + intBuffIn[i]
+            longBuffOut[i] = sum
+        end
+    end
+
+    local prev = 0LL
+    function PipelineFuncs.difference(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+        local longBuffIn = ffi.cast("int64_t*", buffsIn[0])
+        local intBuffOut = ffi.cast("int32_t*", buffsOut[0])
+
+        for i = 0, elems-1
+        do
+            intBuffOut[i] = longBuffIn[i] - prev
+            prev = longBuffIn[i]
+        end
+    end
+
+    function PipelineFuncs.negate(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+        local intBuffIn = ffi.cast("int32_t*", buffsIn[0])
+        local intBuffOut = ffi.cast("int32_t*", buffsOut[0])
+
+        for i = 0, elems-1
+        do
+            intBuffOut[i] = -intBuffIn[i]
+        end
+    end
+
+    return PipelineFuncs
+
+    )";
+
+    static Poco::Random rng;
+
+    Pothos::BufferChunk input("int32", numElements);
+    Pothos::BufferChunk expectedOutput("int32", numElements);
+    for(size_t elem = 0; elem < numElements; ++elem)
+    {
+        input.as<int*>()[elem] = int(rng.next(2000)) - 1000;
+        expectedOutput.as<int*>()[elem] = -input.as<const int*>()[elem];
+    }
+
+    auto source = Pothos::BlockRegistry::make("/blocks/feeder_source", "int32");
+    source.call("feedBuffer", input);
+
+    auto pipelineBlock = Pothos::BlockRegistry::make(
+                             "/luajit/pipeline_block",
+                             "int32",
+                             "int32",
+                             std::vector<std::string>{"int64", "int32"});
+    pipelineBlock.call(
+        "setSource",
+        PipelineFuncsScript,
+        std::vector<std::string>{"runningSum", "difference", "negate"});
+
+    // Small tiles, so each stage is called many times.
+    pipelineBlock.call("setTileSize", 100);
+
+    auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "int32");
+
+    {
+        Pothos::Topology topology;
+        topology.connect(source, 0, pipelineBlock, 0);
+        topology.connect(pipelineBlock, 0, sink, 0);
+
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.05));
+    }
+
+    auto output = sink.call<Pothos::BufferChunk>("getBuffer");
+    POTHOS_TEST_EQUAL(expectedOutput.elements(), output.elements());
+    POTHOS_TEST_EQUALA(
+        expectedOutput.as<const int*>(),
+        output.as<const int*>(),
+        numElements);
+
+    // The number of functions must match the number of stages.
+    POTHOS_TEST_THROWS(
+        pipelineBlock.call("setSource", PipelineFuncsScript, std::vector<std::string>{"negate"}),
+        Pothos::Exception);
+}
+
+//
+// Testing cost-based thread pool placement
+//
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_block_placement)
+{
+    static const std::string PlacementFuncsScript = R"(
+
+    local ffi = require("ffi")
+
+    local PlacementFuncs = {}
+
+    function PlacementFuncs.light(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+        local floatBuffIn = ffi.cast("float*", buffsIn[0])
+        local floatBuffOut = ffi.cast("float*", buffsOut[0])
+
+        for i = 0, elems-1
+        do
+            floatBuffOut[i] = floatBuffIn[i]
+        end
+    end
+
+    function PlacementFuncs.heavy(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+        local floatBuffIn = ffi.cast("float*", buffsIn[0])
+        local floatBuffOut = ffi.cast("float*", buffsOut[0])
+
+        for i = 0, elems-1
+        do
+            local val = floatBuffIn[i]
+            for j = 1, 2000
+            do
+                val = (val * 0.999) + 0.001
+            end
+            floatBuffOut[i] = val
+        end
+    end
+
+    return PlacementFuncs
+
+    )";
+
+    // Heavy blocks first and last, so a naive split would pair them.
+    const std::vector<std::string> functionNames = {"heavy", "light", "light", "heavy"};
+
+    auto source = Pothos::BlockRegistry::make("/blocks/feeder_source", "float32");
+    source.call("feedBuffer", getRandomInputs());
+
+    std::vector<Pothos::Proxy> luajitBlocks;
+    std::vector<Pothos::Proxy> sinks;
+    for(const auto& functionName: functionNames)
+    {
+        auto luajitBlock = Pothos::BlockRegistry::make(
+                               "/blocks/luajit_block",
+                               std::vector<std::string>{"float32"},
+                               std::vector<std::string>{"float32"});
+        luajitBlock.call("setSource", PlacementFuncsScript, functionName);
+
+        luajitBlocks.emplace_back(std::move(luajitBlock));
+        sinks.emplace_back(Pothos::BlockRegistry::make("/blocks/collector_sink", "float32"));
+    }
+
+    {
+        Pothos::Topology topology;
+        for(size_t i = 0; i < luajitBlocks.size(); ++i)
+        {
+            topology.connect(source, 0, luajitBlocks[i], 0);
+            topology.connect(luajitBlocks[i], 0, sinks[i], 0);
+        }
+
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.01, 10.0));
+    }
+
+    POTHOS_TEST_TRUE(luajitBlocks[0].call<double>("getNsPerElement") > luajitBlocks[1].call<double>("getNsPerElement"));
+    POTHOS_TEST_TRUE(luajitBlocks[0].call<double>("getCallRate") > 0.0);
+
+    const std::vector<Pothos::ThreadPool> threadPools =
+    {
+        Pothos::ThreadPool(Pothos::ThreadPoolArgs(1)),
+        Pothos::ThreadPool(Pothos::ThreadPoolArgs(1))
+    };
+
+    auto placeBlocks = Pothos::PluginRegistry::get("/luajit/placement/place_blocks").getObject().extract<Pothos::Callable>();
+    const auto assignments = placeBlocks.call<std::vector<size_t>>(luajitBlocks, threadPools);
+
+    POTHOS_TEST_EQUAL(luajitBlocks.size(), assignments.size());
+    POTHOS_TEST_TRUE(assignments[0] != assignments[3]);
+    POTHOS_TEST_TRUE(assignments[1] != assignments[2]);
+}
+
+//
+// Testing time-sliced work() calls
+//
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_block_time_slice)
+{
+    static const std::string SlowCopyScript = R"(
+
+    local ffi = require("ffi")
+
+    local TestFuncs = {}
+
+    function TestFuncs.slowCopy(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+        local floatBuffIn = ffi.cast("float*", buffsIn[0])
+        local floatBuffOut = ffi.cast("float*", buffsOut[0])
+
+        for i = 0, elems-1
+        do
+            local val = floatBuffIn[i]
+            for j = 1, 1000
+            do
+                val = val + 0.0
+            end
+            floatBuffOut[i] = val
+        end
+    end
+
+    return TestFuncs
+
+    )";
+
+    const auto input = getRandomInputs();
+
+    auto source = Pothos::BlockRegistry::make("/blocks/feeder_source", "float32");
+    source.call("feedBuffer", input);
+
+    auto luajitBlock = Pothos::BlockRegistry::make(
+                           "/blocks/luajit_block",
+                           std::vector<std::string>{"float32"},
+                           std::vector<std::string>{"float32"});
+    luajitBlock.call("setSource", SlowCopyScript, "slowCopy");
+    luajitBlock.call("setTimeSlice", 1);
+    luajitBlock.call("setSliceSize", 16);
+
+    auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "float32");
+
+    {
+        Pothos::Topology topology;
+        topology.connect(source, 0, luajitBlock, 0);
+        topology.connect(luajitBlock, 0, sink, 0);
+
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+    }
+
+    // Partial returns must not lose or reorder any elements.
+    auto output = sink.call<Pothos::BufferChunk>("getBuffer");
+    POTHOS_TEST_EQUAL(input.elements(), output.elements());
+    POTHOS_TEST_EQUALA(
+        input.as<const float*>(),
+        output.as<const float*>(),
+        numElements);
+
+    POTHOS_TEST_TRUE(luajitBlock.call<unsigned long long>("getPartialReturns") > 0);
+}
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_block_time_slice_posts)
+{
+    // Labels each slice's first element with its value, and posts that
+    // element to the second output as an input slice.
+    static const std::string LabeledCopyScript = R"(
+
+    local ffi = require("ffi")
+
+    local TestFuncs = {}
+
+    function TestFuncs.labeledCopy(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+        local floatBuffIn = ffi.cast("float*", buffsIn[0])
+        local floatBuffOut = ffi.cast("float*", buffsOut[0])
+
+        for i = 0, elems-1
+        do
+            floatBuffOut[i] = floatBuffIn[i]
+        end
+
+        BlockEnv.PostLabel(0, "first", floatBuffIn[0], 0)
+        BlockEnv.PostInputSlice(0, 1, 0, 1)
+    end
+
+    return TestFuncs
+
+    )";
+
+    const auto input = getRandomInputs();
+    const auto* inputPtr = input.as<const float*>();
+
+    auto source = Pothos::BlockRegistry::make("/blocks/feeder_source", "float32");
+    source.call("feedBuffer", input);
+
+    // The time slice is long enough that each call runs several slices.
+    auto luajitBlock = Pothos::BlockRegistry::make(
+                           "/blocks/luajit_block",
+                           std::vector<std::string>{"float32"},
+                           std::vector<std::string>{"float32", "float32"});
+    luajitBlock.call("setSource", LabeledCopyScript, "labeledCopy");
+    luajitBlock.call("setTimeSlice", 1000000);
+    luajitBlock.call("setSliceSize", 16);
+
+    auto sink0 = Pothos::BlockRegistry::make("/blocks/collector_sink", "float32");
+    auto sink1 = Pothos::BlockRegistry::make("/blocks/collector_sink", "float32");
+
+    {
+        Pothos::Topology topology;
+        topology.connect(source, 0, luajitBlock, 0);
+        topology.connect(luajitBlock, 0, sink0, 0);
+        topology.connect(luajitBlock, 1, sink1, 0);
+
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+    }
+
+    POTHOS_TEST_EQUAL(input.elements(), sink0.call<Pothos::BufferChunk>("getBuffer").elements());
+
+    // Each label should land on the element it describes, and each input
+    // slice should hold that same element.
+    const auto labels = sink0.call<std::vector<Pothos::Label>>("getLabels");
+    const auto packets = sink1.call<std::vector<Pothos::Packet>>("getPackets");
+    POTHOS_TEST_TRUE(labels.size() >= (numElements / 16));
+    POTHOS_TEST_EQUAL(labels.size(), packets.size());
+    for(size_t i = 0; i < labels.size(); ++i)
+    {
+        POTHOS_TEST_EQUAL("first", labels[i].id);
+        POTHOS_TEST_TRUE(labels[i].index < numElements);
+        POTHOS_TEST_EQUAL(double(inputPtr[labels[i].index]), labels[i].data.convert<double>());
+
+        POTHOS_TEST_EQUAL(1, packets[i].payload.elements());
+        POTHOS_TEST_EQUAL(inputPtr[labels[i].index], packets[i].payload.as<const float*>()[0]);
+    }
+
+    // An output only posted to doesn't produce from its stream buffer.
+    POTHOS_TEST_EQUAL(0, sink1.call<Pothos::BufferChunk>("getBuffer").elements());
+}
+
+//
+// Testing bulk instantiation of conf-loaded blocks
+//
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_make_blocks)
+{
+    static const std::string DoubleScript = R"(
+
+    local ffi = require("ffi")
+
+    local TestFuncs = {}
+
+    function TestFuncs.double(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+        local floatBuffIn = ffi.cast("float*", buffsIn[0])
+        local floatBuffOut = ffi.cast("float*", buffsOut[0])
+
+        for i = 0, elems-1
+        do
+            floatBuffOut[i] = floatBuffIn[i] * 2.0
+        end
+    end
+
+    return TestFuncs
+
+    )";
+    static constexpr size_t numBlocks = 16;
+
+    const auto scriptPath = writeToFileAndGetPath(DoubleScript, "lua");
+
+    // The conf loader only needs the conf file's path to resolve the
+    // source, so the conf file itself doesn't need to exist.
+    const std::map<std::string, std::string> config =
+    {
+        {"confFilePath", Poco::Path(Poco::Path::temp(), "test.conf").toString()},
+        {"factory", "/luajit/tests/double"},
+        {"source", Poco::Path(scriptPath).getFileName()},
+        {"function", "double"},
+        {"input_types", "float32"},
+        {"output_types", "float32"},
+        {"stateless", "true"},
+        {"bench_chunk_sizes", "256"},
+        {"bench_iterations", "2"}
+    };
+    auto confLoader = Pothos::PluginRegistry::get("/framework/conf_loader/luajit").getObject().extract<Pothos::Callable>();
+    const auto confPluginPaths = confLoader.call<std::vector<Pothos::PluginPath>>(config);
+
+    auto benchFactories = Pothos::PluginRegistry::get("/luajit/bench/conf_factories").getObject().extract<Pothos::Callable>();
+    POTHOS_TEST_TRUE(benchFactories.call<std::string>().find("/luajit/tests/double") != std::string::npos);
+
+    auto makeBlocks = Pothos::PluginRegistry::get("/luajit/make_blocks").getObject().extract<Pothos::Callable>();
+    const auto luajitBlocks = makeBlocks.call<std::vector<Pothos::Proxy>>("/luajit/tests/double", numBlocks);
+    POTHOS_TEST_EQUAL(numBlocks, luajitBlocks.size());
+
+    POTHOS_TEST_THROWS(
+        makeBlocks.call("/luajit/tests/not_a_factory", numBlocks),
+        Pothos::NotFoundException);
+
+    const auto input = getRandomInputs();
+    std::vector<float> expectedOutput(numElements);
+    std::transform(
+        input.as<const float*>(),
+        input.as<const float*>()+numElements,
+        expectedOutput.begin(),
+        [](float val){return val * 2.0f;});
+
+    for(const auto& luajitBlock: luajitBlocks)
+    {
+        POTHOS_TEST_EQUAL("/luajit/tests/double", luajitBlock.call<std::string>("getName"));
+
+        auto source = Pothos::BlockRegistry::make("/blocks/feeder_source", "float32");
+        source.call("feedBuffer", input);
+
+        auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "float32");
+
+        {
+            Pothos::Topology topology;
+            topology.connect(source, 0, luajitBlock, 0);
+            topology.connect(luajitBlock, 0, sink, 0);
+
+            topology.commit();
+            POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+        }
+
+        auto output = sink.call<Pothos::BufferChunk>("getBuffer");
+        POTHOS_TEST_EQUAL(numElements, output.elements());
+        POTHOS_TEST_CLOSEA(
+            expectedOutput.data(),
+            output.as<const float*>(),
+            1e-6,
+            numElements);
+    }
+
+    for(const auto& pluginPath: confPluginPaths)
+    {
+        Pothos::PluginRegistry::remove(pluginPath);
+    }
+
+    // Once the conf's plugins are removed, its factory is gone.
+    POTHOS_TEST_THROWS(
+        makeBlocks.call("/luajit/tests/double", numBlocks),
+        Pothos::NotFoundException);
+    POTHOS_TEST_TRUE(benchFactories.call<std::string>().find("/luajit/tests/double") == std::string::npos);
+
+    auto zeroIterationsConfig = config;
+    zeroIterationsConfig["bench_iterations"] = "0";
+    POTHOS_TEST_THROWS(
+        confLoader.call(zeroIterationsConfig),
+        Pothos::InvalidArgumentException);
+}
+
+//
+// Testing the block documentation cache
+//
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_conf_doc_cache)
+{
+    static const std::string DocumentedScript = R"(
+
+    local TestFuncs = {}
+
+    --[[
+    /*
+    |PothosDoc Documented (LuaJIT)
+
+    A block whose docs should be cached.
+
+    |category /LuaJIT/Tests
+
+    |factory /luajit/tests/documented()
+    */
+    --]]
+    function TestFuncs.documented(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+    end
+
+    return TestFuncs
+
+    )";
+
+    const auto scriptPath = writeToFileAndGetPath(DocumentedScript, "lua");
+
+    const std::map<std::string, std::string> config =
+    {
+        {"confFilePath", Poco::Path(Poco::Path::temp(), "test.conf").toString()},
+        {"factory", "/luajit/tests/documented"},
+        {"source", Poco::Path(scriptPath).getFileName()},
+        {"function", "documented"},
+        {"input_types", "float32"},
+        {"output_types", "float32"}
+    };
+    auto confLoader = Pothos::PluginRegistry::get("/framework/conf_loader/luajit").getObject().extract<Pothos::Callable>();
+
+    const auto loadDocsJSON = [&]()
+    {
+        const auto confPluginPaths = confLoader.call<std::vector<Pothos::PluginPath>>(config);
+        const auto docsJSON = Pothos::PluginRegistry::get("/blocks/docs/luajit/tests/documented").getObject().extract<std::string>();
+
+        for(const auto& pluginPath: confPluginPaths)
+        {
+            Pothos::PluginRegistry::remove(pluginPath);
+        }
+
+        return docsJSON;
+    };
+
+    // Start without a cache entry, so the first load parses the docs.
+    std::string docSource;
+    {
+        std::ifstream in(scriptPath.c_str(), std::ios::in | std::ios::binary);
+        docSource.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    const auto cacheFilepath = getDocCacheFilepath(docSource, "/luajit/tests/documented");
+    const auto cacheRoot = Poco::Path(Pothos::System::getUserDataPath(), Poco::Path("luajit/doc_cache/")).toString();
+    POTHOS_TEST_EQUAL(cacheRoot, getDocCacheRoot());
+    POTHOS_TEST_EQUAL(0, cacheFilepath.find(cacheRoot));
+    POTHOS_TEST_EQUAL("json", Poco::Path(cacheFilepath).getExtension());
+    Poco::File cacheFile(cacheFilepath);
+    if(cacheFile.exists()) cacheFile.remove();
+
+    const auto parsedJSON = loadDocsJSON();
+    POTHOS_TEST_FALSE(parsedJSON.empty());
+    POTHOS_TEST_EQUAL("Documented (LuaJIT)", nlohmann::json::parse(parsedJSON)["name"].get<std::string>());
+
+    POTHOS_TEST_TRUE(cacheFile.exists());
+    std::string cachedJSON;
+    {
+        std::ifstream in(cacheFilepath.c_str(), std::ios::in | std::ios::binary);
+        cachedJSON.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    POTHOS_TEST_EQUAL(parsedJSON, cachedJSON);
+
+    // If the second load reads the changed cache file, it didn't parse.
+    auto changedDocs = nlohmann::json::parse(cachedJSON);
+    changedDocs["name"] = "Cached (LuaJIT)";
+    const auto changedJSON = changedDocs.dump();
+    {
+        std::ofstream out(cacheFilepath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        out << changedJSON;
+    }
+
+    POTHOS_TEST_EQUAL(changedJSON, loadDocsJSON());
+
+    cacheFile.remove();
+}
+
+//
+// Testing pooled buffers
+//
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_block_buffer_pool)
+{
+    static const std::string PostBufferScript = R"(
+
+    local ffi = require("ffi")
+
+    local TestFuncs = {}
+
+    function TestFuncs.postDoubled(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+        local floatBuffIn = ffi.cast("float*", buffsIn[0])
+
+        local handle, ptr = BlockEnv.AcquireBuffer(elems * ffi.sizeof("float"))
+        local floatBuffOut = ffi.cast("float*", ptr)
+
+        for i = 0, elems-1
+        do
+            floatBuffOut[i] = floatBuffIn[i] * 2.0
+        end
+
+        BlockEnv.PostBuffer(handle, 0, elems)
+
+        -- Acquiring and releasing shouldn't post anything.
+        local tempHandle = BlockEnv.AcquireBuffer(16)
+        BlockEnv.ReleaseBuffer(tempHandle)
+    end
+
+    return TestFuncs
+
+    )";
+
+    const auto input = getRandomInputs();
+
+    auto source = Pothos::BlockRegistry::make("/blocks/feeder_source", "float32");
+    source.call("feedBuffer", input);
+
+    auto luajitBlock = Pothos::BlockRegistry::make(
+                           "/blocks/luajit_block",
+                           std::vector<std::string>{"float32"},
+                           std::vector<std::string>{"float32"});
+    luajitBlock.call("setSource", PostBufferScript, "postDoubled");
+    luajitBlock.call("setBufferPoolSizes", std::vector<size_t>{64, numElements * sizeof(float)});
+    luajitBlock.call("setBufferPoolDepth", 2);
+
+    auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "float32");
+
+    {
+        Pothos::Topology topology;
+        topology.connect(source, 0, luajitBlock, 0);
+        topology.connect(luajitBlock, 0, sink, 0);
+
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+    }
+
+    auto output = sink.call<Pothos::BufferChunk>("getBuffer");
+    POTHOS_TEST_EQUAL(input.elements(), output.elements());
+    for(size_t elem = 0; elem < numElements; ++elem)
+    {
+        POTHOS_TEST_CLOSE(
+            (input.as<const float*>()[elem] * 2.0f),
+            output.as<const float*>()[elem],
+            1e-6f);
+    }
+
+    // Both pools start full, so at least the first acquisitions are hits.
+    POTHOS_TEST_TRUE(luajitBlock.call<double>("getBufferPoolHitRate") > 0.0);
+}
+
+//
+// Testing BlockEnv math types
+//
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_block_math_types)
+{
+    static const std::string MathTypesScript = R"(
+
+    local ffi = require("ffi")
+
+    local TestFuncs = {}
+
+    -- (a * conj(b)) / |b|, plus a vec2 round trip that should be a no-op.
+    function TestFuncs.mathTypes(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+        local buffIn0 = ffi.cast(BlockEnv.complex_float32_ptr, buffsIn[0])
+        local buffIn1 = ffi.cast(BlockEnv.complex_float32_ptr, buffsIn[1])
+        local buffOut = ffi.cast(BlockEnv.complex_float32_ptr, buffsOut[0])
+
+        for i = 0, elems-1
+        do
+            local a = buffIn0[i]
+            local b = buffIn1[i]
+            local c = (a * b:conj()) / b:abs()
+
+            local v = ((BlockEnv.vec2(c.real, c.imag) * 2.0) + 1.0 - 1.0) / 2.0
+            buffOut[i] = BlockEnv.complex_float32(v.x, v.y)
+        end
+    end
+
+    return TestFuncs
+
+    )";
+
+    std::vector<Pothos::BufferChunk> inputs;
+    for(size_t i = 0; i < 2; ++i)
+    {
+        const auto randomInputs = getRandomInputs();
+
+        // Reinterpret pairs of floats as complex values.
+        Pothos::BufferChunk complexInputs("complex_float32", numElements/2);
+        std::memcpy(complexInputs.as<void*>(), randomInputs.as<const void*>(), complexInputs.length);
+        inputs.emplace_back(complexInputs);
+    }
+
+    Pothos::BufferChunk expectedOutput("complex_float32", numElements/2);
+    for(size_t elem = 0; elem < expectedOutput.elements(); ++elem)
+    {
+        const auto a = inputs[0].as<const std::complex<float>*>()[elem];
+        const auto b = inputs[1].as<const std::complex<float>*>()[elem];
+        expectedOutput.as<std::complex<float>*>()[elem] = (a * std::conj(b)) / std::abs(b);
+    }
+
+    std::vector<Pothos::Proxy> sources;
+    for(const auto& input: inputs)
+    {
+        sources.emplace_back(Pothos::BlockRegistry::make("/blocks/feeder_source", "complex_float32"));
+        sources.back().call("feedBuffer", input);
+    }
+
+    auto luajitBlock = Pothos::BlockRegistry::make(
+                           "/blocks/luajit_block",
+                           std::vector<std::string>{"complex_float32", "complex_float32"},
+                           std::vector<std::string>{"complex_float32"});
+    luajitBlock.call("setSource", MathTypesScript, "mathTypes");
+
+    auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "complex_float32");
+
+    {
+        Pothos::Topology topology;
+        topology.connect(sources[0], 0, luajitBlock, 0);
+        topology.connect(sources[1], 0, luajitBlock, 1);
+        topology.connect(luajitBlock, 0, sink, 0);
+
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+    }
+
+    auto output = sink.call<Pothos::BufferChunk>("getBuffer");
+    POTHOS_TEST_EQUAL(expectedOutput.elements(), output.elements());
+    POTHOS_TEST_CLOSEA(
+        expectedOutput.as<const float*>(),
+        output.as<const float*>(),
+        1e-4f,
+        (output.elements() * 2));
+}
+
+//
+// Testing port staging
+//
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_block_port_staging)
+{
+    // The ports are interleaved complex_int16, but the function sees split
+    // float arrays: elems reals followed by elems imaginary values.
+    static const std::string SwapIQScript = R"(
+
+    local ffi = require("ffi")
+
+    local TestFuncs = {}
+
+    function TestFuncs.swapIQ(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+        local realIn = ffi.cast("float*", buffsIn[0])
+        local imagIn = realIn + elems
+        local realOut = ffi.cast("float*", buffsOut[0])
+        local imagOut = realOut + elems
+
+        for i = 0, elems-1
+        do
+            realOut[i] = imagIn[i] * 2.0
+            imagOut[i] = realIn[i] * 2.0
+        end
+    end
+
+    return TestFuncs
+
+    )";
+
+    Pothos::BufferChunk input("complex_int16", numElements);
+    auto* inputPtr = input.as<std::int16_t*>();
+    for(size_t i = 0; i < (numElements * 2); ++i)
+    {
+        inputPtr[i] = std::int16_t(int(i % 2000) - 1000);
+    }
+
+    auto source = Pothos::BlockRegistry::make("/blocks/feeder_source", "complex_int16");
+    source.call("feedBuffer", input);
+
+    auto luajitBlock = Pothos::BlockRegistry::make(
+                           "/blocks/luajit_block",
+                           std::vector<std::string>{"complex_int16"},
+                           std::vector<std::string>{"complex_int16"});
+    luajitBlock.call("setSource", SwapIQScript, "swapIQ");
+    luajitBlock.call("setInputStaging", 0, "complex_float32", true);
+    luajitBlock.call("setOutputStaging", 0, "complex_float32", true);
+
+    POTHOS_TEST_THROWS(
+        luajitBlock.call("setInputStaging", 0, "float32", false),
+        Pothos::InvalidArgumentException);
+
+    auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "complex_int16");
+
+    {
+        Pothos::Topology topology;
+        topology.connect(source, 0, luajitBlock, 0);
+        topology.connect(luajitBlock, 0, sink, 0);
+
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+    }
+
+    auto output = sink.call<Pothos::BufferChunk>("getBuffer");
+    POTHOS_TEST_EQUAL(numElements, output.elements());
+
+    const auto* outputPtr = output.as<const std::int16_t*>();
+    for(size_t elem = 0; elem < numElements; ++elem)
+    {
+        POTHOS_TEST_EQUAL(inputPtr[(2*elem)+1] * 2, outputPtr[2*elem]);
+        POTHOS_TEST_EQUAL(inputPtr[2*elem] * 2, outputPtr[(2*elem)+1]);
+    }
+
+    // Float values written to an integer port are rounded and saturated.
+    static const std::string CopyScript = R"(
+
+    local ffi = require("ffi")
+
+    local TestFuncs = {}
+
+    function TestFuncs.copy(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+        local input = ffi.cast("double*", buffsIn[0])
+        local output = ffi.cast("double*", buffsOut[0])
+
+        for i = 0, elems-1
+        do
+            output[i] = input[i]
+        end
+    end
+
+    return TestFuncs
+
+    )";
+
+    const std::vector<double> roundingInputs{
+        1.4, 1.6, -1.4, -1.6, 32767.4, -32768.4, 32767.6, -32768.6,
+        40000.0, -40000.0, 1e300, -std::numeric_limits<double>::infinity(),
+        std::numeric_limits<double>::quiet_NaN()};
+    const std::vector<std::int16_t> roundingOutputs{
+        1, 2, -1, -2, 32767, -32768, 32767, -32768,
+        32767, -32768, 32767, -32768,
+        0};
+
+    Pothos::BufferChunk roundingInput("float64", roundingInputs.size());
+    std::memcpy(roundingInput.as<void*>(), roundingInputs.data(), roundingInput.length);
+
+    auto roundingSource = Pothos::BlockRegistry::make("/blocks/feeder_source", "float64");
+    roundingSource.call("feedBuffer", roundingInput);
+
+    auto roundingBlock = Pothos::BlockRegistry::make(
+                             "/blocks/luajit_block",
+                             std::vector<std::string>{"float64"},
+                             std::vector<std::string>{"int16"});
+    roundingBlock.call("setSource", CopyScript, "copy");
+    roundingBlock.call("setOutputStaging", 0, "float64", false);
+
+    auto roundingSink = Pothos::BlockRegistry::make("/blocks/collector_sink", "int16");
+
+    {
+        Pothos::Topology topology;
+        topology.connect(roundingSource, 0, roundingBlock, 0);
+        topology.connect(roundingBlock, 0, roundingSink, 0);
+
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+    }
+
+    const auto roundingOutput = roundingSink.call<Pothos::BufferChunk>("getBuffer");
+    POTHOS_TEST_EQUAL(roundingOutputs.size(), roundingOutput.elements());
+    POTHOS_TEST_EQUALA(roundingOutputs.data(), roundingOutput.as<const std::int16_t*>(), roundingOutputs.size());
+}
+
+//
+// Testing denormal control
+//
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_block_flush_denormals)
+{
+    static const std::string CopyScript = R"(
+
+    local ffi = require("ffi")
+
+    local TestFuncs = {}
+
+    function TestFuncs.copy(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+        local floatBuffIn = ffi.cast("float*", buffsIn[0])
+        local floatBuffOut = ffi.cast("float*", buffsOut[0])
+
+        for i = 0, elems-1
+        do
+            floatBuffOut[i] = floatBuffIn[i] * 1.0
+        end
+    end
+
+    return TestFuncs
+
+    )";
+
+    // Smaller than the smallest normal float
+    Pothos::BufferChunk input("float32", numElements);
+    std::fill(input.as<float*>(), input.as<float*>()+numElements, 1e-39f);
+
+    for(const bool flushDenormals: {false, true})
+    {
+        auto source = Pothos::BlockRegistry::make("/blocks/feeder_source", "float32");
+        source.call("feedBuffer", input);
+
+        auto luajitBlock = Pothos::BlockRegistry::make(
+                               "/blocks/luajit_block",
+                               std::vector<std::string>{"float32"},
+                               std::vector<std::string>{"float32"});
+        luajitBlock.call("setSource", CopyScript, "copy");
+        luajitBlock.call("setFlushDenormals", flushDenormals);
+
+        auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "float32");
+
+        {
+            Pothos::Topology topology;
+            topology.connect(source, 0, luajitBlock, 0);
+            topology.connect(luajitBlock, 0, sink, 0);
+
+            topology.commit();
+            POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+        }
+
+        // The first call is always sampled.
+        POTHOS_TEST_TRUE(luajitBlock.call<unsigned long long>("getDenormalInputs") > 0);
+
+        const auto output = sink.call<Pothos::BufferChunk>("getBuffer");
+        POTHOS_TEST_EQUAL(numElements, output.elements());
+
+#if defined(POTHOS_LUAJIT_FLUSH_DENORMALS_SSE) || defined(POTHOS_LUAJIT_FLUSH_DENORMALS_AARCH64)
+        if(flushDenormals)
+        {
+            POTHOS_TEST_EQUAL(0, luajitBlock.call<unsigned long long>("getDenormalOutputs"));
+            POTHOS_TEST_EQUAL(0.0f, output.as<const float*>()[0]);
+        }
+        else
+#endif
+        {
+            POTHOS_TEST_TRUE(luajitBlock.call<unsigned long long>("getDenormalOutputs") > 0);
+            POTHOS_TEST_EQUAL(1e-39f, output.as<const float*>()[0]);
+        }
+    }
+}
+
+//
+// Testing the channelizer
+//
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_channelizer)
+{
+    constexpr size_t numChannels = 8;
+
+    static Poco::Random rng;
+
+    Pothos::BufferChunk input("complex_float32", numElements);
+    auto* inputPtr = input.as<std::complex<float>*>();
+    for(size_t elem = 0; elem < numElements; ++elem)
+    {
+        inputPtr[elem] = {(rng.nextFloat() * 2.0f) - 1.0f, (rng.nextFloat() * 2.0f) - 1.0f};
+    }
+
+    for(const size_t oversampling: {1, 2})
+    {
+        const auto decimation = numChannels / oversampling;
+
+        auto source = Pothos::BlockRegistry::make("/blocks/feeder_source", "complex_float32");
+        source.call("feedBuffer", input);
+
+        auto channelizer = Pothos::BlockRegistry::make("/luajit/channelizer", numChannels, oversampling);
+        const auto taps = channelizer.call<std::vector<double>>("getTaps");
+        POTHOS_TEST_EQUAL(numChannels * 8, taps.size());
+
+        std::vector<Pothos::Proxy> sinks;
+        for(size_t channel = 0; channel < numChannels; ++channel)
+        {
+            sinks.emplace_back(Pothos::BlockRegistry::make("/blocks/collector_sink", "complex_float32"));
+        }
+
+        {
+            Pothos::Topology topology;
+            topology.connect(source, 0, channelizer, 0);
+            for(size_t channel = 0; channel < numChannels; ++channel)
+            {
+                topology.connect(channelizer, channel, sinks[channel], 0);
+            }
+
+            topology.commit();
+            POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+        }
+
+        // Compare against filtering each channel's mixer output directly.
+        const auto numOutputs = numElements / decimation;
+        for(size_t channel = 0; channel < numChannels; ++channel)
+        {
+            const auto output = sinks[channel].call<Pothos::BufferChunk>("getBuffer");
+            POTHOS_TEST_EQUAL(numOutputs, output.elements());
+
+            const auto* outputPtr = output.as<const std::complex<float>*>();
+            for(size_t n = 0; n < numOutputs; ++n)
+            {
+                const auto newest = ((n + 1) * decimation) - 1;
+
+                std::complex<double> expected;
+                for(size_t i = 0; (i < taps.size()) && (i <= newest); ++i)
+                {
+                    const auto phase = 2.0 * M_PI * double((channel * i) % numChannels) / double(numChannels);
+                    expected += taps[i] * std::complex<double>(inputPtr[newest - i]) * std::polar(1.0, phase);
+                }
+                if((oversampling == 2) && (channel % 2) && (n % 2)) expected = -expected;
+
+                POTHOS_TEST_CLOSE(expected.real(), outputPtr[n].real(), 1e-4);
+                POTHOS_TEST_CLOSE(expected.imag(), outputPtr[n].imag(), 1e-4);
+            }
+        }
+    }
+}
+
+//
+// Testing carrier recovery
+//
+
+static constexpr size_t numCarrierLoopElements = 8192;
+
+// Random PSK symbols at one sample per symbol, rotated by the given carrier
+// frequency (in cycles per sample) and phase
+static Pothos::BufferChunk getRotatedPSK(
+    size_t order,
+    double phaseOffset,
+    double frequency,
+    double phase)
+{
+    static Poco::Random rng;
+
+    Pothos::BufferChunk output("complex_float32", numCarrierLoopElements);
+    auto* outputPtr = output.as<std::complex<float>*>();
+    for(size_t elem = 0; elem < numCarrierLoopElements; ++elem)
+    {
+        const auto symbolPhase = phaseOffset + (2.0 * M_PI * double(rng.next(Poco::UInt32(order))) / double(order));
+        const auto carrierPhase = phase + (2.0 * M_PI * frequency * double(elem));
+        outputPtr[elem] = std::complex<float>(std::polar(1.0, symbolPhase + carrierPhase));
+    }
+
+    return output;
+}
+
+static void testCarrierLoop(
+    Pothos::Proxy carrierLoop,
+    size_t order,
+    double phaseOffset,
+    double frequency,
+    size_t labelInterval,
+    bool tracksPhase)
+{
+    carrierLoop.call("setLabelInterval", labelInterval);
+
+    auto source = Pothos::BlockRegistry::make("/blocks/feeder_source", "complex_float32");
+    source.call("feedBuffer", getRotatedPSK(order, phaseOffset, frequency, 0.7));
+
+    auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "complex_float32");
+
+    {
+        Pothos::Topology topology;
+        topology.connect(source, 0, carrierLoop, 0);
+        topology.connect(carrierLoop, 0, sink, 0);
+
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+    }
+
+    POTHOS_TEST_CLOSE(frequency, carrierLoop.call<double>("getFrequency"), 1e-4);
+    POTHOS_TEST_TRUE(carrierLoop.call<bool>("isLocked"));
+
+    const auto output = sink.call<Pothos::BufferChunk>("getBuffer");
+    POTHOS_TEST_EQUAL(numCarrierLoopElements, output.elements());
+
+    // Once locked, the symbols should be back on their constellation points.
+    if(tracksPhase)
+    {
+        const auto* outputPtr = output.as<const std::complex<float>*>();
+        for(size_t elem = (numCarrierLoopElements - 1024); elem < numCarrierLoopElements; ++elem)
+        {
+            double minDistance = 2.0;
+            for(size_t point = 0; point < order; ++point)
+            {
+                const auto expected = std::polar(1.0, phaseOffset + (2.0 * M_PI * double(point) / double(order)));
+                minDistance = std::min(minDistance, std::abs(std::complex<double>(outputPtr[elem]) - expected));
+            }
+            POTHOS_TEST_TRUE(minDistance < 0.01);
+        }
+    }
+
+    // The loop should lock once, and label its frequency on schedule.
+    size_t numLockLabels = 0;
+    size_t numFreqLabels = 0;
+    for(const auto& label: sink.call<std::vector<Pothos::Label>>("getLabels"))
+    {
+        if(label.id == "lock")
+        {
+            POTHOS_TEST_TRUE(label.data.convert<bool>());
+            ++numLockLabels;
+        }
+        else if(label.id == "freq")
+        {
+            POTHOS_TEST_EQUAL(((numFreqLabels+1) * labelInterval) - 1, label.index);
+            ++numFreqLabels;
+        }
+    }
+    POTHOS_TEST_EQUAL(1, numLockLabels);
+    POTHOS_TEST_EQUAL((numCarrierLoopElements / labelInterval), numFreqLabels);
+}
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_carrier_loops)
+{
+    constexpr double frequency = 0.002;
+
+    // An unmodulated carrier should be mixed down to DC.
+    testCarrierLoop(Pothos::BlockRegistry::make("/luajit/pll"), 1, 0.0, frequency, 1024, true);
+
+    // QPSK settles on odd multiples of pi/4, and the others on multiples of
+    // 2pi/order.
+    testCarrierLoop(Pothos::BlockRegistry::make("/luajit/costas_loop", size_t(2)), 2, 0.0, frequency, 1024, true);
+    testCarrierLoop(Pothos::BlockRegistry::make("/luajit/costas_loop", size_t(4)), 4, (M_PI / 4.0), frequency, 1024, true);
+    testCarrierLoop(Pothos::BlockRegistry::make("/luajit/costas_loop", size_t(8)), 8, 0.0, frequency, 1024, true);
+
+    testCarrierLoop(Pothos::BlockRegistry::make("/luajit/fll", size_t(4)), 4, (M_PI / 4.0), 0.02, 1000, false);
+}
+
+//
+// Testing symbol timing recovery
+//
+
+// Raised-cosine QPSK symbols with unit energy, sampled with the given symbol
+// period and timing offset (in symbols)
+static Pothos::BufferChunk getRaisedCosineQPSK(
+    size_t numSamples,
+    double samplesPerSymbol,
+    double timingOffset)
+{
+    static constexpr double RolloffFactor = 0.5;
+    static constexpr int PulseSymbols = 8;
+
+    static Poco::Random rng;
+
+    const auto raisedCosine = [](double t)
+    {
+        if(std::abs(t) < 1e-9) return 1.0;
+        const auto sinc = std::sin(M_PI * t) / (M_PI * t);
+        const auto denom = 1.0 - std::pow(2.0 * RolloffFactor * t, 2.0);
+        if(std::abs(denom) < 1e-9) return (M_PI / 4.0) * sinc;
+
+        return sinc * std::cos(M_PI * RolloffFactor * t) / denom;
+    };
+
+    const auto numSymbols = size_t(double(numSamples) / samplesPerSymbol) + PulseSymbols + 1;
+    std::vector<std::complex<double>> symbols;
+    for(size_t i = 0; i < numSymbols; ++i)
+    {
+        symbols.emplace_back(
+            (rng.nextBool() ? 1.0 : -1.0) / std::sqrt(2.0),
+            (rng.nextBool() ? 1.0 : -1.0) / std::sqrt(2.0));
+    }
+
+    Pothos::BufferChunk output("complex_float32", numSamples);
+    auto* outputPtr = output.as<std::complex<float>*>();
+    for(size_t elem = 0; elem < numSamples; ++elem)
+    {
+        const auto t = (double(elem) / samplesPerSymbol) - timingOffset;
+        const auto nearest = int(std::floor(t));
+
+        std::complex<double> sample;
+        for(int symbol = std::max(0, nearest - PulseSymbols); symbol <= (nearest + PulseSymbols); ++symbol)
+        {
+            sample += symbols[symbol] * raisedCosine(t - double(symbol));
+        }
+        outputPtr[elem] = std::complex<float>(sample);
+    }
+
+    return output;
+}
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_symbol_sync)
+{
+    constexpr size_t numSamples = 8000;
+    constexpr double samplesPerSymbol = 4.0;
+
+    // The transmitter's clock is slightly slow.
+    constexpr double actualSamplesPerSymbol = samplesPerSymbol * 1.0005;
+    const auto input = getRaisedCosineQPSK(numSamples, actualSamplesPerSymbol, 0.37);
+
+    for(const std::string detector: {"gardner", "mm"})
+    {
+        auto source = Pothos::BlockRegistry::make("/blocks/feeder_source", "complex_float32");
+        source.call("feedBuffer", input);
+
+        auto symbolSync = Pothos::BlockRegistry::make("/luajit/symbol_sync", samplesPerSymbol, detector);
+
+        auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "complex_float32");
+
+        {
+            Pothos::Topology topology;
+            topology.connect(source, 0, symbolSync, 0);
+            topology.connect(symbolSync, 0, sink, 0);
+
+            topology.commit();
+            POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+        }
+
+        POTHOS_TEST_CLOSE(actualSamplesPerSymbol, symbolSync.call<double>("getSymbolPeriod"), 1e-3);
+
+        const auto output = sink.call<Pothos::BufferChunk>("getBuffer");
+        POTHOS_TEST_CLOSE(double(numSamples) / actualSamplesPerSymbol, double(output.elements()), 2.0);
+
+        // Once locked, the symbols should be near the constellation points.
+        const auto* outputPtr = output.as<const std::complex<float>*>();
+        for(size_t elem = (output.elements() - 300); elem < output.elements(); ++elem)
+        {
+            POTHOS_TEST_CLOSE(1.0 / std::sqrt(2.0), std::abs(outputPtr[elem].real()), 0.05);
+            POTHOS_TEST_CLOSE(1.0 / std::sqrt(2.0), std::abs(outputPtr[elem].imag()), 0.05);
+        }
+    }
+}
+
+//
+// Testing adaptive equalizers
+//
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_equalizers)
+{
+    constexpr size_t numSymbols = 8000;
+    constexpr size_t numTaps = 11;
+
+    static Poco::Random rng;
+
+    const auto scale = 1.0 / std::sqrt(2.0);
+    std::vector<std::complex<double>> symbols;
+    for(size_t i = 0; i < numSymbols; ++i)
+    {
+        symbols.emplace_back(
+            (rng.nextBool() ? scale : -scale),
+            (rng.nextBool() ? scale : -scale));
+    }
+
+    // A minimum-phase channel, whose inverse is causal
+    const std::vector<std::complex<double>> channel = {{1.0, 0.0}, {0.3, 0.2}, {0.0, -0.1}};
+
+    Pothos::BufferChunk input("complex_float32", numSymbols);
+    auto* inputPtr = input.as<std::complex<float>*>();
+    for(size_t n = 0; n < numSymbols; ++n)
+    {
+        std::complex<double> sample;
+        for(size_t k = 0; (k < channel.size()) && (k <= n); ++k) sample += channel[k] * symbols[n-k];
+        inputPtr[n] = std::complex<float>(sample);
+    }
+
+    const std::vector<std::pair<std::string, double>> algorithms = {{"lms", 0.01}, {"nlms", 0.05}, {"cma", 0.005}};
+    for(const auto& algorithm: algorithms)
+    {
+        for(const size_t blockSize: {1, 16})
+        {
+            auto source = Pothos::BlockRegistry::make("/blocks/feeder_source", "complex_float32");
+            source.call("feedBuffer", input);
+
+            auto equalizer = Pothos::BlockRegistry::make("/luajit/equalizer", algorithm.first, numTaps, size_t(1));
+            equalizer.call("setStepSize", algorithm.second);
+            equalizer.call("setBlockSize", blockSize);
+
+            // Leave room for the causal inverse after the main tap.
+            std::vector<std::complex<double>> taps(numTaps);
+            taps[1] = 1.0;
+            equalizer.call("setTaps", taps);
+
+            auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "complex_float32");
+
+            {
+                Pothos::Topology topology;
+                topology.connect(source, 0, equalizer, 0);
+                topology.connect(equalizer, 0, sink, 0);
+
+                topology.commit();
+                POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+            }
+
+            const auto output = sink.call<Pothos::BufferChunk>("getBuffer");
+            POTHOS_TEST_EQUAL(numSymbols, output.elements());
+
+            // CMA only recovers the symbols up to a phase rotation, so just
+            // check that the ISI is gone.
+            const auto* outputPtr = output.as<const std::complex<float>*>();
+            for(size_t n = (numSymbols - 500); n < numSymbols; ++n)
+            {
+                if(algorithm.first == "cma") POTHOS_TEST_CLOSE(1.0, std::abs(outputPtr[n]), 0.02);
+                else
+                {
+                    POTHOS_TEST_CLOSE(symbols[n-1].real(), outputPtr[n].real(), 0.02);
+                    POTHOS_TEST_CLOSE(symbols[n-1].imag(), outputPtr[n].imag(), 0.02);
+                }
+            }
+
+            POTHOS_TEST_EQUAL(numTaps, equalizer.call<std::vector<std::complex<double>>>("getTaps").size());
+        }
+    }
+}
+
+//
+// Testing Viterbi decoding
+//
+
+// Rate 1/N convolutional encoder, where bit K-1 of each polynomial taps the
+// newest input bit
+static std::vector<uint8_t> convolutionalEncode(
+    const std::vector<uint8_t>& bits,
+    size_t constraintLength,
+    const std::vector<size_t>& polynomials)
+{
+    std::vector<uint8_t> symbols;
+    size_t state = 0;
+    for(const auto bit: bits)
+    {
+        const size_t reg = (size_t(bit) << (constraintLength - 1)) | state;
+        for(const auto polynomial: polynomials)
+        {
+            size_t value = reg & polynomial;
+            uint8_t parity = 0;
+            for(; value != 0; value >>= 1) parity ^= uint8_t(value & 1);
+            symbols.emplace_back(parity);
+        }
+        state = reg >> 1;
+    }
+
+    return symbols;
+}
+
+static void testViterbiDecoder(
+    const Pothos::BufferChunk& input,
+    bool softInput,
+    size_t frameSize,
+    const std::vector<uint8_t>& expectedBits)
+{
+    const std::vector<size_t> polynomials = {121, 91};
+
+    auto source = Pothos::BlockRegistry::make("/blocks/feeder_source", input.dtype);
+    source.call("feedBuffer", input);
+
+    auto decoder = Pothos::BlockRegistry::make("/luajit/viterbi_decoder", size_t(7), polynomials, softInput);
+    decoder.call("setFrameSize", frameSize);
+
+    auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "uint8");
+
+    {
+        Pothos::Topology topology;
+        topology.connect(source, 0, decoder, 0);
+        topology.connect(decoder, 0, sink, 0);
+
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+    }
+
+    // In streaming mode, the last window's worth of bits stays in the decoder.
+    const auto output = sink.call<Pothos::BufferChunk>("getBuffer");
+    if(frameSize > 0) POTHOS_TEST_EQUAL(expectedBits.size(), output.elements());
+    else
+    {
+        POTHOS_TEST_TRUE(output.elements() <= expectedBits.size());
+        POTHOS_TEST_TRUE(output.elements() >= (expectedBits.size() - 96));
+    }
+
+    POTHOS_TEST_EQUALA(expectedBits.data(), output.as<const uint8_t*>(), output.elements());
+}
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_viterbi_decoder)
+{
+    constexpr size_t numBits = 5000;
+    constexpr size_t constraintLength = 7;
+    constexpr size_t frameSize = 500;
+    const std::vector<size_t> polynomials = {121, 91};
+
+    static Poco::Random rng;
+
+    std::vector<uint8_t> bits;
+    for(size_t i = 0; i < numBits; ++i) bits.emplace_back(rng.nextBool() ? 1 : 0);
+
+    const auto symbols = convolutionalEncode(bits, constraintLength, polynomials);
+
+    // Hard input, with scattered bit errors
+    Pothos::BufferChunk hardInput("uint8", symbols.size());
+    for(size_t i = 0; i < symbols.size(); ++i)
+    {
+        hardInput.as<uint8_t*>()[i] = (i % 37 == 0) ? (symbols[i] ^ 1) : symbols[i];
+    }
+    testViterbiDecoder(hardInput, false, 0, bits);
+
+    // Soft input, with gaussian noise
+    Pothos::BufferChunk softInput("float32", symbols.size());
+    for(size_t i = 0; i < symbols.size(); ++i)
+    {
+        const auto u1 = std::max(1e-12, double(rng.nextDouble()));
+        const auto u2 = double(rng.nextDouble());
+        const auto noise = 0.5 * std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+
+        softInput.as<float*>()[i] = float((symbols[i] ? 1.0 : -1.0) + noise);
+    }
+    testViterbiDecoder(softInput, true, 0, bits);
+
+    // Frame mode, where each frame is followed by K-1 zero tail bits
+    std::vector<uint8_t> frameSymbols;
+    for(size_t frame = 0; frame < (numBits / frameSize); ++frame)
+    {
+        std::vector<uint8_t> frameBits(bits.begin() + (frame * frameSize), bits.begin() + ((frame + 1) * frameSize));
+        frameBits.resize(frameSize + constraintLength - 1, 0);
+
+        const auto encoded = convolutionalEncode(frameBits, constraintLength, polynomials);
+        frameSymbols.insert(frameSymbols.end(), encoded.begin(), encoded.end());
+    }
+
+    Pothos::BufferChunk frameInput("uint8", frameSymbols.size());
+    for(size_t i = 0; i < frameSymbols.size(); ++i)
+    {
+        frameInput.as<uint8_t*>()[i] = (i % 37 == 0) ? (frameSymbols[i] ^ 1) : frameSymbols[i];
+    }
+    testViterbiDecoder(frameInput, false, frameSize, bits);
+}
+
+//
+// Testing interleavers
+//
+
+// Returns the collector sink at the end of the chain.
+static Pothos::Proxy runInterleaverChain(
+    const Pothos::BufferChunk& input,
+    const std::vector<Pothos::Proxy>& blocks)
+{
+    auto source = Pothos::BlockRegistry::make("/blocks/feeder_source", input.dtype);
+    source.call("feedBuffer", input);
+
+    auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", input.dtype);
+
+    {
+        Pothos::Topology topology;
+        topology.connect(source, 0, blocks.front(), 0);
+        for(size_t i = 1; i < blocks.size(); ++i) topology.connect(blocks[i-1], 0, blocks[i], 0);
+        topology.connect(blocks.back(), 0, sink, 0);
+
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+    }
+
+    return sink;
+}
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_interleavers)
+{
+    constexpr size_t numRows = 20;
+    constexpr size_t numColumns = 37;
+    constexpr size_t frameSize = numRows * numColumns;
+    constexpr size_t numFrames = 10;
+
+    // The partial frame at the end should be left unconsumed.
+    Pothos::BufferChunk blockInput("uint32", (numFrames * frameSize) + 11);
+    for(size_t i = 0; i < blockInput.elements(); ++i) blockInput.as<uint32_t*>()[i] = uint32_t(i);
+
+    auto interleaver = Pothos::BlockRegistry::make("/luajit/block_interleaver", "uint32", numRows, numColumns);
+    interleaver.call("setFrameLabelId", "frame");
+
+    const auto interleaverSink = runInterleaverChain(blockInput, {interleaver});
+    const auto interleaved = interleaverSink.call<Pothos::BufferChunk>("getBuffer");
+    POTHOS_TEST_EQUAL(numFrames * frameSize, interleaved.elements());
+
+    const auto frameLabels = interleaverSink.call<std::vector<Pothos::Label>>("getLabels");
+    POTHOS_TEST_EQUAL(numFrames, frameLabels.size());
+    for(size_t frame = 0; frame < numFrames; ++frame)
+    {
+        POTHOS_TEST_EQUAL("frame", frameLabels[frame].id);
+        POTHOS_TEST_EQUAL(frame * frameSize, frameLabels[frame].index);
+    }
+    for(size_t frame = 0; frame < numFrames; ++frame)
+    {
+        for(size_t row = 0; row < numRows; ++row)
+        {
+            for(size_t column = 0; column < numColumns; ++column)
+            {
+                POTHOS_TEST_EQUAL(
+                    (frame * frameSize) + (row * numColumns) + column,
+                    interleaved.as<const uint32_t*>()[(frame * frameSize) + (column * numRows) + row]);
+            }
+        }
+    }
+
+    // The interleaver and deinterleaver share the same index map.
+    const auto blockRoundTrip = runInterleaverChain(
+                                    blockInput,
+                                    {Pothos::BlockRegistry::make("/luajit/block_interleaver", "uint32", numRows, numColumns),
+                                     Pothos::BlockRegistry::make("/luajit/block_deinterleaver", "uint32", numRows, numColumns)})
+                                    .call<Pothos::BufferChunk>("getBuffer");
+    POTHOS_TEST_EQUAL(numFrames * frameSize, blockRoundTrip.elements());
+    POTHOS_TEST_EQUALA(blockInput.as<const uint32_t*>(), blockRoundTrip.as<const uint32_t*>(), blockRoundTrip.elements());
+
+    // Every branch is delayed by the same total, so the round trip is a
+    // plain delay with zeros shifted in.
+    constexpr size_t numBranches = 12;
+    constexpr size_t delay = 17;
+    constexpr size_t totalDelay = (numBranches - 1) * delay * numBranches;
+
+    Pothos::BufferChunk convInput("complex_float64", 20000);
+    for(size_t i = 0; i < convInput.elements(); ++i)
+    {
+        convInput.as<std::complex<double>*>()[i] = std::complex<double>(double(i + 1), -double(i + 1));
+    }
+
+    const auto convInterleaved = runInterleaverChain(
+                                     convInput,
+                                     {Pothos::BlockRegistry::make("/luajit/convolutional_interleaver", "complex_float64", numBranches, delay)})
+                                     .call<Pothos::BufferChunk>("getBuffer");
+    POTHOS_TEST_EQUAL(convInput.elements(), convInterleaved.elements());
+    for(size_t i = 0; i < convInterleaved.elements(); ++i)
+    {
+        const auto branchDelay = (i % numBranches) * delay * numBranches;
+        const auto expected = (i >= branchDelay) ? convInput.as<const std::complex<double>*>()[i - branchDelay] : std::complex<double>();
+        POTHOS_TEST_EQUAL(expected, convInterleaved.as<const std::complex<double>*>()[i]);
+    }
+
+    const auto convRoundTrip = runInterleaverChain(
+                                   convInput,
+                                   {Pothos::BlockRegistry::make("/luajit/convolutional_interleaver", "complex_float64", numBranches, delay),
+                                    Pothos::BlockRegistry::make("/luajit/convolutional_deinterleaver", "complex_float64", numBranches, delay)})
+                                   .call<Pothos::BufferChunk>("getBuffer");
+    POTHOS_TEST_EQUAL(convInput.elements(), convRoundTrip.elements());
+    POTHOS_TEST_EQUALA(
+        convInput.as<const std::complex<double>*>(),
+        convRoundTrip.as<const std::complex<double>*>() + totalDelay,
+        convInput.elements() - totalDelay);
+}
+
+//
+// Testing stream synchronization
+//
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_stream_synchronizer)
+{
+    constexpr size_t numElems = 5000;
+    constexpr double sampleRate = 1e6;
+    constexpr long long startTimeNs = 1000000000LL;
+
+    // Each sample's value is its index on a shared clock. The second stream
+    // starts 25 samples later and skips 20 samples partway through.
+    constexpr size_t startOffset = 25;
+    constexpr size_t gapIndex = 2000;
+    constexpr size_t gapLength = 20;
+
+    Pothos::BufferChunk input0("uint32", numElems);
+    Pothos::BufferChunk input1("uint32", numElems);
+    for(size_t i = 0; i < numElems; ++i)
+    {
+        input0.as<uint32_t*>()[i] = uint32_t(i);
+        input1.as<uint32_t*>()[i] = uint32_t(i + startOffset + ((i >= gapIndex) ? gapLength : 0));
+    }
+
+    const auto sampleTimeNs = [&](size_t clockIndex)
+    {
+        return startTimeNs + static_cast<long long>(std::llround(double(clockIndex) * 1e9 / sampleRate));
+    };
+
+    auto source0 = Pothos::BlockRegistry::make("/blocks/feeder_source", "uint32");
+    source0.call("feedLabels", std::vector<Pothos::Label>{Pothos::Label("rxTime", sampleTimeNs(0), 0)});
+    source0.call("feedBuffer", input0);
+
+    auto source1 = Pothos::BlockRegistry::make("/blocks/feeder_source", "uint32");
+    source1.call(
+        "feedLabels",
+        std::vector<Pothos::Label>{
+            Pothos::Label("rxTime", sampleTimeNs(startOffset), 0),
+            Pothos::Label("rxTime", sampleTimeNs(gapIndex + startOffset + gapLength), gapIndex)});
+    source1.call("feedBuffer", input1);
+
+    auto synchronizer = Pothos::BlockRegistry::make("/luajit/stream_synchronizer", "uint32", size_t(2));
+    synchronizer.call("setSampleRate", sampleRate);
+
+    auto sink0 = Pothos::BlockRegistry::make("/blocks/collector_sink", "uint32");
+    auto sink1 = Pothos::BlockRegistry::make("/blocks/collector_sink", "uint32");
+
+    {
+        Pothos::Topology topology;
+        topology.connect(source0, 0, synchronizer, 0);
+        topology.connect(source1, 0, synchronizer, 1);
+        topology.connect(synchronizer, 0, sink0, 0);
+        topology.connect(synchronizer, 1, sink1, 0);
+
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+    }
+
+    // The first stream drops samples at the start and at the gap, and the
+    // rest line up.
+    const auto dropCounts = synchronizer.call<std::vector<size_t>>("getDropCounts");
+    POTHOS_TEST_EQUAL(2, dropCounts.size());
+    POTHOS_TEST_EQUAL(startOffset + gapLength, dropCounts[0]);
+    POTHOS_TEST_EQUAL(0, dropCounts[1]);
+    POTHOS_TEST_CLOSE(0.0, synchronizer.call<double>("getAlignmentError"), 1e-9);
+
+    const auto output0 = sink0.call<Pothos::BufferChunk>("getBuffer");
+    const auto output1 = sink1.call<Pothos::BufferChunk>("getBuffer");
+    POTHOS_TEST_EQUAL(numElems - startOffset - gapLength, output0.elements());
+    POTHOS_TEST_EQUAL(output0.elements(), output1.elements());
+    POTHOS_TEST_EQUALA(output0.as<const uint32_t*>(), output1.as<const uint32_t*>(), output0.elements());
+    POTHOS_TEST_EQUAL(startOffset, output0.as<const uint32_t*>()[0]);
+
+    // Each stream's timestamps only go to its own output. The first
+    // stream's initial timestamp was on a dropped sample, so its output is
+    // labeled with the times of the first samples after each drop instead.
+    const auto labels0 = sink0.call<std::vector<Pothos::Label>>("getLabels");
+    POTHOS_TEST_EQUAL(2, labels0.size());
+    POTHOS_TEST_EQUAL("rxTime", labels0[0].id);
+    POTHOS_TEST_EQUAL(0, labels0[0].index);
+    POTHOS_TEST_EQUAL(sampleTimeNs(startOffset), labels0[0].data.convert<long long>());
+    POTHOS_TEST_EQUAL("rxTime", labels0[1].id);
+    POTHOS_TEST_EQUAL(gapIndex, labels0[1].index);
+    POTHOS_TEST_EQUAL(sampleTimeNs(gapIndex + startOffset + gapLength), labels0[1].data.convert<long long>());
+
+    const auto labels1 = sink1.call<std::vector<Pothos::Label>>("getLabels");
+    POTHOS_TEST_EQUAL(2, labels1.size());
+    POTHOS_TEST_EQUAL(0, labels1[0].index);
+    POTHOS_TEST_EQUAL(sampleTimeNs(startOffset), labels1[0].data.convert<long long>());
+    POTHOS_TEST_EQUAL(gapIndex, labels1[1].index);
+    POTHOS_TEST_EQUAL(sampleTimeNs(gapIndex + startOffset + gapLength), labels1[1].data.convert<long long>());
+}
+
+//
+// Testing burst extraction
+//
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_burst_extractor)
+{
+    constexpr size_t numBursts = 30;
+    constexpr size_t holdoff = 8;
+
+    static Poco::Random rng;
+
+    // Unit-power bursts between stretches of low-level noise
+    std::vector<std::complex<float>> samples;
+    std::vector<std::pair<size_t, size_t>> bursts;
+    for(size_t burst = 0; burst < numBursts; ++burst)
+    {
+        const auto gapLength = 20 + rng.next(300);
+        for(size_t i = 0; i < gapLength; ++i)
+        {
+            samples.emplace_back(0.01f * (rng.nextFloat() - 0.5f), 0.01f * (rng.nextFloat() - 0.5f));
+        }
+
+        const auto burstLength = 10 + size_t(rng.next(400));
+        bursts.emplace_back(samples.size(), burstLength);
+        for(size_t i = 0; i < burstLength; ++i)
+        {
+            samples.emplace_back(std::polar(1.0f, 6.28f * rng.nextFloat()));
+        }
+    }
+    samples.resize(samples.size() + 50);
+
+    // Feeding in small buffers makes some bursts span them.
+    auto source = Pothos::BlockRegistry::make("/blocks/feeder_source", "complex_float32");
+    for(size_t first = 0; first < samples.size(); first += 256)
+    {
+        const auto elems = std::min<size_t>(256, samples.size() - first);
+        Pothos::BufferChunk buffer("complex_float32", elems);
+        std::memcpy(buffer.as<void*>(), &samples[first], elems * sizeof(samples[0]));
+        source.call("feedBuffer", buffer);
+    }
+
+    auto burstExtractor = Pothos::BlockRegistry::make("/luajit/burst_extractor", "complex_float32");
+    burstExtractor.call("setOnThreshold", 0.25);
+    burstExtractor.call("setOffThreshold", 0.04);
+    burstExtractor.call("setHoldoff", holdoff);
+    burstExtractor.call("setMinBurstLength", size_t(5));
+
+    auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "complex_float32");
+
+    {
+        Pothos::Topology topology;
+        topology.connect(source, 0, burstExtractor, 0);
+        topology.connect(burstExtractor, 0, sink, 0);
+
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+    }
+
+    // Each burst also includes the quiet samples that ended it.
+    const auto packets = sink.call<std::vector<Pothos::Packet>>("getPackets");
+    POTHOS_TEST_EQUAL(numBursts, packets.size());
+    for(size_t burst = 0; burst < numBursts; ++burst)
+    {
+        const auto& payload = packets[burst].payload;
+        POTHOS_TEST_EQUAL(bursts[burst].second + holdoff, payload.elements());
+        POTHOS_TEST_EQUALA(
+            &samples[bursts[burst].first],
+            payload.as<const std::complex<float>*>(),
+            bursts[burst].second);
+    }
+
+    // Detectors that don't compile are rejected.
+    POTHOS_TEST_THROWS(
+        burstExtractor.call("setDetector", std::string("return function(")),
+        Pothos::Exception);
+}
+
+//
+// Testing fixed-point kernels
+//
+
+// Rounds half up, like the kernels, then saturates.
+static int64_t fixedRoundSaturate(int64_t value, size_t shift, size_t outputBits)
+{
+    const auto rounded = (shift > 0) ? ((value + (int64_t(1) << (shift - 1))) >> shift) : value;
+    const auto maxValue = (int64_t(1) << (outputBits - 1)) - 1;
+
+    return std::min(std::max(rounded, -maxValue - 1), maxValue);
+}
+
+template <typename T>
+static std::string getFixedPointDType()
+{
+    return (sizeof(T) == 2) ? "complex_int16" : "complex_int32";
+}
+
+template <typename T>
+static Pothos::BufferChunk getRandomFixedPoint(size_t numElems)
+{
+    static Poco::Random rng;
+
+    Pothos::BufferChunk output(getFixedPointDType<T>(), numElems);
+    for(size_t i = 0; i < (2 * numElems); ++i)
+    {
+        const auto value = (uint64_t(rng.next()) << 32) | rng.next();
+        output.as<T*>()[i] = T(value);
+    }
+
+    // The extremes are where saturation happens.
+    const T edges[] = {std::numeric_limits<T>::min(), std::numeric_limits<T>::max(), T(-1), T(0)};
+    for(size_t i = 0; i < 16; ++i) output.as<T*>()[i] = edges[i % 4];
+    for(size_t i = 16; i < 24; ++i) output.as<T*>()[i] = (i % 2) ? T(0) : edges[0];
+
+    return output;
+}
+
+static Pothos::BufferChunk runSingleOutputBlock(
+    const Pothos::Proxy& block,
+    const std::vector<Pothos::BufferChunk>& inputs,
+    const std::string& outputDType)
+{
+    std::vector<Pothos::Proxy> sources;
+    for(const auto& input: inputs)
+    {
+        sources.emplace_back(Pothos::BlockRegistry::make("/blocks/feeder_source", input.dtype));
+        sources.back().call("feedBuffer", input);
+    }
+
+    auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", outputDType);
+
+    {
+        Pothos::Topology topology;
+        for(size_t i = 0; i < sources.size(); ++i) topology.connect(sources[i], 0, block, i);
+        topology.connect(block, 0, sink, 0);
+
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+    }
+
+    return sink.call<Pothos::BufferChunk>("getBuffer");
+}
+
+template <typename InType, typename OutType>
+static void testFixedPointKernels()
+{
+    constexpr size_t numFixedElems = 10007;
+    constexpr size_t inputBits = sizeof(InType) * 8;
+    constexpr size_t outputBits = sizeof(OutType) * 8;
+
+    const auto inputDType = getFixedPointDType<InType>();
+    const auto outputDType = getFixedPointDType<OutType>();
+
+    const auto input0 = getRandomFixedPoint<InType>(numFixedElems);
+    const auto input1 = getRandomFixedPoint<InType>(numFixedElems);
+    const auto* in0 = input0.as<const InType*>();
+    const auto* in1 = input1.as<const InType*>();
+
+    if(inputBits == outputBits)
+    {
+        // Q15/Q31 by default
+        const auto multiplied = runSingleOutputBlock(
+                                    Pothos::BlockRegistry::make("/luajit/fixed_multiply", inputDType),
+                                    {input0, input1},
+                                    outputDType);
+        POTHOS_TEST_EQUAL(numFixedElems, multiplied.elements());
+
+        std::vector<OutType> expected(2 * numFixedElems);
+        for(size_t i = 0; i < numFixedElems; ++i)
+        {
+            const int64_t ar = in0[2*i], ai = in0[(2*i)+1];
+            const int64_t br = in1[2*i], bi = in1[(2*i)+1];
+            expected[2*i] = OutType(fixedRoundSaturate((ar * br) - (ai * bi), inputBits-1, outputBits));
+            expected[(2*i)+1] = OutType(fixedRoundSaturate((ar * bi) + (ai * br), inputBits-1, outputBits));
+        }
+        POTHOS_TEST_EQUALA(expected.data(), multiplied.as<const OutType*>(), expected.size());
+
+        // The gain is quantized to 2^-12, which 1.5-0.25j is exactly.
+        constexpr size_t scaleShift = 12;
+        constexpr int64_t gainReal = 6144;
+        constexpr int64_t gainImag = -1024;
+
+        auto scale = Pothos::BlockRegistry::make("/luajit/fixed_scale", inputDType);
+        scale.call("setShift", scaleShift);
+        scale.call("setGain", std::complex<double>(1.5, -0.25));
+
+        const auto scaled = runSingleOutputBlock(scale, {input0}, outputDType);
+        POTHOS_TEST_EQUAL(numFixedElems, scaled.elements());
+        for(size_t i = 0; i < numFixedElems; ++i)
+        {
+            const int64_t ar = in0[2*i], ai = in0[(2*i)+1];
+            expected[2*i] = OutType(fixedRoundSaturate((ar * gainReal) - (ai * gainImag), scaleShift, outputBits));
+            expected[(2*i)+1] = OutType(fixedRoundSaturate((ar * gainImag) + (ai * gainReal), scaleShift, outputBits));
+        }
+        POTHOS_TEST_EQUALA(expected.data(), scaled.as<const OutType*>(), expected.size());
+    }
+
+    // The partial sum at the end is never output, and a decimation of 1
+    // only shifts and saturates.
+    for(const size_t decimation: {1, 10})
+    {
+        constexpr size_t accumulateShift = 2;
+        auto accumulate = Pothos::BlockRegistry::make("/luajit/fixed_accumulate", inputDType, outputDType, decimation);
+        accumulate.call("setShift", accumulateShift);
+
+        const auto accumulated = runSingleOutputBlock(accumulate, {input0}, outputDType);
+        POTHOS_TEST_EQUAL(numFixedElems / decimation, accumulated.elements());
+
+        std::vector<OutType> expected(2 * accumulated.elements());
+        for(size_t i = 0; i < expected.size(); ++i)
+        {
+            int64_t sum = 0;
+            for(size_t j = 0; j < decimation; ++j) sum += in0[(2 * ((i/2) * decimation + j)) + (i % 2)];
+            expected[i] = OutType(fixedRoundSaturate(sum, accumulateShift, outputBits));
+        }
+        POTHOS_TEST_EQUALA(expected.data(), accumulated.as<const OutType*>(), expected.size());
+    }
+
+    // By default, narrowing keeps the top bits.
+    auto roundSaturate = Pothos::BlockRegistry::make("/luajit/fixed_round_saturate", inputDType, outputDType);
+    const auto roundShift = roundSaturate.call<size_t>("getShift");
+    POTHOS_TEST_EQUAL((inputBits > outputBits) ? (inputBits - outputBits) : 0, roundShift);
+
+    const auto rounded = runSingleOutputBlock(roundSaturate, {input0}, outputDType);
+    POTHOS_TEST_EQUAL(numFixedElems, rounded.elements());
+    {
+        std::vector<OutType> expected(2 * numFixedElems);
+        for(size_t i = 0; i < expected.size(); ++i)
+        {
+            expected[i] = OutType(fixedRoundSaturate(in0[i], roundShift, outputBits));
+        }
+        POTHOS_TEST_EQUALA(expected.data(), rounded.as<const OutType*>(), expected.size());
+    }
+}
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_fixed_point)
+{
+    testFixedPointKernels<int16_t, int16_t>();
+    testFixedPointKernels<int16_t, int32_t>();
+    testFixedPointKernels<int32_t, int16_t>();
+    testFixedPointKernels<int32_t, int32_t>();
+
+    // Only complex 16- and 32-bit integers are supported.
+    POTHOS_TEST_THROWS(
+        Pothos::BlockRegistry::make("/luajit/fixed_multiply", "complex_float32"),
+        Pothos::Exception);
+    POTHOS_TEST_THROWS(
+        Pothos::BlockRegistry::make("/luajit/fixed_scale", "int16"),
+        Pothos::Exception);
+
+    // The default shift depends on the types, and a negative shift, the
+    // GUI's default, restores it.
+    auto scale = Pothos::BlockRegistry::make("/luajit/fixed_scale", "complex_int32");
+    POTHOS_TEST_EQUAL(31, scale.call<size_t>("getShift"));
+    scale.call("setShift", 12);
+    POTHOS_TEST_EQUAL(12, scale.call<size_t>("getShift"));
+    scale.call("setShift", -1);
+    POTHOS_TEST_EQUAL(31, scale.call<size_t>("getShift"));
+
+    // A gain that doesn't fit in 32 bits at this shift
+    POTHOS_TEST_THROWS(
+        scale.call("setGain", std::complex<double>(2.0, 0.0)),
+        Pothos::Exception);
+}
+
+//
+// Testing noise
+//
+
+static constexpr size_t numNoiseElements = 1 << 17;
+
+static Pothos::BufferChunk addNoiseToZeros(
+    const Pothos::Proxy& adder,
+    const std::string& dtype)
+{
+    Pothos::BufferChunk zeros(dtype, numNoiseElements);
+    std::memset(zeros.as<void*>(), 0, zeros.length);
+
+    return runSingleOutputBlock(adder, {zeros}, dtype);
+}
+
+// Returns the mean and variance.
+template <typename T>
+static std::pair<double, double> getNoiseStats(const Pothos::BufferChunk& noise)
+{
+    const auto numValues = noise.length / sizeof(T);
+    const auto* values = noise.as<const T*>();
+
+    double sum = 0.0;
+    double sumSquares = 0.0;
+    for(size_t i = 0; i < numValues; ++i)
+    {
+        sum += values[i];
+        sumSquares += double(values[i]) * double(values[i]);
+    }
+
+    const auto mean = sum / numValues;
+    return std::make_pair(mean, (sumSquares / numValues) - (mean * mean));
+}
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_noise)
+{
+    // Complex Gaussian noise splits its power between the components.
+    auto gaussianAdder = Pothos::BlockRegistry::make("/luajit/noise_adder", "complex_float32", "gaussian");
+    gaussianAdder.call("setAmplitude", 0.5);
+    const auto gaussian = addNoiseToZeros(gaussianAdder, "complex_float32");
+    POTHOS_TEST_EQUAL(numNoiseElements, gaussian.elements());
+
+    const auto gaussianStats = getNoiseStats<float>(gaussian);
+    POTHOS_TEST_CLOSE(0.0, gaussianStats.first, 0.005);
+    POTHOS_TEST_CLOSE(0.125, gaussianStats.second, 0.005);
+
+    size_t numTail = 0;
+    for(size_t i = 0; i < (2 * numNoiseElements); ++i)
+    {
+        if(std::abs(gaussian.as<const float*>()[i]) > (3.0 * std::sqrt(0.125))) ++numTail;
+    }
+    POTHOS_TEST_CLOSE(0.0027, double(numTail) / (2 * numNoiseElements), 0.0005);
+
+    auto uniformAdder = Pothos::BlockRegistry::make("/luajit/noise_adder", "float64", "uniform");
+    uniformAdder.call("setAmplitude", 2.0);
+    const auto uniform = addNoiseToZeros(uniformAdder, "float64");
+    for(size_t i = 0; i < numNoiseElements; ++i)
+    {
+        POTHOS_TEST_TRUE(uniform.as<const double*>()[i] >= -2.0);
+        POTHOS_TEST_TRUE(uniform.as<const double*>()[i] < 2.0);
+    }
+
+    const auto uniformStats = getNoiseStats<double>(uniform);
+    POTHOS_TEST_CLOSE(0.0, uniformStats.first, 0.02);
+    POTHOS_TEST_CLOSE(4.0 / 3.0, uniformStats.second, 0.02);
+
+    // Each block gets its own stream, and restarts it on activation.
+    auto adder0 = Pothos::BlockRegistry::make("/luajit/noise_adder", "float64", "gaussian");
+    auto adder1 = Pothos::BlockRegistry::make("/luajit/noise_adder", "float64", "gaussian");
+    POTHOS_TEST_TRUE(adder0.call<unsigned long long>("getStream") != adder1.call<unsigned long long>("getStream"));
+
+    const auto noise0 = addNoiseToZeros(adder0, "float64");
+    const auto noise1 = addNoiseToZeros(adder1, "float64");
+    POTHOS_TEST_TRUE(0 != std::memcmp(noise0.as<const void*>(), noise1.as<const void*>(), noise0.length));
+
+    const auto noise0Again = addNoiseToZeros(adder0, "float64");
+    POTHOS_TEST_EQUALA(noise0.as<const double*>(), noise0Again.as<const double*>(), numNoiseElements);
+
+    adder1.call("setStream", adder0.call<unsigned long long>("getStream"));
+    const auto noise1SameStream = addNoiseToZeros(adder1, "float64");
+    POTHOS_TEST_EQUALA(noise0.as<const double*>(), noise1SameStream.as<const double*>(), numNoiseElements);
+
+    adder1.call("setSeed", 12345ULL);
+    const auto noise1NewSeed = addNoiseToZeros(adder1, "float64");
+    POTHOS_TEST_TRUE(0 != std::memcmp(noise0.as<const void*>(), noise1NewSeed.as<const void*>(), noise0.length));
+
+    // Streams are reached by squaring jumps, so even distant ones are cheap
+    // to seed, and still repeat on each activation.
+    adder1.call("setStream", 1ULL << 40);
+    const auto noise1FarStream = addNoiseToZeros(adder1, "float64");
+    POTHOS_TEST_TRUE(0 != std::memcmp(noise1NewSeed.as<const void*>(), noise1FarStream.as<const void*>(), noise0.length));
+
+    const auto noise1FarStreamAgain = addNoiseToZeros(adder1, "float64");
+    POTHOS_TEST_EQUALA(noise1FarStream.as<const double*>(), noise1FarStreamAgain.as<const double*>(), numNoiseElements);
+
+    // A source on the same stream generates the same noise.
+    auto source = Pothos::BlockRegistry::make("/luajit/noise_source", "float64", "gaussian");
+    source.call("setStream", adder0.call<unsigned long long>("getStream"));
+
+    auto sink = Pothos::BlockRegistry::make("/blocks/collector_sink", "float64");
+    {
+        Pothos::Topology topology;
+        topology.connect(source, 0, sink, 0);
+        topology.commit();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    const auto sourceNoise = sink.call<Pothos::BufferChunk>("getBuffer");
+    POTHOS_TEST_TRUE(sourceNoise.elements() > 0);
+    POTHOS_TEST_EQUALA(
+        noise0.as<const double*>(),
+        sourceNoise.as<const double*>(),
+        std::min(numNoiseElements, sourceNoise.elements()));
+
+    POTHOS_TEST_THROWS(
+        Pothos::BlockRegistry::make("/luajit/noise_source", "int16", "gaussian"),
+        Pothos::Exception);
+    POTHOS_TEST_THROWS(
+        Pothos::BlockRegistry::make("/luajit/noise_adder", "float32", "pink"),
+        Pothos::Exception);
+}
+
+//
+// Testing function approximation
+//
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_approximate)
+{
+    static const std::string ApproximateScript = R"(
+
+    local ffi = require("ffi")
+
+    local TestFuncs = {}
+
+    local approxExp, info = BlockEnv.Approximate("tests/exp", math.exp, -5.0, 5.0, 1e-9)
+    assert(info.maxError <= 1e-9)
+    assert(info.segments >= 1)
+    assert(info.measureSpeedup() > 0.0)
+
+    function TestFuncs.exp(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems)
+        local doubleBuffIn = ffi.cast("double*", buffsIn[0])
+        local doubleBuffOut = ffi.cast("double*", buffsOut[0])
+
+        for i = 0, elems-1
+        do
+            doubleBuffOut[i] = approxExp(doubleBuffIn[i])
+        end
+    end
+
+    return TestFuncs
+
+    )";
+
+    // Past the domain, the values at its ends are returned.
+    Pothos::BufferChunk input("float64", numElements);
+    for(size_t elem = 0; elem < numElements; ++elem)
+    {
+        input.as<double*>()[elem] = -6.0 + (12.0 * double(elem) / double(numElements - 1));
+    }
+
+    auto luajitBlock = Pothos::BlockRegistry::make(
+                           "/blocks/luajit_block",
+                           std::vector<std::string>{"float64"},
+                           std::vector<std::string>{"float64"});
+    luajitBlock.call("setSource", ApproximateScript, "exp");
+
+    const auto output = runSingleOutputBlock(luajitBlock, {input}, "float64");
+    POTHOS_TEST_EQUAL(numElements, output.elements());
+    for(size_t elem = 0; elem < numElements; ++elem)
+    {
+        const auto x = std::max(-5.0, std::min(5.0, input.as<const double*>()[elem]));
+        POTHOS_TEST_CLOSE(std::exp(x), output.as<const double*>()[elem], 1e-9);
+    }
+
+    // 1/x can't be approximated across its pole.
+    static const std::string PoleScript = R"(
+
+    local TestFuncs = {}
+
+    BlockEnv.Approximate("tests/reciprocal", function(x) return 1.0 / x end, -1.0, 1.0, 1e-3)
+
+    function TestFuncs.unused(buffsIn, numBuffsIn, buffsOut, numBuffsOut, elems) end
+
+    return TestFuncs
+
+    )";
+
+    POTHOS_TEST_THROWS(
+        luajitBlock.call("setSource", PoleScript, "unused"),
+        Pothos::Exception);
+}
+
+//
+// Testing frame kernels
+//
+
+template <typename T>
+static Pothos::BufferChunk getRandomFrameInput(const std::string& dtype, size_t numElems)
+{
+    static Poco::Random rng;
+
+    Pothos::BufferChunk output(dtype, numElems);
+    for(size_t i = 0; i < numElems; ++i)
+    {
+        if(std::is_floating_point<T>::value) output.as<T*>()[i] = T((rng.nextDouble() * 2000.0) - 1000.0);
+        else                                 output.as<T*>()[i] = T(rng.next());
+    }
+
+    return output;
+}
+
+static std::vector<Pothos::Proxy> runTwoOutputBlock(
+    const Pothos::Proxy& block,
+    const Pothos::BufferChunk& input,
+    const std::string& outputDType0,
+    const std::string& outputDType1)
+{
+    auto source = Pothos::BlockRegistry::make("/blocks/feeder_source", input.dtype);
+    source.call("feedBuffer", input);
+
+    std::vector<Pothos::Proxy> sinks;
+    sinks.emplace_back(Pothos::BlockRegistry::make("/blocks/collector_sink", outputDType0));
+    sinks.emplace_back(Pothos::BlockRegistry::make("/blocks/collector_sink", outputDType1));
+
+    {
+        Pothos::Topology topology;
+        topology.connect(source, 0, block, 0);
+        topology.connect(block, 0, sinks[0], 0);
+        topology.connect(block, 1, sinks[1], 0);
+
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.01));
+    }
+
+    return sinks;
+}
+
+template <typename T>
+static void testFrameSorting(const std::string& dtype)
+{
+    constexpr size_t frameSize = 1000;
+    constexpr size_t numFrames = 8;
+    constexpr size_t k = 10;
+
+    // The partial frame at the end should be left unconsumed.
+    const auto input = getRandomFrameInput<T>(dtype, (numFrames * frameSize) + 7);
+    const auto* inputPtr = input.as<const T*>();
+
+    if("float64" != dtype)
+    {
+        const auto sorted = runSingleOutputBlock(
+                                Pothos::BlockRegistry::make("/luajit/radix_sort", dtype, frameSize),
+                                {input},
+                                dtype);
+        POTHOS_TEST_EQUAL(numFrames * frameSize, sorted.elements());
+        for(size_t frame = 0; frame < numFrames; ++frame)
+        {
+            std::vector<T> expected(inputPtr + (frame * frameSize), inputPtr + ((frame + 1) * frameSize));
+            std::sort(expected.begin(), expected.end());
+            POTHOS_TEST_EQUALA(expected.data(), sorted.as<const T*>() + (frame * frameSize), frameSize);
+        }
+    }
+
+    const auto topKSinks = runTwoOutputBlock(
+                               Pothos::BlockRegistry::make("/luajit/top_k", dtype, frameSize, k),
+                               input,
+                               dtype,
+                               "uint32");
+    const auto values = topKSinks[0].call<Pothos::BufferChunk>("getBuffer");
+    const auto indices = topKSinks[1].call<Pothos::BufferChunk>("getBuffer");
+    POTHOS_TEST_EQUAL(numFrames * k, values.elements());
+    POTHOS_TEST_EQUAL(numFrames * k, indices.elements());
+    for(size_t frame = 0; frame < numFrames; ++frame)
+    {
+        std::vector<T> expected(inputPtr + (frame * frameSize), inputPtr + ((frame + 1) * frameSize));
+        std::partial_sort(expected.begin(), expected.begin() + k, expected.end(), std::greater<T>());
+        POTHOS_TEST_EQUALA(expected.data(), values.as<const T*>() + (frame * k), k);
+
+        for(size_t i = 0; i < k; ++i)
+        {
+            const auto index = indices.as<const uint32_t*>()[(frame * k) + i];
+            POTHOS_TEST_TRUE(index < frameSize);
+            POTHOS_TEST_EQUAL(expected[i], inputPtr[(frame * frameSize) + index]);
+        }
+    }
+}
+
+POTHOS_TEST_BLOCK("/luajit/tests", test_luajit_frame_kernels)
+{
+    testFrameSorting<float>("float32");
+    testFrameSorting<double>("float64");
+    testFrameSorting<int32_t>("int32");
+    testFrameSorting<uint32_t>("uint32");
+
+    // Radix sort orders floats by sign first, including infinities.
+    const std::vector<float> specialValues{
+        std::numeric_limits<float>::infinity(), 1.5f, -0.0f, -std::numeric_limits<float>::infinity(),
+        std::numeric_limits<float>::denorm_min(), -1e30f, 0.0f, -std::numeric_limits<float>::denorm_min()};
+    const std::vector<float> sortedSpecialValues{
+        -std::numeric_limits<float>::infinity(), -1e30f, -std::numeric_limits<float>::denorm_min(), -0.0f,
+        0.0f, std::numeric_limits<float>::denorm_min(), 1.5f, std::numeric_limits<float>::infinity()};
+
+    Pothos::BufferChunk specialInput("float32", specialValues.size());
+    std::memcpy(specialInput.as<void*>(), specialValues.data(), specialInput.length);
+
+    const auto specialSorted = runSingleOutputBlock(
+                                   Pothos::BlockRegistry::make("/luajit/radix_sort", "float32", specialValues.size()),
+                                   {specialInput},
+                                   "float32");
+    POTHOS_TEST_EQUAL(specialValues.size(), specialSorted.elements());
+    POTHOS_TEST_EQUAL(0, std::memcmp(sortedSpecialValues.data(), specialSorted.as<const void*>(), specialSorted.length));
+
+    // Each frame has three parabolic peaks above the threshold and one bump
+    // below it, on a flat floor. Parabolic interpolation is exact here.
+    constexpr size_t frameSize = 256;
+    constexpr size_t numFrames = 5;
+    constexpr double floorValue = -1.0;
+    const std::vector<std::pair<double, double>> peaks{{40.3, 5.0}, {100.7, 9.0}, {180.45, 3.0}, {220.0, -0.5}};
+
+    Pothos::BufferChunk peakInput("float64", numFrames * frameSize);
+    for(size_t frame = 0; frame < numFrames; ++frame)
+    {
+        for(size_t i = 0; i < frameSize; ++i)
+        {
+            auto value = floorValue;
+            for(const auto& peak: peaks)
+            {
+                // Each frame's peaks are offset a little, to tell frames apart.
+                const auto offset = double(i) - (peak.first + (0.1 * frame));
+                value = std::max(value, peak.second - (offset * offset));
+            }
+            peakInput.as<double*>()[(frame * frameSize) + i] = value;
+        }
+    }
+
+    auto peakFinder = Pothos::BlockRegistry::make("/luajit/peak_finder", "float64", frameSize);
+    peakFinder.call("setThreshold", 0.0);
+    peakFinder.call("setMaxPeaks", size_t(2));
+    peakFinder.call("setFrameLabelId", "peaks");
+
+    const auto peakSinks = runTwoOutputBlock(peakFinder, peakInput, "float64", "float64");
+    const auto positions = peakSinks[0].call<Pothos::BufferChunk>("getBuffer");
+    const auto values = peakSinks[1].call<Pothos::BufferChunk>("getBuffer");
+    POTHOS_TEST_EQUAL(2 * numFrames, positions.elements());
+    POTHOS_TEST_EQUAL(2 * numFrames, values.elements());
+
+    const auto peakLabels = peakSinks[0].call<std::vector<Pothos::Label>>("getLabels");
+    POTHOS_TEST_EQUAL(numFrames, peakLabels.size());
+    for(size_t frame = 0; frame < numFrames; ++frame)
+    {
+        POTHOS_TEST_EQUAL("peaks", peakLabels[frame].id);
+        POTHOS_TEST_EQUAL(2 * frame, peakLabels[frame].index);
+        POTHOS_TEST_EQUAL(2, peakLabels[frame].data.convert<size_t>());
+
+        // The strongest two peaks, strongest first
+        for(size_t i = 0; i < 2; ++i)
+        {
+            const auto& peak = peaks[1 - i];
+            POTHOS_TEST_CLOSE(peak.first + (0.1 * frame), positions.as<const double*>()[(2 * frame) + i], 1e-9);
+            POTHOS_TEST_CLOSE(peak.second, values.as<const double*>()[(2 * frame) + i], 1e-9);
+        }
+    }
+
+    POTHOS_TEST_THROWS(
+        Pothos::BlockRegistry::make("/luajit/top_k", "float32", 16, 17),
+        Pothos::Exception);
+    POTHOS_TEST_THROWS(
+        Pothos::BlockRegistry::make("/luajit/radix_sort", "float64", 16),
+        Pothos::Exception);
+    POTHOS_TEST_THROWS(
+        Pothos::BlockRegistry::make("/luajit/peak_finder", "int32", 16),
+        Pothos::Exception);
+    POTHOS_TEST_THROWS(
+        peakFinder.call("setMaxPeaks", size_t(0)),
+        Pothos::Exception);
+}
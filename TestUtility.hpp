@@ -0,0 +1,30 @@
+// Copyright (c) 2020-2021 Nicholas Corgan
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <Poco/Format.h>
+#include <Poco/NumberFormatter.h>
+#include <Poco/Path.h>
+#include <Poco/TemporaryFile.h>
+#include <Poco/Timestamp.h>
+
+#include <fstream>
+#include <string>
+
+static inline std::string writeToFileAndGetPath(
+    const std::string& str,
+    const std::string& extension)
+{
+    auto tempFilepath = Poco::format(
+                            "%s%s.%s",
+                            Poco::Path::temp(),
+                            Poco::NumberFormatter::format(Poco::Timestamp().epochMicroseconds()),
+                            extension);
+    Poco::TemporaryFile::registerForDeletion(tempFilepath);
+
+    std::ofstream out(tempFilepath.c_str(), std::ios::out);
+    out << str;
+
+    return tempFilepath;
+}